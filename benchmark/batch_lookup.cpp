@@ -0,0 +1,122 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <random>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n, m) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Args({n, m})->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 100000, 1000); \
+REG_SINGLE_TEST(group, cls, 100000, 10000); \
+REG_SINGLE_TEST(group, cls, 100000, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000, 10000); \
+REG_SINGLE_TEST(group, cls, 1000000, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000, 250000); \
+REG_SINGLE_TEST(group, cls, 1000000, 500000); \
+REG_SINGLE_TEST(group, cls, 1000000, 1000000)
+
+
+using pmap_t = pmap<uint64_t,uint64_t>;
+
+
+template<typename M>
+static M build(size_t n_vals, std::default_random_engine& generator) {
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    M m;
+    for (size_t i=0;i<n_vals;i++) {
+        m.insert(std::make_pair(distribution(generator), i));
+    }
+    return m;
+}
+
+static std::vector<uint64_t> sorted_keys(size_t n_vals, size_t n_keys, std::default_random_engine& generator) {
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_keys;i++) {
+        keys.push_back(distribution(generator));
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+
+// one find() from the root for each key
+template<typename M>
+void BM_find_each(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto m = build<M>(state.range(0), generator);
+    const auto keys = sorted_keys(state.range(0), state.range(1), generator);
+    std::vector<typename M::const_iterator> results;
+    results.reserve(keys.size());
+
+    for (auto _: state) {
+        results.clear();
+        for (auto& key: keys) {
+            results.push_back(m.find(key));
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(find_each, pmap_t);
+
+
+template<typename M>
+void BM_find_many(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto m = build<M>(state.range(0), generator);
+    const auto keys = sorted_keys(state.range(0), state.range(1), generator);
+    std::vector<typename M::const_iterator> results;
+    results.reserve(keys.size());
+
+    for (auto _: state) {
+        results.clear();
+        m.find_many(keys.begin(), keys.end(), std::back_inserter(results));
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(find_many, pmap_t);
+
+
+template<typename M>
+void BM_rank_each(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto m = build<M>(state.range(0), generator);
+    const auto keys = sorted_keys(state.range(0), state.range(1), generator);
+    std::vector<size_t> results(keys.size());
+
+    for (auto _: state) {
+        for (size_t i=0;i<keys.size();i++) {
+            results[i] = m.rank(keys[i]);
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(rank_each, pmap_t);
+
+
+template<typename M>
+void BM_rank_many(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto m = build<M>(state.range(0), generator);
+    const auto keys = sorted_keys(state.range(0), state.range(1), generator);
+    std::vector<size_t> results(keys.size());
+
+    for (auto _: state) {
+        m.rank_many(keys.begin(), keys.end(), results.begin());
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(rank_many, pmap_t);
+
+
+BENCHMARK_MAIN();
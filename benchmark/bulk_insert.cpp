@@ -0,0 +1,89 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <random>
+#include <vector>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n, m) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Args({n, m})->Name(#group"/"#cls)->Unit(benchmark::kMillisecond)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 0, 1000000); \
+REG_SINGLE_TEST(group, cls, 1000000, 10000); \
+REG_SINGLE_TEST(group, cls, 1000000, 30000); \
+REG_SINGLE_TEST(group, cls, 1000000, 60000); \
+REG_SINGLE_TEST(group, cls, 1000000, 125000); \
+REG_SINGLE_TEST(group, cls, 1000000, 250000); \
+REG_SINGLE_TEST(group, cls, 1000000, 1000000); \
+REG_SINGLE_TEST(group, cls, 4000000, 1000000)
+
+
+using pset_t = pset<uint64_t>;
+using pmultiset_t = pmultiset<uint64_t>;
+using set2_t = set2<uint64_t>;
+
+
+static std::vector<uint64_t> random_values(size_t n_vals, std::default_random_engine& generator) {
+    std::uniform_int_distribution<uint64_t> distribution;
+    std::vector<uint64_t> values;
+    for (size_t i=0;i<n_vals;i++) {
+        values.push_back(distribution(generator));
+    }
+    return values;
+}
+
+
+// insert() of one value after another
+template<typename S>
+void BM_insert_each(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto base = random_values(state.range(0), generator);
+    const auto batch = random_values(state.range(1), generator);
+
+    for (auto _: state) {
+        state.PauseTiming();
+        {
+            S s(base.begin(), base.end());
+            state.ResumeTiming();
+            for (auto& val: batch) {
+                s.insert(val);
+            }
+            benchmark::DoNotOptimize(s.size());
+            state.PauseTiming();
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BM_func(insert_each, pset_t);
+BM_func(insert_each, pmultiset_t);
+BM_func(insert_each, set2_t);
+
+
+template<typename S>
+void BM_insert_range(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto base = random_values(state.range(0), generator);
+    const auto batch = random_values(state.range(1), generator);
+
+    for (auto _: state) {
+        state.PauseTiming();
+        {
+            S s(base.begin(), base.end());
+            state.ResumeTiming();
+            s.insert(batch.begin(), batch.end());
+            benchmark::DoNotOptimize(s.size());
+            state.PauseTiming();
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BM_func(insert_range, pset_t);
+BM_func(insert_range, pmultiset_t);
+BM_func(insert_range, set2_t);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,85 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n, m) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Args({n, m})->Name(#group"/"#cls)->Unit(benchmark::kMillisecond)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000000, 1000); \
+REG_SINGLE_TEST(group, cls, 1000000, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000, 500000)
+
+
+using pmap_t = pmap<uint64_t,uint64_t>;
+using map2_t = map2<uint64_t,uint64_t>;
+
+
+// keys are timestamps, the oldest m of them are trimmed from the middle of the map
+template<typename M>
+static M build(size_t n_vals) {
+    std::default_random_engine generator(n_vals);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_vals;i++) keys.push_back(i);
+    std::shuffle(keys.begin(), keys.end(), generator);
+    M m;
+    for (auto key: keys) {
+        m.insert(std::make_pair(key, key));
+    }
+    return m;
+}
+
+
+// erase() of one value after another
+template<typename M>
+void BM_erase_each(benchmark::State& state) {
+    const auto base = build<M>(state.range(0));
+    const uint64_t lo = state.range(0) / 4, hi = lo + state.range(1);
+
+    for (auto _: state) {
+        state.PauseTiming();
+        {
+            M m(base);
+            state.ResumeTiming();
+            for (auto it=m.lower_bound(lo);it!=m.end() && it->first<hi;) {
+                it = m.erase(it);
+            }
+            benchmark::DoNotOptimize(m.size());
+            state.PauseTiming();
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(erase_each, pmap_t);
+BM_func(erase_each, map2_t);
+
+
+template<typename M>
+void BM_erase_range(benchmark::State& state) {
+    const auto base = build<M>(state.range(0));
+    const uint64_t lo = state.range(0) / 4, hi = lo + state.range(1);
+
+    for (auto _: state) {
+        state.PauseTiming();
+        {
+            M m(base);
+            state.ResumeTiming();
+            m.erase(m.lower_bound(lo), m.lower_bound(hi));
+            benchmark::DoNotOptimize(m.size());
+            state.PauseTiming();
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(erase_range, pmap_t);
+BM_func(erase_range, map2_t);
+
+
+BENCHMARK_MAIN();
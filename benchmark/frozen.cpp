@@ -0,0 +1,97 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <set>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Arg(n)->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000); \
+REG_SINGLE_TEST(group, cls, 10000); \
+REG_SINGLE_TEST(group, cls, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000)
+
+
+using std_set_t    = std::set<uint64_t>;
+using pset_t       = pset<uint64_t>;
+using frozen_set_t = pset<uint64_t>::frozen_type;
+
+
+template<typename S>
+static S build(const std::vector<uint64_t>& vals) {
+    return S(vals.begin(), vals.end());
+}
+
+template<>
+frozen_set_t build<frozen_set_t>(const std::vector<uint64_t>& vals) {
+    return pset_t(vals.begin(), vals.end()).freeze();
+}
+
+
+template<typename S>
+void BM_find_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_vals;i++) {
+        keys.push_back(distribution(generator));
+    }
+    const auto s = build<S>(keys);
+    std::shuffle(keys.begin(), keys.end(), generator);
+
+    size_t i = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(s.find(keys[i++ % keys.size()]));
+    }
+}
+BM_func(find_random, std_set_t);
+BM_func(find_random, pset_t);
+BM_func(find_random, frozen_set_t);
+
+
+template<typename S>
+void BM_lower_bound_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_vals;i++) {
+        keys.push_back(distribution(generator));
+    }
+    const auto s = build<S>(keys);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(s.lower_bound(distribution(generator)));
+    }
+}
+BM_func(lower_bound_random, std_set_t);
+BM_func(lower_bound_random, pset_t);
+BM_func(lower_bound_random, frozen_set_t);
+
+
+template<typename S>
+void BM_freeze(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_vals;i++) {
+        keys.push_back(distribution(generator));
+    }
+    const auto s = build<S>(keys);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(s.freeze());
+    }
+}
+BM_func(freeze, pset_t);
+
+
+BENCHMARK_MAIN();
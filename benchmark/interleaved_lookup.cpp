@@ -0,0 +1,121 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <random>
+#include <vector>
+#include <iterator>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n, m) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Args({n, m})->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 100000, 10000); \
+REG_SINGLE_TEST(group, cls, 1000000, 10000); \
+REG_SINGLE_TEST(group, cls, 1000000, 100000); \
+REG_SINGLE_TEST(group, cls, 4000000, 100000); \
+REG_SINGLE_TEST(group, cls, 4000000, 500000)
+
+
+using pset_t = fast::pset<uint64_t>;
+using set2_t = set2<uint64_t>;
+
+
+template<typename S>
+static S build(size_t n_vals, std::default_random_engine& generator) {
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    S s;
+    for (size_t i=0;i<n_vals;i++) {
+        s.insert(distribution(generator));
+    }
+    return s;
+}
+
+// unsorted, so that every lookup misses the cache below the top levels of the tree
+static std::vector<uint64_t> random_keys(size_t n_vals, size_t n_keys, std::default_random_engine& generator) {
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_keys;i++) {
+        keys.push_back(distribution(generator));
+    }
+    return keys;
+}
+
+
+// one find() after another
+template<typename S>
+void BM_find_sequential(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(state.range(0), generator);
+    const auto keys = random_keys(state.range(0), state.range(1), generator);
+    std::vector<typename S::const_iterator> results;
+    results.reserve(keys.size());
+
+    for (auto _: state) {
+        results.clear();
+        for (auto& key: keys) {
+            results.push_back(s.find(key));
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(find_sequential, pset_t);
+BM_func(find_sequential, set2_t);
+
+
+template<typename S>
+void BM_find_interleaved(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(state.range(0), generator);
+    const auto keys = random_keys(state.range(0), state.range(1), generator);
+    std::vector<typename S::const_iterator> results;
+    results.reserve(keys.size());
+
+    for (auto _: state) {
+        results.clear();
+        s.find_many(keys.begin(), keys.end(), std::back_inserter(results));
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(find_interleaved, pset_t);
+BM_func(find_interleaved, set2_t);
+
+
+template<typename S>
+void BM_contains_sequential(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(state.range(0), generator);
+    const auto keys = random_keys(state.range(0), state.range(1), generator);
+    std::vector<char> results(keys.size());
+
+    for (auto _: state) {
+        for (size_t i=0;i<keys.size();i++) {
+            results[i] = s.contains(keys[i]);
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(contains_sequential, pset_t);
+
+
+template<typename S>
+void BM_contains_interleaved(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(state.range(0), generator);
+    const auto keys = random_keys(state.range(0), state.range(1), generator);
+    std::vector<char> results(keys.size());
+
+    for (auto _: state) {
+        s.contains_many(keys.begin(), keys.end(), results.begin());
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BM_func(contains_interleaved, pset_t);
+
+
+BENCHMARK_MAIN();
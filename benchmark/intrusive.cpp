@@ -0,0 +1,73 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <set>
+#include <random>
+#include <vector>
+#include <algorithm>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Arg(n)->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000); \
+REG_SINGLE_TEST(group, cls, 10000); \
+REG_SINGLE_TEST(group, cls, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000)
+
+
+struct Object: public intrusive::pset_hook<Object> {
+    size_t key;
+    explicit Object(size_t key): key(key) {}
+    bool operator<(const Object& oth) const { return this->key < oth.key; }
+};
+
+using std_set_t       = std::set<size_t>;
+using pset_t          = pset<size_t>;
+using intrusive_set_t = intrusive::pset<Object>;
+
+template<typename S>
+static void link(S& st, std::vector<Object>& objs, size_t i) {
+    st.insert(objs[i].key);
+}
+
+static void link(intrusive_set_t& st, std::vector<Object>& objs, size_t i) {
+    st.insert(objs[i]);
+}
+
+template<typename S>
+static void unlink(S& st, std::vector<Object>& objs, size_t i) {
+    st.erase(objs[i].key);
+}
+
+static void unlink(intrusive_set_t& st, std::vector<Object>& objs, size_t i) {
+    st.erase(objs[i]);
+}
+
+
+template<typename S>
+void BM_churn(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::vector<Object> objs;
+    for (size_t i=0;i<n_vals*2;i++) objs.emplace_back(i);
+    std::shuffle(objs.begin(), objs.end(), generator);
+
+    S st;
+    for (size_t i=0;i<n_vals;i++) link(st, objs, i);
+
+    size_t i = 0;
+    for (auto _: state) {
+        unlink(st, objs, i % (n_vals * 2));
+        link(st, objs, (i + n_vals) % (n_vals * 2));
+        i++;
+    }
+    st.clear();
+}
+BM_func(churn, std_set_t);
+BM_func(churn, pset_t);
+BM_func(churn, intrusive_set_t);
+
+
+BENCHMARK_MAIN();
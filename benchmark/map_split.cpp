@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <map>
+#include <array>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Arg(n)->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000); \
+REG_SINGLE_TEST(group, cls, 10000); \
+REG_SINGLE_TEST(group, cls, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000)
+
+
+struct BigRecord {
+    std::array<uint64_t,32> payload;
+};
+using std_map_t   = std::map<uint64_t, BigRecord>;
+using pmap_t      = pmap<uint64_t, BigRecord>;
+using split_map_t = split::pmap<uint64_t, BigRecord>;
+
+
+template<typename M>
+static void reserve(M& m, size_t n) {
+    m.reserve(n);
+}
+
+template<typename K, typename V>
+static void reserve(std::map<K,V>& /*m*/, size_t /*n*/) {
+}
+
+
+template<typename M>
+void BM_find_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    M m;
+    reserve(m, n_vals);
+    std::vector<uint64_t> keys;
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = distribution(generator);
+        if (m.insert(std::make_pair(key, BigRecord())).second) keys.push_back(key);
+    }
+    std::shuffle(keys.begin(), keys.end(), generator);
+
+    size_t i = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(m.find(keys[i++ % keys.size()]));
+    }
+}
+BM_func(find_random, std_map_t);
+BM_func(find_random, pmap_t);
+BM_func(find_random, split_map_t);
+
+
+template<typename M>
+void BM_lower_bound_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    M m;
+    reserve(m, n_vals);
+    for (size_t i=0;i<n_vals;i++) {
+        m.insert(std::make_pair(distribution(generator), BigRecord()));
+    }
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(m.lower_bound(distribution(generator)));
+    }
+}
+BM_func(lower_bound_random, std_map_t);
+BM_func(lower_bound_random, pmap_t);
+BM_func(lower_bound_random, split_map_t);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <set>
+#include <random>
+#include <vector>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, pooled, n) \
+    BENCHMARK_TEMPLATE2(BM_##group, cls, pooled)->Arg(n)->Name(#group"/"#cls"/"#pooled)
+
+#define BM_func(group, cls, pooled) \
+REG_SINGLE_TEST(group, cls, pooled, 100); \
+REG_SINGLE_TEST(group, cls, pooled, 1000); \
+REG_SINGLE_TEST(group, cls, pooled, 10000); \
+REG_SINGLE_TEST(group, cls, pooled, 100000); \
+REG_SINGLE_TEST(group, cls, pooled, 1000000)
+
+
+template<typename S>
+static void reserve(S& /*st*/, size_t /*n*/, std::false_type) {
+}
+
+template<typename S>
+static void reserve(S& st, size_t n, std::true_type) {
+    st.reserve(n);
+}
+
+
+template<typename S, bool pooled>
+void BM_churn_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<size_t> distribution(0,n_vals*3);
+    S st;
+    reserve(st, n_vals, std::integral_constant<bool,pooled>());
+    std::vector<size_t> vals;
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        if (st.insert(val).second) vals.push_back(val);
+    }
+
+    size_t i = 0;
+    for (auto _: state) {
+        auto& val = vals[i++ % vals.size()];
+        st.erase(st.find(val));
+        val = distribution(generator);
+        for (;!st.insert(val).second;val = distribution(generator));
+    }
+}
+BM_func(churn_random, std::set<size_t>, false);
+BM_func(churn_random, pset<size_t>, false);
+BM_func(churn_random, pset<size_t>, true);
+BM_func(churn_random, set2<size_t>, false);
+BM_func(churn_random, set2<size_t>, true);
+
+
+template<typename S, bool pooled>
+void BM_fill_clear(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    S st;
+    reserve(st, n_vals, std::integral_constant<bool,pooled>());
+
+    for (auto _: state) {
+        for (size_t i=0;i<n_vals;i++) {
+            st.insert(i);
+        }
+        st.clear();
+    }
+}
+BM_func(fill_clear, std::set<size_t>, false);
+BM_func(fill_clear, pset<size_t>, false);
+BM_func(fill_clear, pset<size_t>, true);
+BM_func(fill_clear, set2<size_t>, false);
+BM_func(fill_clear, set2<size_t>, true);
+
+
+/** the third parameter tells whether the tree is compacted after the churn */
+template<typename S, bool compacted>
+void BM_scan_after_churn(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<size_t> distribution(0,n_vals*3);
+    S st;
+    std::vector<size_t> vals;
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        if (st.insert(val).second) vals.push_back(val);
+    }
+    for (size_t i=0;i<n_vals*4;i++) {
+        auto& val = vals[i % vals.size()];
+        st.erase(st.find(val));
+        val = distribution(generator);
+        for (;!st.insert(val).second;val = distribution(generator));
+    }
+    if (compacted) st.compact();
+
+    for (auto _: state) {
+        size_t sum = 0;
+        for (auto val: st) sum += val;
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BM_func(scan_after_churn, pset<size_t>, false);
+BM_func(scan_after_churn, pset<size_t>, true);
+BM_func(scan_after_churn, fast::pset<size_t>, false);
+BM_func(scan_after_churn, fast::pset<size_t>, true);
+BM_func(scan_after_churn, threaded::pset<size_t>, false);
+BM_func(scan_after_churn, threaded::fast::pset<size_t>, false);
+
+
+BENCHMARK_MAIN();
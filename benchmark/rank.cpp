@@ -0,0 +1,115 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <random>
+#include <vector>
+#include <iterator>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Arg(n)->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000); \
+REG_SINGLE_TEST(group, cls, 10000); \
+REG_SINGLE_TEST(group, cls, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000)
+
+
+using pset_t      = pset<uint64_t>;
+using fast_pset_t = fast::pset<uint64_t>;
+
+
+template<typename S>
+static S build(size_t n_vals, std::default_random_engine& generator) {
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+    S s;
+    for (size_t i=0;i<n_vals;i++) {
+        s.insert(distribution(generator));
+    }
+    return s;
+}
+
+
+// lower_bound() followed by climbing up to the root
+template<typename S>
+void BM_rank_climb(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(n_vals, generator);
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(std::distance(s.begin(), s.lower_bound(distribution(generator))));
+    }
+}
+BM_func(rank_climb, pset_t);
+BM_func(rank_climb, fast_pset_t);
+
+
+template<typename S>
+void BM_rank(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(n_vals, generator);
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(s.rank(distribution(generator)));
+    }
+}
+BM_func(rank, pset_t);
+BM_func(rank, fast_pset_t);
+
+
+template<typename S>
+void BM_count_between(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(n_vals, generator);
+    std::uniform_int_distribution<uint64_t> distribution(0,n_vals*3);
+
+    for (auto _: state) {
+        const auto lo = distribution(generator);
+        benchmark::DoNotOptimize(s.count_between(lo, lo + 100));
+    }
+}
+BM_func(count_between, pset_t);
+BM_func(count_between, fast_pset_t);
+
+
+// begin() followed by std::advance
+template<typename S>
+void BM_select_advance(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(n_vals, generator);
+    std::uniform_int_distribution<size_t> distribution(0,s.size()-1);
+
+    for (auto _: state) {
+        auto it = s.begin();
+        std::advance(it, distribution(generator));
+        benchmark::DoNotOptimize(it);
+    }
+}
+BM_func(select_advance, pset_t);
+BM_func(select_advance, fast_pset_t);
+
+
+template<typename S>
+void BM_select(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    const auto s = build<S>(n_vals, generator);
+    std::uniform_int_distribution<size_t> distribution(0,s.size()-1);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(s.select(distribution(generator)));
+    }
+}
+BM_func(select, pset_t);
+BM_func(select, fast_pset_t);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,134 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <vector>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n, m) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Args({n, m})->Name(#group"/"#cls)->Unit(benchmark::kMicrosecond)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000000, 1000); \
+REG_SINGLE_TEST(group, cls, 1000000, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000, 1000000)
+
+
+using pset_t = pset<uint64_t>;
+using set2_t = set2<uint64_t>;
+
+
+// n even values and m values spread over the same range, half of which are even
+template<typename S>
+static std::pair<S,S> build(size_t n_vals, size_t m_vals) {
+    S s, t;
+    for (size_t i=0;i<n_vals;i++) {
+        s.insert(i * 2);
+    }
+    const size_t step = std::max<size_t>(n_vals * 2 / m_vals, 1);
+    for (size_t i=0;i<m_vals;i++) {
+        t.insert(i * step + (i & 1));
+    }
+    return std::make_pair(std::move(s), std::move(t));
+}
+
+
+template<typename S>
+void BM_std_set_union(benchmark::State& state) {
+    auto sets = build<S>(state.range(0), state.range(1));
+
+    for (auto _: state) {
+        std::vector<uint64_t> merged;
+        std::set_union(sets.first.begin(), sets.first.end(), sets.second.begin(), sets.second.end(), std::back_inserter(merged));
+        S u(merged.begin(), merged.end());
+        benchmark::DoNotOptimize(u.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(std_set_union, pset_t);
+BM_func(std_set_union, set2_t);
+
+
+template<typename S>
+void BM_set_union(benchmark::State& state) {
+    auto sets = build<S>(state.range(0), state.range(1));
+
+    S u, t;
+    for (auto _: state) {
+        // the copies and the previous result are destroyed outside of the measurement
+        state.PauseTiming();
+        u = sets.first;
+        t = sets.second;
+        state.ResumeTiming();
+        u.set_union(std::move(t));
+        benchmark::DoNotOptimize(u.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(set_union, pset_t);
+BM_func(set_union, set2_t);
+
+
+template<typename S>
+void BM_parallel_set_union(benchmark::State& state) {
+    auto sets = build<S>(state.range(0), state.range(1));
+    rbtree_thread_executor executor;
+
+    S u, t;
+    for (auto _: state) {
+        state.PauseTiming();
+        u = sets.first;
+        t = sets.second;
+        state.ResumeTiming();
+        u.parallel_set_union(std::move(t), executor);
+        benchmark::DoNotOptimize(u.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(parallel_set_union, pset_t);
+BM_func(parallel_set_union, set2_t);
+
+
+// m values are inserted into a tree of n values, both sorted
+template<typename S>
+void BM_insert_batch(benchmark::State& state) {
+    auto sets = build<S>(state.range(0), state.range(1));
+    const std::vector<uint64_t> batch(sets.second.begin(), sets.second.end());
+    rbtree_thread_executor executor;
+
+    S u;
+    for (auto _: state) {
+        state.PauseTiming();
+        u = sets.first;
+        state.ResumeTiming();
+        u.insert_batch(batch.begin(), batch.end(), executor);
+        benchmark::DoNotOptimize(u.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(insert_batch, pset_t);
+BM_func(insert_batch, set2_t);
+
+
+template<typename S>
+void BM_insert_range(benchmark::State& state) {
+    auto sets = build<S>(state.range(0), state.range(1));
+    const std::vector<uint64_t> batch(sets.second.begin(), sets.second.end());
+
+    S u;
+    for (auto _: state) {
+        state.PauseTiming();
+        u = sets.first;
+        state.ResumeTiming();
+        u.insert(batch.begin(), batch.end());
+        benchmark::DoNotOptimize(u.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(insert_range, pset_t);
+BM_func(insert_range, set2_t);
+
+
+BENCHMARK_MAIN();
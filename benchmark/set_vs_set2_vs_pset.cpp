@@ -4,6 +4,7 @@
 #include <iostream>
 #include <random>
 #include <stdexcept>
+#include <vector>
 using namespace curly;
 
 
@@ -21,6 +22,12 @@ REG_SINGLE_TEST(group, cls, 10000); \
 REG_SINGLE_TEST(group, cls, 100000); \
 REG_SINGLE_TEST(group, cls, 1000000)
 
+#if __cplusplus >= 201703
+#define BM_func_bptree(group) BM_func(group, bptree::pset<size_t>)
+#else
+#define BM_func_bptree(group)
+#endif // __cplusplus >= 201703
+
 
 template<typename S>
 void BM_advance_random(benchmark::State& state) {
@@ -45,6 +52,8 @@ void BM_advance_random(benchmark::State& state) {
 BM_func(advance_random, std::set<size_t>);
 BM_func(advance_random, set2<size_t>);
 BM_func(advance_random, pset<size_t>);
+BM_func(advance_random, fast::pset<size_t>);
+BM_func_bptree(advance_random);
 
 
 template<typename S>
@@ -74,6 +83,8 @@ void BM_distance_random(benchmark::State& state) {
 BM_func(distance_random, std::set<size_t>);
 BM_func(distance_random, set2<size_t>);
 BM_func(distance_random, pset<size_t>);
+BM_func(distance_random, fast::pset<size_t>);
+BM_func_bptree(distance_random);
 
 
 template<typename S>
@@ -101,6 +112,30 @@ void BM_advance_distance_random(benchmark::State& state) {
 BM_func(advance_distance_random, std::set<size_t>);
 BM_func(advance_distance_random, set2<size_t>);
 BM_func(advance_distance_random, pset<size_t>);
+BM_func_bptree(advance_distance_random);
+
+
+template<typename S>
+void BM_scan_random(benchmark::State& state) {
+    auto n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<size_t> distribution(0,n_vals*3);
+    S st;
+    for (int64_t i=0;i<state.range(0);i++) {
+        st.insert(distribution(generator));
+    }
+
+    for (auto _: state) {
+        size_t sum = 0;
+        for (auto& val: st) sum += val;
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BM_func(scan_random, std::set<size_t>);
+BM_func(scan_random, set2<size_t>);
+BM_func(scan_random, pset<size_t>);
+BM_func(scan_random, fast::pset<size_t>);
+BM_func_bptree(scan_random);
 
 
 template<typename S>
@@ -118,6 +153,7 @@ void BM_copy_incremental(benchmark::State& state) {
 BM_func(copy_incremental, std::set<size_t>);
 BM_func(copy_incremental, set2<size_t>);
 BM_func(copy_incremental, pset<size_t>);
+BM_func_bptree(copy_incremental);
 
 
 template<typename S>
@@ -138,6 +174,28 @@ void BM_copy_random(benchmark::State& state) {
 BM_func(copy_random, std::set<size_t>);
 BM_func(copy_random, set2<size_t>);
 BM_func(copy_random, pset<size_t>);
+BM_func_bptree(copy_random);
+
+
+// the subtrees are cloned on up to hardware_concurrency() threads, copy_random does so above rbtree_parallel_copy_size
+template<typename S>
+void BM_parallel_copy_random(benchmark::State& state) {
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<size_t> distribution(0,state.range(0)*3);
+    S st;
+    for (int64_t i=0;i<state.range(0);i++) {
+        st.insert(distribution(generator));
+    }
+
+    rbtree_thread_executor executor;
+    for (auto _: state) {
+        S vals;
+        vals.parallel_assign(st, executor);
+        vals.clear();
+    }
+}
+BM_func(parallel_copy_random, set2<size_t>);
+BM_func(parallel_copy_random, pset<size_t>);
 
 
 template<typename S>
@@ -169,6 +227,7 @@ void BM_erase_random(benchmark::State& state) {
 BM_func(erase_random, std::set<size_t>);
 BM_func(erase_random, set2<size_t>);
 BM_func(erase_random, pset<size_t>);
+BM_func_bptree(erase_random);
 
 
 template<typename S>
@@ -184,6 +243,7 @@ void BM_insert_incremental(benchmark::State& state) {
 BM_func(insert_incremental, std::set<size_t>);
 BM_func(insert_incremental, set2<size_t>);
 BM_func(insert_incremental, pset<size_t>);
+BM_func_bptree(insert_incremental);
 
 
 template<typename S>
@@ -202,6 +262,7 @@ void BM_insert_hint_incremental(benchmark::State& state) {
 BM_func(insert_hint_incremental, std::set<size_t>);
 BM_func(insert_hint_incremental, set2<size_t>);
 BM_func(insert_hint_incremental, pset<size_t>);
+BM_func_bptree(insert_hint_incremental);
 
 
 template<typename S>
@@ -217,6 +278,7 @@ void BM_insert_decremental(benchmark::State& state) {
 BM_func(insert_decremental, std::set<size_t>);
 BM_func(insert_decremental, set2<size_t>);
 BM_func(insert_decremental, pset<size_t>);
+BM_func_bptree(insert_decremental);
 
 
 template<typename S>
@@ -235,6 +297,7 @@ void BM_insert_hint_decremental(benchmark::State& state) {
 BM_func(insert_hint_decremental, std::set<size_t>);
 BM_func(insert_hint_decremental, set2<size_t>);
 BM_func(insert_hint_decremental, pset<size_t>);
+BM_func_bptree(insert_hint_decremental);
 
 
 template<typename S>
@@ -255,6 +318,7 @@ void BM_insert_random(benchmark::State& state) {
 BM_func(insert_random, std::set<size_t>);
 BM_func(insert_random, set2<size_t>);
 BM_func(insert_random, pset<size_t>);
+BM_func_bptree(insert_random);
 
 
 template<typename S>
@@ -276,6 +340,66 @@ void BM_insert_hint_random(benchmark::State& state) {
 BM_func(insert_hint_random, std::set<size_t>);
 BM_func(insert_hint_random, set2<size_t>);
 BM_func(insert_hint_random, pset<size_t>);
+BM_func_bptree(insert_hint_random);
+
+
+// two sets of n random values, about a third of the values of the second one are in the first one as well
+template<typename S>
+void BM_merge_random(benchmark::State& state) {
+    auto n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<size_t> distribution(0,n_vals*3);
+    S st1, st2;
+    for (size_t i=0;i<n_vals;i++) {
+        st1.insert(distribution(generator));
+        st2.insert(distribution(generator));
+    }
+
+    for (auto _: state) {
+        state.PauseTiming();
+        S vals = st1, other = st2;
+        state.ResumeTiming();
+        vals.merge(other);
+        benchmark::DoNotOptimize(vals.size());
+        state.PauseTiming();
+        vals.clear();
+        other.clear();
+        state.ResumeTiming();
+    }
+}
+// std::set::merge() is C++17
+#if __cplusplus >= 201703
+BM_func(merge_random, std::set<size_t>);
+#endif // __cplusplus >= 201703
+BM_func(merge_random, set2<size_t>);
+BM_func(merge_random, pset<size_t>);
+BM_func_bptree(merge_random);
+
+
+// n random values out of n/4, so that most of them are duplicates
+template<typename S>
+void BM_emplace_duplicates(benchmark::State& state) {
+    auto n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    std::uniform_int_distribution<size_t> distribution(0,n_vals/4);
+    std::vector<size_t> vals;
+    for (size_t i=0;i<n_vals;i++) {
+        vals.push_back(distribution(generator));
+    }
+
+    for (auto _: state) {
+        S st;
+        for (auto val: vals) st.emplace(val);
+        benchmark::DoNotOptimize(st.size());
+        state.PauseTiming();
+        st.clear();
+        state.ResumeTiming();
+    }
+}
+BM_func(emplace_duplicates, std::set<size_t>);
+BM_func(emplace_duplicates, set2<size_t>);
+BM_func(emplace_duplicates, pset<size_t>);
+BM_func_bptree(emplace_duplicates);
 
 
 BENCHMARK_MAIN();
@@ -0,0 +1,69 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <iterator>
+#include <cstdint>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n, m) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Args({n, m})->Name(#group"/"#cls)->Unit(benchmark::kMicrosecond)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000000, 1000); \
+REG_SINGLE_TEST(group, cls, 1000000, 100000); \
+REG_SINGLE_TEST(group, cls, 1000000, 500000)
+
+
+using pset_t = pset<uint64_t>;
+using set2_t = set2<uint64_t>;
+
+
+template<typename S>
+static S build(size_t n_vals) {
+    S s;
+    for (size_t i=0;i<n_vals;i++) {
+        s.insert(i);
+    }
+    return s;
+}
+
+
+// the last m values are moved to another container and back by extract() and insert()
+template<typename S>
+void BM_extract_insert(benchmark::State& state) {
+    auto s = build<S>(state.range(0));
+    const uint64_t key = state.range(0) - state.range(1);
+
+    for (auto _: state) {
+        S right;
+        for (auto it=s.lower_bound(key);it!=s.end();it=s.lower_bound(key)) {
+            right.insert(right.end(), s.extract(it));
+        }
+        for (;!right.empty();) {
+            s.insert(s.end(), right.extract(right.begin()));
+        }
+        benchmark::DoNotOptimize(s.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(extract_insert, pset_t);
+BM_func(extract_insert, set2_t);
+
+
+template<typename S>
+void BM_split_append(benchmark::State& state) {
+    auto s = build<S>(state.range(0));
+    const uint64_t key = state.range(0) - state.range(1);
+
+    for (auto _: state) {
+        S right = s.split_off(key);
+        s.append(std::move(right));
+        benchmark::DoNotOptimize(s.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BM_func(split_append, pset_t);
+BM_func(split_append, set2_t);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,99 @@
+#include <benchmark/benchmark.h>
+#include "rbtree.hpp"
+#include <set>
+#include <string>
+#include <random>
+#include <vector>
+using namespace curly;
+
+
+#define REG_SINGLE_TEST(group, cls, n) \
+    BENCHMARK_TEMPLATE1(BM_##group, cls)->Arg(n)->Name(#group"/"#cls)
+
+#define BM_func(group, cls) \
+REG_SINGLE_TEST(group, cls, 1000); \
+REG_SINGLE_TEST(group, cls, 10000); \
+REG_SINGLE_TEST(group, cls, 100000)
+
+
+// a three-way comparator, each level of a lookup compares the strings once
+struct string_compare {
+    bool operator()(const std::string& a, const std::string& b) const { return a < b; }
+    int compare(const std::string& a, const std::string& b) const { return a.compare(b); }
+};
+
+// a plain less-than, a unique lookup compares the strings a second time to tell equality
+struct string_less {
+    bool operator()(const std::string& a, const std::string& b) const { return a < b; }
+};
+
+// std::less<std::string> and std::less<> are compared three-way like string_compare
+using std_set_t        = std::set<std::string>;
+using pset_t           = pset<std::string>;
+#if __cplusplus >= 201402
+using pset_less_t      = pset<std::string,std::less<>>;
+#endif // __cplusplus >= 201402
+using pset_two_way_t   = pset<std::string,string_less>;
+using pset_three_way_t = pset<std::string,string_compare>;
+using set2_t           = set2<std::string>;
+using set2_two_way_t   = set2<std::string,string_less>;
+using set2_three_way_t = set2<std::string,string_compare>;
+
+
+// keys share a long prefix, so that a comparison of strings isn't decided by the first byte
+static std::vector<std::string> random_keys(size_t n_vals, std::default_random_engine& generator) {
+    std::uniform_int_distribution<size_t> distribution(0,n_vals*3);
+    std::vector<std::string> keys;
+    for (size_t i=0;i<n_vals;i++) {
+        keys.push_back("/service/leaderboard/season/" + std::to_string(distribution(generator)));
+    }
+    return keys;
+}
+
+
+template<typename S>
+void BM_find_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    auto keys = random_keys(n_vals, generator);
+    const S s(keys.begin(), keys.end());
+    auto lookups = random_keys(n_vals, generator);
+
+    size_t i = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(s.find(lookups[i++ % lookups.size()]));
+    }
+}
+BM_func(find_random, std_set_t);
+BM_func(find_random, pset_t);
+#if __cplusplus >= 201402
+BM_func(find_random, pset_less_t);
+#endif // __cplusplus >= 201402
+BM_func(find_random, pset_two_way_t);
+BM_func(find_random, pset_three_way_t);
+BM_func(find_random, set2_t);
+BM_func(find_random, set2_two_way_t);
+BM_func(find_random, set2_three_way_t);
+
+
+template<typename S>
+void BM_insert_random(benchmark::State& state) {
+    const size_t n_vals = state.range(0);
+    std::default_random_engine generator(state.range(0));
+    auto keys = random_keys(n_vals, generator);
+
+    for (auto _: state) {
+        S s;
+        for (auto& key: keys) {
+            s.insert(key);
+        }
+        benchmark::DoNotOptimize(s.size());
+    }
+}
+BM_func(insert_random, std_set_t);
+BM_func(insert_random, pset_t);
+BM_func(insert_random, pset_two_way_t);
+BM_func(insert_random, pset_three_way_t);
+
+
+BENCHMARK_MAIN();
@@ -1,22 +1,34 @@
 #pragma once
 #include <functional>
 #include <utility>
+#include <tuple>
 #include <iterator>
 #include <type_traits>
 #include <memory>
 #include <stdexcept>
 #include <limits>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <system_error>
 #if __cplusplus >= 201703
 #include <memory_resource>
 #endif // __cplusplus >= 201703
 #if __cplusplus >= 202002
 #include <concepts>
+#include <compare>
 #endif // __cplusplus >= 202002
 
 
 #ifdef DEBUG
 #include <assert.h>
 #include <queue>
+#include <unordered_map>
 #define RB_ASSERT(x) assert(x)
 #else
 #define RB_ASSERT(x)
@@ -36,6 +48,14 @@ template <typename T1, typename T2>
 concept C_is_same_value_type = is_same_value_type<T1,T2>::value;
 #endif // __cplusplus >= 202002
 
+/**
+ * tag of the constructors which move a value out of a storage that is destroyed right after without being read,
+ * its const key is moved as well. Values of a B+tree are relocated this way when the slots of a leaf shift
+ */
+struct rbtree_relocate_t {
+    explicit rbtree_relocate_t() = default;
+};
+
 template<typename K, typename V>
 struct RBTreeValueKV: public std::pair<const K,V> {
 public:
@@ -58,19 +78,42 @@ public:
 #endif // __cplusplus >= 202002
     RBTreeValueKV(T1&& v1, T2&& v2): std::pair<const K,V>(std::forward<T1>(v1), std::forward<T2>(v2)) {}
 
+    /** the key and the mapped value are constructed in place from the arguments in the tuples */
+    template<typename ... A1, typename ... A2>
+    RBTreeValueKV(std::piecewise_construct_t tag, std::tuple<A1...> a1, std::tuple<A2...> a2):
+        std::pair<const K,V>(tag, std::move(a1), std::move(a2)) {}
+
     RBTreeValueKV(const RBTreeValueKV&) = default;
     RBTreeValueKV(RBTreeValueKV&&) = default;
+    RBTreeValueKV(rbtree_relocate_t, RBTreeValueKV& oth)
+        noexcept(std::is_nothrow_move_constructible<K>::value && std::is_nothrow_move_constructible<V>::value):
+        std::pair<const K,V>(std::move(const_cast<K&>(oth.first)), std::move(oth.second)) {}
 
     RBTreeValueKV& assign_value(const RBTreeValueKV& oth) {
-        RB_ASSERT(this->first == oth.first);
         this->second = oth.second;
         return *this;
     }
     RBTreeValueKV& assign_value(RBTreeValueKV&& oth) {
-        RB_ASSERT(this->first == oth.first);
         this->second = std::move(oth.second);
         return *this;
     }
+    /** the mapped value of a pair whose key is equivalent to this one */
+    template<typename T>
+    RBTreeValueKV& assign_from(T&& v) {
+        this->second = std::forward<T>(v).second;
+        return *this;
+    }
+    /** the mapped value of the arguments of a pair whose key is equivalent to this one, see rbtree_emplace_key */
+    template<typename T1, typename T2>
+    RBTreeValueKV& assign_from(T1&&, T2&& v2) {
+        this->second = V(std::forward<T2>(v2));
+        return *this;
+    }
+    template<typename A1, typename ... A2>
+    RBTreeValueKV& assign_from(std::piecewise_construct_t tag, std::tuple<A1> a1, std::tuple<A2...> a2) {
+        this->second = std::move(std::pair<const K&,V>(tag, std::move(a1), std::move(a2)).second);
+        return *this;
+    }
 
     RBTreeValueKV& operator=(const RBTreeValueKV&) = delete;
     RBTreeValueKV& operator=(RBTreeValueKV&&) = delete;
@@ -84,10 +127,180 @@ public:
         return *this;
     }
 };
+/**
+ * only the key is kept in the node, the pair lives in a separately allocated block,
+ * so that descending the tree doesn't pull the mapped values into cache.
+ * The block is allocated by Alloc, a tree passes its own allocator, see rbtree_uses_allocator
+ */
+template<typename K, typename V, typename Alloc = std::allocator<std::pair<const K,V>>>
+struct RBTreeValueKVSplit: private std::allocator_traits<Alloc>::template rebind_alloc<std::pair<const K,V>> {
+public:
+    using key_type = K;
+    using storage_type_base = std::pair<const K,V>;
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<storage_type_base>;
+    static_assert(std::is_copy_constructible<K>::value, "key is duplicated in the node");
+
+private:
+    using cold_traits = std::allocator_traits<allocator_type>;
+
+    /** owns the block until the key in the node is constructed */
+    struct cold_block {
+        allocator_type alloc;
+        storage_type_base* ptr;
+
+        template<typename ... Args>
+        explicit cold_block(const allocator_type& alloc, Args&& ... args): alloc(alloc), ptr(cold_traits::allocate(this->alloc, 1)) {
+            try {
+                new (this->ptr) storage_type_base(std::forward<Args>(args)...);
+            } catch (...) {
+                cold_traits::deallocate(this->alloc, this->ptr, 1);
+                throw;
+            }
+        }
+        cold_block(cold_block&& oth): alloc(oth.alloc), ptr(oth.ptr) {
+            oth.ptr = nullptr;
+        }
+        cold_block(const cold_block&) = delete;
+
+        ~cold_block() {
+            if (this->ptr == nullptr) return;
+            this->ptr->~storage_type_base();
+            cold_traits::deallocate(this->alloc, this->ptr, 1);
+        }
+    };
+
+    storage_type_base* cold;
+
+    explicit RBTreeValueKVSplit(cold_block&& block): allocator_type(block.alloc), cold(block.ptr), first(cold->first) {
+        block.ptr = nullptr;
+    }
+
+    const allocator_type& cold_allocator() const {
+        return *this;
+    }
+
+public:
+    const K first;
+
+    RBTreeValueKVSplit() = delete;
+
+#if __cplusplus >= 202002
+    template<typename T>
+        requires ( std::constructible_from<storage_type_base,T&&> )
+#else
+    template<typename T, typename std::enable_if<std::is_constructible<storage_type_base,T&&>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+    explicit RBTreeValueKVSplit(T&& v): RBTreeValueKVSplit(cold_block(allocator_type(), std::forward<T>(v))) {}
+
+    template<typename T1, typename T2>
+#if __cplusplus >= 202002
+        requires ( std::constructible_from<const K,T1&&> && std::constructible_from<V,T2&&> )
+#endif // __cplusplus >= 202002
+    RBTreeValueKVSplit(T1&& v1, T2&& v2): RBTreeValueKVSplit(cold_block(allocator_type(), std::forward<T1>(v1), std::forward<T2>(v2))) {}
+
+    template<typename ... A1, typename ... A2>
+    RBTreeValueKVSplit(std::piecewise_construct_t tag, std::tuple<A1...> a1, std::tuple<A2...> a2):
+        RBTreeValueKVSplit(cold_block(allocator_type(), tag, std::move(a1), std::move(a2))) {}
+
+    /** the block is allocated by alloc, the pair is constructed from args */
+#if __cplusplus >= 202002
+    template<typename A, typename ... Args>
+        requires ( std::constructible_from<storage_type_base,Args&&...> )
+#else
+    template<typename A, typename ... Args,
+             typename std::enable_if<std::is_constructible<storage_type_base,Args&&...>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+    RBTreeValueKVSplit(std::allocator_arg_t, const A& alloc, Args&& ... args):
+        RBTreeValueKVSplit(cold_block(allocator_type(alloc), std::forward<Args>(args)...)) {}
+
+    template<typename A>
+    RBTreeValueKVSplit(std::allocator_arg_t, const A& alloc, const RBTreeValueKVSplit& oth):
+        RBTreeValueKVSplit(cold_block(allocator_type(alloc), *oth.cold)) {}
+
+    /** the block of oth is taken if it's allocated by alloc as well */
+    template<typename A>
+    RBTreeValueKVSplit(std::allocator_arg_t, const A& alloc, RBTreeValueKVSplit&& oth):
+        RBTreeValueKVSplit(allocator_type(alloc) == oth.cold_allocator() ? RBTreeValueKVSplit(std::move(oth)) :
+                           RBTreeValueKVSplit(cold_block(allocator_type(alloc), std::move(*oth.cold)))) {}
+
+    /** the copy allocates its block by the allocator of oth */
+    RBTreeValueKVSplit(const RBTreeValueKVSplit& oth): RBTreeValueKVSplit(cold_block(oth.cold_allocator(), *oth.cold)) {}
+    RBTreeValueKVSplit(RBTreeValueKVSplit&& oth): allocator_type(oth.cold_allocator()), cold(oth.cold), first(oth.first) {
+        oth.cold = nullptr;
+    }
+    RBTreeValueKVSplit(rbtree_relocate_t, RBTreeValueKVSplit& oth) noexcept(std::is_nothrow_move_constructible<K>::value):
+        allocator_type(oth.cold_allocator()), cold(oth.cold), first(std::move(const_cast<K&>(oth.first)))
+    {
+        oth.cold = nullptr;
+    }
+
+    ~RBTreeValueKVSplit() {
+        if (this->cold == nullptr) return;
+
+        allocator_type alloc(this->cold_allocator());
+        this->cold->~storage_type_base();
+        cold_traits::deallocate(alloc, this->cold, 1);
+    }
+
+    RBTreeValueKVSplit& assign_value(const RBTreeValueKVSplit& oth) {
+        this->cold->second = oth.cold->second;
+        return *this;
+    }
+    RBTreeValueKVSplit& assign_value(RBTreeValueKVSplit&& oth) {
+        this->cold->second = std::move(oth.cold->second);
+        return *this;
+    }
+    template<typename T>
+    RBTreeValueKVSplit& assign_from(T&& v) {
+        this->cold->second = std::forward<T>(v).second;
+        return *this;
+    }
+    template<typename T1, typename T2>
+    RBTreeValueKVSplit& assign_from(T1&&, T2&& v2) {
+        this->cold->second = V(std::forward<T2>(v2));
+        return *this;
+    }
+    template<typename A1, typename ... A2>
+    RBTreeValueKVSplit& assign_from(std::piecewise_construct_t tag, std::tuple<A1> a1, std::tuple<A2...> a2) {
+        this->cold->second = std::move(std::pair<const K&,V>(tag, std::move(a1), std::move(a2)).second);
+        return *this;
+    }
+
+    RBTreeValueKVSplit& operator=(const RBTreeValueKVSplit&) = delete;
+    RBTreeValueKVSplit& operator=(RBTreeValueKVSplit&&) = delete;
+    bool operator==(const RBTreeValueKVSplit&) = delete;
+
+    const storage_type_base& get() const {
+        return *this->cold;
+    }
+
+    storage_type_base& get() {
+        return *this->cold;
+    }
+};
+
 template<typename T>
 struct IsRBTreeValueKV: std::false_type {};
 template<typename K, typename V>
 struct IsRBTreeValueKV<RBTreeValueKV<K,V>>: std::true_type {};
+template<typename K, typename V, typename Alloc>
+struct IsRBTreeValueKV<RBTreeValueKVSplit<K,V,Alloc>>: std::true_type {};
+
+/** whether values S allocate memory of their own, the trees construct them with std::allocator_arg and their allocator */
+template<typename S>
+struct rbtree_uses_allocator: std::false_type {};
+template<typename K, typename V, typename Alloc>
+struct rbtree_uses_allocator<RBTreeValueKVSplit<K,V,Alloc>>: std::true_type {};
+
+/** node N constructed at ptr, the tag tells whether its value takes alloc */
+template<typename N, typename A, typename ... Args>
+inline N* rbtree_new_node(N* ptr, std::false_type, const A&, Args&& ... args) {
+    return new (ptr) N(std::forward<Args>(args)...);
+}
+template<typename N, typename A, typename ... Args>
+inline N* rbtree_new_node(N* ptr, std::true_type, const A& alloc, Args&& ... args) {
+    return new (ptr) N(std::allocator_arg, alloc, std::forward<Args>(args)...);
+}
 
 
 template<typename K>
@@ -119,13 +332,21 @@ public:
 
     RBTreeValueK(const RBTreeValueK&) = default;
     RBTreeValueK(RBTreeValueK&&) = default;
+    RBTreeValueK(rbtree_relocate_t, RBTreeValueK& oth) noexcept(std::is_nothrow_move_constructible<K>::value):
+        key(std::move(const_cast<K&>(oth.key))) {}
 
     RBTreeValueK& assign_value(const RBTreeValueK& oth) {
-        RB_ASSERT(this->key == oth.key);
+        (void)oth;
         return *this;
     }
     RBTreeValueK& assign_value(RBTreeValueK&& oth) {
-        RB_ASSERT(this->key == oth.key);
+        (void)oth;
+        return *this;
+    }
+    /** the key is equivalent to k, so there's nothing to assign */
+    template<typename T>
+    RBTreeValueK& assign_from(const T& k) {
+        (void)k;
         return *this;
     }
 
@@ -142,6 +363,33 @@ struct IsRBTreeValueK: std::false_type {};
 template<typename K>
 struct IsRBTreeValueK<RBTreeValueK<K>>: std::true_type {};
 
+
+/**
+ * storage of nodes of intrusive trees, it holds nothing since the node is
+ * a base of the object T, which is compared as a whole, see RBTreeHook
+ */
+template<typename T>
+struct RBTreeValueHook {
+public:
+    using key_type = T;
+    using storage_type_base = T;
+
+    RBTreeValueHook() = default;
+    RBTreeValueHook(const RBTreeValueHook&) = default;
+    RBTreeValueHook(RBTreeValueHook&&) = default;
+
+    RBTreeValueHook& assign_value(const RBTreeValueHook&) {
+        return *this;
+    }
+
+    RBTreeValueHook& operator=(const RBTreeValueHook&) = delete;
+    RBTreeValueHook& operator=(RBTreeValueHook&&) = delete;
+};
+template<typename T>
+struct IsRBTreeValueHook: std::false_type {};
+template<typename T>
+struct IsRBTreeValueHook<RBTreeValueHook<T>>: std::true_type {};
+
 #if __cplusplus >= 202002
 template <typename T>
 concept C_RBTreeValueKV = IsRBTreeValueKV<T>::value;
@@ -157,7 +405,7 @@ template <C_RBTreeValueKV T, C_RBTreeValueCompare<T> Compare>
 #else
 template<typename T, typename Compare, typename std::enable_if<IsRBTreeValueKV<T>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_compare(Compare cmp, const T& v1, const T& v2) {
+inline bool rbvalue_compare(const Compare& cmp, const T& v1, const T& v2) {
     return cmp(v1.first,v2.first);
 }
 
@@ -168,7 +416,7 @@ template<
     typename T1, typename T2, typename Compare,
     typename std::enable_if<IsRBTreeValueKV<T1>::value && !IsRBTreeValueKV<T2>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_compare(Compare cmp, const T1& v1, const T2& v2) {
+inline bool rbvalue_compare(const Compare& cmp, const T1& v1, const T2& v2) {
     return cmp(v1.first,v2);
 }
 
@@ -179,7 +427,7 @@ template<
     typename T1, typename T2, typename Compare,
     typename std::enable_if<!IsRBTreeValueKV<T1>::value && IsRBTreeValueKV<T2>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_compare(Compare cmp, const T1& v1, const T2& v2) {
+inline bool rbvalue_compare(const Compare& cmp, const T1& v1, const T2& v2) {
     return cmp(v1,v2.first);
 }
 
@@ -188,7 +436,7 @@ template<C_RBTreeValueK T, C_RBTreeValueCompare<T> Compare>
 #else
 template<typename T, typename Compare, typename std::enable_if<IsRBTreeValueK<T>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_compare(Compare cmp, const T& v1, const T& v2) {
+inline bool rbvalue_compare(const Compare& cmp, const T& v1, const T& v2) {
     return cmp(v1.key,v2.key);
 }
 
@@ -199,7 +447,7 @@ template<
     typename T1, typename T2, typename Compare,
     typename std::enable_if<IsRBTreeValueK<T1>::value && !IsRBTreeValueK<T2>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_compare(Compare cmp, const T1& v1, const T2& v2) {
+inline bool rbvalue_compare(const Compare& cmp, const T1& v1, const T2& v2) {
     return cmp(v1.key,v2);
 }
 
@@ -210,7 +458,7 @@ template<
     typename T1, typename T2, typename Compare,
     typename std::enable_if<!IsRBTreeValueK<T1>::value && IsRBTreeValueK<T2>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_compare(Compare cmp, const T1& v1, const T2& v2) {
+inline bool rbvalue_compare(const Compare& cmp, const T1& v1, const T2& v2) {
     return cmp(v1,v2.key);
 }
 
@@ -219,71 +467,211 @@ template <C_RBTreeValueKV T>
 #else
 template<typename T, typename std::enable_if<IsRBTreeValueKV<T>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_equal(const T& v1, const T& v2) {
-    return v1.first == v2.first;
+inline const typename T::key_type& rbvalue_key(const T& v) {
+    return v.first;
 }
 
 #if __cplusplus >= 202002
-template<C_RBTreeValueKV T1, typename T2> requires ( !C_RBTreeValueKV<T2> )
+template <C_RBTreeValueK T>
 #else
-template<
-    typename T1, typename T2,
-    typename std::enable_if<IsRBTreeValueKV<T1>::value && !IsRBTreeValueKV<T2>::value,bool>::type = true>
+template<typename T, typename std::enable_if<IsRBTreeValueK<T>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_equal(const T1& v1, const T2& v2) {
-    return v1.first == v2;
+inline const typename T::key_type& rbvalue_key(const T& v) {
+    return v.key;
 }
 
 #if __cplusplus >= 202002
-template<typename T1, C_RBTreeValueKV T2> requires ( !C_RBTreeValueKV<T1> )
+template <typename T> requires ( !C_RBTreeValueKV<T> && !C_RBTreeValueK<T> )
 #else
-template<
-    typename T1, typename T2,
-    typename std::enable_if<!IsRBTreeValueKV<T1>::value && IsRBTreeValueKV<T2>::value,bool>::type = true>
+template<typename T, typename std::enable_if<!IsRBTreeValueKV<T>::value && !IsRBTreeValueK<T>::value,bool>::type = true>
 #endif // __cplusplus >= 202002
-inline bool rbvalue_equal(const T1& v1, const T2& v2) {
-    return v1 == v2.first;
+inline const T& rbvalue_key(const T& v) {
+    return v;
 }
 
+template<typename T>
+using rbtree_key_t = typename std::decay<decltype(rbvalue_key(std::declval<const T&>()))>::type;
+
+/**
+ * whether the key can be read from the arguments of emplace() without constructing the stored value S,
+ * i.e. the argument is the key of a set or a pair of the key and the mapped value of a map, or the arguments
+ * are the key and the mapped value or std::piecewise_construct and a tuple of the key
+ */
+template<typename S, typename ... Args>
+struct rbtree_emplace_key: std::false_type {};
+
+template<typename K, typename A>
+struct rbtree_emplace_key<RBTreeValueK<K>,A>: std::is_same<typename std::decay<A>::type,K> {
+    static const K& get(const K& key) { return key; }
+};
+
+template<typename K, typename V, typename A>
+struct rbtree_pair_key: std::false_type {};
+template<typename K, typename V>
+struct rbtree_pair_key<K,V,std::pair<K,V>>: std::true_type {
+    static const K& get(const std::pair<K,V>& v) { return v.first; }
+};
+template<typename K, typename V>
+struct rbtree_pair_key<K,V,std::pair<const K,V>>: std::true_type {
+    static const K& get(const std::pair<const K,V>& v) { return v.first; }
+};
+
+template<typename K, typename A, typename M>
+struct rbtree_mapped_args_key: std::is_same<typename std::decay<A>::type,K> {
+    static const K& get(const K& key, const M&) { return key; }
+};
+
+template<typename K, typename P, typename T1, typename T2>
+struct rbtree_piecewise_key: std::false_type {};
+template<typename K, typename A, typename T2>
+struct rbtree_piecewise_key<K,std::piecewise_construct_t,std::tuple<A>,T2>: std::is_same<typename std::decay<A>::type,K> {
+    template<typename P, typename T1>
+    static const K& get(const P&, const T1& key, const T2&) { return std::get<0>(key); }
+};
+
+template<typename K, typename V, typename A>
+struct rbtree_emplace_key<RBTreeValueKV<K,V>,A>: rbtree_pair_key<K,V,typename std::decay<A>::type> {};
+template<typename K, typename V, typename Alloc, typename A>
+struct rbtree_emplace_key<RBTreeValueKVSplit<K,V,Alloc>,A>: rbtree_pair_key<K,V,typename std::decay<A>::type> {};
+template<typename K, typename V, typename A, typename M>
+struct rbtree_emplace_key<RBTreeValueKV<K,V>,A,M>: rbtree_mapped_args_key<K,A,M> {};
+template<typename K, typename V, typename Alloc, typename A, typename M>
+struct rbtree_emplace_key<RBTreeValueKVSplit<K,V,Alloc>,A,M>: rbtree_mapped_args_key<K,A,M> {};
+template<typename K, typename V, typename P, typename T1, typename T2>
+struct rbtree_emplace_key<RBTreeValueKV<K,V>,P,T1,T2>:
+    rbtree_piecewise_key<K,typename std::decay<P>::type,typename std::decay<T1>::type,T2> {};
+template<typename K, typename V, typename Alloc, typename P, typename T1, typename T2>
+struct rbtree_emplace_key<RBTreeValueKVSplit<K,V,Alloc>,P,T1,T2>:
+    rbtree_piecewise_key<K,typename std::decay<P>::type,typename std::decay<T1>::type,T2> {};
+
+/** results of a member compare(a, b) which are three-way, signed integers and strong or weak orderings */
+template<typename R>
+struct rbtree_three_way_result: std::integral_constant<bool,std::is_integral<R>::value && std::is_signed<R>::value> {};
+
 #if __cplusplus >= 202002
-template<C_RBTreeValueK T>
-#else
-template<typename T, typename std::enable_if<IsRBTreeValueK<T>::value,bool>::type = true>
+template<>
+struct rbtree_three_way_result<std::strong_ordering>: std::true_type {};
+template<>
+struct rbtree_three_way_result<std::weak_ordering>: std::true_type {};
 #endif // __cplusplus >= 202002
-inline bool rbvalue_equal(const T& v1, const T& v2) {
-    return v1.key == v2.key;
-}
+
+/**
+ * keys whose std::less is their operator< as given by the standard library, so that operator<=> orders them
+ * the same way. Program-defined keys may have their own std::less, they opt in by specializing this trait
+ */
+template<typename K>
+struct rbtree_less_is_three_way: std::false_type {};
+
+template<typename C, typename A>
+struct rbtree_less_is_three_way<std::basic_string<C,std::char_traits<C>,A>>: std::true_type {};
+
+/**
+ * comparators which tell the order of two keys with a single comparison, compare() returns
+ * a negative value, zero or a positive value. They are Compare with a member compare(a, b)
+ * returning a signed integer or an ordering, and std::less of the keys of rbtree_less_is_three_way
+ */
+template<typename Compare, typename T1, typename T2, typename = void>
+struct rbtree_three_way: std::false_type {};
+
+template<typename Compare, typename T1, typename T2>
+struct rbtree_three_way<Compare,T1,T2,typename std::enable_if<rbtree_three_way_result<typename std::decay<
+    decltype(std::declval<const Compare&>().compare(std::declval<const T1&>(), std::declval<const T2&>()))>::type>::value>::type>:
+    std::true_type
+{
+    static inline int compare(const Compare& cmp, const T1& a, const T2& b) {
+        const auto c = cmp.compare(a, b);
+        return c < 0 ? -1 : (c == 0 ? 0 : 1);
+    }
+};
+
+/** std::less and std::less<> of strings compare them once with basic_string::compare(), also before C++20 */
+template<typename S>
+struct rbtree_string_three_way: std::true_type
+{
+    static inline int compare(const std::less<S>&, const S& a, const S& b) {
+        return rbtree_string_three_way::compare(a, b);
+    }
+
+#if __cplusplus >= 201402
+    static inline int compare(const std::less<>&, const S& a, const S& b) {
+        return rbtree_string_three_way::compare(a, b);
+    }
+#endif // __cplusplus >= 201402
+
+    static inline int compare(const S& a, const S& b) {
+        const int c = a.compare(b);
+        return c < 0 ? -1 : (c == 0 ? 0 : 1);
+    }
+};
+
+template<typename C, typename A>
+struct rbtree_three_way<std::less<std::basic_string<C,std::char_traits<C>,A>>,
+                        std::basic_string<C,std::char_traits<C>,A>,std::basic_string<C,std::char_traits<C>,A>,void>:
+    rbtree_string_three_way<std::basic_string<C,std::char_traits<C>,A>> {};
+
+#if __cplusplus >= 201402
+template<typename C, typename A>
+struct rbtree_three_way<std::less<>,std::basic_string<C,std::char_traits<C>,A>,std::basic_string<C,std::char_traits<C>,A>,void>:
+    rbtree_string_three_way<std::basic_string<C,std::char_traits<C>,A>> {};
+#endif // __cplusplus >= 201402
+
 #if __cplusplus >= 202002
-template<C_RBTreeValueK T1, typename T2> requires ( !C_RBTreeValueK<T2> )
-#else
-template<
-    typename T1, typename T2,
-    typename std::enable_if<IsRBTreeValueK<T1>::value && !IsRBTreeValueK<T2>::value,bool>::type = true>
+template<typename K, typename T1, typename T2>
+    requires ( rbtree_less_is_three_way<K>::value && std::same_as<T1,K> && std::same_as<T2,K> && std::three_way_comparable<K> )
+struct rbtree_three_way<std::less<K>,T1,T2,void>: std::true_type
+{
+    static inline int compare(const std::less<K>&, const T1& a, const T2& b) {
+        const auto c = a <=> b;
+        return c < 0 ? -1 : (c == 0 ? 0 : 1);
+    }
+};
 #endif // __cplusplus >= 202002
-inline bool rbvalue_equal(const T1& v1, const T2& v2) {
-    return v1.key == v2;
-}
 
-#if __cplusplus >= 202002
-template<typename T1, C_RBTreeValueK T2> requires ( !C_RBTreeValueK<T1> )
+/** comparators declaring is_transparent accept keys of any type, like std::less<> */
+template<typename Compare, typename = void>
+struct rbtree_transparent: std::false_type {};
+
+template<typename Compare>
+struct rbtree_transparent<Compare,typename std::conditional<true,void,typename Compare::is_transparent>::type>: std::true_type {};
+
+
+template<typename T>
+inline void rbtree_prefetch(const T* ptr) noexcept {
+#if defined(__GNUC__)
+    __builtin_prefetch(ptr);
 #else
-template<
-    typename T1, typename T2,
-    typename std::enable_if<!IsRBTreeValueK<T1>::value && IsRBTreeValueK<T2>::value,bool>::type = true>
-#endif // __cplusplus >= 202002
-inline bool rbvalue_equal(const T1& v1, const T2& v2) {
-    return v1 == v2.key;
+    (void)ptr;
+#endif // __GNUC__
 }
 
 
-template<typename S, typename N>
-struct RBTreeNodeBasic {
+/** in-order neighbours of a threaded node, nothing is kept otherwise */
+template<typename N, bool threaded>
+struct RBTreeNodeThreads {};
+
+template<typename N>
+struct RBTreeNodeThreads<N,true> {
+    N successor, predecessor;
+
+    RBTreeNodeThreads(): successor(nullptr), predecessor(nullptr) {}
+    // a copy isn't linked to anything
+    RBTreeNodeThreads(const RBTreeNodeThreads&): RBTreeNodeThreads() {}
+    RBTreeNodeThreads(RBTreeNodeThreads&& oth): successor(oth.successor), predecessor(oth.predecessor) {
+        oth.successor = oth.predecessor = nullptr;
+    }
+    RBTreeNodeThreads& operator=(const RBTreeNodeThreads&) { return *this; }
+};
+
+template<typename S, typename N, bool threaded = false>
+struct RBTreeNodeBasic: public RBTreeNodeThreads<N,threaded> {
 public:
     using storage_type = S;
     using nodeptr_t = N;
     using rbtree_node_type = typename std::remove_pointer<nodeptr_t>::type;
     using size_type = size_t;
     using const_nodeptr_t = const rbtree_node_type*;
+    using threads_type = RBTreeNodeThreads<N,threaded>;
+    constexpr static bool Threaded = threaded;
 
 public:
     inline nodeptr_t minimum() {
@@ -308,13 +696,27 @@ public:
         return const_cast<RBTreeNodeBasic*>(this)->maximum();
     }
 
-    nodeptr_t next() {
+    /** in-order successor, a single load for threaded nodes */
+    inline nodeptr_t next() {
+        return this->next(std::integral_constant<bool,threaded>());
+    }
+
+    inline nodeptr_t next(std::true_type) {
+        return this->successor;
+    }
+
+    inline nodeptr_t next(std::false_type) {
+        return this->tree_next();
+    }
+
+    /** successor which is found by walking the tree */
+    nodeptr_t tree_next() {
         auto node = static_cast<nodeptr_t>(this);
 
         if (node->right) return node->right->minimum();
-        for (;node;node=node->parent) {
-            if (node->parent && node->parent->left == node) {
-                node = node->parent;
+        for (;node;node=node->parent()) {
+            if (node->parent() && node->parent()->left == node) {
+                node = node->parent();
                 break;
             }
         }
@@ -326,13 +728,25 @@ public:
         return const_cast<RBTreeNodeBasic*>(this)->next();
     }
 
-    nodeptr_t prev() {
+    inline nodeptr_t prev() {
+        return this->prev(std::integral_constant<bool,threaded>());
+    }
+
+    inline nodeptr_t prev(std::true_type) {
+        return this->predecessor;
+    }
+
+    inline nodeptr_t prev(std::false_type) {
+        return this->tree_prev();
+    }
+
+    nodeptr_t tree_prev() {
         auto node = static_cast<nodeptr_t>(this);
 
         if (node->left) return node->left->maximum();
-        for (;node;node=node->parent) {
-            if (node->parent && node->parent->right == node) {
-                node = node->parent;
+        for (;node;node=node->parent()) {
+            if (node->parent() && node->parent()->right == node) {
+                node = node->parent();
                 break;
             }
         }
@@ -344,9 +758,78 @@ public:
         return const_cast<RBTreeNodeBasic*>(this)->prev();
     }
 
+    inline const_nodeptr_t tree_next() const {
+        return const_cast<RBTreeNodeBasic*>(this)->tree_next();
+    }
+
+    inline const_nodeptr_t tree_prev() const {
+        return const_cast<RBTreeNodeBasic*>(this)->tree_prev();
+    }
+
+    /** link the node between pred and succ of in-order sequence, either of them may be nullptr */
+    inline void thread_between(nodeptr_t pred, nodeptr_t succ) {
+        this->thread_between(pred, succ, std::integral_constant<bool,threaded>());
+    }
+
+    inline void thread_between(nodeptr_t pred, nodeptr_t succ, std::true_type) {
+        auto node = static_cast<nodeptr_t>(this);
+        this->predecessor = pred;
+        this->successor = succ;
+        if (pred) pred->successor = node;
+        if (succ) succ->predecessor = node;
+    }
+
+    inline void thread_between(nodeptr_t, nodeptr_t, std::false_type) {}
+
+    /** remove the node from in-order sequence */
+    inline void unthread() {
+        this->unthread(std::integral_constant<bool,threaded>());
+    }
+
+    inline void unthread(std::true_type) {
+        if (this->predecessor) this->predecessor->successor = this->successor;
+        if (this->successor) this->successor->predecessor = this->predecessor;
+        this->predecessor = this->successor = nullptr;
+    }
+
+    inline void unthread(std::false_type) {}
+
+    /** exchange places of two nodes in in-order sequence */
+    static inline void swap_threads(nodeptr_t n1, nodeptr_t n2) {
+        swap_threads(n1, n2, std::integral_constant<bool,threaded>());
+    }
+
+    static inline void swap_threads(nodeptr_t n1, nodeptr_t n2, std::true_type) {
+        auto other = [n1, n2](nodeptr_t n) { return n == n1 ? n2 : (n == n2 ? n1 : n); };
+        const auto p1 = other(n1->predecessor), s1 = other(n1->successor);
+        const auto p2 = other(n2->predecessor), s2 = other(n2->successor);
+        n2->predecessor = p1;
+        n2->successor = s1;
+        n1->predecessor = p2;
+        n1->successor = s2;
+        if (p1) p1->successor = n2;
+        if (s1) s1->predecessor = n2;
+        if (p2) p2->successor = n1;
+        if (s2) s2->predecessor = n1;
+    }
+
+    static inline void swap_threads(nodeptr_t, nodeptr_t, std::false_type) {}
+
+    /** make pred and succ neighbours in in-order sequence, either of them may be nullptr */
+    static inline void link_threads(nodeptr_t pred, nodeptr_t succ) {
+        link_threads(pred, succ, std::integral_constant<bool,threaded>());
+    }
+
+    static inline void link_threads(nodeptr_t pred, nodeptr_t succ, std::true_type) {
+        if (pred) pred->successor = succ;
+        if (succ) succ->predecessor = pred;
+    }
+
+    static inline void link_threads(nodeptr_t, nodeptr_t, std::false_type) {}
+
     nodeptr_t root() {
         auto node = static_cast<nodeptr_t>(this);
-        for (;node->parent;node=node->parent);
+        for (;node->parent();node=node->parent());
         return node;
     }
 
@@ -354,21 +837,52 @@ public:
         return const_cast<RBTreeNodeBasic*>(this)->root();
     }
 
+private:
+    // the color is stored in the lowest bit of parent pointer, which is always
+    // zero because of the alignment of node, set means black
+    std::uintptr_t parent_and_color;
+    constexpr static std::uintptr_t color_mask = 1;
+
 public:
-    nodeptr_t left, right, parent;
+    nodeptr_t left, right;
     storage_type value;
-    bool black;
+
+    inline nodeptr_t parent() const {
+        return reinterpret_cast<nodeptr_t>(this->parent_and_color & ~color_mask);
+    }
+
+    inline void set_parent(nodeptr_t parent) {
+        RB_ASSERT((reinterpret_cast<std::uintptr_t>(parent) & color_mask) == 0);
+        this->parent_and_color = reinterpret_cast<std::uintptr_t>(parent) | (this->parent_and_color & color_mask);
+    }
+
+    inline bool is_black() const {
+        return (this->parent_and_color & color_mask) != 0;
+    }
+
+    inline void set_black(bool black) {
+        this->parent_and_color = (this->parent_and_color & ~color_mask) | (black ? color_mask : 0);
+    }
+
+    inline void swap_color(RBTreeNodeBasic& oth) {
+        const bool black = this->is_black();
+        this->set_black(oth.is_black());
+        oth.set_black(black);
+    }
 
     RBTreeNodeBasic(RBTreeNodeBasic&& oth):
-        left(oth.left), right(oth.right), parent(oth.parent),
-        black(oth.black), value(std::move(oth.value))
+        threads_type(std::move(oth)),
+        parent_and_color(oth.parent_and_color),
+        left(oth.left), right(oth.right), value(std::move(oth.value))
     {
-        oth.parent = oth.right = oth.left = nullptr;
+        oth.set_parent(nullptr);
+        oth.right = oth.left = nullptr;
     }
 
     RBTreeNodeBasic(const RBTreeNodeBasic& oth):
-        left(nullptr), right(nullptr), parent(nullptr),
-        black(oth.black), value(oth.value)
+        threads_type(oth),
+        parent_and_color(oth.parent_and_color & color_mask),
+        left(nullptr), right(nullptr), value(oth.value)
     {
     }
 
@@ -376,7 +890,7 @@ public:
     {
         RB_ASSERT(this->left == nullptr);
         RB_ASSERT(this->right == nullptr);
-        this->black = oth.black;
+        this->set_black(oth.is_black());
         this->value = oth.value;
     }
 
@@ -389,11 +903,10 @@ public:
             delete this->right;
             this->right = oth.right;
         }
-        this->parent = oth.parent;
-        oth.parent = nullptr;
+        this->parent_and_color = oth.parent_and_color;
+        oth.set_parent(nullptr);
 
         this->value = std::move(oth.value);
-        this->black = oth.black;
     }
 
     size_t num_of_left_children() const {
@@ -414,6 +927,10 @@ public:
     void update_position_info(nodeptr_t to) {
     }
 
+    /** n is the number of nodes in the subtree, only nodes counting them keep it */
+    inline void set_subtree_size(size_t) {
+    }
+
     const_nodeptr_t advance(long n) const {
         return const_cast<RBTreeNodeBasic*>(this)->advance(n);
     }
@@ -443,7 +960,7 @@ public:
     }
 
     nodeptr_t flatten2List() {
-        RB_ASSERT(this->parent == nullptr);
+        RB_ASSERT(this->parent() == nullptr);
         auto node = this->minimum();
         auto head = node;
 
@@ -453,9 +970,9 @@ public:
             if (node->right) {
                 next = node->right->minimum();
             } else {
-                for (next=node;next;next=next->parent) {
-                    if (next->parent && next->parent->left == next) {
-                        next = next->parent;
+                for (next=node;next;next=next->parent()) {
+                    if (next->parent() && next->parent()->left == next) {
+                        next = next->parent();
                         break;
                     }
                 }
@@ -471,11 +988,14 @@ public:
     nodeptr_t fromList() {
         auto head = static_cast<nodeptr_t>(this);
         size_t size = 0;
-        for (auto node=head;node!=nullptr;node=node->right,size++);
+        for (nodeptr_t node=head,prev=nullptr;node!=nullptr;prev=node,node=node->right,size++) {
+            node->thread_between(prev, nullptr);
+        }
 
+        // all levels except the deepest one are full, nodes of the deepest level are red unless it's full as well
         size_t max_depth = 0;
-        for (;(1<<max_depth) < size;max_depth++);
-        bool always_black = (1<<max_depth) == size;
+        for (;(size_t(2)<<max_depth) <= size;max_depth++);
+        bool always_black = (size_t(2)<<max_depth) == size + 1;
 
         auto node = head;
         const std::function<nodeptr_t(long,long,size_t)> inorderHelper = 
@@ -491,39 +1011,92 @@ public:
 
             auto right = inorderHelper(mid+1, end, depth+1);
 
-            if (left) left->parent = pn;
-            if (right) right->parent = pn;
+            if (left) left->set_parent(pn);
+            if (right) right->set_parent(pn);
             pn->left = left;
             pn->right = right;
-            pn->black = always_black || depth != max_depth;
-            pn->update_position_info(pn->parent);
+            pn->set_black(always_black || depth != max_depth);
+            pn->update_position_info(pn->parent());
             return pn;
         };
 
         auto root = inorderHelper(0, size - 1, 0);
-        root->parent = nullptr;
+        root->set_parent(nullptr);
+        return root;
+    }
+
+    /**
+     * balanced tree of nodes[0, n), which are in order, colored like fromList(). Subtree sizes follow
+     * from the ranges of the array, so each node is written once without reading its children
+     */
+    static nodeptr_t fromArray(const nodeptr_t* nodes, size_t n) {
+        if (n == 0) return nullptr;
+        for (size_t i=0;i<n;i++) {
+            nodes[i]->thread_between(i > 0 ? nodes[i-1] : nullptr, nullptr);
+        }
+
+        size_t max_depth = 0;
+        for (;(size_t(2)<<max_depth) <= n;max_depth++);
+        const bool always_black = (size_t(2)<<max_depth) == n + 1;
+        auto root = buildFromArray(nodes, n, 0, max_depth, always_black);
+        root->set_parent(nullptr);
         return root;
     }
 
+private:
+    static nodeptr_t buildFromArray(const nodeptr_t* nodes, size_t n, size_t depth, size_t max_depth, bool always_black) {
+        if (n == 0) return nullptr;
+        const size_t mid = (n - 1) / 2;
+        auto node = nodes[mid];
+        node->left = buildFromArray(nodes, mid, depth + 1, max_depth, always_black);
+        node->right = buildFromArray(nodes + mid + 1, n - mid - 1, depth + 1, max_depth, always_black);
+        if (node->left) node->left->set_parent(node);
+        if (node->right) node->right->set_parent(node);
+        node->set_black(always_black || depth != max_depth);
+        node->set_subtree_size(n);
+        return node;
+    }
+
+public:
+
 #if __cplusplus >= 202002
     template<typename St> requires (!C_is_same_value_type<St,RBTreeNodeBasic>)
 #else
     template<typename St, typename std::enable_if<!is_same_value_type<St,RBTreeNodeBasic>::value, bool>::type = true>
 #endif // __cplusplus >= 202002
     explicit RBTreeNodeBasic(St&& val):
-        left(nullptr), right(nullptr), parent(nullptr),
-        black(false), value(std::forward<St>(val))
+        parent_and_color(0), left(nullptr), right(nullptr),
+        value(std::forward<St>(val))
     {}
 
+    /** the value is constructed from several arguments, e.g. std::piecewise_construct and two tuples */
+#if __cplusplus >= 202002
+    template<typename T1, typename T2, typename ... Args> requires std::constructible_from<S,T1&&,T2&&,Args&&...>
+#else
+    template<typename T1, typename T2, typename ... Args,
+             typename std::enable_if<std::is_constructible<S,T1&&,T2&&,Args&&...>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+    RBTreeNodeBasic(T1&& a1, T2&& a2, Args&& ... args):
+        parent_and_color(0), left(nullptr), right(nullptr), value(std::forward<T1>(a1), std::forward<T2>(a2), std::forward<Args>(args)...) {}
+
+    /** copy of oth whose value allocates by alloc, see rbtree_uses_allocator */
+    template<typename A>
+    RBTreeNodeBasic(std::allocator_arg_t tag, const A& alloc, const RBTreeNodeBasic& oth):
+        threads_type(oth),
+        parent_and_color(oth.parent_and_color & color_mask),
+        left(nullptr), right(nullptr), value(tag, alloc, oth.value)
+    {
+    }
+
     ~RBTreeNodeBasic() {
         RB_ASSERT(this->left == nullptr);
         RB_ASSERT(this->right == nullptr);
     }
 };
 
-template<typename S>
-struct RBTreeNode: public RBTreeNodeBasic<S,RBTreeNode<S>*> {
-    using base_type = RBTreeNodeBasic<S,RBTreeNode<S>*>;
+template<typename S, bool threaded = false>
+struct RBTreeNode: public RBTreeNodeBasic<S,RBTreeNode<S,threaded>*,threaded> {
+    using base_type = RBTreeNodeBasic<S,RBTreeNode<S,threaded>*,threaded>;
 
 #if __cplusplus >= 202002
     template<typename St> requires (!C_is_same_value_type<St,RBTreeNode>)
@@ -531,35 +1104,59 @@ struct RBTreeNode: public RBTreeNodeBasic<S,RBTreeNode<S>*> {
     template<typename St, typename std::enable_if<!is_same_value_type<St,RBTreeNode>::value, bool>::type = true>
 #endif // __cplusplus >= 202002
     explicit RBTreeNode(St&& val): base_type(std::forward<St>(val)) {}
+
+    /** the value is constructed from several arguments, e.g. std::piecewise_construct and two tuples */
+#if __cplusplus >= 202002
+    template<typename T1, typename T2, typename ... Args> requires std::constructible_from<S,T1&&,T2&&,Args&&...>
+#else
+    template<typename T1, typename T2, typename ... Args,
+             typename std::enable_if<std::is_constructible<S,T1&&,T2&&,Args&&...>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+    RBTreeNode(T1&& a1, T2&& a2, Args&& ... args):
+        base_type(std::forward<T1>(a1), std::forward<T2>(a2), std::forward<Args>(args)...) {}
+
+    template<typename A>
+    RBTreeNode(std::allocator_arg_t tag, const A& alloc, const RBTreeNode& oth): base_type(tag, alloc, oth) {}
 };
 
-template<typename S>
-struct RBTreeNodePosInfo: public RBTreeNodeBasic<S,RBTreeNodePosInfo<S>*> {
+/**
+ * node which maintains number of nodes in its subtree, SizeT is type of the counter,
+ * a narrower type (e.g. uint32_t) shrinks the node but limits size of the tree
+ */
+template<typename S, typename SizeT = size_t, bool threaded = false>
+struct RBTreeNodePosInfo: public RBTreeNodeBasic<S,RBTreeNodePosInfo<S,SizeT,threaded>*,threaded> {
+    static_assert(std::is_integral<SizeT>::value && std::is_unsigned<SizeT>::value, "counter should be an unsigned integer");
+
 private:
-    size_t num_nodes;
+    SizeT num_nodes;
 
 public:
-    using base_type = RBTreeNodeBasic<S,RBTreeNodePosInfo<S>*>;
+    using base_type = RBTreeNodeBasic<S,RBTreeNodePosInfo<S,SizeT,threaded>*,threaded>;
     using size_type = typename base_type::size_type;
+    using counter_type = SizeT;
     using storage_type = typename base_type::storage_type;
     using nodeptr_t = typename base_type::nodeptr_t;
     using const_nodeptr_t = typename base_type::const_nodeptr_t;
 
-    inline size_t num_of_left_children() const {
+    inline counter_type num_of_left_children() const {
         return this->left ? this->left->num_of_nodes() : 0;
     }
 
-    inline size_t num_of_right_children() const {
+    inline counter_type num_of_right_children() const {
         return this->right ? this->right->num_of_nodes() : 0;
     }
 
-    inline size_t num_of_nodes() const {
+    inline counter_type num_of_nodes() const {
         return this->num_nodes;
     }
 
+    inline void set_subtree_size(size_t n) {
+        this->num_nodes = static_cast<counter_type>(n);
+    }
+
     void update_position_info(nodeptr_t to) {
-        for (auto node=this;node!=to;node=node->parent) {
-            size_t n = 1;
+        for (auto node=this;node!=to;node=node->parent()) {
+            counter_type n = 1;
             if (node->left) n += node->left->num_nodes;
             if (node->right) n += node->right->num_nodes;
 
@@ -584,7 +1181,7 @@ public:
                     node = node->left;
                     long m = node->right == nullptr ? 0 : node->right->num_nodes;
                     n = n + m + 1;
-                } else if (auto p = node->parent) {
+                } else if (auto p = node->parent()) {
                     if (p->left == node) {
                         long m = node->right == nullptr ? 0 : node->right->num_nodes;
                         n = n - m - 1;
@@ -603,7 +1200,7 @@ public:
                     node = node->right;
                     long m = node->left == nullptr ? 0 : node->left->num_nodes;
                     n = n - m - 1;
-                } else if (auto p = node->parent) {
+                } else if (auto p = node->parent()) {
                     if (p->right == node) {
                         long m = node->left == nullptr ? 0 : node->left->num_nodes;
                         n = n + m + 1;
@@ -622,7 +1219,7 @@ public:
     }
 
     size_type indexof() const {
-        size_t ans = 0;
+        size_type ans = 0;
         auto node = this;
         RB_ASSERT(node);
 
@@ -631,10 +1228,10 @@ public:
                 ans += repr_node->left->num_nodes;
             }
 
-            auto parent = repr_node->parent;
+            auto parent = repr_node->parent();
             while (parent && parent->left == repr_node) {
                 repr_node = parent;
-                parent = parent->parent;
+                parent = parent->parent();
             }
 
             repr_node = parent;
@@ -650,18 +1247,116 @@ public:
     template<typename St, typename std::enable_if<!is_same_value_type<St,RBTreeNodePosInfo>::value, bool>::type = true>
 #endif // __cplusplus >= 202002
     explicit RBTreeNodePosInfo(St&& val): base_type(std::forward<St>(val)), num_nodes(1) {}
+
+    /** the value is constructed from several arguments, e.g. std::piecewise_construct and two tuples */
+#if __cplusplus >= 202002
+    template<typename T1, typename T2, typename ... Args> requires std::constructible_from<S,T1&&,T2&&,Args&&...>
+#else
+    template<typename T1, typename T2, typename ... Args,
+             typename std::enable_if<std::is_constructible<S,T1&&,T2&&,Args&&...>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+    RBTreeNodePosInfo(T1&& a1, T2&& a2, Args&& ... args):
+        base_type(std::forward<T1>(a1), std::forward<T2>(a2), std::forward<Args>(args)...), num_nodes(1) {}
+
+    template<typename A>
+    RBTreeNodePosInfo(std::allocator_arg_t tag, const A& alloc, const RBTreeNodePosInfo& oth):
+        base_type(tag, alloc, oth), num_nodes(oth.num_nodes) {}
+};
+
+/**
+ * memory footprint of a tree node, overhead is the space which is
+ * spent for tree links, color and position information
+ */
+template<typename Node>
+struct rbtree_node_footprint {
+    using storage_type = typename Node::storage_type;
+    constexpr static size_t size = sizeof(Node);
+    constexpr static size_t payload = sizeof(storage_type);
+    constexpr static size_t overhead = size - payload;
+};
+static_assert(rbtree_node_footprint<RBTreeNode<RBTreeValueK<std::uintptr_t>>>::overhead == 3 * sizeof(void*),
+              "color of node should be packed into parent pointer");
+static_assert(rbtree_node_footprint<RBTreeNodePosInfo<RBTreeValueK<std::uintptr_t>>>::overhead == 3 * sizeof(void*) + sizeof(size_t),
+              "color of node should be packed into parent pointer");
+static_assert(rbtree_node_footprint<RBTreeNode<RBTreeValueK<std::uintptr_t>,true>>::overhead == 5 * sizeof(void*),
+              "threaded node should only add two links");
+
+
+/** mapped type of maps whose mapped values are stored out of the nodes, see RBTreeValueKVSplit */
+template<typename V>
+struct rbtree_cold {};
+
+/** Alloc is the allocator of the tree, values which allocate (see rbtree_uses_allocator) rebind it */
+template<typename _Key, typename _Value, typename _Alloc = std::allocator<_Key>>
+struct rbtree_storage_selector {
+    using type = typename std::conditional<std::is_same<_Value,void>::value,RBTreeValueK<_Key>, RBTreeValueKV<_Key,_Value>>::type;
+    using mapped_type = _Value;
 };
+template<typename _Key, typename _Value, typename _Alloc>
+struct rbtree_storage_selector<_Key,rbtree_cold<_Value>,_Alloc> {
+    using type = RBTreeValueKVSplit<_Key,_Value,typename std::allocator_traits<_Alloc>::template rebind_alloc<std::pair<const _Key,_Value>>>;
+    using mapped_type = _Value;
+};
+
+/** mapped type of intrusive trees, whose keys are the user objects deriving from RBTreeHook */
+struct rbtree_intrusive {};
 
+template<typename _Key, typename _Alloc>
+struct rbtree_storage_selector<_Key,rbtree_intrusive,_Alloc> {
+    using type = RBTreeValueHook<_Key>;
+    using mapped_type = void;
+};
 
+template<typename _Key, typename _Value, typename _Alloc = std::allocator<_Key>>
+using rbtree_storage_type = typename rbtree_storage_selector<_Key,_Value,_Alloc>::type;
 template<typename _Key, typename _Value>
-using rbtree_storage_type = typename std::conditional<std::is_same<_Value,void>::value,RBTreeValueK<_Key>, RBTreeValueKV<_Key,_Value>>::type;
+using rbtree_mapped_type = typename rbtree_storage_selector<_Key,_Value>::mapped_type;
 template<typename _Key, typename _Value>
 using rbtree_compare_type = _Key;
 
-template<typename S, bool keep_position_info>
-using node_pointer = typename std::conditional<keep_position_info,RBTreeNodePosInfo<S>,RBTreeNode<S>>::type::nodeptr_t;
-template<typename S, bool keep_position_info>
-using const_node_pointer = typename std::conditional<keep_position_info,RBTreeNodePosInfo<S>,RBTreeNode<S>>::type::const_nodeptr_t;
+/** NodePolicy of a tree or a container, nodes only link to their parent and children */
+struct rbtree_plain {};
+
+/**
+ * NodePolicy of a tree or a container, nodes keep links to their in-order successor and predecessor,
+ * so stepping an iterator is a single load, at the cost of two pointers per node
+ */
+struct rbtree_threaded {};
+
+template<typename NodePolicy>
+struct rbtree_node_options {
+    constexpr static bool threaded = false;
+};
+template<>
+struct rbtree_node_options<rbtree_threaded> {
+    constexpr static bool threaded = true;
+};
+
+template<typename S, bool keep_position_info, typename SizeT = size_t, typename NodePolicy = rbtree_plain>
+using rbtree_node_t = typename std::conditional<keep_position_info,
+                                                RBTreeNodePosInfo<S,SizeT,rbtree_node_options<NodePolicy>::threaded>,
+                                                RBTreeNode<S,rbtree_node_options<NodePolicy>::threaded>>::type;
+template<typename S, bool keep_position_info, typename SizeT = size_t, typename NodePolicy = rbtree_plain>
+using node_pointer = typename rbtree_node_t<S,keep_position_info,SizeT,NodePolicy>::nodeptr_t;
+template<typename S, bool keep_position_info, typename SizeT = size_t, typename NodePolicy = rbtree_plain>
+using const_node_pointer = typename rbtree_node_t<S,keep_position_info,SizeT,NodePolicy>::const_nodeptr_t;
+
+/**
+ * base class of objects which are linked into intrusive containers, the hook is the tree node itself,
+ * so that insertion and erasure never allocate. links aren't copied along with the object,
+ * and an object must be erased from its container before it's destroyed.
+ */
+template<typename T, bool keep_position_info = true, typename SizeT = size_t, typename NodePolicy = rbtree_plain>
+struct RBTreeHook: public rbtree_node_t<RBTreeValueHook<T>,keep_position_info,SizeT,NodePolicy> {
+    using node_type = rbtree_node_t<RBTreeValueHook<T>,keep_position_info,SizeT,NodePolicy>;
+
+    RBTreeHook(): node_type(RBTreeValueHook<T>()) {}
+    RBTreeHook(const RBTreeHook&): RBTreeHook() {}
+
+    RBTreeHook& operator=(const RBTreeHook&) {
+        return *this;
+    }
+};
 
 template<typename _Key>
 using default_compare_t = std::less<_Key>;
@@ -673,22 +1368,356 @@ template<typename Compare, typename Key>
 concept C_KeyCompare = std::predicate<Compare,Key,Key>;
 #endif // __cplusplus >= 202002
 
-template<
-    typename _Key, typename _Value, bool multi, bool keep_position_info=true,
-#if __cplusplus >= 202002
-    C_KeyCompare<_Key> Compare = default_compare_t<_Key>,
-#else
+/**
+ * allocators whose deallocate() does nothing (e.g. monotonic arenas) can specialize this trait,
+ * trees with trivially destructible values then drop their nodes in clear() without visiting them
+ */
+template<typename Alloc>
+struct rbtree_allocator_bulk_release {
+    static bool allowed(const Alloc&) { return false; }
+};
+#if __cplusplus >= 201703
+template<typename T>
+struct rbtree_allocator_bulk_release<std::pmr::polymorphic_allocator<T>> {
+    static bool allowed(const std::pmr::polymorphic_allocator<T>& alloc) {
+        return dynamic_cast<std::pmr::monotonic_buffer_resource*>(alloc.resource()) != nullptr;
+    }
+};
+#endif // __cplusplus >= 201703
+
+/**
+ * slab of tree nodes. nodes are handed out from contiguous chunks which are
+ * allocated by Alloc, released nodes are kept in a free list, so capacity
+ * survives clear() of the tree until shrink_to_fit() or destruction.
+ * the pool is inactive (and allocates nothing) until reserve() is called.
+ * an inactive pool only keeps the dedicated chunks of allocate_chunk(), which
+ * are released as soon as their last node is deallocated.
+ */
+template<typename Node, typename Alloc>
+class RBTreeNodePool {
+    private:
+        struct chunk {
+            Node* begin;
+            size_t n;
+            size_t live; // nodes in use of a dedicated chunk, 0 for the chunks of reserve()
+        };
+        struct free_node {
+            free_node* next;
+        };
+        static_assert(sizeof(Node) >= sizeof(free_node), "node is too small to be linked in free list");
+
+        std::vector<chunk> chunks;    // sorted by address
+        std::vector<chunk> untouched; // chunks without any node handed out since reset()
+        free_node* free_list;
+        Node *cursor, *cursor_end;    // never used part of the latest chunk
+        size_t _capacity, _in_use;    // nodes of the chunks of reserve()
+        size_t _dedicated;            // nodes in use of the dedicated chunks
+
+        constexpr static size_t min_chunk_size = 16;
+
+        size_t chunk_index(const Node* node) const {
+            auto it = std::upper_bound(this->chunks.begin(), this->chunks.end(), node,
+                    [](const Node* n, const chunk& c) { return std::less<const Node*>()(n, c.begin); });
+            if (it == this->chunks.begin()) return this->chunks.size();
+            --it;
+            return std::less<const Node*>()(node, it->begin + it->n) ? it - this->chunks.begin() : this->chunks.size();
+        }
+
+        void add_chunk(Alloc& alloc, size_t n) {
+            for (;this->cursor!=this->cursor_end;this->cursor++) {
+                this->push_free(this->cursor);
+            }
+
+            chunk c { alloc.allocate(n), n, 0 };
+            auto pos = std::upper_bound(this->chunks.begin(), this->chunks.end(), c,
+                    [](const chunk& a, const chunk& b) { return std::less<const Node*>()(a.begin, b.begin); });
+            try {
+                this->untouched.reserve(this->chunks.size() + 1);
+                this->chunks.insert(pos, c);
+            } catch (...) {
+                alloc.deallocate(c.begin, n);
+                throw;
+            }
+            this->cursor = c.begin;
+            this->cursor_end = c.begin + n;
+            this->_capacity += n;
+        }
+
+        inline void push_free(Node* node) {
+            auto fn = reinterpret_cast<free_node*>(node);
+            fn->next = this->free_list;
+            this->free_list = fn;
+        }
+
+    public:
+        RBTreeNodePool(): free_list(nullptr), cursor(nullptr), cursor_end(nullptr), _capacity(0), _in_use(0), _dedicated(0) {}
+        RBTreeNodePool(const RBTreeNodePool&) = delete;
+        RBTreeNodePool& operator=(const RBTreeNodePool&) = delete;
+
+        ~RBTreeNodePool() {
+            RB_ASSERT(this->chunks.empty() && "pool should be released with its allocator");
+        }
+
+        inline bool active() const { return this->_capacity > 0; }
+        inline size_t capacity() const { return this->_capacity + this->_dedicated; }
+        inline size_t in_use() const { return this->_in_use + this->_dedicated; }
+
+        inline bool owns(const Node* node) const {
+            return !this->chunks.empty() && this->chunk_index(node) != this->chunks.size();
+        }
+
+        /** make sure that n more nodes can be handed out without allocation */
+        void reserve(Alloc& alloc, size_t n) {
+            const size_t available = this->_capacity - this->_in_use;
+            if (n > available) {
+                this->add_chunk(alloc, n - available);
+            }
+        }
+
+        /**
+         * allocate a new chunk of n nodes which are all handed out, the nodes are deallocated one by one.
+         * the chunk of an inactive pool is dedicated, it doesn't activate the pool and it's released
+         * with its last node instead of adding the nodes to the free list
+         */
+        Node* allocate_chunk(Alloc& alloc, size_t n) {
+            const bool dedicated = !this->active();
+            chunk c { alloc.allocate(n), n, dedicated ? n : 0 };
+            auto pos = std::upper_bound(this->chunks.begin(), this->chunks.end(), c,
+                    [](const chunk& a, const chunk& b) { return std::less<const Node*>()(a.begin, b.begin); });
+            try {
+                this->untouched.reserve(this->chunks.size() + 1);
+                this->chunks.insert(pos, c);
+            } catch (...) {
+                alloc.deallocate(c.begin, n);
+                throw;
+            }
+            if (dedicated) {
+                this->_dedicated += n;
+            } else {
+                this->_capacity += n;
+                this->_in_use += n;
+            }
+            return c.begin;
+        }
+
+        /** return nullptr if the pool is inactive */
+        Node* allocate(Alloc& alloc) {
+            if (this->free_list) {
+                auto node = this->free_list;
+                this->free_list = node->next;
+                this->_in_use++;
+                return reinterpret_cast<Node*>(node);
+            }
+
+            if (this->cursor == this->cursor_end) {
+                if (!this->untouched.empty()) {
+                    this->cursor = this->untouched.back().begin;
+                    this->cursor_end = this->cursor + this->untouched.back().n;
+                    this->untouched.pop_back();
+                } else if (!this->active()) {
+                    return nullptr;
+                } else {
+                    this->add_chunk(alloc, std::max(this->_capacity, size_t(min_chunk_size)));
+                }
+            }
+
+            this->_in_use++;
+            return this->cursor++;
+        }
+
+        /** return false if the node doesn't belong to the pool */
+        bool deallocate(Alloc& alloc, Node* node) {
+            if (this->chunks.empty()) return false;
+            const size_t idx = this->chunk_index(node);
+            if (idx == this->chunks.size()) return false;
+
+            auto& c = this->chunks[idx];
+            if (c.live > 0) {
+                this->_dedicated--;
+                if (--c.live == 0) {
+                    alloc.deallocate(c.begin, c.n);
+                    this->chunks.erase(this->chunks.begin() + idx);
+                }
+                return true;
+            }
+
+            RB_ASSERT(this->_in_use > 0);
+            this->_in_use--;
+            this->push_free(node);
+            return true;
+        }
+
+        /** release chunks which have no node in use */
+        void shrink_to_fit(Alloc& alloc) {
+            if (!this->active()) return;
+
+            std::vector<size_t> nfree(this->chunks.size(), 0);
+            for (auto fn=this->free_list;fn!=nullptr;fn=fn->next) {
+                nfree[this->chunk_index(reinterpret_cast<Node*>(fn))]++;
+            }
+            if (this->cursor != this->cursor_end) {
+                nfree[this->chunk_index(this->cursor)] += this->cursor_end - this->cursor;
+            }
+            for (auto& c: this->untouched) {
+                nfree[this->chunk_index(c.begin)] += c.n;
+            }
+            this->untouched.clear();
+
+            std::vector<bool> released(this->chunks.size(), false);
+            for (size_t i=0;i<this->chunks.size();i++) {
+                released[i] = nfree[i] == this->chunks[i].n;
+            }
+
+            free_node* kept = nullptr;
+            for (auto fn=this->free_list;fn!=nullptr;) {
+                auto next = fn->next;
+                if (!released[this->chunk_index(reinterpret_cast<Node*>(fn))]) {
+                    fn->next = kept;
+                    kept = fn;
+                }
+                fn = next;
+            }
+            this->free_list = kept;
+            if (this->cursor != this->cursor_end && released[this->chunk_index(this->cursor)]) {
+                this->cursor = this->cursor_end = nullptr;
+            }
+
+            size_t j = 0;
+            for (size_t i=0;i<this->chunks.size();i++) {
+                if (released[i]) {
+                    alloc.deallocate(this->chunks[i].begin, this->chunks[i].n);
+                    this->_capacity -= this->chunks[i].n;
+                } else {
+                    this->chunks[j++] = this->chunks[i];
+                }
+            }
+            this->chunks.resize(j);
+        }
+
+        /** take back every node at once, nodes in use are abandoned without being destroyed */
+        void reset(Alloc& alloc) {
+            this->free_list = nullptr;
+            this->_in_use = 0;
+            if (this->_dedicated > 0) {
+                for (auto& c: this->chunks) {
+                    if (c.live > 0) alloc.deallocate(c.begin, c.n);
+                }
+                this->chunks.erase(std::remove_if(this->chunks.begin(), this->chunks.end(), [](const chunk& c) { return c.live > 0; }),
+                                   this->chunks.end());
+                this->_dedicated = 0;
+            }
+            if (this->chunks.empty()) return;
+
+            this->untouched.assign(this->chunks.begin() + 1, this->chunks.end());
+            this->cursor = this->chunks.front().begin;
+            this->cursor_end = this->cursor + this->chunks.front().n;
+        }
+
+        /** deallocate all chunks, nodes of the pool must not be in use */
+        void release(Alloc& alloc) {
+            RB_ASSERT(this->_in_use == 0);
+            for (auto& c: this->chunks) {
+                alloc.deallocate(c.begin, c.n);
+            }
+            this->chunks.clear();
+            this->untouched.clear();
+            this->free_list = nullptr;
+            this->cursor = this->cursor_end = nullptr;
+            this->_capacity = 0;
+        }
+};
+
+/**
+ * values kept by a set operation: those only in the left tree, those in both trees and those only in the right one.
+ * for a value in both the value of the left tree is kept, unless right_value is set
+ */
+struct rbtree_set_operation {
+    bool left, both, right, right_value;
+};
+
+/** parallel algorithms combine parts of the trees which hold fewer nodes than this serially */
+constexpr size_t rbtree_parallel_grain = 1 << 14;
+
+/**
+ * allocators whose copies may allocate and deallocate on several threads at once, so that a tree is cloned
+ * in parallel. Only std::allocator is assumed to be, a stateless allocator may still share unlocked state,
+ * other allocators can specialize this trait
+ */
+template<typename Alloc>
+struct rbtree_allocator_concurrent: std::false_type {};
+
+template<typename T>
+struct rbtree_allocator_concurrent<std::allocator<T>>: std::true_type {};
+
+/** copy construction and copy assignment of containers clone trees of at least this many nodes in parallel */
+constexpr size_t rbtree_parallel_copy_size = 1 << 17;
+
+/**
+ * values which may be copied on several threads at once, so that copy construction and copy assignment
+ * clone a large tree in parallel. Values which are copied without throwing are assumed to be, others can
+ * specialize this trait
+ */
+template<typename T>
+struct rbtree_value_concurrent_copy: std::is_nothrow_copy_constructible<T> {};
+
+/**
+ * executor of the parallel algorithms, executor(f, g) runs the tasks f and g and returns after both are done.
+ * While fewer than max_threads threads run its tasks, the calling one included, f runs on a new std::async thread
+ * and g on the calling thread, otherwise both run on the calling thread. Every fork starts its own thread, no thread
+ * is reused. f runs on the calling thread too when no thread can be started
+ */
+class rbtree_thread_executor {
+    public:
+        explicit rbtree_thread_executor(size_t max_threads = std::thread::hardware_concurrency()):
+            max_threads(max_threads), busy(1) {}
+
+        rbtree_thread_executor(const rbtree_thread_executor&) = delete;
+        rbtree_thread_executor& operator=(const rbtree_thread_executor&) = delete;
+
+        template<typename F, typename G>
+        void operator()(F&& f, G&& g) {
+            if (this->busy.fetch_add(1) >= this->max_threads) {
+                this->busy--;
+                f();
+                g();
+                return;
+            }
+
+            // declared before the future, so the slot is released after the future waited for f, also when g throws
+            struct release { std::atomic<size_t>& busy; ~release() { busy--; } } guard{this->busy};
+            std::future<void> task;
+            try {
+                task = std::async(std::launch::async, [&f]() { f(); });
+            } catch (const std::system_error&) {
+                f();
+                g();
+                return;
+            }
+            g();
+            task.get();
+        }
+
+    private:
+        const size_t max_threads;
+        std::atomic<size_t> busy;
+};
+
+template<
+    typename _Key, typename _Value, bool multi, bool keep_position_info=true,
+#if __cplusplus >= 202002
+    C_KeyCompare<_Key> Compare = default_compare_t<_Key>,
+#else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,_Value>>
+    typename Alloc = default_allocato_t<_Key,_Value>, typename SizeT = size_t, typename NodePolicy = rbtree_plain>
 class RBTreeImpl {
     public:
-        using storage_type = rbtree_storage_type<_Key,_Value>;
-        using nodeptr_t = node_pointer<storage_type,keep_position_info>;
-        using const_nodeptr_t = const_node_pointer<storage_type,keep_position_info>;
+        using storage_type = rbtree_storage_type<_Key,_Value,Alloc>;
+        using nodeptr_t = node_pointer<storage_type,keep_position_info,SizeT,NodePolicy>;
+        using const_nodeptr_t = const_node_pointer<storage_type,keep_position_info,SizeT,NodePolicy>;
         using rbtree_node_type = typename std::remove_pointer<nodeptr_t>::type;
         using key_type = _Key;
-        using mapped_type = _Value;
+        using mapped_type = rbtree_mapped_type<_Key,_Value>;
         using value_type = typename storage_type::storage_type_base;
         using size_type = typename rbtree_node_type::size_type;
         using difference_type = std::ptrdiff_t;
@@ -699,13 +1728,24 @@ class RBTreeImpl {
         using pointer = typename std::allocator_traits<Alloc>::pointer;
         using const_pointer = typename std::allocator_traits<Alloc>::const_pointer;
         constexpr static bool PositionInformation = keep_position_info;
+        constexpr static bool RelocatesValues = false;
+        constexpr static bool Intrusive = IsRBTreeValueHook<storage_type>::value;
         using storage_allocator_ = typename std::allocator_traits<Alloc>::template rebind_alloc<rbtree_node_type>;
+        using uses_allocator_ = std::integral_constant<bool,rbtree_uses_allocator<storage_type>::value>;
+        static_assert(alignof(rbtree_node_type) > 1, "lowest bit of node address is used to store color");
 
     private:
         nodeptr_t root;
         size_t _version, _size;
         Compare cmp;
         storage_allocator_ allocator;
+        RBTreeNodePool<rbtree_node_type,storage_allocator_> pool;
+#ifdef DEBUG
+        // nodes which left the tree map to SIZE_MAX, those which came back since to the version they came back at,
+        // nodes are never dereferenced through it. iterators older than _cleared_version are invalid, see erased()
+        std::unordered_map<const_nodeptr_t,size_t> _epochs;
+        size_t _cleared_version = 0;
+#endif // DEBUG
 
 #if __cplusplus >= 202002
         template<typename ... Args> requires std::constructible_from<rbtree_node_type,Args&&...>
@@ -713,29 +1753,244 @@ class RBTreeImpl {
         template<typename ... Args, typename std::enable_if<std::is_constructible<rbtree_node_type,Args&&...>::value,bool>::type = true>
 #endif // __cplusplu >= 202002
         inline nodeptr_t construct_node(Args&& ... args) {
-            auto ptr = this->allocator.allocate(1);
-            return new (ptr) rbtree_node_type(std::forward<Args>(args)...);
+            auto ptr = this->pool.allocate(this->allocator);
+            if (ptr == nullptr) {
+                ptr = this->allocator.allocate(1);
+            }
+
+            try {
+                auto node = rbtree_new_node(ptr, uses_allocator_(), this->allocator, std::forward<Args>(args)...);
+                // the address may be that of an erased node
+                this->mark_linked(node);
+                return node;
+            } catch (...) {
+                this->deallocate_node(ptr);
+                throw;
+            }
+        }
+
+        inline void deallocate_node(nodeptr_t node) {
+            if (!this->pool.deallocate(this->allocator, node)) {
+                this->allocator.deallocate(node, 1);
+            }
         }
 
         inline void delete_node(nodeptr_t node) {
+            this->delete_node(node, std::integral_constant<bool,Intrusive>());
+        }
+
+        inline void delete_node(nodeptr_t node, std::false_type) {
+            this->mark_removed(node);
 #if __cplusplus >= 201703
             std::destroy_n(node, 1);
 #else
             node->~rbtree_node_type();
 #endif // __cplusplus >= 201703
-            this->allocator.deallocate(node, 1);
+            this->deallocate_node(node);
+        }
+
+        /** nodes of intrusive tree are owned by user, they are only unlinked */
+        inline void delete_node(nodeptr_t node, std::true_type) {
+            this->mark_removed(node);
+            node->left = node->right = nullptr;
+            node->set_parent(nullptr);
+        }
+
+        /** whether all nodes can be dropped without visiting them */
+        inline bool bulk_releasable() const {
+            if (Intrusive || !std::is_trivially_destructible<storage_type>::value) return false;
+
+            return this->pool.in_use() == this->_size ||
+                (this->pool.in_use() == 0 && rbtree_allocator_bulk_release<storage_allocator_>::allowed(this->allocator));
+        }
+
+        /** pending nodes which aren't in the tree are allowed only when bulk is false */
+        void clear_nodes(bool bulk) {
+            if (!this->root) return;
+
+            if (bulk) {
+                this->pool.reset(this->allocator);
+                this->root = nullptr;
+                this->_version++;
+                this->_size = 0;
+                this->mark_cleared();
+                return;
+            }
+
+            this->delete_subtree(this->root);
+            this->root = nullptr;
+            this->_version++;
+            this->_size = 0;
+            this->mark_cleared();
+        }
+
+        /** delete the nodes of the subtree of root, which is detached, without rebalancing, returns their number */
+        size_type delete_subtree(nodeptr_t root) {
+            RB_ASSERT(root == nullptr || root->parent() == nullptr);
+            size_type n = 0;
+            for(auto node=root;node!=nullptr;) {
+                if (node->left) {
+                    node = node->left;
+                } else if (node->right) {
+                    node = node->right;
+                } else {
+                    auto deadnode = node;
+                    node = node->parent();
+                    if (node) {
+                        if (node->left == deadnode) {
+                            node->left = nullptr;
+                        } else {
+                            RB_ASSERT(node->right == deadnode);
+                            node->right = nullptr;
+                        }
+                    }
+                    this->delete_node(deadnode);
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        template<typename N = rbtree_node_type, typename std::enable_if<std::is_move_constructible<typename N::storage_type>::value,bool>::type = true>
+        nodeptr_t relocate_from_pool(nodeptr_t node) {
+            auto ptr = this->allocator.allocate(1);
+            try {
+                new (ptr) rbtree_node_type(std::move(*node));
+            } catch (...) {
+                this->allocator.deallocate(ptr, 1);
+                throw;
+            }
+            this->delete_node(node);
+            return ptr;
+        }
+
+        template<typename N = rbtree_node_type, typename std::enable_if<!std::is_move_constructible<typename N::storage_type>::value,bool>::type = true>
+        nodeptr_t relocate_from_pool(nodeptr_t node) {
+            throw std::logic_error("node of a pooled tree can't leave the tree since its value isn't movable");
+        }
+
+        /** see relocate_from_pool(), node keeps its place in the tree, prev and next are its neighbours */
+        template<typename N = rbtree_node_type, typename std::enable_if<std::is_move_constructible<typename N::storage_type>::value,bool>::type = true>
+        nodeptr_t relocate_in_tree(nodeptr_t node, nodeptr_t prev, nodeptr_t next) {
+            auto parent = node->parent();
+            const bool is_left_child = parent && parent->left == node;
+            auto ptr = this->allocator.allocate(1);
+            try {
+                new (ptr) rbtree_node_type(std::move(*node));
+            } catch (...) {
+                // the threads are taken before the value
+                rbtree_node_type::link_threads(prev, node);
+                rbtree_node_type::link_threads(node, next);
+                this->allocator.deallocate(ptr, 1);
+                throw;
+            }
+
+            if (parent == nullptr) {
+                this->root = ptr;
+            } else if (is_left_child) {
+                parent->left = ptr;
+            } else {
+                parent->right = ptr;
+            }
+            if (ptr->left) ptr->left->set_parent(ptr);
+            if (ptr->right) ptr->right->set_parent(ptr);
+            rbtree_node_type::link_threads(prev, ptr);
+            rbtree_node_type::link_threads(ptr, next);
+            this->delete_node(node);
+            this->mark_linked(ptr);
+            return ptr;
+        }
+
+        template<typename N = rbtree_node_type, typename std::enable_if<!std::is_move_constructible<typename N::storage_type>::value,bool>::type = true>
+        nodeptr_t relocate_in_tree(nodeptr_t, nodeptr_t, nodeptr_t) {
+            throw std::logic_error("node of a pooled tree can't leave the tree since its value isn't movable");
+        }
+
+        /**
+         * move the nodes of [first, last) which are in the pool to memory from the allocator in O(k),
+         * so that the range can be handed to another tree, the new first node is returned. The tree stays valid
+         * if a move throws
+         */
+        nodeptr_t relocate_range_from_pool(nodeptr_t first, nodeptr_t last) {
+            if (this->pool.in_use() == 0) return first;
+
+            nodeptr_t ans = nullptr;
+            for (auto prev=first->prev(), node=first;node!=last;) {
+                auto next = node->next();
+                if (this->pool.owns(node)) node = this->relocate_in_tree(node, prev, next);
+                if (ans == nullptr) ans = node;
+                prev = node;
+                node = next;
+            }
+            return ans;
+        }
+
+        /** what's compared of a node, the storage or the user object of intrusive tree */
+        using compared_type = typename std::conditional<Intrusive,value_type,storage_type>::type;
+
+        static inline const compared_type& value_of(const_nodeptr_t node) {
+            return value_of(node, std::integral_constant<bool,Intrusive>());
+        }
+
+        static inline const storage_type& value_of(const_nodeptr_t node, std::false_type) {
+            return node->value;
+        }
+
+        static inline const compared_type& value_of(const_nodeptr_t node, std::true_type) {
+            return static_cast<const compared_type&>(*node);
         }
 
         template<typename T1, typename T2>
         inline bool rb_comp(const T1& a, const T2& b) const
+        {
+            return this->rb_comp(a, b, std::integral_constant<bool,Intrusive>());
+        }
+
+        template<typename T1, typename T2>
+        inline bool rb_comp(const T1& a, const T2& b, std::false_type) const
         {
             return rbvalue_compare(this->cmp, a, b);
         }
 
+        template<typename T1, typename T2>
+        inline bool rb_comp(const T1& a, const T2& b, std::true_type) const
+        {
+            return this->cmp(a, b);
+        }
+
+        /**
+         * values are equal if they are equivalent, as in std containers the comparator decides, so keys
+         * of a transparent lookup needn't be comparable with operator==
+         */
         template<typename T1, typename T2>
         inline bool rb_equal(const T1& a, const T2& b) const
         {
-            return rbvalue_equal(a, b);
+            return !this->rb_comp(a, b) && !this->rb_comp(b, a);
+        }
+
+        template<typename T1, typename T2>
+        using three_way_t = std::integral_constant<bool,!Intrusive && rbtree_three_way<Compare,rbtree_key_t<T1>,rbtree_key_t<T2>>::value>;
+
+        /**
+         * negative, zero or positive as a is ordered before, equal to or after b. It's a single
+         * comparison with a three-way comparator, otherwise equality is only checked for unique trees
+         */
+        template<typename T1, typename T2>
+        inline int rb_order(const T1& a, const T2& b) const
+        {
+            return this->rb_order(a, b, three_way_t<T1,T2>());
+        }
+
+        template<typename T1, typename T2>
+        inline int rb_order(const T1& a, const T2& b, std::false_type) const
+        {
+            return this->rb_comp(a, b) ? -1 : (!multi && !this->rb_comp(b, a) ? 0 : 1);
+        }
+
+        template<typename T1, typename T2>
+        inline int rb_order(const T1& a, const T2& b, std::true_type) const
+        {
+            return rbtree_three_way<Compare,rbtree_key_t<T1>,rbtree_key_t<T2>>::compare(this->cmp, rbvalue_key(a), rbvalue_key(b));
         }
 
         inline void update_num_nodes(nodeptr_t node, nodeptr_t end) const
@@ -747,18 +2002,18 @@ class RBTreeImpl {
 
         inline void be_left_child(nodeptr_t parent, nodeptr_t child) const {
             parent->left = child;
-            if (child) child->parent = parent;
-            this->update_num_nodes(parent, parent->parent);
+            if (child) child->set_parent(parent);
+            this->update_num_nodes(parent, parent->parent());
         }
 
         inline void be_right_child(nodeptr_t parent, nodeptr_t child) const {
             parent->right = child;
-            if (child) child->parent = parent;
-            this->update_num_nodes(parent, parent->parent);
+            if (child) child->set_parent(parent);
+            this->update_num_nodes(parent, parent->parent());
         }
 
         inline nodeptr_t left_rotate(nodeptr_t node) {
-            auto node_parent = node->parent;
+            auto node_parent = node->parent();
             bool left = node_parent && node_parent->left == node;
 
             auto node_right = node->right;
@@ -768,7 +2023,7 @@ class RBTreeImpl {
             this->be_right_child(node, node_right_left);
             this->be_left_child(node_right, node);
 
-            node_right->parent = node_parent;
+            node_right->set_parent(node_parent);
             if (node_parent) {
                 if (left) {
                     node_parent->left = node_right;
@@ -781,7 +2036,7 @@ class RBTreeImpl {
         }
 
         inline nodeptr_t right_rotate(nodeptr_t node) {
-            auto node_parent = node->parent;
+            auto node_parent = node->parent();
             bool right = node_parent && node_parent->right == node;
 
             auto node_left = node->left;
@@ -791,7 +2046,7 @@ class RBTreeImpl {
             this->be_left_child(node, node_left_right);
             this->be_right_child(node_left, node);
 
-            node_left->parent = node_parent;
+            node_left->set_parent(node_parent);
             if (node_parent) {
                 if (right) {
                     node_parent->right = node_left;
@@ -804,21 +2059,21 @@ class RBTreeImpl {
         }
 
         inline void fix_redred(nodeptr_t node) {
-            auto p = node->parent;
-            auto pp = p->parent;
-            RB_ASSERT(!node->black);
-            RB_ASSERT(!p->black);
-            RB_ASSERT(pp->black);
-            this->update_num_nodes(p, pp->parent);
-
-            for (;!node->black && p && !p->black;) {
+            auto p = node->parent();
+            auto pp = p->parent();
+            RB_ASSERT(!node->is_black());
+            RB_ASSERT(!p->is_black());
+            RB_ASSERT(pp->is_black());
+            this->update_num_nodes(p, pp->parent());
+
+            for (;!node->is_black() && p && !p->is_black();) {
                 if (pp->left == p) {
                     if (p->right == node) {
                         p = this->left_rotate(p);
                     }
 
                     node = this->right_rotate(pp);
-                    node->left->black = true;
+                    node->left->set_black(true);
                 } else {
                     RB_ASSERT(pp->right == p);
 
@@ -827,15 +2082,15 @@ class RBTreeImpl {
                     }
 
                     node = this->left_rotate(pp);
-                    node->right->black = true;
+                    node->right->set_black(true);
                 }
 
-                RB_ASSERT(!node->black);
-                if (node->parent) {
-                    p = node->parent;
-                    pp = p->parent ? p->parent : nullptr;
+                RB_ASSERT(!node->is_black());
+                if (node->parent()) {
+                    p = node->parent();
+                    pp = p->parent() ? p->parent() : nullptr;
                 } else {
-                    node->black = true;
+                    node->set_black(true);
                     this->root = node;
                     p = pp = nullptr;
                     break;
@@ -846,39 +2101,39 @@ class RBTreeImpl {
         }
 
         inline bool is_black_node(nodeptr_t node) const {
-            return node == nullptr || node->black;
+            return node == nullptr || node->is_black();
         }
 
         inline void fix_delete(nodeptr_t extra_parent, nodeptr_t extra_black, bool is_left_child) {
-            for (;(extra_black == nullptr || extra_black->black) && extra_black != this->root;) {
+            for (;(extra_black == nullptr || extra_black->is_black()) && extra_black != this->root;) {
                 RB_ASSERT(extra_parent);
                 
                 if (is_left_child) {
                     auto sibling = extra_parent->right;
                     RB_ASSERT(sibling);
 
-                    if (!sibling->black) {
-                        RB_ASSERT(extra_parent->black);
+                    if (!sibling->is_black()) {
+                        RB_ASSERT(extra_parent->is_black());
 
-                        if (extra_parent->parent == nullptr) {
+                        if (extra_parent->parent() == nullptr) {
                             RB_ASSERT(extra_parent == this->root);
                             this->root = sibling;
                         }
 
                         auto siblingx = this->left_rotate(extra_parent);
                         RB_ASSERT(siblingx == sibling);
-                        sibling->black = true;
-                        extra_parent->black = false;
+                        sibling->set_black(true);
+                        extra_parent->set_black(false);
 
                         extra_parent = sibling->left;
                         sibling = extra_parent->right;
                     }
 
-                    RB_ASSERT(sibling->black);
+                    RB_ASSERT(sibling->is_black());
                     if (this->is_black_node(sibling->left) && this->is_black_node(sibling->right)) {
-                        sibling->black = false;
+                        sibling->set_black(false);
                         extra_black = extra_parent;
-                        extra_parent = extra_black->parent;
+                        extra_parent = extra_black->parent();
                         is_left_child = extra_parent != nullptr ? extra_parent->left == extra_black : false;
                         if (extra_parent == nullptr) {
                             RB_ASSERT(extra_black == this->root);
@@ -890,19 +2145,19 @@ class RBTreeImpl {
                             this->be_left_child(sibling, sl->right);
                             this->be_right_child(sl, sibling);
                             this->be_right_child(extra_parent, sl);
-                            sl->black = true;
-                            sibling->black = false;
+                            sl->set_black(true);
+                            sibling->set_black(false);
                             sibling = sl;
                         }
 
-                        auto pp = extra_parent->parent;
+                        auto pp = extra_parent->parent();
                         bool pp_left = pp && pp->left == extra_parent;
 
-                        auto extra_parent_color = extra_parent->black;
+                        auto extra_parent_color = extra_parent->is_black();
 
                         if (pp == nullptr) {
                             RB_ASSERT(extra_parent == this->root);
-                            RB_ASSERT(extra_parent->black);
+                            RB_ASSERT(extra_parent->is_black());
                             this->root = sibling;
                         }
 
@@ -910,9 +2165,9 @@ class RBTreeImpl {
                         auto sl = sibling->left, sr = sibling->right;
                         this->be_right_child(extra_parent, sl);
                         this->be_left_child(sibling, extra_parent);
-                        sibling->black = extra_parent_color;
-                        extra_parent->black = true;
-                        sr->black = true;
+                        sibling->set_black(extra_parent_color);
+                        extra_parent->set_black(true);
+                        sr->set_black(true);
 
                         if (pp) {
                             if (pp_left) {
@@ -921,7 +2176,7 @@ class RBTreeImpl {
                                 this->be_right_child(pp, sibling);
                             }
                         } else {
-                            sibling->parent = pp;
+                            sibling->set_parent(pp);
                         }
                         extra_black = this->root;
                         extra_parent = nullptr;
@@ -930,28 +2185,28 @@ class RBTreeImpl {
                     auto sibling = extra_parent->left;
                     RB_ASSERT(sibling);
 
-                    if (!sibling->black) {
-                        RB_ASSERT(extra_parent->black);
+                    if (!sibling->is_black()) {
+                        RB_ASSERT(extra_parent->is_black());
 
-                        if (extra_parent->parent == nullptr) {
+                        if (extra_parent->parent() == nullptr) {
                             RB_ASSERT(extra_parent == this->root);
                             this->root = sibling;
                         }
 
                         auto siblingx = this->right_rotate(extra_parent);
                         RB_ASSERT(siblingx == sibling);
-                        sibling->black = true;
-                        extra_parent->black = false;
+                        sibling->set_black(true);
+                        extra_parent->set_black(false);
 
                         extra_parent = sibling->right;
                         sibling = extra_parent->left;
                     }
 
-                    RB_ASSERT(sibling->black);
+                    RB_ASSERT(sibling->is_black());
                     if (this->is_black_node(sibling->right) && this->is_black_node(sibling->left)) {
-                        sibling->black = false;
+                        sibling->set_black(false);
                         extra_black = extra_parent;
-                        extra_parent = extra_black->parent;
+                        extra_parent = extra_black->parent();
                         is_left_child = extra_parent != nullptr ? extra_parent->left == extra_black : false;
                         if (extra_parent == nullptr) {
                             RB_ASSERT(extra_black == this->root);
@@ -963,19 +2218,19 @@ class RBTreeImpl {
                             this->be_right_child(sibling, sl->left);
                             this->be_left_child(sl, sibling);
                             this->be_left_child(extra_parent, sl);
-                            sl->black = true;
-                            sibling->black = false;
+                            sl->set_black(true);
+                            sibling->set_black(false);
                             sibling = sl;
                         }
 
-                        auto pp = extra_parent->parent;
+                        auto pp = extra_parent->parent();
                         bool pp_right = pp && pp->right == extra_parent;
 
-                        auto extra_parent_color = extra_parent->black;
+                        auto extra_parent_color = extra_parent->is_black();
 
                         if (pp == nullptr) {
                             RB_ASSERT(extra_parent == this->root);
-                            RB_ASSERT(extra_parent->black);
+                            RB_ASSERT(extra_parent->is_black());
                             this->root = sibling;
                         }
 
@@ -983,9 +2238,9 @@ class RBTreeImpl {
                         auto sl = sibling->right, sr = sibling->left;
                         this->be_left_child(extra_parent, sl);
                         this->be_right_child(sibling, extra_parent);
-                        sibling->black = extra_parent_color;
-                        extra_parent->black = true;
-                        sr->black = true;
+                        sibling->set_black(extra_parent_color);
+                        extra_parent->set_black(true);
+                        sr->set_black(true);
 
                         if (pp) {
                             if (pp_right) {
@@ -994,7 +2249,7 @@ class RBTreeImpl {
                                 this->be_left_child(pp, sibling);
                             }
                         } else {
-                            sibling->parent = pp;
+                            sibling->set_parent(pp);
                         }
                         extra_black = this->root;
                         extra_parent = nullptr;
@@ -1003,61 +2258,503 @@ class RBTreeImpl {
             }
 
             RB_ASSERT(extra_black);
-            RB_ASSERT(!extra_black->black || extra_black == this->root);
-            extra_black->black = true;
+            RB_ASSERT(!extra_black->is_black() || extra_black == this->root);
+            extra_black->set_black(true);
         }
 
-        inline nodeptr_t minimum(nodeptr_t node) const {
-            return node->minimum();
-        }
+        /** number of black nodes on a path from node down to a leaf */
+        static size_type black_height(const_nodeptr_t node) {
+            size_type h = 0;
+            for (;node!=nullptr;node=node->left) {
+                if (node->is_black()) h++;
+            }
+            return h;
+        }
+
+        static inline size_type subtree_size(const_nodeptr_t node) {
+            return keep_position_info && node != nullptr ? node->num_of_nodes() : 0;
+        }
+
+        inline void attach(nodeptr_t node, nodeptr_t left, nodeptr_t right) {
+            node->left = left;
+            node->right = right;
+            if (left) left->set_parent(node);
+            if (right) right->set_parent(node);
+            if (keep_position_info) node->set_subtree_size(1 + subtree_size(left) + subtree_size(right));
+        }
+
+        /** black height of the detached tree t once its root is black */
+        static inline size_type root_black_height(const_nodeptr_t t) {
+            return t && !t->is_black() ? black_height(t) + 1 : black_height(t);
+        }
+
+        /**
+         * join the detached trees l and r and the detached node pivot, whose values are in this order,
+         * into one tree whose root is returned. It walks the trees to find their black heights, so it's O(lg n)
+         */
+        nodeptr_t join(nodeptr_t l, nodeptr_t pivot, nodeptr_t r) {
+            size_type h;
+            return this->join(l, root_black_height(l), pivot, r, root_black_height(r), h);
+        }
+
+        /**
+         * see join(), hl and hr are the black heights of l and r once their roots are black, the height of the
+         * result is stored to h. The shorter tree is hung on the spine of the taller one,
+         * so it's O(|hl - hr| + 1). Threads of the nodes are left alone
+         */
+        nodeptr_t join(nodeptr_t l, size_type hl, nodeptr_t pivot, nodeptr_t r, size_type hr, size_type& h) {
+            RB_ASSERT(l == nullptr || l->parent() == nullptr);
+            RB_ASSERT(r == nullptr || r->parent() == nullptr);
+            if (l) l->set_black(true);
+            if (r) r->set_black(true);
+            RB_ASSERT(hl == black_height(l) && hr == black_height(r));
+            if (hl == hr) {
+                this->attach(pivot, l, r);
+                pivot->set_parent(nullptr);
+                pivot->set_black(true);
+                h = hl + 1;
+                return pivot;
+            }
 
-        inline nodeptr_t maximum(nodeptr_t node) const {
-            return node->maximum();
+            // the highest black node of the spine of the taller tree which is as high as the other tree
+            const bool left_taller = hl > hr;
+            auto node = left_taller ? l : r;
+            nodeptr_t parent = nullptr;
+            for (auto k=left_taller ? hl : hr;k!=(left_taller ? hr : hl) || !this->is_black_node(node);) {
+                if (node->is_black()) k--;
+                parent = node;
+                node = left_taller ? node->right : node->left;
+            }
+
+            if (left_taller) {
+                this->attach(pivot, node, r);
+                parent->right = pivot;
+            } else {
+                this->attach(pivot, l, node);
+                parent->left = pivot;
+            }
+            pivot->set_parent(parent);
+            pivot->set_black(false);
+            this->update_num_nodes(parent, nullptr);
+
+            const auto taller = left_taller ? l : r;
+            this->root = taller;
+            if (!parent->is_black()) this->fix_redred(pivot);
+            // the tree only grows if the red nodes are rotated up to a new root
+            h = (left_taller ? hl : hr) + (this->root != taller ? 1 : 0);
+            return this->root;
+        }
+
+        /** join the detached trees l and r, whose values are in this order, in O(lg n) */
+        nodeptr_t join(nodeptr_t l, nodeptr_t r) {
+            if (l == nullptr) return r;
+            if (r == nullptr) return l;
+
+            // threads may lead out of r while trees are cut and joined
+            auto pivot = r->minimum();
+            auto next = pivot->tree_next();
+            size_type hl = root_black_height(l), hr = 0, h;
+            if (next) {
+                size_type hp;
+                r = this->split_before(next, hp, hr).second;
+            } else {
+                r = nullptr;
+            }
+            return this->join(l, hl, pivot, r, hr, h);
+        }
+
+        /**
+         * split the tree of node into the trees of the values before node and of node and the values after
+         * it, the roots are returned. The subtrees along the path from node to the root are joined to either
+         * side bottom-up, their heights grow along the path, so it's O(lg n). Threads are left alone
+         */
+        std::pair<nodeptr_t,nodeptr_t> split_before(nodeptr_t node) {
+            size_type hl, hr;
+            return this->split_before(node, hl, hr);
+        }
+
+        /** see split_before(), the black heights of the two trees are stored to hl and hr */
+        std::pair<nodeptr_t,nodeptr_t> split_before(nodeptr_t node, size_type& hl, size_type& hr) {
+            // black height of the subtree of the path node before it's cut, the heights of the siblings follow from it
+            size_type hc = black_height(node);
+            auto parent = node->parent();
+            bool is_left_child = parent && parent->left == node;
+            auto l = node->left, r = node->right;
+            const size_type hsub = node->is_black() ? hc - 1 : hc;
+            hl = l && !l->is_black() ? hsub + 1 : hsub;
+            hr = r && !r->is_black() ? hsub + 1 : hsub;
+            if (l) l->set_parent(nullptr);
+            if (r) r->set_parent(nullptr);
+            node->left = node->right = nullptr;
+            r = this->join(nullptr, 0, node, r, hr, hr);
+
+            for (auto p=parent;p!=nullptr;) {
+                auto pp = p->parent();
+                const bool p_is_left_child = pp && pp->left == p;
+                const bool p_black = p->is_black();
+                if (is_left_child) {
+                    auto pr = p->right;
+                    const size_type hs = pr && !pr->is_black() ? hc + 1 : hc;
+                    if (pr) pr->set_parent(nullptr);
+                    r = this->join(r, hr, p, pr, hs, hr);
+                } else {
+                    auto pl = p->left;
+                    const size_type hs = pl && !pl->is_black() ? hc + 1 : hc;
+                    if (pl) pl->set_parent(nullptr);
+                    l = this->join(pl, hs, p, l, hl, hl);
+                }
+                if (p_black) hc++;
+                p = pp;
+                is_left_child = p_is_left_child;
+            }
+            return std::make_pair(l, r);
+        }
+
+        /**
+         * cut [first, last) out of the tree and join the rest, the detached root of the range is returned.
+         * the threads of the range are cut at both ends
+         */
+        nodeptr_t cut_range(nodeptr_t first, nodeptr_t last) {
+            auto pred = first->prev();
+            auto before = this->split_before(first);
+            auto range = before.second, after = static_cast<nodeptr_t>(nullptr);
+            if (last) {
+                auto parts = this->split_before(last);
+                range = parts.first;
+                after = parts.second;
+            }
+            this->root = this->join(before.first, after);
+            if (this->root) this->root->set_black(true);
+            if (rbtree_node_type::Threaded) {
+                rbtree_node_type::link_threads(range->maximum(), nullptr);
+                rbtree_node_type::link_threads(nullptr, first);
+                rbtree_node_type::link_threads(pred, last);
+            }
+            return range;
         }
 
-        inline void swap_node(nodeptr_t n1, nodeptr_t n2) const {
-            RB_ASSERT(n1);
-            RB_ASSERT(n2);
-            std::swap(n1->black, n2->black);
+        /**
+         * number of nodes of the detached tree a, which has total nodes together with the detached tree b.
+         * without position information both trees are walked in turns, so it's O(min(|a|, |b|))
+         */
+        static size_type count_nodes(nodeptr_t a, nodeptr_t b, size_type total) {
+            if (keep_position_info) return subtree_size(a);
 
-            if (n1->parent == n2)
-                std::swap(n1, n2);
+            size_type k = 0;
+            a = a ? a->minimum() : nullptr;
+            b = b ? b->minimum() : nullptr;
+            for (;a!=nullptr && b!=nullptr;a=a->next(),b=b->next(),k++);
+            return a == nullptr ? k : total - k;
+        }
 
-            if (n2->parent == n1) {
-                auto p = n1->parent;
-                const bool is_left_child = n1->left == n2;
-                const bool n1_is_left_child = p ? p ->left == n1 : false;
-                const auto n1_left = n1->left, n1_right = n1->right;
+        inline void set_root(nodeptr_t node, size_type n) {
+            RB_ASSERT(node == nullptr || node->parent() == nullptr);
+            this->root = node;
+            if (node) node->set_black(true);
+            this->_size = n;
+            this->_version++;
+            // the nodes may come from another tree
+            if (node == nullptr) {
+                this->mark_cleared();
+            } else {
+                this->mark_linked_subtree(node);
+            }
+        }
 
-                this->be_left_child(n1, n2->left);
-                this->be_right_child(n1, n2->right);
-                if (is_left_child) {
-                    this->be_left_child(n2, n1);
-                    this->be_right_child(n2, n1_right);
+        /**
+         * move [first, last) of other to this tree node by node, which is needed when the nodes are in the pool
+         * of other. hint is the position of the first node in this tree, each node is inserted next to the previous one
+         */
+        void move_nodes(RBTreeImpl& other, nodeptr_t first, nodeptr_t last, nodeptr_t hint) {
+            for (;first!=last;) {
+                auto result = other.extract(first, true);
+                first = result.second;
+                auto inserted = this->insert_node(hint, other.release_node(result.first));
+                // the value of a duplicate is assigned to the existing node
+                if (std::get<1>(inserted)) this->delete_node(std::get<1>(inserted));
+                hint = std::get<0>(inserted);
+            }
+            other._version++;
+            this->_version++;
+        }
+
+        /** split the detached tree t into the values less than the value of k, the node equal to it and the greater values */
+        std::tuple<nodeptr_t,nodeptr_t,nodeptr_t> split_by(nodeptr_t t, const_nodeptr_t k) {
+            nodeptr_t lb = nullptr;
+            for (auto node=t;node!=nullptr;) {
+                if (!this->rb_comp(value_of(node), value_of(k))) {
+                    lb = node;
+                    node = node->left;
                 } else {
-                    this->be_right_child(n2, n1);
-                    this->be_left_child(n2, n1_left);
+                    node = node->right;
                 }
-                if (p) {
-                    if (n1_is_left_child) {
-                        this->be_left_child(p, n2);
-                    } else {
-                        this->be_right_child(p, n2);
-                    }
-                } else {
-                    n2->parent = nullptr;
+            }
+            if (lb == nullptr) return std::make_tuple(t, nullptr, nullptr);
+
+            auto parts = this->split_before(lb);
+            if (this->rb_comp(value_of(k), value_of(lb))) return std::make_tuple(parts.first, nullptr, parts.second);
+
+            // lb is the minimum of the right part, it's split off before its successor
+            auto succ = lb->right ? lb->right->minimum() : lb->parent();
+            auto greater = succ ? this->split_before(succ).second : nullptr;
+            RB_ASSERT(lb->left == nullptr && lb->right == nullptr && lb->parent() == nullptr);
+            return std::make_tuple(parts.first, lb, greater);
+        }
+
+        /**
+         * the tree of the values of the detached trees t1 of this tree and t2 of other which op keeps. t1 is split
+         * by the root of t2, both halves are combined recursively and joined by the root of t2 or its duplicate in t1.
+         * drop(t, in_this) is called with the detached subtrees which op drops
+         */
+        template<typename Drop>
+        nodeptr_t set_operation(nodeptr_t t1, nodeptr_t t2, const rbtree_set_operation& op, Drop& drop) {
+            if (t1 == nullptr || t2 == nullptr) {
+                if (t1 && !op.left) {
+                    drop(t1, true);
+                    t1 = nullptr;
                 }
-            } else {
-                auto n1_parent = n1->parent;
-                bool n1_is_left = n1_parent ? n1_parent->left == n1 : false;
-                auto n1_left = n1->left, n1_right = n1->right;
-
-                auto n2_parent = n2->parent;
-                bool n2_is_left = n2_parent ? n2_parent->left == n2 : false;
-                auto n2_left = n2->left, n2_right = n2->right;
+                if (t2 && !op.right) {
+                    drop(t2, false);
+                    t2 = nullptr;
+                }
+                return t1 ? t1 : t2;
+            }
 
-                std::swap(n1->parent, n2->parent);
-                this->be_left_child(n2, n1_left);
+            auto k = t2, l2 = t2->left, r2 = t2->right;
+            if (l2) l2->set_parent(nullptr);
+            if (r2) r2->set_parent(nullptr);
+            k->left = k->right = nullptr;
+            auto parts = this->split_by(t1, k);
+            auto l = this->set_operation(std::get<0>(parts), l2, op, drop);
+            auto r = this->set_operation(std::get<2>(parts), r2, op, drop);
+            return this->set_operation_join(l, k, std::get<1>(parts), r, op, drop);
+        }
+
+        /**
+         * join the combined halves l and r by the root k of other or its duplicate dup in this tree, whichever op keeps.
+         * the halves are threaded inside, only the threads across the seams between them and the pivot are linked
+         */
+        template<typename Drop>
+        nodeptr_t set_operation_join(nodeptr_t l, nodeptr_t k, nodeptr_t dup, nodeptr_t r, const rbtree_set_operation& op, Drop& drop) {
+            if (dup && op.both && op.right_value) dup->value.assign_value(std::move(k->value));
+            auto pivot = k;
+            if (dup || !op.right) {
+                drop(k, false);
+                pivot = nullptr;
+            }
+            if (dup) {
+                pivot = dup;
+                if (!op.both) {
+                    drop(dup, true);
+                    pivot = nullptr;
+                }
+            }
+
+            auto lmax = l && rbtree_node_type::Threaded ? l->maximum() : nullptr;
+            auto rmin = r && rbtree_node_type::Threaded ? r->minimum() : nullptr;
+            if (pivot) {
+                rbtree_node_type::link_threads(lmax, pivot);
+                rbtree_node_type::link_threads(pivot, rmin);
+            } else {
+                rbtree_node_type::link_threads(lmax, rmin);
+            }
+            return pivot ? this->join(l, pivot, r) : this->join(l, r);
+        }
+
+        /** see set_operation_join(), the first and the last node of root may still be linked to dropped nodes */
+        static void unlink_ends(nodeptr_t root) {
+            if (!rbtree_node_type::Threaded || root == nullptr) return;
+
+            rbtree_node_type::link_threads(nullptr, root->minimum());
+            rbtree_node_type::link_threads(root->maximum(), nullptr);
+        }
+
+        /**
+         * see set_operation(), the halves are combined as two tasks of executor while both trees hold at least grain
+         * nodes together. The dropped subtrees are collected, because the allocators may not be used concurrently
+         */
+        template<typename Executor>
+        nodeptr_t parallel_set_operation(nodeptr_t t1, nodeptr_t t2, const rbtree_set_operation& op,
+                                         std::vector<nodeptr_t>& dropped, std::vector<nodeptr_t>& other_dropped,
+                                         Executor& executor, size_type grain)
+        {
+            auto drop = [&dropped, &other_dropped](nodeptr_t t, bool in_this) {
+                (in_this ? dropped : other_dropped).push_back(t);
+            };
+            if (t1 == nullptr || t2 == nullptr || estimated_size(t1) + estimated_size(t2) < grain) {
+                return this->set_operation(t1, t2, op, drop);
+            }
+
+            auto k = t2, l2 = t2->left, r2 = t2->right;
+            if (l2) l2->set_parent(nullptr);
+            if (r2) r2->set_parent(nullptr);
+            k->left = k->right = nullptr;
+            auto parts = this->split_by(t1, k);
+            nodeptr_t l = nullptr, r = nullptr;
+            std::vector<nodeptr_t> right_dropped, right_other_dropped;
+            // join() keeps the tree it works on in this->root, so the right halves are combined on another tree object
+            RBTreeImpl worker(this->cmp, this->allocator);
+            struct release { RBTreeImpl& worker; ~release() { worker.root = nullptr; } } guard{worker};
+            executor(
+                [&]() { l = this->parallel_set_operation(std::get<0>(parts), l2, op, dropped, other_dropped, executor, grain); },
+                [&]() { r = worker.parallel_set_operation(std::get<2>(parts), r2, op, right_dropped, right_other_dropped, executor, grain); });
+            dropped.insert(dropped.end(), right_dropped.begin(), right_dropped.end());
+            other_dropped.insert(other_dropped.end(), right_other_dropped.begin(), right_other_dropped.end());
+            return this->set_operation_join(l, k, std::get<1>(parts), r, op, drop);
+        }
+
+        /** the number of nodes of a detached subtree, without position information a lower bound from its black height */
+        static size_type estimated_size(const_nodeptr_t node) {
+            if (keep_position_info) return subtree_size(node);
+
+            const auto h = black_height(node);
+            return h < static_cast<size_type>(std::numeric_limits<size_type>::digits) ?
+                (static_cast<size_type>(1) << h) - 1 : std::numeric_limits<size_type>::max();
+        }
+
+        /**
+         * see set_operation(), this tree is much larger than small, so the values of small are searched one by one
+         * from the previous bound. With keep_big the values of this tree are kept and the ones of small are moved
+         * into it, otherwise the values of small are filtered and this tree is cleared
+         */
+        void set_operation_gallop(RBTreeImpl& small, bool keep_big, bool keep_both, bool keep_small, bool keep_big_value) {
+            nodeptr_t finger = nullptr;
+            for (auto node=small.begin();node!=nullptr;) {
+                auto lb = this->bound_from(finger, 0, value_of(node), false).first;
+                const bool equal = lb != nullptr && !this->rb_comp(value_of(node), value_of(lb));
+                finger = lb;
+                if (!keep_big) {
+                    if (equal ? keep_both : keep_small) {
+                        if (equal && keep_big_value) node->value.assign_value(std::move(lb->value));
+                        node = node->next();
+                    } else {
+                        node = small.erase(node, true);
+                    }
+                    continue;
+                }
+
+                auto result = small.extract(node, true);
+                node = result.second;
+                if (equal && keep_both) {
+                    if (!keep_big_value) lb->value.assign_value(std::move(result.first->value));
+                    small.delete_node(result.first);
+                } else if (equal) {
+                    small.delete_node(result.first);
+                    finger = this->erase(lb, true);
+                } else if (keep_small) {
+                    finger = std::get<0>(this->insert_node(lb, result.first));
+                } else {
+                    small.delete_node(result.first);
+                }
+            }
+            small._version++;
+            this->_version++;
+            if (!keep_big) this->clear();
+        }
+
+        /** take the nodes of other, this tree is empty */
+        inline void take(RBTreeImpl& other) {
+            RB_ASSERT(this->root == nullptr);
+            this->set_root(other.root, other._size);
+            other.set_root(nullptr, 0);
+        }
+
+        /**
+         * link the threads of all nodes in order after the tree was put together from parts with stale threads,
+         * subtrees are linked as two tasks of executor while they hold at least grain nodes
+         */
+        template<typename Executor>
+        void parallel_rethread(Executor& executor, size_type grain) {
+            if (!rbtree_node_type::Threaded || this->root == nullptr) return;
+
+            this->rethread(this->root, nullptr, nullptr, this->_size, executor, grain);
+        }
+
+        /**
+         * link the threads of the subtree t whose in-order predecessor is pred and successor is succ, a node links
+         * itself to pred (succ) only without a left (right) child, so each link is written by one node
+         */
+        template<typename Executor>
+        void rethread(nodeptr_t t, nodeptr_t pred, nodeptr_t succ, size_type estimate, Executor& executor, size_type grain) {
+            if (estimate < grain) {
+                this->rethread(t, pred, succ);
+                return;
+            }
+
+            if (t->left == nullptr) rbtree_node_type::link_threads(pred, t);
+            if (t->right == nullptr) rbtree_node_type::link_threads(t, succ);
+            executor(
+                [&]() { if (t->left) this->rethread(t->left, pred, t, estimate / 2, executor, grain); },
+                [&]() { if (t->right) this->rethread(t->right, t, succ, estimate / 2, executor, grain); });
+        }
+
+        void rethread(nodeptr_t t, nodeptr_t pred, nodeptr_t succ) {
+            for (;;) {
+                if (t->left) {
+                    this->rethread(t->left, pred, t);
+                } else {
+                    rbtree_node_type::link_threads(pred, t);
+                }
+                if (t->right == nullptr) break;
+                pred = t;
+                t = t->right;
+            }
+            rbtree_node_type::link_threads(t, succ);
+        }
+
+        inline nodeptr_t minimum(nodeptr_t node) const {
+            return node->minimum();
+        }
+
+        inline nodeptr_t maximum(nodeptr_t node) const {
+            return node->maximum();
+        }
+
+        inline void swap_node(nodeptr_t n1, nodeptr_t n2) const {
+            RB_ASSERT(n1);
+            RB_ASSERT(n2);
+            n1->swap_color(*n2);
+            rbtree_node_type::swap_threads(n1, n2);
+
+            if (n1->parent() == n2)
+                std::swap(n1, n2);
+
+            if (n2->parent() == n1) {
+                auto p = n1->parent();
+                const bool is_left_child = n1->left == n2;
+                const bool n1_is_left_child = p ? p ->left == n1 : false;
+                const auto n1_left = n1->left, n1_right = n1->right;
+
+                this->be_left_child(n1, n2->left);
+                this->be_right_child(n1, n2->right);
+                if (is_left_child) {
+                    this->be_left_child(n2, n1);
+                    this->be_right_child(n2, n1_right);
+                } else {
+                    this->be_right_child(n2, n1);
+                    this->be_left_child(n2, n1_left);
+                }
+                if (p) {
+                    if (n1_is_left_child) {
+                        this->be_left_child(p, n2);
+                    } else {
+                        this->be_right_child(p, n2);
+                    }
+                } else {
+                    n2->set_parent(nullptr);
+                }
+            } else {
+                auto n1_parent = n1->parent();
+                bool n1_is_left = n1_parent ? n1_parent->left == n1 : false;
+                auto n1_left = n1->left, n1_right = n1->right;
+
+                auto n2_parent = n2->parent();
+                bool n2_is_left = n2_parent ? n2_parent->left == n2 : false;
+                auto n2_left = n2->left, n2_right = n2->right;
+
+                n1->set_parent(n2_parent);
+                n2->set_parent(n1_parent);
+                this->be_left_child(n2, n1_left);
                 this->be_right_child(n2, n1_right);
                 this->be_left_child(n1, n2_left);
                 this->be_right_child(n1, n2_right);
@@ -1084,6 +2781,90 @@ class RBTreeImpl {
             this->_version++;
         }
 
+        /**
+         * bookkeeping of erased() under DEBUG, nodes leave the tree and come back to it,
+         * for instance from another tree, they do nothing otherwise. Intrusive trees don't allocate for it
+         */
+        inline void mark_removed(const_nodeptr_t node) {
+#ifdef DEBUG
+            if (Intrusive) return;
+            this->_epochs[node] = SIZE_MAX;
+#else
+            (void)node;
+#endif // DEBUG
+        }
+
+        inline void mark_linked(const_nodeptr_t node) {
+#ifdef DEBUG
+            if (this->_epochs.empty()) return;
+            auto it = this->_epochs.find(node);
+            // iterators taken from now on are newer than the epoch
+            if (it != this->_epochs.end() && it->second == SIZE_MAX) it->second = this->_version++;
+#else
+            (void)node;
+#endif // DEBUG
+        }
+
+        void mark_linked_subtree(const_nodeptr_t t) {
+#ifdef DEBUG
+            if (this->_epochs.empty() || t == nullptr) return;
+            this->mark_linked(t);
+            this->mark_linked_subtree(t->left);
+            this->mark_linked_subtree(t->right);
+#else
+            (void)t;
+#endif // DEBUG
+        }
+
+        void mark_removed_subtree(const_nodeptr_t t) {
+#ifdef DEBUG
+            if (t == nullptr) return;
+            this->mark_removed(t);
+            this->mark_removed_subtree(t->left);
+            this->mark_removed_subtree(t->right);
+#else
+            (void)t;
+#endif // DEBUG
+        }
+
+        /** all nodes left the tree, iterators taken before are invalid */
+        inline void mark_cleared() {
+#ifdef DEBUG
+            this->_epochs.clear();
+            this->_cleared_version = this->_version;
+#endif // DEBUG
+        }
+
+#ifdef DEBUG
+        /**
+         * whether node of an iterator taken at version has left the tree since, it's erased or moved to another tree.
+         * node isn't dereferenced unless the tree is intrusive, so it may be freed already
+         */
+        bool erased(const_nodeptr_t node, size_t version) const {
+            if (version < this->_cleared_version) return true;
+            if (Intrusive) {
+                // the nodes are owned by user and unlinked when they leave the tree, see delete_node()
+                for (;node->parent()!=nullptr;node=node->parent()) {}
+                return node != this->root;
+            }
+            auto it = this->_epochs.find(node);
+            return it != this->_epochs.end() && version <= it->second;
+        }
+#endif // DEBUG
+
+        /** value which iterators refer to */
+        static inline value_type& value_ref(nodeptr_t node) {
+            return value_ref(node, std::integral_constant<bool,Intrusive>());
+        }
+
+        static inline value_type& value_ref(nodeptr_t node, std::false_type) {
+            return node->value.get();
+        }
+
+        static inline value_type& value_ref(nodeptr_t node, std::true_type) {
+            return static_cast<value_type&>(*node);
+        }
+
         template<typename Sx>
         std::pair<nodeptr_t,bool> insert(nodeptr_t hint, Sx&& val) {
             return this->emplace(hint, std::forward<Sx>(val));
@@ -1092,9 +2873,20 @@ class RBTreeImpl {
         template<typename ... Args >
         std::pair<nodeptr_t,bool> emplace(nodeptr_t hint, Args&& ...args)
         {
-            this->_version++;
+            return this->emplace(hint, std::integral_constant<bool,!multi && rbtree_emplace_key<storage_type,Args...>::value>(), std::forward<Args>(args)...);
+        }
+
+        template<typename ... Args >
+        std::pair<nodeptr_t,bool> emplace(nodeptr_t hint, std::false_type, Args&& ...args)
+        {
             auto node = this->construct_node(std::forward<Args>(args)...);
-            auto result = this->insert_node(hint, node);
+            std::tuple<nodeptr_t,nodeptr_t,bool> result;
+            try {
+                result = this->insert_node(hint, node);
+            } catch (...) {
+                this->delete_node(node);
+                throw;
+            }
             if (std::get<1>(result)) {
                 auto rnode = std::get<1>(result);
                 RB_ASSERT(rnode == node);
@@ -1103,16 +2895,60 @@ class RBTreeImpl {
             return std::make_pair(std::get<0>(result), std::get<2>(result));
         }
 
+        /** the key of a unique tree is looked up first, so a duplicate is assigned without constructing a node */
+        template<typename ... Args>
+        std::pair<nodeptr_t,bool> emplace(nodeptr_t hint, std::true_type, Args&& ... args)
+        {
+            const auto pos = this->insert_position(hint, rbtree_emplace_key<storage_type,Args...>::get(args...));
+            if (std::get<0>(pos)) {
+                std::get<0>(pos)->value.assign_from(std::forward<Args>(args)...);
+                return std::make_pair(std::get<0>(pos), false);
+            }
+
+            this->check_capacity(this->_size + 1);
+            auto node = this->construct_node(std::forward<Args>(args)...);
+            this->link_node(std::get<1>(pos), std::get<2>(pos), node);
+            return std::make_pair(node, true);
+        }
+
+        /**
+         * the node of key in a unique tree, otherwise a node constructed from args is inserted,
+         * within a single descent. Nothing is constructed if key is in the tree
+         */
+        template<typename K, typename ... Args>
+        std::pair<nodeptr_t,bool> try_emplace(const K& key, Args&& ... args)
+        {
+            const auto pos = this->insert_position(nullptr, key);
+            if (std::get<0>(pos)) return std::make_pair(std::get<0>(pos), false);
+
+            this->check_capacity(this->_size + 1);
+            auto node = this->construct_node(std::forward<Args>(args)...);
+            this->link_node(std::get<1>(pos), std::get<2>(pos), node);
+            return std::make_pair(node, true);
+        }
+
         std::tuple<nodeptr_t,nodeptr_t,bool> insert_node(nodeptr_t hint, nodeptr_t node) {
-            const auto& val = node->value;
-            if (this->root == nullptr) {
-                this->root = node;
-                this->root->black = true;
-                RB_ASSERT(this->_size == 0);
-                this->_size++;
-                return std::make_tuple(this->root, nullptr, true);
+            RB_ASSERT(node->left == nullptr && node->right == nullptr && node->parent() == nullptr);
+            const auto pos = this->insert_position(hint, value_of(node));
+            if (std::get<0>(pos)) {
+                std::get<0>(pos)->value.assign_value(std::move(node->value));
+                return std::make_tuple(std::get<0>(pos), node, false);
             }
 
+            // a duplicate doesn't count against the capacity
+            this->check_capacity(this->_size + 1);
+            this->link_node(std::get<1>(pos), std::get<2>(pos), node);
+            return std::make_tuple(node, nullptr, true);
+        }
+
+        /**
+         * where a value of key is inserted: the equal node of a unique tree, or else nullptr, the parent of the
+         * new node and whether it's the left child. The search starts from hint if the value fits next to it
+         */
+        template<typename K>
+        std::tuple<nodeptr_t,nodeptr_t,bool> insert_position(nodeptr_t hint, const K& val) {
+            if (this->root == nullptr) return std::make_tuple(nullptr, nullptr, false);
+
             auto cn = this->root;
             if (hint != nullptr) {
                 bool left_is_ok = false, right_is_ok = false;
@@ -1120,7 +2956,7 @@ class RBTreeImpl {
 
                 for (;(!left_is_ok && left_node) || (!right_is_ok && right_node);) {
                     if (!left_is_ok && left_node) {
-                        if (this->rb_comp(left_node->value, val)) {
+                        if (this->rb_comp(value_of(left_node), val)) {
                             left_is_ok = true;
                         } else {
                             left_node = left_node->left;
@@ -1128,7 +2964,7 @@ class RBTreeImpl {
                     }
 
                     if (!right_is_ok && right_node) {
-                        if (this->rb_comp(val, right_node->value)) {
+                        if (this->rb_comp(val, value_of(right_node))) {
                             right_is_ok = true;
                         } else {
                             right_node = right_node->right;
@@ -1136,13 +2972,13 @@ class RBTreeImpl {
                     }
                 }
 
-                for (auto tp=hint->parent;(!left_is_ok || !right_is_ok) && tp;tp=tp->parent) {
-                    if (!left_is_ok && this->rb_comp(tp->value, val)) {
+                for (auto tp=hint->parent();(!left_is_ok || !right_is_ok) && tp;tp=tp->parent()) {
+                    if (!left_is_ok && this->rb_comp(value_of(tp), val)) {
                         hint = tp;
                         left_is_ok = true;
                     }
 
-                    if (!right_is_ok && this->rb_comp(val, tp->value)) {
+                    if (!right_is_ok && this->rb_comp(val, value_of(tp))) {
                         hint = tp;
                         right_is_ok = true;
                     }
@@ -1154,35 +2990,47 @@ class RBTreeImpl {
             }
 
             for(;;) {
-                if (this->rb_comp(node->value, cn->value)) {
-                    if (cn->left == nullptr) {
-                        cn->left = node;
-                        node->parent = cn;
-                        break;
-                    } else {
-                        cn = cn->left;
-                    }
-                } else if (!multi && this->rb_equal(node->value, cn->value)) {
-                    cn->value.assign_value(std::move(node->value));
-                    return std::make_tuple(cn, node, false);
+                const int order = this->rb_order(val, value_of(cn));
+                if (order < 0) {
+                    if (cn->left == nullptr) return std::make_tuple(nullptr, cn, true);
+                    cn = cn->left;
+                } else if (!multi && order == 0) {
+                    return std::make_tuple(cn, nullptr, false);
                 } else {
-                    if (cn->right == nullptr) {
-                        cn->right = node;
-                        node->parent = cn;
-                        break;
-                    } else {
-                        cn = cn->right;
-                    }
+                    if (cn->right == nullptr) return std::make_tuple(nullptr, cn, false);
+                    cn = cn->right;
                 }
             }
+        }
 
+        /** link a detached node at a position found by insert_position() and rebalance the tree */
+        void link_node(nodeptr_t parent, bool left, nodeptr_t node) {
+            this->mark_linked(node);
+            node->set_black(false);
+            // position information of an extracted node is stale
+            this->update_num_nodes(node, nullptr);
             this->_size++;
-            if (cn->black) {
-                this->update_num_nodes(cn, nullptr);
+            if (parent == nullptr) {
+                RB_ASSERT(this->root == nullptr);
+                this->root = node;
+                this->root->set_black(true);
+                return;
+            }
+
+            node->set_parent(parent);
+            if (left) {
+                parent->left = node;
+                if (rbtree_node_type::Threaded) node->thread_between(parent->prev(), parent);
+            } else {
+                parent->right = node;
+                if (rbtree_node_type::Threaded) node->thread_between(parent, parent->next());
+            }
+
+            if (parent->is_black()) {
+                this->update_num_nodes(parent, nullptr);
             } else {
                 this->fix_redred(node);
             }
-            return std::make_tuple(node, nullptr, true);
         }
 
         template<typename Sx>
@@ -1197,13 +3045,16 @@ class RBTreeImpl {
 
             std::queue<std::pair<nodeptr_t,size_t>> queue;
             queue.push(std::make_pair(this->root, 0));
+            // number of black nodes on the path to every null link
             size_t black_depth = 0;
+            for (auto node=this->root;node!=nullptr;node=node->left) {
+                black_depth += node->is_black() ? 1 : 0;
+            }
 
             for (;!queue.empty();queue.pop()) {
                 auto front = queue.front();
                 auto node = front.first;
-                auto bdepth = front.second + (node->black ? 1 : 0);
-                black_depth = black_depth > bdepth ? black_depth : bdepth;
+                auto bdepth = front.second + (node->is_black() ? 1 : 0);
 
                 if (keep_position_info) {
                     auto left_n = node->num_of_left_children();
@@ -1212,32 +3063,38 @@ class RBTreeImpl {
                     RB_ASSERT(node->num_of_nodes() == left_n + right_n + 1);
                 }
 
-                if (!node->black) {
+                if (!node->is_black()) {
                     RB_ASSERT(this->is_black_node(node->left));
                     RB_ASSERT(this->is_black_node(node->right));
                 }
 
                 if (node->left) {
-                    RB_ASSERT(node->left->parent == node);
-                    RB_ASSERT(this->rb_comp(node->left->value, node->value) || (multi && this->rb_equal(node->left->value, node->value)));
+                    RB_ASSERT(node->left->parent() == node);
+                    RB_ASSERT(this->rb_comp(value_of(node->left), value_of(node)) || (multi && this->rb_equal(value_of(node->left), value_of(node))));
                     queue.push(std::make_pair(node->left, bdepth));
                 }
                 if (node->right) {
-                    RB_ASSERT(node->right->parent == node);
-                    RB_ASSERT(!this->rb_comp(node->right->value, node->value) || (multi && this->rb_equal(node->right->value, node->value)));
+                    RB_ASSERT(node->right->parent() == node);
+                    RB_ASSERT(!this->rb_comp(value_of(node->right), value_of(node)) || (multi && this->rb_equal(value_of(node->right), value_of(node))));
                     queue.push(std::make_pair(node->right, bdepth));
                 }
 
-                if (!node->left && !node->right) {
+                if (!node->left || !node->right) {
                     RB_ASSERT(bdepth == black_depth);
                 }
+                if (rbtree_node_type::Threaded) {
+                    RB_ASSERT(node->next() == node->tree_next());
+                    RB_ASSERT(node->prev() == node->tree_prev());
+                }
             }
         }
+
 #endif // DEBUG
 
         std::pair<nodeptr_t,nodeptr_t> extract(nodeptr_t node, bool return_next_node)
         {
             RB_ASSERT(node != nullptr);
+            this->mark_removed(node);
             nodeptr_t extra_black = nullptr;
             nodeptr_t extra_parent = nullptr;
             bool extra_is_left_child = true;
@@ -1252,7 +3109,7 @@ class RBTreeImpl {
                 }
 
                 if (node == this->root) {
-                    RB_ASSERT(node->parent == nullptr);
+                    RB_ASSERT(node->parent() == nullptr);
                     this->root = successor;
                 }
 
@@ -1260,14 +3117,14 @@ class RBTreeImpl {
             } else if (return_next_node) {
                 next_node = this->advance(node, 1);
             }
-            const auto node_parent = node->parent;
+            const auto node_parent = node->parent();
 
-            bool need_extra_black = node->black && node_parent;
+            bool need_extra_black = node->is_black() && node_parent;
             if (node->left == nullptr) {
                 if (node->right != nullptr) {
-                    RB_ASSERT(!node->right->black);
+                    RB_ASSERT(!node->right->is_black());
                     need_extra_black = false;
-                    node->right->black = true;
+                    node->right->set_black(true);
                 }
 
                 if (node_parent) {
@@ -1281,7 +3138,7 @@ class RBTreeImpl {
                 } else {
                     RB_ASSERT(node == this->root);
                     if (node->right != nullptr) {
-                        node->right->parent = nullptr;
+                        node->right->set_parent(nullptr);
                     }
                     this->root = node->right;
                 }
@@ -1290,10 +3147,10 @@ class RBTreeImpl {
             } else {
                 RB_ASSERT(node->right == nullptr);
                 RB_ASSERT(node->left != nullptr);
-                RB_ASSERT(!node->left->black);
-                RB_ASSERT(node->black);
+                RB_ASSERT(!node->left->is_black());
+                RB_ASSERT(node->is_black());
                 need_extra_black = false;
-                node->left->black = true;
+                node->left->set_black(true);
 
                 if (node_parent) {
                     if (node_parent->left == node) {
@@ -1304,20 +3161,21 @@ class RBTreeImpl {
                     }
                 } else {
                     RB_ASSERT(node == this->root);
-                    node->left->parent = nullptr;
+                    node->left->set_parent(nullptr);
                     this->root = node->left;
                 }
             }
+            node->unthread();
             node->left = nullptr;
             node->right = nullptr;
-            node->parent = nullptr;
+            node->set_parent(nullptr);
             RB_ASSERT(this->_size > 0);
             this->_size--;
 
             if (this->root != nullptr) {
-                RB_ASSERT(this->root->parent == nullptr);
-                if (node_parent && node_parent->parent) {
-                    this->update_num_nodes(node_parent->parent, nullptr);
+                RB_ASSERT(this->root->parent() == nullptr);
+                if (node_parent && node_parent->parent()) {
+                    this->update_num_nodes(node_parent->parent(), nullptr);
                 }
 
                 if (need_extra_black) {
@@ -1329,6 +3187,15 @@ class RBTreeImpl {
             return std::make_pair(node, next_node);
         }
 
+        /**
+         * hand an extracted node over to a node handle, which releases it through the allocator,
+         * nodes in the pool are moved to memory from the allocator
+         */
+        inline nodeptr_t release_node(nodeptr_t node) {
+            RB_ASSERT(node->left == nullptr && node->right == nullptr && node->parent() == nullptr);
+            return this->pool.owns(node) ? this->relocate_from_pool(node) : node;
+        }
+
         inline nodeptr_t erase(nodeptr_t node, bool return_next_node) {
             auto result = this->extract(node, return_next_node);
             this->_version++;
@@ -1336,6 +3203,195 @@ class RBTreeImpl {
             return result.second;
         }
 
+        /**
+         * erase [first, last) and return last. A long range is cut out by splitting the tree before
+         * first and before last, the rest is joined and the range is deleted without rebalancing,
+         * so it's O(lg n + k) instead of k erasures
+         */
+        nodeptr_t erase_range(nodeptr_t first, nodeptr_t last) {
+            size_type k = 0;
+            for (auto node=first;node!=last && k<erase_range_min;node=node->next(),k++);
+            if (k < erase_range_min) {
+                for (;first!=last;first=this->erase(first, true));
+                return last;
+            }
+
+            auto range = this->cut_range(first, last);
+            this->_size -= this->delete_subtree(range);
+            this->_version++;
+            return last;
+        }
+
+        /**
+         * move node and the nodes after it to the empty tree other in O(lg n) by splitting the tree before node.
+         * without position information the sizes of both parts are counted in O(min(k, n - k)).
+         * nodes in the pool of this tree can't change hands, the k nodes moved to other are taken out
+         * of the pool first, which is O(k)
+         */
+        void split_off(nodeptr_t node, RBTreeImpl& other) {
+            RB_ASSERT(this != &other && other.root == nullptr);
+            if (node == nullptr) return;
+            node = this->relocate_range_from_pool(node, nullptr);
+
+            auto pred = node->prev();
+            auto parts = this->split_before(node);
+            rbtree_node_type::link_threads(pred, nullptr);
+            rbtree_node_type::link_threads(nullptr, node);
+            const auto k = count_nodes(parts.second, parts.first, this->_size);
+            this->mark_removed_subtree(parts.second);
+            this->set_root(parts.first, this->_size - k);
+            other.set_root(parts.second, k);
+        }
+
+        /**
+         * keep the values of this tree and of other which op selects, the value of this tree is kept for a value in
+         * both unless op.right_value is set, the nodes of other are moved or deleted and other is left empty. this tree is split at the roots of
+         * other and joined again recursively, which is O(m lg(n/m + 1)) for m <= n besides deleting dropped nodes,
+         * the threads are only linked across the seams of the joins.
+         * if one tree is set_gallop_ratio times larger, the values of the small one are searched in it one by one
+         */
+        void set_operation(RBTreeImpl& other, const rbtree_set_operation& op) {
+            static_assert(!multi, "set operations are defined for unique values");
+            RB_ASSERT(this != &other);
+            // the values of other may all be kept, the trees are left alone if they might not fit
+            if (op.right) this->check_capacity(static_cast<size_t>(this->_size) + other._size);
+            if (other.pool.in_use() > 0) {
+                // nodes in the pool of other can't change hands
+                RBTreeImpl copy(other.cmp, other.allocator);
+                other.copy_to(copy);
+                other.clear();
+                this->set_operation(copy, op);
+                return;
+            }
+
+            if (other._size * set_gallop_ratio <= this->_size) {
+                this->set_operation_gallop(other, op.left, op.both, op.right, !op.right_value);
+                if (!op.left) this->take(other);
+                return;
+            }
+            if (this->_size * set_gallop_ratio <= other._size) {
+                other.set_operation_gallop(*this, op.right, op.both, op.left, op.right_value);
+                if (op.right) this->take(other);
+                return;
+            }
+
+            size_type dropped = 0;
+            auto drop = [this, &other, &dropped](nodeptr_t t, bool in_this) {
+                dropped += in_this ? this->delete_subtree(t) : other.delete_subtree(t);
+            };
+            auto root = this->set_operation(this->root, other.root, op, drop);
+            const auto n = this->_size + other._size - dropped;
+            other.set_root(nullptr, 0);
+            this->set_root(root, n);
+            unlink_ends(root);
+        }
+
+        /**
+         * see set_operation(), the halves of each split are combined as two tasks of executor, which may run them
+         * in parallel, while both trees hold at least grain nodes together. executor(f, g) returns after both tasks
+         * are done. The dropped nodes are deleted afterwards on the calling thread. A tree smaller than grain is
+         * combined serially
+         */
+        template<typename Executor>
+        void parallel_set_operation(RBTreeImpl& other, const rbtree_set_operation& op, Executor& executor, size_type grain) {
+            static_assert(!multi, "set operations are defined for unique values");
+            RB_ASSERT(this != &other);
+            // see set_operation(), the tasks can't be undone once they are forked
+            if (op.right) this->check_capacity(static_cast<size_t>(this->_size) + other._size);
+            // it's O(m lg n) for a small m, the serial version can search the values of the small tree one by one
+            if (std::min(this->_size, other._size) < grain) {
+                this->set_operation(other, op);
+                return;
+            }
+            if (other.pool.in_use() > 0) {
+                RBTreeImpl copy(other.cmp, other.allocator);
+                other.copy_to(copy);
+                other.clear();
+                this->parallel_set_operation(copy, op, executor, grain);
+                return;
+            }
+
+            std::vector<nodeptr_t> dropped, other_dropped;
+            auto root = this->parallel_set_operation(this->root, other.root, op, dropped, other_dropped, executor, grain);
+            auto n = this->_size + other._size;
+            for (auto t: dropped) n -= this->delete_subtree(t);
+            for (auto t: other_dropped) n -= other.delete_subtree(t);
+            other.set_root(nullptr, 0);
+            this->set_root(root, n);
+            unlink_ends(root);
+        }
+
+        /** move the values which aren't less than key to the empty tree other */
+        template<typename _K>
+        void split(const _K& key, RBTreeImpl& other) {
+            this->split_off(this->lower_bound(key), other);
+        }
+
+        /** move the values whose ranks aren't less than index to the empty tree other */
+        void split_at(size_type index, RBTreeImpl& other) {
+            this->split_off(this->select(index), other);
+        }
+
+        /** whether the values of this tree are less than the values of other, or not greater if multi */
+        bool precedes(const RBTreeImpl& other) const {
+            if (this->root == nullptr || other.root == nullptr) return true;
+
+            const auto& last = value_of(this->root->maximum());
+            const auto& first = value_of(other.root->minimum());
+            return multi ? !this->rb_comp(first, last) : this->rb_comp(last, first);
+        }
+
+        /**
+         * move the nodes of other, which follow the nodes of this tree, to the end of it in O(lg n + lg m).
+         * nodes in the pool of other are taken out of it first, which is O(m)
+         */
+        void append(RBTreeImpl& other) {
+            RB_ASSERT(this != &other && this->precedes(other));
+            if (other.root == nullptr) return;
+            this->check_capacity(this->_size + other._size);
+            auto first = other.relocate_range_from_pool(other.root->minimum(), nullptr);
+            auto last = this->root ? this->root->maximum() : nullptr;
+            this->set_root(this->join(this->root, other.root), this->_size + other._size);
+            other.set_root(nullptr, 0);
+            rbtree_node_type::link_threads(last, first);
+        }
+
+        /**
+         * move [first, last) of other to this tree. If the range fits between two neighbours in this tree,
+         * it's cut out of other and joined in between, so it's O(lg n + lg m), otherwise the nodes are
+         * inserted one by one like insert() does, the value of a duplicate replaces the existing one.
+         * the k nodes of the range which are in the pool of other are taken out of it first, which is O(k)
+         */
+        void splice(RBTreeImpl& other, nodeptr_t first, nodeptr_t last) {
+            RB_ASSERT(this != &other);
+            if (first == last) return;
+            if (keep_position_info) this->check_capacity(this->_size + other.indexof(last) - other.indexof(first));
+
+            auto pos = this->upper_bound(value_of(first));
+            auto pred = pos ? pos->prev() : (this->root ? this->root->maximum() : nullptr);
+            auto hi = last ? last->prev() : other.root->maximum();
+            const bool fits = (pos == nullptr || this->rb_comp(value_of(hi), value_of(pos))) &&
+                              (multi || pred == nullptr || this->rb_comp(value_of(pred), value_of(first)));
+            if (!fits) {
+                this->move_nodes(other, first, last, pred);
+                return;
+            }
+
+            // first and hi may be replaced
+            first = other.relocate_range_from_pool(first, last);
+            hi = last ? last->prev() : other.root->maximum();
+            auto range = other.cut_range(first, last);
+            const auto n = count_nodes(range, other.root, other._size);
+            other.mark_removed_subtree(range);
+            other.set_root(other.root, other._size - n);
+
+            // join(l, r) walks from the minimum of r, so the threads are linked after joining
+            auto parts = pos ? this->split_before(pos) : std::make_pair(this->root, static_cast<nodeptr_t>(nullptr));
+            this->set_root(this->join(this->join(parts.first, range), parts.second), this->_size + n);
+            rbtree_node_type::link_threads(pred, first);
+            rbtree_node_type::link_threads(hi, pos);
+        }
+
         size_type indexof(nodeptr_t node) const {
             size_type ans = 0;
             if (node == nullptr)
@@ -1352,16 +3408,10 @@ class RBTreeImpl {
 
         template<typename _K>
         nodeptr_t lower_bound(const _K& val) {
-            auto root = this->root;
             nodeptr_t ans = nullptr;
-            if (!root) return ans;
-
-            for (auto node=root;node!=nullptr;) {
-                if (!this->rb_comp(node->value, val)) {
-                    if (ans == nullptr || !this->rb_comp(ans->value, node->value) || this->rb_equal(node->value, ans->value)) {
-                        ans = node;
-                    }
-
+            for (auto node=this->root;node!=nullptr;) {
+                if (!this->rb_comp(value_of(node), val)) {
+                    ans = node;
                     node = node->left;
                 } else {
                     node = node->right;
@@ -1378,16 +3428,10 @@ class RBTreeImpl {
 
         template<typename _K>
         nodeptr_t upper_bound(const _K& val) {
-            auto root = this->root;
             nodeptr_t ans = nullptr;
-            if (!root) return ans;
-
-            for (auto node=root;node!=nullptr;) {
-                if (this->rb_comp(val, node->value)) {
-                    if (ans == nullptr || this->rb_comp(node->value, ans->value) || this->rb_equal(node->value, ans->value)) {
-                        ans = node;
-                    }
-
+            for (auto node=this->root;node!=nullptr;) {
+                if (this->rb_comp(val, value_of(node))) {
+                    ans = node;
                     node = node->left;
                 } else {
                     node = node->right;
@@ -1402,71 +3446,286 @@ class RBTreeImpl {
             return const_cast<RBTreeImpl*>(this)->upper_bound(val);
         }
 
+        /**
+         * bound of val and the number of values before it, the subtree counters are
+         * accumulated in a single descent if keep_position_info
+         */
         template<typename _K>
-        nodeptr_t find(const _K& val) {
-            auto node = this->lower_bound(val);
-            return node && this->rb_equal(node->value, val) ? node : nullptr;
+        std::pair<nodeptr_t,size_type> bound_with_rank(const _K& val, bool upper) {
+            if (!keep_position_info) {
+                auto node = upper ? this->upper_bound(val) : this->lower_bound(val);
+                return std::make_pair(node, this->indexof(node));
+            }
+
+            nodeptr_t ans = nullptr;
+            size_type rank = 0;
+            for (auto node=this->root;node!=nullptr;) {
+                if (upper ? this->rb_comp(val, value_of(node)) : !this->rb_comp(value_of(node), val)) {
+                    ans = node;
+                    node = node->left;
+                } else {
+                    rank += node->num_of_left_children() + 1;
+                    node = node->right;
+                }
+            }
+            return std::make_pair(ans, rank);
         }
 
         template<typename _K>
-        const_nodeptr_t find(const _K& val) const {
-            auto node = this->lower_bound(val);
-            return node && this->rb_equal(node->value, val) ? node : nullptr;
+        std::pair<nodeptr_t,size_type> lower_bound_with_rank(const _K& val) {
+            return this->bound_with_rank(val, false);
         }
 
         template<typename _K>
-        size_type count(const _K& val) const {
-            auto lb = this->lower_bound(val);
-            auto ub = this->upper_bound(val);
-            return this->indexof(ub) - this->indexof(lb);
+        std::pair<const_nodeptr_t,size_type> lower_bound_with_rank(const _K& val) const {
+            return const_cast<RBTreeImpl*>(this)->bound_with_rank(val, false);
         }
 
-        nodeptr_t begin() {
-            if (!this->root) return nullptr;
+        template<typename _K>
+        std::pair<nodeptr_t,size_type> upper_bound_with_rank(const _K& val) {
+            return this->bound_with_rank(val, true);
+        }
 
-            return this->minimum(this->root);
+        template<typename _K>
+        std::pair<const_nodeptr_t,size_type> upper_bound_with_rank(const _K& val) const {
+            return const_cast<RBTreeImpl*>(this)->bound_with_rank(val, true);
         }
 
-        const_nodeptr_t begin() const {
-            if (!this->root) return nullptr;
+        /**
+         * bound_with_rank() of a value which isn't less than the value whose bound is finger, the
+         * search climbs from finger to the lowest ancestor whose subtree holds the bound and descends
+         * from there, so it's O(lg d) for a bound d positions after finger. finger == nullptr starts
+         * from the root, the rank is only tracked if keep_position_info
+         */
+        template<typename _K>
+        std::pair<nodeptr_t,size_type> bound_from(nodeptr_t finger, size_type finger_rank, const _K& val, bool upper) {
+            if (finger == nullptr) return this->bound_with_rank(val, upper);
 
-            return this->minimum(this->root);
-        }
+            auto is_bound = [&](const_nodeptr_t node) {
+                return upper ? this->rb_comp(val, value_of(node)) : !this->rb_comp(value_of(node), val);
+            };
+            if (is_bound(finger)) return std::make_pair(finger, finger_rank);
 
-        nodeptr_t rbegin() {
-            if (!this->root) return nullptr;
+            // the values of subtree are between the value of finger and ans
+            auto subtree = finger;
+            nodeptr_t ans = nullptr;
+            size_type rank = finger_rank;
+            for (auto p=subtree->parent();p!=nullptr;subtree=p,p=p->parent()) {
+                if (p->left == subtree) {
+                    if (keep_position_info) rank += subtree->num_of_right_children() + 1;
+                    if (is_bound(p)) {
+                        ans = p;
+                        break;
+                    }
+                } else if (keep_position_info) {
+                    rank -= subtree->num_of_left_children() + 1;
+                }
+            }
 
-            return this->maximum(this->root);
+            // rank of the minimum of subtree
+            if (keep_position_info) rank = ans ? rank - subtree->num_of_nodes() : this->_size - subtree->num_of_nodes();
+            for (auto node=subtree;node!=nullptr;) {
+                if (is_bound(node)) {
+                    ans = node;
+                    node = node->left;
+                } else {
+                    if (keep_position_info) rank += node->num_of_left_children() + 1;
+                    node = node->right;
+                }
+            }
+            if (!keep_position_info) rank = 0;
+            return std::make_pair(ans, rank);
         }
 
-        const_nodeptr_t rbegin() const {
-            if (!this->root) return nullptr;
-
-            return this->maximum(this->root);
+        template<typename _K>
+        inline bool key_equal(const_nodeptr_t node, const _K& val) const {
+            return node != nullptr && this->rb_equal(value_of(node), val);
         }
 
-        // TODO prototype
-        nodeptr_t advance(nodeptr_t node, long n) const {
-            // node == nullptr represent end
-            if (node == nullptr) {
-                // TODO why this->root (shoud be const qualified) can assign to node
-                node = this->root;
-                n += node && node->right ? node->right->num_of_nodes() + 1 : 1;
+        /** ranges shorter than this are erased node by node by erase_range() */
+        constexpr static size_type erase_range_min = 16;
+
+        /** set_operation() searches the values of a tree which is this many times smaller one by one */
+        constexpr static size_type set_gallop_ratio = 16;
+
+        /** number of lookups which lower_bound_interleaved() advances in lockstep */
+        constexpr static size_t interleave_width = 16;
+
+        /**
+         * out[i] = lower_bound(key_at(i)) for i in [0, n). Up to interleave_width lookups descend
+         * together, one level per round, and each prefetches the child it moves to, so the cache
+         * misses of the independent lookups overlap instead of being paid one after another
+         */
+        template<typename KeyAt>
+        void lower_bound_interleaved(size_t n, KeyAt key_at, nodeptr_t* out) {
+            if (this->root == nullptr) {
+                std::fill(out, out + n, nullptr);
+                return;
             }
 
-            return node->advance(n);
-        }
+            struct lane_t {
+                nodeptr_t node, ans;
+                size_t index;
+            };
+            lane_t lanes[interleave_width];
+            size_t n_lanes = 0, next = 0;
+            for (;n_lanes<interleave_width && next<n;n_lanes++,next++) {
+                lanes[n_lanes] = lane_t{ this->root, nullptr, next };
+            }
 
-        inline size_type size() const {
-            return this->_size;
-        }
+            while (n_lanes > 0) {
+                for (size_t i=0;i<n_lanes;) {
+                    auto& lane = lanes[i];
+                    if (lane.node == nullptr) {
+                        out[lane.index] = lane.ans;
+                        if (next == n) {
+                            lane = lanes[--n_lanes];
+                            continue;
+                        }
+                        lane = lane_t{ this->root, nullptr, next++ };
+                    }
 
-        inline size_t version() const {
-            return this->_version;
+                    if (!this->rb_comp(value_of(lane.node), key_at(lane.index))) {
+                        lane.ans = lane.node;
+                        lane.node = lane.node->left;
+                    } else {
+                        lane.node = lane.node->right;
+                    }
+                    rbtree_prefetch(lane.node);
+                    i++;
+                }
+            }
+        }
+
+        /** the value at index, nullptr if it's out of range */
+        nodeptr_t select(size_type index) const {
+            if (index >= this->_size) return nullptr;
+            if (!keep_position_info) return this->advance(this->root->minimum(), index);
+
+            auto node = this->root;
+            for (;;) {
+                const size_type k = node->num_of_left_children();
+                if (index < k) {
+                    node = node->left;
+                } else if (index == k) {
+                    return node;
+                } else {
+                    index -= k + 1;
+                    node = node->right;
+                }
+            }
+        }
+
+        template<typename _K>
+        nodeptr_t find(const _K& val) {
+            return this->find(val, three_way_t<compared_type,_K>());
+        }
+
+        template<typename _K>
+        const_nodeptr_t find(const _K& val) const {
+            return const_cast<RBTreeImpl*>(this)->find(val, three_way_t<compared_type,_K>());
+        }
+
+        template<typename _K>
+        nodeptr_t find(const _K& val, std::false_type) {
+            auto node = this->lower_bound(val);
+            return node && !this->rb_comp(val, value_of(node)) ? node : nullptr;
+        }
+
+        /** a single comparison at each level, the first equal node is taken unless it's a multi tree */
+        template<typename _K>
+        nodeptr_t find(const _K& val, std::true_type) {
+            nodeptr_t ans = nullptr;
+            for (auto node=this->root;node!=nullptr;) {
+                const int order = this->rb_order(value_of(node), val);
+                if (order < 0) {
+                    node = node->right;
+                } else {
+                    if (order == 0) {
+                        if (!multi) return node;
+                        ans = node;
+                    }
+                    node = node->left;
+                }
+            }
+            return ans;
+        }
+
+        template<typename _K>
+        size_type count(const _K& val) const {
+            if (!keep_position_info) {
+                size_type n = 0;
+                for (auto node=this->lower_bound(val), ub=this->upper_bound(val);node!=ub;node=node->next()) n++;
+                return n;
+            }
+            return this->upper_bound_with_rank(val).second - this->lower_bound_with_rank(val).second;
+        }
+
+        nodeptr_t begin() {
+            if (!this->root) return nullptr;
+
+            return this->minimum(this->root);
+        }
+
+        const_nodeptr_t begin() const {
+            if (!this->root) return nullptr;
+
+            return this->minimum(this->root);
+        }
+
+        nodeptr_t rbegin() {
+            if (!this->root) return nullptr;
+
+            return this->maximum(this->root);
+        }
+
+        const_nodeptr_t rbegin() const {
+            if (!this->root) return nullptr;
+
+            return this->maximum(this->root);
+        }
+
+        // TODO prototype
+        nodeptr_t advance(nodeptr_t node, long n) const {
+            if (rbtree_node_type::Threaded && node != nullptr && (n == 1 || n == -1)) {
+                return n == 1 ? node->next() : node->prev();
+            }
+
+            // node == nullptr represent end
+            if (node == nullptr) {
+                if (!keep_position_info) {
+                    if (n >= 0 || this->root == nullptr) return nullptr;
+                    return this->root->maximum()->advance(n + 1);
+                }
+
+                // TODO why this->root (shoud be const qualified) can assign to node
+                node = this->root;
+                n += node && node->right ? node->right->num_of_nodes() + 1 : 1;
+            }
+
+            return node->advance(n);
+        }
+
+        inline size_type size() const {
+            return this->_size;
+        }
+
+        static inline size_type max_size() {
+            return keep_position_info ? std::numeric_limits<SizeT>::max() : std::numeric_limits<size_type>::max();
+        }
+
+        inline void check_capacity(size_t n) const {
+            if (n > this->max_size()) {
+                throw std::length_error("number of nodes exceeds the capacity of node counter");
+            }
+        }
+
+        inline size_t version() const {
+            return this->_version;
         }
 
         void copy_to(RBTreeImpl& target) const {
-            target.~RBTreeImpl();
+            target.clear();
             target._version++;
             target._size = this->_size;
             if (!this->root) return;
@@ -1475,9 +3734,8 @@ class RBTreeImpl {
             nodeptr_t parent_node = nullptr;
             nodeptr_t* pptr = &target.root;
             for (nodeptr_t node=this->root;node!=nullptr;) {
-                auto val = node->value;
                 nodeptr_t new_node = target.construct_node(*node);
-                new_node->parent = parent_node;
+                new_node->set_parent(parent_node);
                 *pptr = new_node;
 
                 if (node->left) {
@@ -1495,9 +3753,9 @@ class RBTreeImpl {
                 }
 
                 pptr = nullptr;
-                for (;node && node->parent;) {
+                for (;node && node->parent();) {
                     auto old_node = node;
-                    node = node->parent;
+                    node = node->parent();
                     RB_ASSERT(parent_node);
 
                     if (node->left == old_node && node->right) {
@@ -1505,7 +3763,7 @@ class RBTreeImpl {
                         pptr = &parent_node->right;
                         break;
                     } else {
-                        parent_node = parent_node->parent;
+                        parent_node = parent_node->parent();
                     }
                 }
                 RB_ASSERT(pptr != nullptr || node == this->root);
@@ -1513,41 +3771,184 @@ class RBTreeImpl {
                     break;
                 }
             }
+
+            if (rbtree_node_type::Threaded) {
+                nodeptr_t prev = nullptr;
+                for (auto node=target.root->minimum();node!=nullptr;prev=node,node=node->tree_next()) {
+                    node->thread_between(prev, nullptr);
+                }
+            }
+        }
+
+        /**
+         * see copy_to(), the left and right subtrees are cloned as two tasks of executor while they hold at least
+         * grain nodes. Each task allocates from its own copy of the allocator, so the tree is copied serially unless
+         * the allocator is rbtree_allocator_concurrent. If target has a node pool the nodes are taken from it on
+         * the calling thread beforehand and each task constructs the values in its own range of them, which needs
+         * the allocator only if the values use it
+         */
+        template<typename Executor>
+        void parallel_copy_to(RBTreeImpl& target, Executor& executor, size_type grain) const {
+            const bool pooled = target.pool.active();
+            if (this->_size < grain || !(rbtree_allocator_concurrent<storage_allocator_>::value || (pooled && !uses_allocator_::value))) {
+                this->copy_to(target);
+                return;
+            }
+
+            target.clear();
+            target._version++;
+            if (!pooled) {
+                clone_source source(target.allocator, nullptr);
+                target.root = this->clone(this->root, this->_size, source, executor, grain);
+            } else {
+                std::vector<nodeptr_t> slots(this->_size);
+                target.pool.reserve(target.allocator, this->_size);
+                for (auto& slot: slots) slot = target.pool.allocate(target.allocator);
+                clone_source source(target.allocator, slots.data());
+                try {
+                    target.root = this->clone(this->root, this->_size, source, executor, grain);
+                } catch (...) {
+                    // the values of the clone are destroyed already, all nodes go back to the pool
+                    for (auto slot: slots) target.pool.deallocate(target.allocator, slot);
+                    throw;
+                }
+            }
+            target._size = this->_size;
+            target.parallel_rethread(executor, grain);
+        }
+
+    private:
+        /** nodes of a parallel clone, slots are the nodes taken from the pool of the target if it has one */
+        struct clone_source {
+            const storage_allocator_& allocator;
+            nodeptr_t* slots;
+            std::atomic<size_type> next;
+
+            clone_source(const storage_allocator_& allocator, nodeptr_t* slots): allocator(allocator), slots(slots), next(0) {}
+
+            /** range of n slots of a task */
+            inline nodeptr_t* claim(size_type n) {
+                return this->slots ? this->slots + this->next.fetch_add(n) : nullptr;
+            }
+        };
+
+        /** nodes of a task, taken from its range of slots or from its copy of the allocator */
+        struct clone_nodes {
+            storage_allocator_ alloc;
+            nodeptr_t* slot;
+
+            clone_nodes(const storage_allocator_& allocator, nodeptr_t* slot): alloc(allocator), slot(slot) {}
+
+            inline nodeptr_t allocate() {
+                return this->slot ? *this->slot++ : this->alloc.allocate(1);
+            }
+
+            /** slots are given back to the pool by parallel_copy_to() */
+            inline void deallocate(nodeptr_t node) {
+                if (!this->slot) this->alloc.deallocate(node, 1);
+            }
+        };
+
+        template<typename Executor>
+        nodeptr_t clone(const_nodeptr_t t, size_type estimate, clone_source& source, Executor& executor, size_type grain) const {
+            if (estimate < grain) {
+                clone_nodes nodes(source.allocator, source.slots ? source.claim(count_nodes(t)) : nullptr);
+                return this->clone(t, nodes);
+            }
+
+            clone_nodes nodes(source.allocator, source.claim(1));
+            auto node = this->clone_node(t, nodes);
+            nodeptr_t left = nullptr, right = nullptr;
+            try {
+                executor(
+                    [&]() { if (t->left) left = this->clone(t->left, estimate / 2, source, executor, grain); },
+                    [&]() { if (t->right) right = this->clone(t->right, estimate / 2, source, executor, grain); });
+            } catch (...) {
+                // a task which threw has released its part already
+                destroy_clone(left, nodes);
+                destroy_clone(right, nodes);
+                destroy_clone(node, nodes);
+                throw;
+            }
+            adopt_children(node, left, right);
+            return node;
+        }
+
+        /** the depth of the recursion is the height of the tree */
+        nodeptr_t clone(const_nodeptr_t t, clone_nodes& nodes) const {
+            auto node = this->clone_node(t, nodes);
+            nodeptr_t left = nullptr, right = nullptr;
+            try {
+                if (t->left) left = this->clone(t->left, nodes);
+                if (t->right) right = this->clone(t->right, nodes);
+            } catch (...) {
+                destroy_clone(left, nodes);
+                destroy_clone(node, nodes);
+                throw;
+            }
+            adopt_children(node, left, right);
+            return node;
+        }
+
+        static nodeptr_t clone_node(const_nodeptr_t t, clone_nodes& nodes) {
+            auto ptr = nodes.allocate();
+            try {
+                return rbtree_new_node(ptr, uses_allocator_(), nodes.alloc, *t);
+            } catch (...) {
+                nodes.deallocate(ptr);
+                throw;
+            }
+        }
+
+        /** nodes of the subtree t, they're counted if the nodes don't keep their number */
+        static size_type count_nodes(const_nodeptr_t t) {
+            if (keep_position_info || t == nullptr) return subtree_size(t);
+            return 1 + count_nodes(t->left) + count_nodes(t->right);
+        }
+
+        static void adopt_children(nodeptr_t node, nodeptr_t left, nodeptr_t right) {
+            node->left = left;
+            node->right = right;
+            if (left) left->set_parent(node);
+            if (right) right->set_parent(node);
         }
 
+        static void destroy_clone(nodeptr_t t, clone_nodes& nodes) {
+            if (t == nullptr) return;
+            destroy_clone(t->left, nodes);
+            destroy_clone(t->right, nodes);
+            t->left = t->right = nullptr;
+            t->~rbtree_node_type();
+            nodes.deallocate(t);
+        }
+
+    public:
+
         Compare cmp_object() const {
             return this->cmp;
         }
 
+        /** make sure that tree can hold n nodes without allocation */
+        void reserve(size_type n) {
+            if (n > this->_size) {
+                this->pool.reserve(this->allocator, n - this->_size);
+            }
+        }
+
+        void shrink_to_fit() {
+            this->pool.shrink_to_fit(this->allocator);
+        }
+
+        inline size_type capacity() const {
+            return this->_size - this->pool.in_use() + this->pool.capacity();
+        }
+
         Alloc get_allocator() const {
             return this->allocator;
         }
 
         void clear() {
-            if (!this->root) return;
-
-            for(auto node=this->root;node!=nullptr;) {
-                if (node->left) {
-                    node = node->left;
-                } else if (node->right) {
-                    node = node->right;
-                } else {
-                    auto deadnode = node;
-                    node = node->parent;
-                    if (node) {
-                        if (node->left == deadnode) {
-                            node->left = nullptr;
-                        } else {
-                            RB_ASSERT(node->right == deadnode);
-                            node->right = nullptr;
-                        }
-                    }
-                    this->delete_node(deadnode);
-                }
-            }
-            this->root = nullptr;
-            this->_version++;
-            this->_size = 0;
+            this->clear_nodes(this->bulk_releasable());
         }
 
         void convert2BST() {
@@ -1557,15 +3958,139 @@ class RBTreeImpl {
             this->root = head->fromList();
         }
 
+        /**
+         * move the values into one new chunk of the pool in sorted order and rebuild a balanced tree,
+         * the old nodes and the unused chunks of the pool are released afterwards. Without reserve() the
+         * chunk is dedicated, later nodes come from the allocator and the chunk is released with its last node.
+         * values are copied if their move constructor may throw, the tree is unchanged if that fails
+         */
+        void compact() {
+            static_assert(!Intrusive, "nodes of intrusive tree are owned by user");
+            if (this->root == nullptr) {
+                this->pool.shrink_to_fit(this->allocator);
+                return;
+            }
+
+            const size_type n = this->_size;
+            auto nodes = this->pool.allocate_chunk(this->allocator, n);
+            size_type i = 0;
+            try {
+                for (auto node=this->root->minimum();node!=nullptr;node=node->next(),i++) {
+                    new (nodes + i) rbtree_node_type(std::move_if_noexcept(node->value));
+                    if (i > 0) nodes[i-1].right = nodes + i;
+                }
+            } catch (...) {
+                for (size_type k=0;k<n;k++) {
+                    if (k < i) {
+                        nodes[k].right = nullptr;
+                        nodes[k].~rbtree_node_type();
+                    }
+                    this->deallocate_node(nodes + k);
+                }
+                this->pool.shrink_to_fit(this->allocator);
+                throw;
+            }
+
+            this->construct_from_nodelist(nodes);
+            this->pool.shrink_to_fit(this->allocator);
+        }
+
         void construct_from_nodelist(nodeptr_t head) {
-            this->clear();
+            this->clear_nodes(false);
             if (head == nullptr) return;
             size_type size = 0;
             for (auto h=head;h!=nullptr;h=h->right,size++) {}
+            this->check_capacity(size);
             this->root = head->fromList();
             this->_size = size;
         }
 
+        /** the tree of nodes, which are in order, the previous nodes of the tree are left alone since they're reused */
+        void construct_from_nodes(const std::vector<nodeptr_t>& nodes) {
+            for (auto node: nodes) this->mark_linked(node);
+            this->root = rbtree_node_type::fromArray(nodes.data(), nodes.size());
+            this->_size = nodes.size();
+            this->_version++;
+        }
+
+        /**
+         * move the nodes of source into this tree unless an equal value is in it already, like std::set::merge().
+         * both sequences of nodes are merged in order and both trees are rebuilt, so it's O(n + m) and nodes are
+         * reused, except that nodes in the pool of source are moved out of it.
+         * source may be ordered by another comparator, then its nodes are sorted first
+         */
+        template<typename Tree>
+        void merge(Tree& source) {
+            if (source.size() == 0) return;
+
+            std::vector<nodeptr_t> nodes, merged, rejected;
+            std::vector<bool> moved;
+            nodes.reserve(source.size());
+            merged.reserve(this->_size + source.size());
+            moved.reserve(this->_size + source.size());
+            for (auto node=source.begin();node!=nullptr;node=node->next()) nodes.push_back(node);
+            this->sort_nodes(nodes);
+
+            auto node = this->root ? this->root->minimum() : nullptr;
+            for (auto b: nodes) {
+                for (;node!=nullptr && !this->rb_comp(value_of(b), value_of(node));node=node->next()) {
+                    merged.push_back(node);
+                    moved.push_back(false);
+                }
+                // equal values are next to each other, so a duplicate of b is the last node taken
+                if (!multi && !merged.empty() && !this->rb_comp(value_of(merged.back()), value_of(b))) {
+                    rejected.push_back(b);
+                } else {
+                    merged.push_back(b);
+                    moved.push_back(true);
+                }
+            }
+            for (;node!=nullptr;node=node->next()) {
+                merged.push_back(node);
+                moved.push_back(false);
+            }
+            // the rejected duplicates don't count, neither tree has been changed yet
+            this->check_capacity(merged.size());
+
+            size_t i = 0;
+            try {
+                for (;i<merged.size();i++) {
+                    if (!moved[i]) continue;
+                    merged[i]->left = merged[i]->right = nullptr;
+                    merged[i]->set_parent(nullptr);
+                    auto taken = merged[i];
+                    merged[i] = source.release_node(taken);
+                    source.mark_removed(taken);
+                }
+            } catch (...) {
+                // the nodes which haven't left the pool of source stay there
+                size_t k = 0;
+                for (size_t j=0;j<merged.size();j++) {
+                    if (j >= i && moved[j]) {
+                        rejected.push_back(merged[j]);
+                    } else {
+                        merged[k++] = merged[j];
+                    }
+                }
+                merged.resize(k);
+                source.sort_nodes(rejected);
+                this->construct_from_nodes(merged);
+                source.construct_from_nodes(rejected);
+                throw;
+            }
+            source.sort_nodes(rejected);
+            this->construct_from_nodes(merged);
+            source.construct_from_nodes(rejected);
+        }
+
+        /** sort nodes in the order of this tree, it's stable */
+        void sort_nodes(std::vector<nodeptr_t>& nodes) const {
+            auto comp = [this](const_nodeptr_t x, const_nodeptr_t y) { return this->rb_comp(value_of(x), value_of(y)); };
+            if (!std::is_sorted(nodes.begin(), nodes.end(), comp)) {
+                std::stable_sort(nodes.begin(), nodes.end(), comp);
+            }
+        }
+
 #if __cplusplus >= 202002
         template<std::forward_iterator Iter>
 #else
@@ -1580,7 +4105,8 @@ class RBTreeImpl {
                     head = n;
                     node = n;
                 } else {
-                    if (!(rbvalue_compare(this->cmp, node->value, n->value) || (multi && rbvalue_equal(node->value,n->value)))) {
+                    if (!(this->rb_comp(value_of(node), value_of(n)) || (multi && this->rb_equal(value_of(node), value_of(n))))) {
+                        this->delete_node(n);
                         failure = true;
                         break;
                     }
@@ -1591,8 +4117,11 @@ class RBTreeImpl {
             }
 
             if (failure) {
-                for (auto n=head;n!=nullptr;n=n->right) {
+                for (auto n=head;n!=nullptr;) {
+                    auto next = n->right;
+                    n->right = nullptr;
                     this->delete_node(n);
+                    n = next;
                 }
             } else {
                 this->construct_from_nodelist(head);
@@ -1600,6 +4129,59 @@ class RBTreeImpl {
             return !failure;
         }
 
+        /**
+         * insert the values of [begin, end) by sorting them, merging them with the values of the tree
+         * and rebuilding it, O(n + m lg m). Equal values end up in the order sequential insertions
+         * would give, in unique trees they are assigned to the value which is kept
+         */
+#if __cplusplus >= 202002
+        template<std::forward_iterator Iter>
+#else
+        template<typename Iter>
+#endif // __cplusplus >= 202002
+        void insert_by_rebuild(Iter begin, Iter end) {
+            static_assert(!Intrusive, "nodes of intrusive tree are owned by user");
+            std::vector<nodeptr_t> nodes, merged;
+            // duplicates in a unique tree and the nodes whose values are assigned to them
+            std::vector<std::pair<nodeptr_t,nodeptr_t>> duplicates;
+            try {
+                nodes.reserve(std::distance(begin, end));
+                merged.reserve(this->_size + nodes.capacity());
+                for (;begin!=end;begin++) nodes.push_back(this->construct_node(*begin));
+                std::stable_sort(nodes.begin(), nodes.end(), [this](const_nodeptr_t a, const_nodeptr_t b) {
+                    return this->rb_comp(value_of(a), value_of(b));
+                });
+
+                auto node = this->root ? this->root->minimum() : nullptr;
+                for (size_t i=0;node!=nullptr || i<nodes.size();) {
+                    if (i < nodes.size() && (node == nullptr || this->rb_comp(value_of(nodes[i]), value_of(node)))) {
+                        auto next = nodes[i++];
+                        if (!multi && !merged.empty() && !this->rb_comp(value_of(merged.back()), value_of(next))) {
+                            duplicates.emplace_back(merged.back(), next);
+                        } else {
+                            merged.push_back(next);
+                        }
+                    } else {
+                        merged.push_back(node);
+                        node = node->next();
+                    }
+                }
+                // the tree is left alone until the merged values are known to fit
+                this->check_capacity(merged.size());
+            } catch (...) {
+                for (auto node: nodes) this->delete_node(node);
+                throw;
+            }
+
+            for (auto& dup: duplicates) {
+                dup.first->value.assign_value(std::move(dup.second->value));
+                this->delete_node(dup.second);
+            }
+            this->root = rbtree_node_type::fromArray(merged.data(), merged.size());
+            this->_size = merged.size();
+            this->_version++;
+        }
+
         RBTreeImpl(): root(nullptr), _version(0), _size(0) {
         }
         RBTreeImpl(const Compare& cmp, const Alloc& alloc): root(nullptr), _version(0), _size(0), cmp(cmp), allocator(alloc) {
@@ -1609,65 +4191,1976 @@ class RBTreeImpl {
 
         ~RBTreeImpl() {
             this->clear();
+            this->pool.release(this->allocator);
         }
 };
 
 
-template<typename T>
-struct IsRBTreeImpl : std::false_type {};
-template<typename T1, typename T2, bool V1, bool V2, typename T4, typename T5>
-struct IsRBTreeImpl<RBTreeImpl<T1,T2,V1,V2,T4,T5>> : std::true_type {};
-#if __cplusplus >= 202002
-template<typename T>
-concept C_RBTreeImpl = IsRBTreeImpl<T>::value;
-#endif // __cplusplus >= 202002
+#if __cplusplus >= 201703
+/** links shared by leaves and inner nodes of BPTreeImpl, count is the number of slots or children */
+struct BPTreeNodeBase {
+    BPTreeNodeBase* parent;
+    unsigned count;
+    bool leaf;
 
+    explicit BPTreeNodeBase(bool leaf): parent(nullptr), count(0), leaf(leaf) {}
+};
 
-template<bool reverse, bool const_iterator, typename RBTreeType>
-struct DummyIterator {
-    using rbtree_t = RBTreeType;
-    using nodeptr_t = typename rbtree_t::nodeptr_t;
+/** bytes before the first slot of a leaf */
+template<typename S>
+constexpr size_t bptree_leaf_header() {
+    return (sizeof(BPTreeNodeBase) + 2 * sizeof(void*) + alignof(S) - 1) / alignof(S) * alignof(S);
+}
 
-    DummyIterator(std::weak_ptr<rbtree_t> tree, nodeptr_t node, size_t version) {}
-};
+/** size of a leaf, it's a power of two which leaves are aligned to and it holds at least 8 values */
+template<typename S>
+constexpr size_t bptree_leaf_bytes() {
+    size_t bytes = 512;
+    for (;(bytes - bptree_leaf_header<S>()) / sizeof(S) < 8;) bytes *= 2;
+    return bytes;
+}
+
+template<typename S>
+struct BPTreeLeaf;
+
+/** value of BPTreeImpl, it's either in a leaf or detached and owned by a node handle */
+template<typename S>
+struct BPTreeSlot {
+    using storage_type = S;
+    S value;
 
 #if __cplusplus >= 202002
-template<bool reverse, bool const_iterator, C_RBTreeImpl RBTreeType>
+    template<typename St> requires (!C_is_same_value_type<St,BPTreeSlot>)
 #else
-template<bool reverse, bool const_iterator, typename RBTreeType, typename std::enable_if<IsRBTreeImpl<RBTreeType>::value,bool>::type = true>
+    template<typename St, typename std::enable_if<!is_same_value_type<St,BPTreeSlot>::value, bool>::type = true>
 #endif // __cplusplus >= 202002
-class RBTreeImplIterator {
-    public:
-        using rbtree_t = RBTreeType;
-        using storage_type = typename rbtree_t::storage_type;
-        using nodeptr_t = typename rbtree_t::nodeptr_t;
-        using const_nodeptr_t = typename rbtree_t::const_nodeptr_t;
-        using const_iterator_alt_t = typename std::conditional<const_iterator,DummyIterator<reverse,true,RBTreeType>,RBTreeImplIterator<reverse,true,RBTreeType>>::type;
+    explicit BPTreeSlot(St&& val): value(std::forward<St>(val)) {}
 
-        using iterator_category = typename std::conditional<RBTreeType::PositionInformation, std::random_access_iterator_tag, std::bidirectional_iterator_tag>::type;
-        using value_type = typename storage_type::storage_type_base;
-        using difference_type = long;
-        using pointer = value_type*;
-        using reference = typename std::conditional<const_iterator, const value_type&, value_type&>::type;
-        using const_reference = const value_type&;
+    /** the value is constructed from several arguments, e.g. std::piecewise_construct and two tuples */
+#if __cplusplus >= 202002
+    template<typename T1, typename T2, typename ... Args> requires std::constructible_from<S,T1&&,T2&&,Args&&...>
+#else
+    template<typename T1, typename T2, typename ... Args,
+             typename std::enable_if<std::is_constructible<S,T1&&,T2&&,Args&&...>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+    BPTreeSlot(T1&& a1, T2&& a2, Args&& ... args):
+        value(std::forward<T1>(a1), std::forward<T2>(a2), std::forward<Args>(args)...) {}
 
-    private:
-        std::weak_ptr<rbtree_t> tree;
-        nodeptr_t node;
-        size_t version;
+    template<typename A>
+    BPTreeSlot(std::allocator_arg_t tag, const A& alloc, const BPTreeSlot& oth): value(tag, alloc, oth.value) {}
 
-        std::shared_ptr<rbtree_t> check_version() const {
-            auto tree = this->tree.lock();
-            if (!tree) {
-                throw std::logic_error("access invalid iterator");
-            }
+    BPTreeSlot(const BPTreeSlot&) = default;
+    BPTreeSlot(BPTreeSlot&&) = default;
+    BPTreeSlot(rbtree_relocate_t tag, BPTreeSlot& oth) noexcept(std::is_nothrow_constructible<S,rbtree_relocate_t,S&>::value):
+        value(tag, oth.value) {}
 
-            if (tree->version() != this->version) {
-            }
+    /** neighbours of a slot in a leaf, nullptr at both ends */
+    inline BPTreeSlot* next();
+    inline BPTreeSlot* prev();
+
+    inline const BPTreeSlot* next() const {
+        return const_cast<BPTreeSlot*>(this)->next();
+    }
+
+    inline const BPTreeSlot* prev() const {
+        return const_cast<BPTreeSlot*>(this)->prev();
+    }
+};
+
+template<typename S>
+struct alignas(bptree_leaf_bytes<S>()) BPTreeLeaf: public BPTreeNodeBase {
+    using slot_type = BPTreeSlot<S>;
+    constexpr static size_t bytes = bptree_leaf_bytes<S>();
+    constexpr static unsigned capacity = (bytes - bptree_leaf_header<S>()) / sizeof(S);
+
+    BPTreeLeaf* prev;
+    BPTreeLeaf* next;
+    alignas(S) unsigned char data[capacity * sizeof(S)];
+
+    BPTreeLeaf(): BPTreeNodeBase(true), prev(nullptr), next(nullptr) {}
+
+    inline slot_type* slot(size_t i) {
+        return reinterpret_cast<slot_type*>(this->data) + i;
+    }
+
+    inline const slot_type* slot(size_t i) const {
+        return reinterpret_cast<const slot_type*>(this->data) + i;
+    }
+
+    inline unsigned indexof(const slot_type* s) const {
+        return s - this->slot(0);
+    }
+
+    static inline BPTreeLeaf* of(const slot_type* s) {
+        return reinterpret_cast<BPTreeLeaf*>(reinterpret_cast<std::uintptr_t>(s) & ~static_cast<std::uintptr_t>(bytes - 1));
+    }
+};
+
+template<typename S>
+inline BPTreeSlot<S>* BPTreeSlot<S>::next() {
+    auto leaf = BPTreeLeaf<S>::of(this);
+    if (this + 1 != leaf->slot(leaf->count)) return this + 1;
+    return leaf->next ? leaf->next->slot(0) : nullptr;
+}
+
+template<typename S>
+inline BPTreeSlot<S>* BPTreeSlot<S>::prev() {
+    auto leaf = BPTreeLeaf<S>::of(this);
+    if (this != leaf->slot(0)) return this - 1;
+    return leaf->prev ? leaf->prev->slot(leaf->prev->count - 1) : nullptr;
+}
+
+/** inner node of BPTreeImpl, key(i) separates child i and child i + 1, counts[i] is the number of values below child i */
+template<typename K, typename SizeT>
+struct BPTreeInner: public BPTreeNodeBase {
+    constexpr static unsigned capacity =
+        (512 - sizeof(BPTreeNodeBase)) / (sizeof(K) + sizeof(SizeT) + sizeof(void*)) > 8 ?
+        (512 - sizeof(BPTreeNodeBase)) / (sizeof(K) + sizeof(SizeT) + sizeof(void*)) : 8;
+
+    SizeT counts[capacity];
+    BPTreeNodeBase* children[capacity];
+    alignas(K) unsigned char data[(capacity - 1) * sizeof(K)];
+
+    BPTreeInner(): BPTreeNodeBase(false) {}
+
+    inline K* key(size_t i) {
+        return reinterpret_cast<K*>(this->data) + i;
+    }
+
+    inline const K* key(size_t i) const {
+        return reinterpret_cast<const K*>(this->data) + i;
+    }
+
+    inline unsigned indexof(const BPTreeNodeBase* child) const {
+        unsigned i = 0;
+        for (;this->children[i] != child;i++) {
+            RB_ASSERT(i + 1 < this->count);
+        }
+        return i;
+    }
+};
+
+template<typename K>
+inline const K& bptree_key_of(const RBTreeValueK<K>& v) { return v.key; }
+template<typename K, typename V>
+inline const K& bptree_key_of(const RBTreeValueKV<K,V>& v) { return v.first; }
+template<typename K, typename V, typename Alloc>
+inline const K& bptree_key_of(const RBTreeValueKVSplit<K,V,Alloc>& v) { return v.first; }
+
+/**
+ * B+tree with the interface of RBTreeImpl. values live in slots of wide leaves, and inner nodes
+ * keep the number of values below each child, so that advance() and indexof() are O(log n).
+ * values are relocated by insertion and erasure, which invalidate all iterators.
+ */
+template<
+    typename _Key, typename _Value, bool multi, bool keep_position_info=true,
+#if __cplusplus >= 202002
+    C_KeyCompare<_Key> Compare = default_compare_t<_Key>,
+#else
+    typename Compare = default_compare_t<_Key>,
+#endif // __cplusplus >= 202002
+    typename Alloc = default_allocato_t<_Key,_Value>, typename SizeT = size_t>
+class BPTreeImpl {
+    public:
+        using storage_type = rbtree_storage_type<_Key,_Value,Alloc>;
+        using rbtree_node_type = BPTreeSlot<storage_type>;
+        using nodeptr_t = rbtree_node_type*;
+        using const_nodeptr_t = const rbtree_node_type*;
+        using key_type = _Key;
+        using mapped_type = rbtree_mapped_type<_Key,_Value>;
+        using value_type = typename storage_type::storage_type_base;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using key_compare = Compare;
+        using allocator_type = Alloc;
+        using reference = value_type&;
+        using const_reference = const value_type&;
+        using pointer = typename std::allocator_traits<Alloc>::pointer;
+        using const_pointer = typename std::allocator_traits<Alloc>::const_pointer;
+        constexpr static bool PositionInformation = true;
+        constexpr static bool RelocatesValues = true;
+        constexpr static bool Intrusive = false;
+        using storage_allocator_ = typename std::allocator_traits<Alloc>::template rebind_alloc<rbtree_node_type>;
+        using uses_allocator_ = std::integral_constant<bool,rbtree_uses_allocator<storage_type>::value>;
+        static_assert(std::is_integral<SizeT>::value && std::is_unsigned<SizeT>::value, "counter should be an unsigned integer");
+        static_assert(!IsRBTreeValueHook<storage_type>::value, "intrusive trees aren't supported by B+tree");
+        static_assert(std::is_copy_constructible<key_type>::value, "keys are duplicated in inner nodes");
+        static_assert(sizeof(BPTreeLeaf<storage_type>) == BPTreeLeaf<storage_type>::bytes, "slots should fit in the leaf");
+
+    private:
+        using node_base = BPTreeNodeBase;
+        using leaf_type = BPTreeLeaf<storage_type>;
+        using inner_type = BPTreeInner<key_type,SizeT>;
+        using leaf_allocator_ = typename std::allocator_traits<Alloc>::template rebind_alloc<leaf_type>;
+        using inner_allocator_ = typename std::allocator_traits<Alloc>::template rebind_alloc<inner_type>;
+        constexpr static unsigned leaf_min = leaf_type::capacity / 2;
+        constexpr static unsigned inner_min = inner_type::capacity / 2;
+
+        node_base* root;
+        leaf_type* head;
+        leaf_type* tail;
+        size_t _version, _size;
+        Compare cmp;
+        storage_allocator_ allocator;
+        /** leaves kept by reserve(), they're linked by next */
+        leaf_type* spare;
+        size_t n_spare, spare_limit;
+        /** inner nodes allocated before a split, they're linked by parent */
+        node_base* spare_inner;
+        size_t n_spare_inner;
+
+        template<typename T>
+        using is_storage = is_same_value_type<T,storage_type>;
+
+        template<typename T1, typename T2>
+        inline bool bp_comp(const T1& a, const T2& b) const {
+            return this->bp_comp(a, b, std::integral_constant<bool,is_storage<T1>::value || is_storage<T2>::value>());
+        }
+
+        template<typename T1, typename T2>
+        inline bool bp_comp(const T1& a, const T2& b, std::true_type) const {
+            return rbvalue_compare(this->cmp, a, b);
+        }
+
+        /** separators of inner nodes are keys */
+        template<typename T1, typename T2>
+        inline bool bp_comp(const T1& a, const T2& b, std::false_type) const {
+            return this->cmp(a, b);
+        }
+
+        constexpr static bool nothrow_relocate = std::is_nothrow_constructible<rbtree_node_type,rbtree_relocate_t,rbtree_node_type&>::value;
+
+        /**
+         * the value of src, its key included, is moved to dst and src is destroyed. A value whose move
+         * may throw is copied instead, so that src is left as it was if it throws
+         */
+        static inline void relocate(rbtree_node_type* dst, rbtree_node_type* src) noexcept(nothrow_relocate) {
+            if constexpr (nothrow_relocate || !std::is_copy_constructible<rbtree_node_type>::value) {
+                new (dst) rbtree_node_type(rbtree_relocate_t(), *src);
+            } else {
+                new (dst) rbtree_node_type(static_cast<const rbtree_node_type&>(*src));
+            }
+            src->~rbtree_node_type();
+        }
+
+        /** the value of the detached node is moved into the tree, node is left as it was if that throws */
+        static inline void insert_slot(rbtree_node_type* dst, rbtree_node_type& node) noexcept(nothrow_relocate) {
+            if constexpr (nothrow_relocate) {
+                new (dst) rbtree_node_type(rbtree_relocate_t(), node);
+            } else {
+                new (dst) rbtree_node_type(std::move_if_noexcept(node));
+            }
+        }
+
+        static inline void relocate(key_type* dst, key_type* src) {
+            new (dst) key_type(std::move(*src));
+            src->~key_type();
+        }
+
+        /** move n slots of src to dst, ranges may overlap. If a slot throws, the ones moved before it are moved back */
+        static void move_slots(rbtree_node_type* dst, rbtree_node_type* src, size_t n) noexcept(nothrow_relocate) {
+            if (dst == src || n == 0) return;
+            if constexpr (std::is_trivially_copyable<storage_type>::value) {
+                std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(rbtree_node_type));
+            } else if constexpr (nothrow_relocate) {
+                for (size_t i=0;i<n;i++) {
+                    const size_t j = dst < src ? i : n - 1 - i;
+                    relocate(dst + j, src + j);
+                }
+            } else {
+                size_t i = 0;
+                try {
+                    for (;i<n;i++) {
+                        const size_t j = dst < src ? i : n - 1 - i;
+                        relocate(dst + j, src + j);
+                    }
+                } catch (...) {
+                    if (dst < src) {
+                        move_slots_back(src, dst, i);
+                    } else {
+                        move_slots_back(src + n - i, dst + n - i, i);
+                    }
+                    throw;
+                }
+            }
+        }
+
+        /** undo move_slots(), a value which throws again can't be put back */
+        static void move_slots_back(rbtree_node_type* dst, rbtree_node_type* src, size_t n) noexcept {
+            move_slots(dst, src, n);
+        }
+
+        static void move_keys(key_type* dst, key_type* src, size_t n) {
+            if (dst == src || n == 0) return;
+            if (dst < src) {
+                for (size_t i=0;i<n;i++) relocate(dst + i, src + i);
+            } else {
+                for (size_t i=n;i>0;i--) relocate(dst + i - 1, src + i - 1);
+            }
+        }
+
+        static inline const key_type& first_key(const node_base* node) {
+            for (;!node->leaf;) node = static_cast<const inner_type*>(node)->children[0];
+            return bptree_key_of(static_cast<const leaf_type*>(node)->slot(0)->value);
+        }
+
+        static inline SizeT total_of(const inner_type* node) {
+            SizeT ans = 0;
+            for (unsigned i=0;i<node->count;i++) ans += node->counts[i];
+            return ans;
+        }
+
+        leaf_type* new_leaf() {
+            leaf_type* leaf = this->spare;
+            if (leaf != nullptr) {
+                this->spare = leaf->next;
+                this->n_spare--;
+            } else {
+                leaf_allocator_ alloc(this->allocator);
+                leaf = std::allocator_traits<leaf_allocator_>::allocate(alloc, 1);
+                if (reinterpret_cast<std::uintptr_t>(leaf) % leaf_type::bytes != 0) {
+                    std::allocator_traits<leaf_allocator_>::deallocate(alloc, leaf, 1);
+                    throw std::logic_error("allocator doesn't respect alignment of leaves");
+                }
+            }
+            return new (leaf) leaf_type();
+        }
+
+        void free_leaf(leaf_type* leaf) {
+            if (this->n_spare < this->spare_limit) {
+                leaf->next = this->spare;
+                this->spare = leaf;
+                this->n_spare++;
+            } else {
+                leaf_allocator_ alloc(this->allocator);
+                std::allocator_traits<leaf_allocator_>::deallocate(alloc, leaf, 1);
+            }
+        }
+
+        /** a detached slot, see rbtree_new_node() */
+        template<typename ... Args>
+        rbtree_node_type make_slot(Args&& ... args) {
+            if constexpr (uses_allocator_::value) {
+                return rbtree_node_type(std::allocator_arg, this->allocator, std::forward<Args>(args)...);
+            } else {
+                return rbtree_node_type(std::forward<Args>(args)...);
+            }
+        }
+
+        inner_type* new_inner() {
+            if (this->spare_inner != nullptr) {
+                auto node = this->spare_inner;
+                this->spare_inner = node->parent;
+                this->n_spare_inner--;
+                return new (node) inner_type();
+            }
+            inner_allocator_ alloc(this->allocator);
+            return new (std::allocator_traits<inner_allocator_>::allocate(alloc, 1)) inner_type();
+        }
+
+        /** allocate the inner nodes which a split of leaf takes, so that linking it in can't fail */
+        void reserve_inners(const leaf_type* leaf) {
+            size_t n = 0;
+            auto node = leaf->parent;
+            for (;node!=nullptr && node->count == inner_type::capacity;node=node->parent) n++;
+            if (node == nullptr) n++;
+            for (;this->n_spare_inner < n;) {
+                inner_allocator_ alloc(this->allocator);
+                node_base* spare = new (std::allocator_traits<inner_allocator_>::allocate(alloc, 1)) inner_type();
+                spare->parent = this->spare_inner;
+                this->spare_inner = spare;
+                this->n_spare_inner++;
+            }
+        }
+
+        void free_inner(inner_type* node) {
+            for (unsigned i=0;i+1<node->count;i++) node->key(i)->~key_type();
+            inner_allocator_ alloc(this->allocator);
+            std::allocator_traits<inner_allocator_>::deallocate(alloc, node, 1);
+        }
+
+        void free_subtree(node_base* node) {
+            if (node->leaf) {
+                auto leaf = static_cast<leaf_type*>(node);
+                for (unsigned i=0;i<leaf->count;i++) leaf->slot(i)->~rbtree_node_type();
+                this->free_leaf(leaf);
+            } else {
+                auto inner = static_cast<inner_type*>(node);
+                for (unsigned i=0;i<inner->count;i++) this->free_subtree(inner->children[i]);
+                this->free_inner(inner);
+            }
+        }
+
+        /** all ancestors of node gain or lose values */
+        static inline void add_count(node_base* node, bool increase) {
+            for (auto p=node->parent;p!=nullptr;node=p,p=p->parent) {
+                auto inner = static_cast<inner_type*>(p);
+                auto& c = inner->counts[inner->indexof(node)];
+                c = increase ? c + 1 : c - 1;
+            }
+        }
+
+        /** index of the child whose subtree holds the lower (upper) bound of val */
+        template<typename _K>
+        inline unsigned child_of(const inner_type* node, const _K& val, bool upper) const {
+            unsigned lo = 0, hi = node->count - 1;
+            for (;lo < hi;) {
+                const unsigned mid = (lo + hi) / 2;
+                const auto& sep = *node->key(mid);
+                if (upper ? !this->bp_comp(val, sep) : this->bp_comp(sep, val)) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+
+        template<typename _K>
+        inline unsigned slot_of(const leaf_type* leaf, const _K& val, bool upper) const {
+            unsigned lo = 0, hi = leaf->count;
+            for (;lo < hi;) {
+                const unsigned mid = (lo + hi) / 2;
+                const auto& v = leaf->slot(mid)->value;
+                if (upper ? !this->bp_comp(val, v) : this->bp_comp(v, val)) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+
+        /** leaf and position where val would be inserted, the position may be the end of the leaf */
+        template<typename _K>
+        std::pair<leaf_type*,unsigned> locate(const _K& val, bool upper) const {
+            if (this->root == nullptr) return std::make_pair(nullptr, 0u);
+
+            auto node = this->root;
+            for (;!node->leaf;) {
+                auto inner = static_cast<const inner_type*>(node);
+                node = inner->children[this->child_of(inner, val, upper)];
+            }
+            auto leaf = static_cast<leaf_type*>(node);
+            return std::make_pair(leaf, this->slot_of(leaf, val, upper));
+        }
+
+        /** bound of val and the number of values before it, the counts of the skipped children are summed up */
+        template<typename _K>
+        std::pair<nodeptr_t,size_type> bound_with_rank(const _K& val, bool upper) const {
+            if (this->root == nullptr) return std::make_pair(nullptr, size_type(0));
+
+            size_type rank = 0;
+            auto node = this->root;
+            for (;!node->leaf;) {
+                auto inner = static_cast<const inner_type*>(node);
+                const unsigned c = this->child_of(inner, val, upper);
+                for (unsigned i=0;i<c;i++) rank += inner->counts[i];
+                node = inner->children[c];
+            }
+            auto leaf = static_cast<leaf_type*>(node);
+            const unsigned pos = this->slot_of(leaf, val, upper);
+            return std::make_pair(slot_at(std::make_pair(leaf, pos)), rank + pos);
+        }
+
+        static inline nodeptr_t slot_at(const std::pair<leaf_type*,unsigned>& loc) {
+            if (loc.first == nullptr) return nullptr;
+            if (loc.second < loc.first->count) return loc.first->slot(loc.second);
+            return loc.first->next ? loc.first->next->slot(0) : nullptr;
+        }
+
+        /** move the value of node into the tree, an equal value is assigned instead if it's unique tree */
+        std::pair<nodeptr_t,bool> place(rbtree_node_type&& node) {
+            if (this->root == nullptr) {
+                // the first leaf becomes the root once the value is in it
+                auto leaf = this->new_leaf();
+                try {
+                    insert_slot(leaf->slot(0), node);
+                } catch (...) {
+                    this->free_leaf(leaf);
+                    throw;
+                }
+                leaf->count = 1;
+                this->root = this->head = this->tail = leaf;
+                this->_size++;
+                this->_version++;
+                return std::make_pair(leaf->slot(0), true);
+            }
+
+            auto loc = this->locate(node.value, multi);
+            if (!multi) {
+                auto at = slot_at(loc);
+                if (at && !this->bp_comp(node.value, at->value)) {
+                    at->value.assign_value(std::move(node.value));
+                    return std::make_pair(at, false);
+                }
+            }
+
+            // values after the position are moved
+            this->_version++;
+            return std::make_pair(this->insert_at(loc.first, loc.second, std::move(node)), true);
+        }
+
+        nodeptr_t insert_at(leaf_type* leaf, unsigned pos, rbtree_node_type&& node) {
+            if (leaf->count < leaf_type::capacity) {
+                move_slots(leaf->slot(pos + 1), leaf->slot(pos), leaf->count - pos);
+                try {
+                    insert_slot(leaf->slot(pos), node);
+                } catch (...) {
+                    move_slots_back(leaf->slot(pos), leaf->slot(pos + 1), leaf->count - pos);
+                    throw;
+                }
+                leaf->count++;
+                add_count(leaf, true);
+                this->_size++;
+                return leaf->slot(pos);
+            }
+
+            // everything which may throw is done before right is linked in, a failed split leaves leaf as it was
+            this->reserve_inners(leaf);
+            auto right = this->new_leaf();
+            struct leaf_guard {
+                BPTreeImpl* tree;
+                leaf_type* leaf;
+                ~leaf_guard() { if (leaf) tree->free_leaf(leaf); }
+            } guard{this, right};
+
+            const unsigned total = leaf->count + 1;
+            const unsigned left_n = total / 2;
+            key_type sep(bptree_key_of(pos == left_n ? node.value : leaf->slot(pos < left_n ? left_n - 1 : left_n)->value));
+            nodeptr_t ans;
+            if (pos < left_n) {
+                const unsigned moved = leaf->count - left_n + 1;
+                move_slots(right->slot(0), leaf->slot(left_n - 1), moved);
+                try {
+                    move_slots(leaf->slot(pos + 1), leaf->slot(pos), left_n - 1 - pos);
+                    try {
+                        insert_slot(leaf->slot(pos), node);
+                    } catch (...) {
+                        move_slots_back(leaf->slot(pos), leaf->slot(pos + 1), left_n - 1 - pos);
+                        throw;
+                    }
+                } catch (...) {
+                    move_slots_back(leaf->slot(left_n - 1), right->slot(0), moved);
+                    throw;
+                }
+                ans = leaf->slot(pos);
+            } else {
+                ans = right->slot(pos - left_n);
+                insert_slot(ans, node);
+                try {
+                    move_slots(right->slot(0), leaf->slot(left_n), pos - left_n);
+                    try {
+                        move_slots(right->slot(pos - left_n + 1), leaf->slot(pos), leaf->count - pos);
+                    } catch (...) {
+                        move_slots_back(leaf->slot(left_n), right->slot(0), pos - left_n);
+                        throw;
+                    }
+                } catch (...) {
+                    ans->~rbtree_node_type();
+                    throw;
+                }
+            }
+            guard.leaf = nullptr;
+            leaf->count = left_n;
+            right->count = total - left_n;
+
+            right->next = leaf->next;
+            right->prev = leaf;
+            if (leaf->next) {
+                leaf->next->prev = right;
+            } else {
+                this->tail = right;
+            }
+            leaf->next = right;
+
+            // splits below an ancestor don't change the number of values under it
+            add_count(leaf, true);
+            this->_size++;
+            this->insert_child(leaf, std::move(sep), right, left_n, total - left_n);
+            return ans;
+        }
+
+        /**
+         * right becomes the sibling after left, whose subtree is split. The inner nodes it takes are
+         * reserved beforehand, so it only fails if moving a key throws, which can't be recovered from
+         */
+        void insert_child(node_base* left, key_type&& sep, node_base* right, SizeT left_n, SizeT right_n) noexcept {
+            auto parent = static_cast<inner_type*>(left->parent);
+            if (parent == nullptr) {
+                auto node = this->new_inner();
+                node->children[0] = left;
+                node->children[1] = right;
+                node->counts[0] = left_n;
+                node->counts[1] = right_n;
+                new (node->key(0)) key_type(std::move(sep));
+                node->count = 2;
+                left->parent = right->parent = node;
+                this->root = node;
+                return;
+            }
+
+            const unsigned i = parent->indexof(left);
+            parent->counts[i] = left_n;
+            if (parent->count < inner_type::capacity) {
+                for (unsigned j=parent->count;j>i+1;j--) {
+                    parent->children[j] = parent->children[j-1];
+                    parent->counts[j] = parent->counts[j-1];
+                }
+                move_keys(parent->key(i + 1), parent->key(i), parent->count - 1 - i);
+                parent->children[i+1] = right;
+                parent->counts[i+1] = right_n;
+                new (parent->key(i)) key_type(std::move(sep));
+                parent->count++;
+                right->parent = parent;
+                return;
+            }
+
+            // children and keys after inserting right, left_c of them stay in parent
+            constexpr unsigned total = inner_type::capacity + 1;
+            constexpr unsigned left_c = total / 2;
+            auto child_at = [&](unsigned j) -> std::pair<node_base*,SizeT> {
+                if (j <= i) return std::make_pair(parent->children[j], parent->counts[j]);
+                if (j == i + 1) return std::make_pair(right, right_n);
+                return std::make_pair(parent->children[j-1], parent->counts[j-1]);
+            };
+            auto key_at = [&](unsigned j) -> key_type* {
+                if (j < i) return parent->key(j);
+                if (j == i) return &sep;
+                return parent->key(j-1);
+            };
+            auto take_key = [&](key_type* dst, unsigned j) {
+                auto src = key_at(j);
+                new (dst) key_type(std::move(*src));
+                if (src != &sep) src->~key_type();
+            };
+
+            auto node = this->new_inner();
+            for (unsigned j=left_c;j<total;j++) {
+                auto c = child_at(j);
+                node->children[j-left_c] = c.first;
+                node->counts[j-left_c] = c.second;
+                c.first->parent = node;
+            }
+            for (unsigned j=left_c;j+1<total;j++) {
+                take_key(node->key(j-left_c), j);
+            }
+            key_type up(std::move(*key_at(left_c - 1)));
+            if (key_at(left_c - 1) != &sep) key_at(left_c - 1)->~key_type();
+
+            if (i + 1 < left_c) {
+                for (unsigned j=left_c-1;j>i+1;j--) {
+                    parent->children[j] = parent->children[j-1];
+                    parent->counts[j] = parent->counts[j-1];
+                }
+                move_keys(parent->key(i + 1), parent->key(i), left_c - 2 - i);
+                parent->children[i+1] = right;
+                parent->counts[i+1] = right_n;
+                right->parent = parent;
+                new (parent->key(i)) key_type(std::move(sep));
+            }
+            parent->count = left_c;
+            node->count = total - left_c;
+
+            this->insert_child(parent, std::move(up), node, total_of(parent), total_of(node));
+        }
+
+        /** remove child j and key j - 1 of node, the key must have been destroyed */
+        static void remove_child(inner_type* node, unsigned j) {
+            for (unsigned k=j;k+1<node->count;k++) {
+                node->children[k] = node->children[k+1];
+                node->counts[k] = node->counts[k+1];
+            }
+            move_keys(node->key(j - 1), node->key(j), node->count - 1 - j);
+            node->count--;
+        }
+
+        void rebalance_leaf(leaf_type* leaf) {
+            auto parent = static_cast<inner_type*>(leaf->parent);
+            const unsigned i = parent->indexof(leaf);
+            auto left = i > 0 ? static_cast<leaf_type*>(parent->children[i-1]) : nullptr;
+            auto right = i + 1 < parent->count ? static_cast<leaf_type*>(parent->children[i+1]) : nullptr;
+
+            if (left && left->count > leaf_min) {
+                move_slots(leaf->slot(1), leaf->slot(0), leaf->count);
+                relocate(leaf->slot(0), left->slot(left->count - 1));
+                left->count--;
+                leaf->count++;
+                parent->counts[i-1]--;
+                parent->counts[i]++;
+                parent->key(i-1)->~key_type();
+                new (parent->key(i-1)) key_type(bptree_key_of(leaf->slot(0)->value));
+                return;
+            }
+
+            if (right && right->count > leaf_min) {
+                relocate(leaf->slot(leaf->count), right->slot(0));
+                move_slots(right->slot(0), right->slot(1), right->count - 1);
+                right->count--;
+                leaf->count++;
+                parent->counts[i+1]--;
+                parent->counts[i]++;
+                parent->key(i)->~key_type();
+                new (parent->key(i)) key_type(bptree_key_of(right->slot(0)->value));
+                return;
+            }
+
+            if (left == nullptr) {
+                left = leaf;
+                leaf = right;
+            } else {
+                RB_ASSERT(i > 0);
+            }
+            const unsigned j = parent->indexof(leaf);
+            move_slots(left->slot(left->count), leaf->slot(0), leaf->count);
+            left->count += leaf->count;
+            left->next = leaf->next;
+            if (leaf->next) {
+                leaf->next->prev = left;
+            } else {
+                this->tail = left;
+            }
+            parent->counts[j-1] += parent->counts[j];
+            parent->key(j-1)->~key_type();
+            remove_child(parent, j);
+            leaf->count = 0;
+            this->free_leaf(leaf);
+            this->rebalance_inner(parent);
+        }
+
+        void rebalance_inner(inner_type* node) {
+            auto parent = static_cast<inner_type*>(node->parent);
+            if (parent == nullptr) {
+                if (node->count == 1) {
+                    this->root = node->children[0];
+                    this->root->parent = nullptr;
+                    this->free_inner(node);
+                }
+                return;
+            }
+            if (node->count >= inner_min) return;
+
+            const unsigned i = parent->indexof(node);
+            auto left = i > 0 ? static_cast<inner_type*>(parent->children[i-1]) : nullptr;
+            auto right = i + 1 < parent->count ? static_cast<inner_type*>(parent->children[i+1]) : nullptr;
+
+            if (left && left->count > inner_min) {
+                for (unsigned k=node->count;k>0;k--) {
+                    node->children[k] = node->children[k-1];
+                    node->counts[k] = node->counts[k-1];
+                }
+                move_keys(node->key(1), node->key(0), node->count - 1);
+                const auto moved = left->counts[left->count-1];
+                node->children[0] = left->children[left->count-1];
+                node->counts[0] = moved;
+                node->children[0]->parent = node;
+                relocate(node->key(0), parent->key(i-1));
+                relocate(parent->key(i-1), left->key(left->count-2));
+                left->count--;
+                node->count++;
+                parent->counts[i-1] -= moved;
+                parent->counts[i] += moved;
+                return;
+            }
+
+            if (right && right->count > inner_min) {
+                const auto moved = right->counts[0];
+                node->children[node->count] = right->children[0];
+                node->counts[node->count] = moved;
+                node->children[node->count]->parent = node;
+                relocate(node->key(node->count-1), parent->key(i));
+                relocate(parent->key(i), right->key(0));
+                for (unsigned k=0;k+1<right->count;k++) {
+                    right->children[k] = right->children[k+1];
+                    right->counts[k] = right->counts[k+1];
+                }
+                move_keys(right->key(0), right->key(1), right->count - 2);
+                right->count--;
+                node->count++;
+                parent->counts[i+1] -= moved;
+                parent->counts[i] += moved;
+                return;
+            }
+
+            if (left == nullptr) {
+                left = node;
+                node = right;
+            }
+            const unsigned j = parent->indexof(node);
+            relocate(left->key(left->count-1), parent->key(j-1));
+            move_keys(left->key(left->count), node->key(0), node->count - 1);
+            for (unsigned k=0;k<node->count;k++) {
+                left->children[left->count+k] = node->children[k];
+                left->counts[left->count+k] = node->counts[k];
+                node->children[k]->parent = left;
+            }
+            left->count += node->count;
+            node->count = 0;
+            parent->counts[j-1] += parent->counts[j];
+            remove_child(parent, j);
+            this->free_inner(node);
+            this->rebalance_inner(parent);
+        }
+
+        /** take the value out of its leaf, value is destroyed unless it has been moved out */
+        nodeptr_t remove(nodeptr_t node, bool return_next_node) {
+            auto leaf = leaf_type::of(node);
+            const unsigned pos = leaf->indexof(node);
+            const bool rebalance = leaf->parent != nullptr && leaf->count - 1 < leaf_min;
+            const size_type index = rebalance && return_next_node ? this->indexof(node) : 0;
+
+            node->~rbtree_node_type();
+            move_slots(leaf->slot(pos), leaf->slot(pos + 1), leaf->count - pos - 1);
+            leaf->count--;
+            add_count(leaf, false);
+            this->_size--;
+            this->_version++;
+
+            if (rebalance) {
+                this->rebalance_leaf(leaf);
+                return return_next_node ? this->select(index) : nullptr;
+            }
+
+            if (leaf->count == 0) {
+                RB_ASSERT(leaf == this->root);
+                this->free_leaf(leaf);
+                this->root = this->head = this->tail = nullptr;
+                return nullptr;
+            }
+
+            if (!return_next_node) return nullptr;
+            return slot_at(std::make_pair(leaf, pos));
+        }
+
+        void free_leaf_chain() {
+            for (auto leaf=this->head;leaf!=nullptr;) {
+                auto next = leaf->next;
+                for (unsigned i=0;i<leaf->count;i++) leaf->slot(i)->~rbtree_node_type();
+                this->free_leaf(leaf);
+                leaf = next;
+            }
+            this->root = this->head = this->tail = nullptr;
+        }
+
+        /**
+         * build the tree of n values which next() yields in order, the tree must be empty.
+         * leaves and inner nodes are filled evenly, so each of them is at least half full
+         */
+        template<typename Next>
+        bool bulk_load(size_type n, Next&& next, bool check) {
+            RB_ASSERT(this->root == nullptr);
+            if (n == 0) return true;
+            this->check_capacity(n);
+
+            std::vector<node_base*> level;
+            std::vector<SizeT> counts;
+            std::vector<inner_type*> inners;
+            try {
+                const size_type n_leaves = (n + leaf_type::capacity - 1) / leaf_type::capacity;
+                level.reserve(n_leaves);
+                counts.reserve(n_leaves);
+                const_nodeptr_t last = nullptr;
+                for (size_type i=0;i<n_leaves;i++) {
+                    const size_type m = n / n_leaves + (i < n % n_leaves ? 1 : 0);
+                    auto leaf = this->new_leaf();
+                    leaf->prev = this->tail;
+                    if (this->tail) {
+                        this->tail->next = leaf;
+                    } else {
+                        this->head = leaf;
+                    }
+                    this->tail = leaf;
+                    level.push_back(leaf);
+                    counts.push_back(m);
+
+                    for (size_type j=0;j<m;j++) {
+                        auto slot = rbtree_new_node(leaf->slot(j), uses_allocator_(), this->allocator, next());
+                        leaf->count++;
+                        if (check && last != nullptr &&
+                            !(this->bp_comp(last->value, slot->value) || (multi && !this->bp_comp(slot->value, last->value))))
+                        {
+                            this->free_leaf_chain();
+                            return false;
+                        }
+                        last = slot;
+                    }
+                }
+
+                for (;level.size() > 1;) {
+                    const size_type n_nodes = (level.size() + inner_type::capacity - 1) / inner_type::capacity;
+                    std::vector<node_base*> upper;
+                    std::vector<SizeT> upper_counts;
+                    upper.reserve(n_nodes);
+                    upper_counts.reserve(n_nodes);
+                    size_type k = 0;
+                    for (size_type i=0;i<n_nodes;i++) {
+                        const size_type m = level.size() / n_nodes + (i < level.size() % n_nodes ? 1 : 0);
+                        auto node = this->new_inner();
+                        inners.push_back(node);
+                        SizeT total = 0;
+                        for (size_type c=0;c<m;c++,k++) {
+                            node->children[c] = level[k];
+                            node->counts[c] = counts[k];
+                            if (c > 0) new (node->key(c-1)) key_type(first_key(level[k]));
+                            node->count = c + 1;
+                            level[k]->parent = node;
+                            total += counts[k];
+                        }
+                        upper.push_back(node);
+                        upper_counts.push_back(total);
+                    }
+                    level.swap(upper);
+                    counts.swap(upper_counts);
+                }
+            } catch (...) {
+                for (auto node: inners) this->free_inner(node);
+                this->free_leaf_chain();
+                throw;
+            }
+
+            this->root = level[0];
+            this->root->parent = nullptr;
+            this->_size = n;
+            return true;
+        }
+
+    public:
+        /** rebuild the tree of the values which values point to in order, they may be in this tree or in another one */
+        void reload(const std::vector<storage_type*>& values) {
+            BPTreeImpl tree(this->cmp, this->allocator);
+            auto next = values.begin();
+            tree.bulk_load(values.size(), [&next]() -> decltype(std::move_if_noexcept(**next)) {
+                return std::move_if_noexcept(**next++);
+            }, false);
+
+            this->clear();
+            std::swap(this->root, tree.root);
+            std::swap(this->head, tree.head);
+            std::swap(this->tail, tree.tail);
+            std::swap(this->_size, tree._size);
+        }
+
+        void touch() {
+            this->_version++;
+        }
+
+        /** value which iterators refer to */
+        static inline value_type& value_ref(nodeptr_t node) {
+            return node->value.get();
+        }
+
+        template<typename Sx>
+        std::pair<nodeptr_t,bool> insert(nodeptr_t hint, Sx&& val) {
+            return this->emplace(hint, std::forward<Sx>(val));
+        }
+
+        template<typename Sx>
+        std::pair<nodeptr_t,bool> insert(Sx&& val) {
+            return this->insert(nullptr, std::forward<Sx>(val));
+        }
+
+        /** hint is ignored, a descent from the root only touches a few wide nodes */
+        template<typename ... Args >
+        std::pair<nodeptr_t,bool> emplace(nodeptr_t /*hint*/, Args&& ...args)
+        {
+            this->check_capacity(this->_size + 1);
+            auto node = this->make_slot(std::forward<Args>(args)...);
+            return this->place(std::move(node));
+        }
+
+        /** see RBTreeImpl::try_emplace(), the value is constructed only if key isn't in the tree */
+        template<typename K, typename ... Args>
+        std::pair<nodeptr_t,bool> try_emplace(const K& key, Args&& ... args)
+        {
+            this->check_capacity(this->_size + 1);
+            if (this->root == nullptr) {
+                auto node = this->make_slot(std::forward<Args>(args)...);
+                return this->place(std::move(node));
+            }
+
+            auto loc = this->locate(key, multi);
+            if (!multi) {
+                auto at = slot_at(loc);
+                if (at && !this->bp_comp(key, at->value)) return std::make_pair(at, false);
+            }
+
+            auto node = this->make_slot(std::forward<Args>(args)...);
+            // values after the position are moved
+            this->_version++;
+            return std::make_pair(this->insert_at(loc.first, loc.second, std::move(node)), true);
+        }
+
+        /** node is detached, it's released if its value is moved into the tree */
+        std::tuple<nodeptr_t,nodeptr_t,bool> insert_node(nodeptr_t /*hint*/, nodeptr_t node) {
+            this->check_capacity(this->_size + 1);
+            auto result = this->place(std::move(*node));
+            if (!result.second) {
+                return std::make_tuple(result.first, node, false);
+            }
+
+            node->~rbtree_node_type();
+            this->allocator.deallocate(node, 1);
+            return std::make_tuple(result.first, nullptr, true);
+        }
+
+        /** the value is moved to a detached node */
+        std::pair<nodeptr_t,nodeptr_t> extract(nodeptr_t node, bool return_next_node) {
+            auto ptr = this->allocator.allocate(1);
+            try {
+                new (ptr) rbtree_node_type(std::move(*node));
+            } catch (...) {
+                this->allocator.deallocate(ptr, 1);
+                throw;
+            }
+            return std::make_pair(ptr, this->remove(node, return_next_node));
+        }
+
+        inline nodeptr_t release_node(nodeptr_t node) {
+            return node;
+        }
+
+        inline nodeptr_t erase(nodeptr_t node, bool return_next_node) {
+            return this->remove(node, return_next_node);
+        }
+
+        /** values are moved by erasure, so the range is counted before it's erased value by value */
+        nodeptr_t erase_range(nodeptr_t first, nodeptr_t last) {
+            auto n = this->indexof(last) - this->indexof(first);
+            for (;n>0;n--) first = this->erase(first, true);
+            return first;
+        }
+
+        /** see RBTreeImpl::split_off(), values are moved into new leaves of both trees, so it's O(n) */
+        void split_off(nodeptr_t node, BPTreeImpl& other) {
+            RB_ASSERT(this != &other && other.root == nullptr);
+            if (node == nullptr) return;
+
+            std::vector<storage_type*> left, right;
+            for (auto n=this->begin();n!=nullptr;n=n->next()) {
+                (n == node || !right.empty() ? right : left).push_back(&n->value);
+            }
+            other.reload(right);
+            this->reload(left);
+        }
+
+        template<typename _K>
+        void split(const _K& key, BPTreeImpl& other) {
+            this->split_off(this->lower_bound(key), other);
+        }
+
+        void split_at(size_type index, BPTreeImpl& other) {
+            this->split_off(this->select(index), other);
+        }
+
+        bool precedes(const BPTreeImpl& other) const {
+            if (this->root == nullptr || other.root == nullptr) return true;
+
+            const auto& last = this->tail->slot(this->tail->count-1)->value;
+            const auto& first = other.head->slot(0)->value;
+            return multi ? !this->bp_comp(first, last) : this->bp_comp(last, first);
+        }
+
+        /** see RBTreeImpl::append(), it's O(n + m) */
+        void append(BPTreeImpl& other) {
+            RB_ASSERT(this != &other && this->precedes(other));
+            if (other.root == nullptr) return;
+            this->check_capacity(this->_size + other._size);
+
+            std::vector<storage_type*> values;
+            values.reserve(this->_size + other._size);
+            for (auto n=this->begin();n!=nullptr;n=n->next()) values.push_back(&n->value);
+            for (auto n=other.begin();n!=nullptr;n=n->next()) values.push_back(&n->value);
+            this->reload(values);
+            other.clear();
+        }
+
+        /** see RBTreeImpl::set_operation(), both trees are merged into new leaves, so it's O(n + m) */
+        void set_operation(BPTreeImpl& other, const rbtree_set_operation& op) {
+            static_assert(!multi, "set operations are defined for unique values");
+            RB_ASSERT(this != &other);
+            std::vector<storage_type*> merged;
+            auto a = this->begin(), b = other.begin();
+            for (;a!=nullptr || b!=nullptr;) {
+                if (b == nullptr || (a != nullptr && this->bp_comp(a->value, b->value))) {
+                    if (op.left) merged.push_back(&a->value);
+                    a = a->next();
+                } else if (a == nullptr || this->bp_comp(b->value, a->value)) {
+                    if (op.right) merged.push_back(&b->value);
+                    b = b->next();
+                } else {
+                    if (op.both) merged.push_back(op.right_value ? &b->value : &a->value);
+                    a = a->next();
+                    b = b->next();
+                }
+            }
+            this->check_capacity(merged.size());
+            this->reload(merged);
+            other.clear();
+        }
+
+        /**
+         * see RBTreeImpl::merge(), the values of both trees are merged in order and both trees are rebuilt, so it's
+         * O(n + m), but the values are moved into new leaves
+         */
+        template<typename Tree>
+        void merge(Tree& source) {
+            if (source.size() == 0) return;
+
+            std::vector<storage_type*> values, merged, rejected;
+            for (auto n=source.begin();n!=nullptr;n=n->next()) values.push_back(&n->value);
+            this->sort_values(values);
+
+            auto a = this->begin();
+            for (auto v: values) {
+                for (;a!=nullptr && !this->bp_comp(*v, a->value);a=a->next()) merged.push_back(&a->value);
+                if (!multi && !merged.empty() && !this->bp_comp(*merged.back(), *v)) {
+                    rejected.push_back(v);
+                } else {
+                    merged.push_back(v);
+                }
+            }
+            for (;a!=nullptr;a=a->next()) merged.push_back(&a->value);
+            // the rejected duplicates don't count
+            this->check_capacity(merged.size());
+            source.sort_values(rejected);
+            this->reload(merged);
+            source.reload(rejected);
+        }
+
+        /** sort the values which values point to in the order of this tree, it's stable */
+        void sort_values(std::vector<storage_type*>& values) const {
+            auto comp = [this](const storage_type* x, const storage_type* y) { return this->bp_comp(*x, *y); };
+            if (!std::is_sorted(values.begin(), values.end(), comp)) {
+                std::stable_sort(values.begin(), values.end(), comp);
+            }
+        }
+
+        /** the leaves are merged serially, see set_operation() */
+        template<typename Executor>
+        void parallel_set_operation(BPTreeImpl& other, const rbtree_set_operation& op, Executor&, size_type) {
+            this->set_operation(other, op);
+        }
+
+        /** see RBTreeImpl::splice(), the range is merged with the values of this tree, so it's O(n + m) */
+        void splice(BPTreeImpl& other, nodeptr_t first, nodeptr_t last) {
+            RB_ASSERT(this != &other);
+            if (first == last) return;
+            this->check_capacity(this->_size + other.indexof(last) - other.indexof(first));
+
+            std::vector<storage_type*> range, rest;
+            for (auto n=other.begin();n!=nullptr;n=n->next()) {
+                if (n == first) {
+                    for (;n!=last;n=n->next()) range.push_back(&n->value);
+                    if (n == nullptr) break;
+                }
+                rest.push_back(&n->value);
+            }
+
+            std::vector<storage_type*> merged;
+            merged.reserve(this->_size + range.size());
+            auto node = this->begin();
+            for (size_t i=0;node!=nullptr || i<range.size();) {
+                if (i < range.size() && (node == nullptr || this->bp_comp(*range[i], node->value))) {
+                    auto val = range[i++];
+                    if (!multi && !merged.empty() && !this->bp_comp(*merged.back(), *val)) {
+                        merged.back()->assign_value(std::move(*val));
+                    } else {
+                        merged.push_back(val);
+                    }
+                } else {
+                    merged.push_back(&node->value);
+                    node = node->next();
+                }
+            }
+            this->reload(merged);
+            other.reload(rest);
+        }
+
+#ifdef DEBUG
+        void check_consistency() const {
+            if (this->root == nullptr) {
+                RB_ASSERT(this->_size == 0 && this->head == nullptr && this->tail == nullptr);
+                return;
+            }
+            RB_ASSERT(this->root->parent == nullptr);
+
+            std::vector<const node_base*> level(1, this->root);
+            for (;!level.front()->leaf;) {
+                std::vector<const node_base*> lower;
+                for (auto n: level) {
+                    RB_ASSERT(!n->leaf);
+                    auto inner = static_cast<const inner_type*>(n);
+                    RB_ASSERT(inner->count >= (inner == this->root ? 2 : inner_min));
+                    for (unsigned i=0;i<inner->count;i++) {
+                        auto child = inner->children[i];
+                        RB_ASSERT(child->parent == inner);
+                        RB_ASSERT(inner->counts[i] == (child->leaf ? child->count : total_of(static_cast<const inner_type*>(child))));
+                        if (i > 0) {
+                            const node_base* last = inner->children[i-1];
+                            for (;!last->leaf;last=static_cast<const inner_type*>(last)->children[last->count-1]) {}
+                            auto last_leaf = static_cast<const leaf_type*>(last);
+                            RB_ASSERT(!this->bp_comp(first_key(child), *inner->key(i-1)));
+                            RB_ASSERT(!this->bp_comp(*inner->key(i-1), last_leaf->slot(last_leaf->count-1)->value));
+                        }
+                        lower.push_back(child);
+                    }
+                }
+                level.swap(lower);
+            }
+
+            size_type n = 0;
+            const leaf_type* prev = nullptr;
+            for (auto leaf=this->head;leaf!=nullptr;prev=leaf,leaf=leaf->next) {
+                RB_ASSERT(leaf->prev == prev);
+                RB_ASSERT(leaf->count >= (leaf == this->root ? 1 : leaf_min) && leaf->count <= leaf_type::capacity);
+                RB_ASSERT(n < level.size() && level[n] == leaf);
+                n++;
+            }
+            RB_ASSERT(prev == this->tail);
+            RB_ASSERT(n == level.size());
+
+            size_type total = 0;
+            for (auto node=this->begin();node!=nullptr;node=node->next(),total++) {
+                auto next = node->next();
+                if (next) {
+                    RB_ASSERT(multi ? !this->bp_comp(next->value, node->value) : this->bp_comp(node->value, next->value));
+                }
+            }
+            RB_ASSERT(total == this->_size);
+        }
+
+        /** values move on every change, so an iterator whose version is current has a value of this tree */
+        bool erased(const_nodeptr_t, size_t) const {
+            return false;
+        }
+#endif // DEBUG
+
+        size_type indexof(const_nodeptr_t node) const {
+            if (node == nullptr) return this->size();
+
+            auto leaf = leaf_type::of(node);
+            size_type ans = leaf->indexof(node);
+            const node_base* child = leaf;
+            for (auto p=leaf->parent;p!=nullptr;child=p,p=p->parent) {
+                auto inner = static_cast<const inner_type*>(p);
+                for (unsigned i=0;inner->children[i]!=child;i++) ans += inner->counts[i];
+            }
+            return ans;
+        }
+
+        /** the value at index, nullptr if it's out of range */
+        nodeptr_t select(size_type index) const {
+            if (index >= this->_size) return nullptr;
+
+            auto node = this->root;
+            for (;!node->leaf;) {
+                auto inner = static_cast<inner_type*>(node);
+                unsigned i = 0;
+                for (;index >= inner->counts[i];i++) index -= inner->counts[i];
+                node = inner->children[i];
+            }
+            return static_cast<leaf_type*>(node)->slot(index);
+        }
+
+        template<typename _K>
+        nodeptr_t lower_bound(const _K& val) {
+            return slot_at(this->locate(val, false));
+        }
+
+        template<typename _K>
+        const_nodeptr_t lower_bound(const _K& val) const {
+            return slot_at(this->locate(val, false));
+        }
+
+        template<typename _K>
+        nodeptr_t upper_bound(const _K& val) {
+            return slot_at(this->locate(val, true));
+        }
+
+        template<typename _K>
+        const_nodeptr_t upper_bound(const _K& val) const {
+            return slot_at(this->locate(val, true));
+        }
+
+        template<typename _K>
+        std::pair<nodeptr_t,size_type> lower_bound_with_rank(const _K& val) {
+            return this->bound_with_rank(val, false);
+        }
+
+        template<typename _K>
+        std::pair<const_nodeptr_t,size_type> lower_bound_with_rank(const _K& val) const {
+            return this->bound_with_rank(val, false);
+        }
+
+        template<typename _K>
+        std::pair<nodeptr_t,size_type> upper_bound_with_rank(const _K& val) {
+            return this->bound_with_rank(val, true);
+        }
+
+        template<typename _K>
+        std::pair<const_nodeptr_t,size_type> upper_bound_with_rank(const _K& val) const {
+            return this->bound_with_rank(val, true);
+        }
+
+        /** same as bound_with_rank(), the tree is too shallow to gain from starting at finger */
+        template<typename _K>
+        std::pair<nodeptr_t,size_type> bound_from(nodeptr_t, size_type, const _K& val, bool upper) const {
+            return this->bound_with_rank(val, upper);
+        }
+
+        template<typename _K>
+        inline bool key_equal(const_nodeptr_t node, const _K& val) const {
+            return node != nullptr && !this->bp_comp(node->value, val) && !this->bp_comp(val, node->value);
+        }
+
+        /** out[i] = lower_bound(key_at(i)), the leaves are few enough that lookups one by one don't stall */
+        template<typename KeyAt>
+        void lower_bound_interleaved(size_t n, KeyAt key_at, nodeptr_t* out) {
+            for (size_t i=0;i<n;i++) out[i] = this->lower_bound(key_at(i));
+        }
+
+        template<typename _K>
+        nodeptr_t find(const _K& val) {
+            auto node = this->lower_bound(val);
+            return node && !this->bp_comp(val, node->value) ? node : nullptr;
+        }
+
+        template<typename _K>
+        const_nodeptr_t find(const _K& val) const {
+            auto node = this->lower_bound(val);
+            return node && !this->bp_comp(val, node->value) ? node : nullptr;
+        }
+
+        template<typename _K>
+        size_type count(const _K& val) const {
+            return this->bound_with_rank(val, true).second - this->bound_with_rank(val, false).second;
+        }
+
+        nodeptr_t begin() {
+            return this->head ? this->head->slot(0) : nullptr;
+        }
+
+        const_nodeptr_t begin() const {
+            return this->head ? this->head->slot(0) : nullptr;
+        }
+
+        nodeptr_t rbegin() {
+            return this->tail ? this->tail->slot(this->tail->count - 1) : nullptr;
+        }
+
+        const_nodeptr_t rbegin() const {
+            return this->tail ? this->tail->slot(this->tail->count - 1) : nullptr;
+        }
+
+        nodeptr_t advance(const_nodeptr_t node, long n) const {
+            // node == nullptr represent end
+            if (node == nullptr) {
+                if (n >= 0 || static_cast<size_type>(-n) > this->_size) return nullptr;
+                return this->select(this->_size + n);
+            }
+
+            auto leaf = leaf_type::of(node);
+            const long pos = static_cast<long>(leaf->indexof(node)) + n;
+            if (pos >= 0 && pos < static_cast<long>(leaf->count)) {
+                return leaf->slot(pos);
+            }
+
+            const long index = static_cast<long>(this->indexof(node)) + n;
+            return index < 0 ? nullptr : this->select(index);
+        }
+
+        inline size_type size() const {
+            return this->_size;
+        }
+
+        static inline size_type max_size() {
+            return std::numeric_limits<SizeT>::max();
+        }
+
+        inline void check_capacity(size_t n) const {
+            if (n > this->max_size()) {
+                throw std::length_error("number of nodes exceeds the capacity of node counter");
+            }
+        }
+
+        inline size_t version() const {
+            return this->_version;
+        }
+
+        void copy_to(BPTreeImpl& target) const {
+            target.clear();
+            target._version++;
+            auto node = this->begin();
+            target.bulk_load(this->_size, [&node]() -> const storage_type& {
+                auto& val = node->value;
+                node = node->next();
+                return val;
+            }, false);
+        }
+
+        /** the leaves are copied serially, see RBTreeImpl::parallel_copy_to() */
+        template<typename Executor>
+        void parallel_copy_to(BPTreeImpl& target, Executor&, size_type) const {
+            this->copy_to(target);
+        }
+
+        Compare cmp_object() const {
+            return this->cmp;
+        }
+
+        /** keep enough leaves for n values, they're kept across clear() until shrink_to_fit() */
+        void reserve(size_type n) {
+            if (n <= this->_size) return;
+
+            const size_type n_leaves = (n - this->_size + leaf_min - 1) / leaf_min;
+            this->spare_limit = this->spare_limit > n_leaves ? this->spare_limit : n_leaves;
+            for (;this->n_spare < n_leaves;) {
+                leaf_allocator_ alloc(this->allocator);
+                auto leaf = std::allocator_traits<leaf_allocator_>::allocate(alloc, 1);
+                if (reinterpret_cast<std::uintptr_t>(leaf) % leaf_type::bytes != 0) {
+                    std::allocator_traits<leaf_allocator_>::deallocate(alloc, leaf, 1);
+                    throw std::logic_error("allocator doesn't respect alignment of leaves");
+                }
+                new (leaf) leaf_type();
+                leaf->next = this->spare;
+                this->spare = leaf;
+                this->n_spare++;
+            }
+        }
+
+        /** rebuild the tree with evenly filled leaves and release the spare ones, see RBTreeImpl::compact() */
+        void compact() {
+            if (this->_size > 0) {
+                BPTreeImpl tree(this->cmp, this->allocator);
+                auto node = this->begin();
+                tree.bulk_load(this->_size, [&node]() -> decltype(std::move_if_noexcept(node->value)) {
+                    auto& val = node->value;
+                    node = node->next();
+                    return std::move_if_noexcept(val);
+                }, false);
+
+                this->clear();
+                std::swap(this->root, tree.root);
+                std::swap(this->head, tree.head);
+                std::swap(this->tail, tree.tail);
+                std::swap(this->_size, tree._size);
+            }
+            this->shrink_to_fit();
+        }
+
+        void shrink_to_fit() {
+            this->spare_limit = 0;
+            for (;this->spare != nullptr;) {
+                auto leaf = this->spare;
+                this->spare = leaf->next;
+                this->n_spare--;
+                this->free_leaf(leaf);
+            }
+            for (;this->spare_inner != nullptr;) {
+                auto node = static_cast<inner_type*>(this->spare_inner);
+                this->spare_inner = node->parent;
+                this->n_spare_inner--;
+                this->free_inner(node);
+            }
+        }
+
+        inline size_type capacity() const {
+            return this->_size + this->n_spare * leaf_min;
+        }
+
+        Alloc get_allocator() const {
+            return this->allocator;
+        }
+
+        void clear() {
+            if (this->root) {
+                this->free_subtree(this->root);
+            }
+            this->root = this->head = this->tail = nullptr;
+            this->_version++;
+            this->_size = 0;
+        }
+
+#if __cplusplus >= 202002
+        template<std::forward_iterator Iter>
+#else
+        template<typename Iter>
+#endif // __cplusplus >= 202002
+        bool construct_from_asc_iter(Iter begin, Iter end) {
+            BPTreeImpl tree(this->cmp, this->allocator);
+            const auto n = std::distance(begin, end);
+            if (!tree.bulk_load(n, [&begin]() -> decltype(*begin) { return *begin++; }, true)) {
+                return false;
+            }
+
+            this->clear();
+            std::swap(this->root, tree.root);
+            std::swap(this->head, tree.head);
+            std::swap(this->tail, tree.tail);
+            std::swap(this->_size, tree._size);
+            return true;
+        }
+
+        /** see RBTreeImpl::insert_by_rebuild(), the values of the tree are moved into new leaves */
+#if __cplusplus >= 202002
+        template<std::forward_iterator Iter>
+#else
+        template<typename Iter>
+#endif // __cplusplus >= 202002
+        void insert_by_rebuild(Iter begin, Iter end) {
+            std::vector<storage_type> values;
+            values.reserve(std::distance(begin, end));
+            for (;begin!=end;begin++) values.emplace_back(*begin);
+            std::vector<storage_type*> batch;
+            batch.reserve(values.size());
+            for (auto& val: values) batch.push_back(&val);
+            std::stable_sort(batch.begin(), batch.end(), [this](const storage_type* a, const storage_type* b) {
+                return this->bp_comp(*a, *b);
+            });
+
+            std::vector<storage_type*> merged;
+            std::vector<std::pair<storage_type*,storage_type*>> duplicates;
+            merged.reserve(this->_size + batch.size());
+            auto node = this->begin();
+            for (size_t i=0;node!=nullptr || i<batch.size();) {
+                if (i < batch.size() && (node == nullptr || this->bp_comp(*batch[i], node->value))) {
+                    auto val = batch[i++];
+                    if (!multi && !merged.empty() && !this->bp_comp(*merged.back(), *val)) {
+                        duplicates.emplace_back(merged.back(), val);
+                    } else {
+                        merged.push_back(val);
+                    }
+                } else {
+                    merged.push_back(&node->value);
+                    node = node->next();
+                }
+            }
+            // the values are assigned once the merged values are known to fit
+            this->check_capacity(merged.size());
+
+            for (auto& dup: duplicates) dup.first->assign_value(std::move(*dup.second));
+            this->reload(merged);
+        }
+
+        BPTreeImpl():
+            root(nullptr), head(nullptr), tail(nullptr), _version(0), _size(0),
+            spare(nullptr), n_spare(0), spare_limit(0), spare_inner(nullptr), n_spare_inner(0) {}
+        BPTreeImpl(const Compare& cmp, const Alloc& alloc):
+            root(nullptr), head(nullptr), tail(nullptr), _version(0), _size(0), cmp(cmp), allocator(alloc),
+            spare(nullptr), n_spare(0), spare_limit(0), spare_inner(nullptr), n_spare_inner(0) {}
+        explicit BPTreeImpl(const Alloc& alloc):
+            root(nullptr), head(nullptr), tail(nullptr), _version(0), _size(0), allocator(alloc),
+            spare(nullptr), n_spare(0), spare_limit(0), spare_inner(nullptr), n_spare_inner(0) {}
+
+        BPTreeImpl(const BPTreeImpl&) = delete;
+        BPTreeImpl& operator=(const BPTreeImpl&) = delete;
+
+        ~BPTreeImpl() {
+            this->clear();
+            this->shrink_to_fit();
+        }
+};
+#endif // __cplusplus >= 201703
+
+
+template<typename T>
+struct IsRBTreeImpl : std::false_type {};
+template<typename T1, typename T2, bool V1, bool V2, typename T4, typename T5, typename T6, typename T7>
+struct IsRBTreeImpl<RBTreeImpl<T1,T2,V1,V2,T4,T5,T6,T7>> : std::true_type {};
+#if __cplusplus >= 201703
+template<typename T1, typename T2, bool V1, bool V2, typename T4, typename T5, typename T6>
+struct IsRBTreeImpl<BPTreeImpl<T1,T2,V1,V2,T4,T5,T6>> : std::true_type {};
+#endif // __cplusplus >= 201703
+#if __cplusplus >= 202002
+template<typename T>
+concept C_RBTreeImpl = IsRBTreeImpl<T>::value;
+#endif // __cplusplus >= 202002
+
+
+template<bool reverse, bool const_iterator, typename RBTreeType>
+struct DummyIterator {
+    using rbtree_t = RBTreeType;
+    using nodeptr_t = typename rbtree_t::nodeptr_t;
+
+    template<typename TreeRef>
+    DummyIterator(const TreeRef& tree, nodeptr_t node, size_t version) {}
+    template<typename Owner>
+    explicit DummyIterator(const Owner* owner) {}
+};
+
+#if __cplusplus >= 202002
+template<bool reverse, bool const_iterator, C_RBTreeImpl RBTreeType>
+#else
+template<bool reverse, bool const_iterator, typename RBTreeType, typename std::enable_if<IsRBTreeImpl<RBTreeType>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+class RBTreeImplIterator {
+    public:
+        using rbtree_t = RBTreeType;
+        using storage_type = typename rbtree_t::storage_type;
+        using nodeptr_t = typename rbtree_t::nodeptr_t;
+        using const_nodeptr_t = typename rbtree_t::const_nodeptr_t;
+        using const_iterator_alt_t = typename std::conditional<const_iterator,DummyIterator<reverse,true,RBTreeType>,RBTreeImplIterator<reverse,true,RBTreeType>>::type;
+
+        using iterator_category = typename std::conditional<RBTreeType::PositionInformation, std::random_access_iterator_tag, std::bidirectional_iterator_tag>::type;
+        using value_type = typename storage_type::storage_type_base;
+        using difference_type = long;
+        using pointer = value_type*;
+        using reference = typename std::conditional<const_iterator, const value_type&, value_type&>::type;
+        using const_reference = const value_type&;
+
+    private:
+        std::weak_ptr<rbtree_t> tree;
+        nodeptr_t node;
+        size_t version;
+        // tree of the container whose end iterator was taken before the container had a tree
+        const std::shared_ptr<rbtree_t>* owner;
+
+        /** tree of the iterator, nullptr if it's an iterator of a container which has no tree yet */
+        std::shared_ptr<rbtree_t> check_version() const {
+            if (this->owner != nullptr) {
+                return *this->owner;
+            }
+
+            auto tree = this->tree.lock();
+            if (!tree) {
+                throw std::logic_error("access invalid iterator");
+            }
+
+            // nodes of a red-black tree stay where they are, values of a B+tree move on insertion and erasure
+            if (rbtree_t::RelocatesValues && tree->version() != this->version) {
+                throw std::logic_error("access invalidated iterator");
+            }
 
             return tree;
         }
 
+        /** end iterators of a container which has no tree are told apart by the container */
+        std::ptrdiff_t identity(const std::shared_ptr<rbtree_t>& tree) const {
+            return tree ? reinterpret_cast<std::ptrdiff_t>(tree.get()) : reinterpret_cast<std::ptrdiff_t>(this->owner);
+        }
+
+        /** under DEBUG the node must still be in the tree, it isn't once it's erased or moved to another tree */
+        void check_node(const std::shared_ptr<rbtree_t>& tree) const {
+            if (this->node == nullptr) {
+                throw std::out_of_range("dereference end of a container");
+            }
+#ifdef DEBUG
+            if (tree->erased(this->node, this->version)) {
+                throw std::logic_error("access erased iterator");
+            }
+#else
+            (void)tree;
+#endif // DEBUG
+        }
+
+        /** to is reached by walking the tree, so it's in the tree now even if its address was erased before */
+        void move_to(const std::shared_ptr<rbtree_t>& tree, nodeptr_t to) {
+            this->node = to;
+            if (!rbtree_t::RelocatesValues) this->version = tree->version();
+        }
+
+    protected:
+        template<
+            typename _Key, typename _Value, bool multi, bool keep_position_info,
+#if __cplusplus >= 202002
+            C_KeyCompare<_Key> Compare,
+#else
+            typename Compare,
+#endif // __cplusplus >= 202002
+            typename Alloc, bool checked_iterator, typename SizeT, typename NodePolicy>
+        friend class generic_container;
+
+        void sync_version() {
+            if (this->owner != nullptr) return;
+
+            auto tree = this->tree.lock();
+            if (!tree) {
+                throw std::logic_error("access invalid iterator");
+            }
+
+            this->version = tree->version();
+        }
+
+    public:
+        const_nodeptr_t nodeptr() const { return this->node; }
+        nodeptr_t nodeptr() { return this->node; }
+        ptrdiff_t treeid() const { return this->identity(this->owner != nullptr ? *this->owner : this->tree.lock()); }
+
+        size_t indexof() const {
+            auto tree = this->check_version();
+            return tree ? tree->indexof(this->node) : 0;
+        }
+
+        explicit operator bool() const {
+            this->check_version();
+            return this->node != nullptr;
+        }
+
+        // NOLINTNEXTLINE
+        operator const_iterator_alt_t() const {
+            if (this->owner != nullptr) {
+                return const_iterator_alt_t(this->owner);
+            }
+            return const_iterator_alt_t(this->tree, this->node, this->version);
+        }
+
+        const pointer operator->() const {
+            this->check_node(this->check_version());
+            return &rbtree_t::value_ref(this->node);
+        }
+
+        pointer operator->() {
+            this->check_node(this->check_version());
+            return &rbtree_t::value_ref(this->node);
+        }
+
+        const_reference operator*() const {
+            this->check_node(this->check_version());
+            return rbtree_t::value_ref(this->node);
+        }
+
+        reference operator*() {
+            this->check_node(this->check_version());
+            return rbtree_t::value_ref(this->node);
+        }
+
+        const_reference operator[](difference_type n) const {
+            auto val = this->operator+(n);
+            return *val;
+        }
+
+        reference operator[](difference_type n) {
+            auto val = this->operator+(n);
+            return *val;
+        }
+
+        RBTreeImplIterator& operator++() {
+            auto tree = this->check_version();
+            if (this->node == nullptr) {
+                throw std::out_of_range("increment end iterator");
+            }
+            this->check_node(tree);
+
+            this->move_to(tree, tree->advance(this->node, reverse ? -1 : 1));
+            return *this;
+        }
+
+        RBTreeImplIterator operator++(int) {
+            auto ans = *this;
+            this->operator++();
+            return ans;
+        }
+
+        RBTreeImplIterator& operator--() {
+            auto tree = this->check_version();
+            if (!tree) {
+                throw std::out_of_range("decrement begin iterator");
+            }
+            if (reverse && this->node == nullptr && tree->size() > 0) {
+                this->move_to(tree, tree->begin());
+                return *this;
+            }
+            if (this->node != nullptr) this->check_node(tree);
+
+            auto dec = tree->advance(this->node, reverse ? 1 : -1);
+            if (dec == nullptr) {
+                throw std::out_of_range("decrement begin iterator");
+            } else {
+                this->move_to(tree, dec);
+            }
+            return *this;
+        }
+
+        RBTreeImplIterator operator--(int) {
+            auto ans = *this;
+            this->operator--();
+            return ans;
+        }
+
+        RBTreeImplIterator& operator+=(int n) {
+            auto tree = this->check_version();
+            if (n == 0) return *this;
+            if (!tree) {
+                throw std::out_of_range("out of range by adding '" + std::to_string(n) + "', size: 0");
+            }
+
+            if (reverse && this->node == nullptr && n < 0 && tree->size() > 0) {
+                this->move_to(tree, tree->begin());
+                n += 1;
+            }
+            if (this->node != nullptr) this->check_node(tree);
+
+            auto m = tree->advance(this->node, reverse ? -n : n);
+            if (m == nullptr) {
+                long idx = tree->indexof(this->node);
+                if (0 > idx + n || idx + n > tree->size()) {
+                    throw std::out_of_range(
+                            "out of range by adding '" + std::to_string(n) + 
+                            "', current_idx: " + std::to_string(idx) + 
+                            ", size: " + std::to_string(tree->size()));
+                }
+            }
+            this->move_to(tree, m);
+            return *this;
+        }
+
+        RBTreeImplIterator& operator-=(difference_type n) {
+            return this->operator+=(-n);
+        }
+
+        RBTreeImplIterator operator+(difference_type n) const {
+            auto ans = *this;
+            return ans.operator+=(n);
+        }
+
+        RBTreeImplIterator operator-(difference_type n) const {
+            auto ans = *this;
+            return ans.operator-=(n);
+        }
+
+        difference_type operator-(RBTreeImplIterator iter) const {
+            difference_type idx1 = this->indexof(), idx2 = iter.indexof();
+
+            if (reverse) {
+                auto tree = this->check_version();
+                difference_type size = tree ? tree->size() : 0;
+                idx1 = idx1 != size ? size - 1 - idx1 : idx1;
+                idx2 = idx2 != size ? size - 1 - idx2 : idx2;
+            }
+
+            return idx1 - idx2;
+        }
+
+        /** end iterators taken before the container had a tree equal the end iterators of its tree */
+        bool operator==(const RBTreeImplIterator& oth) const {
+            auto t1 = this->check_version(), t2 = oth.check_version();
+            return oth.node == this->node && this->identity(t1) == oth.identity(t2);
+        }
+
+        bool operator!=(const RBTreeImplIterator& oth) const {
+            return !this->operator==(oth);
+        }
+
+        bool operator<(const RBTreeImplIterator& oth) const {
+            auto t1 = this->check_version(), t2 = oth.check_version();
+            if (this->identity(t1) != oth.identity(t2)) {
+                throw std::logic_error("it's invalid to compare iterators from different container");
+            }
+            if (!t1) return false;
+            const auto idx1 = t1->indexof(this->node), idx2 = t1->indexof(oth.node);
+            return reverse ? idx1 > idx2 :  idx1 < idx2;
+        }
+
+        bool operator>(const RBTreeImplIterator& oth) const {
+            auto t1 = this->check_version(), t2 = oth.check_version();
+            if (this->identity(t1) != oth.identity(t2)) {
+                throw std::logic_error("it's invalid to compare iterators from different container");
+            }
+            if (!t1) return false;
+            const auto idx1 = t1->indexof(this->node), idx2 = t1->indexof(oth.node);
+            return reverse ? idx1 < idx2 :  idx1 > idx2;
+        }
+
+        inline bool operator<=(const RBTreeImplIterator& oth) const {
+            return oth.operator>(*this);
+        }
+
+        inline bool operator>=(const RBTreeImplIterator& oth) const {
+            return oth.operator<(*this);
+        }
+
+        RBTreeImplIterator(std::weak_ptr<rbtree_t> tree, nodeptr_t node, size_t version): tree(tree), node(node), version(version), owner(nullptr) {}
+        /** end iterator of a container which has no tree, owner is where the container keeps its tree */
+        explicit RBTreeImplIterator(const std::shared_ptr<rbtree_t>* owner): node(nullptr), version(0), owner(owner) {}
+};
+
+
+#if __cplusplus >= 202002
+template<bool reverse, bool const_iterator, C_RBTreeImpl RBTreeType>
+#else
+template<bool reverse, bool const_iterator, typename RBTreeType, typename std::enable_if<IsRBTreeImpl<RBTreeType>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+RBTreeImplIterator<reverse,const_iterator,RBTreeType> 
+operator+(
+        typename  std::iterator_traits<RBTreeImplIterator<reverse,const_iterator,RBTreeType>>::difference_type n,
+        RBTreeImplIterator<reverse,const_iterator,RBTreeType> iter)
+{
+    return iter + n;
+}
+
+
+/**
+ * iterator without the std::weak_ptr bookkeeping of RBTreeImplIterator, it only holds
+ * raw pointers of tree and node, so increment and dereference cost nothing beyond
+ * the tree walk. validity of the iterator is asserted only when DEBUG is defined: the node
+ * must not have left the tree since the iterator was taken, the tree records the version at
+ * which nodes are erased or moved to another tree, a B+tree must be unchanged since values
+ * move on insertion and erasure, and += must not move past the end. Other nodes of a red-black
+ * tree may be inserted and erased
+ */
+#if __cplusplus >= 202002
+template<bool reverse, bool const_iterator, C_RBTreeImpl RBTreeType>
+#else
+template<bool reverse, bool const_iterator, typename RBTreeType, typename std::enable_if<IsRBTreeImpl<RBTreeType>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+class RBTreeImplFastIterator {
+    public:
+        using rbtree_t = RBTreeType;
+        using storage_type = typename rbtree_t::storage_type;
+        using nodeptr_t = typename rbtree_t::nodeptr_t;
+        using const_nodeptr_t = typename rbtree_t::const_nodeptr_t;
+        using const_iterator_alt_t = typename std::conditional<const_iterator,DummyIterator<reverse,true,RBTreeType>,RBTreeImplFastIterator<reverse,true,RBTreeType>>::type;
+
+        using iterator_category = typename std::conditional<RBTreeType::PositionInformation, std::random_access_iterator_tag, std::bidirectional_iterator_tag>::type;
+        using value_type = typename storage_type::storage_type_base;
+        using difference_type = long;
+        using pointer = typename std::conditional<const_iterator, const value_type*, value_type*>::type;
+        using reference = typename std::conditional<const_iterator, const value_type&, value_type&>::type;
+        using const_reference = const value_type&;
+
+    private:
+        /**
+         * address of the tree, or with the lowest bit set the address where a container which has no tree
+         * yet will keep it, so that an end iterator taken before the first insertion stays valid
+         */
+        std::uintptr_t treeref;
+        nodeptr_t node;
+#ifdef DEBUG
+        size_t version;
+#endif // DEBUG
+
+        inline rbtree_t* get_tree() const noexcept {
+            if (this->treeref & 1) {
+                return reinterpret_cast<const std::shared_ptr<rbtree_t>*>(this->treeref & ~static_cast<std::uintptr_t>(1))->get();
+            }
+            return reinterpret_cast<rbtree_t*>(this->treeref);
+        }
+
+        /** end iterators of a container which has no tree are told apart by the container */
+        inline std::ptrdiff_t identity() const noexcept {
+            const auto tree = this->get_tree();
+            return tree != nullptr ? reinterpret_cast<std::ptrdiff_t>(tree) : static_cast<std::ptrdiff_t>(this->treeref);
+        }
+
+        inline void check_version() const noexcept {
+#ifdef DEBUG
+            RB_ASSERT(this->treeref != 0);
+            RB_ASSERT(!rbtree_t::RelocatesValues || (this->treeref & 1) || this->get_tree()->version() == this->version);
+#endif // DEBUG
+        }
+
+        inline void check_dereference() const noexcept {
+            this->check_version();
+            RB_ASSERT(this->node != nullptr);
+            RB_ASSERT(!this->get_tree()->erased(this->node, this->version));
+        }
+
+        /** see RBTreeImplIterator::move_to() */
+        inline void move_to(nodeptr_t to) noexcept {
+            this->node = to;
+            if (!rbtree_t::RelocatesValues) this->sync_version();
+        }
+
     protected:
         template<
             typename _Key, typename _Value, bool multi, bool keep_position_info,
@@ -1676,218 +6169,431 @@ class RBTreeImplIterator {
 #else
             typename Compare,
 #endif // __cplusplus >= 202002
-            typename Alloc>
+            typename Alloc, bool checked_iterator, typename SizeT, typename NodePolicy>
         friend class generic_container;
 
-        void sync_version() {
-            auto tree = this->tree.lock();
-            if (!tree) {
-                throw std::logic_error("access invalid iterator");
-            }
-
-            this->version = tree->version();
+        void sync_version() noexcept {
+#ifdef DEBUG
+            const auto tree = this->get_tree();
+            if (tree != nullptr) this->version = tree->version();
+#endif // DEBUG
         }
 
     public:
-        const_nodeptr_t nodeptr() const { return this->node; }
-        nodeptr_t nodeptr() { return this->node; }
-        ptrdiff_t treeid() const { return reinterpret_cast<std::ptrdiff_t>(this->tree.lock().get()); }
+        const_nodeptr_t nodeptr() const noexcept { return this->node; }
+        nodeptr_t nodeptr() noexcept { return this->node; }
+        ptrdiff_t treeid() const noexcept { return this->identity(); }
 
         size_t indexof() const {
-            auto tree = this->check_version();
-            return tree->indexof(this->node);
+            this->check_version();
+            const auto tree = this->get_tree();
+            return tree != nullptr ? tree->indexof(this->node) : 0;
         }
 
-        explicit operator bool() const {
+        explicit operator bool() const noexcept {
             this->check_version();
             return this->node != nullptr;
         }
 
         // NOLINTNEXTLINE
-        operator const_iterator_alt_t() const {
-            return const_iterator_alt_t(this->tree, this->node, this->version);
-        }
-
-        const pointer operator->() const {
-            this->check_version();
-            if (this->node == nullptr) {
-                throw std::out_of_range("dereference end of a container");
+        operator const_iterator_alt_t() const noexcept {
+            if (this->treeref & 1) {
+                return const_iterator_alt_t(reinterpret_cast<const std::shared_ptr<rbtree_t>*>(this->treeref & ~static_cast<std::uintptr_t>(1)));
             }
-            return &node->value.get();
+#ifdef DEBUG
+            return const_iterator_alt_t(this->get_tree(), this->node, this->version);
+#else
+            return const_iterator_alt_t(this->get_tree(), this->node, 0);
+#endif // DEBUG
         }
 
-        pointer operator->() {
-            this->check_version();
-            if (this->node == nullptr) {
-                throw std::out_of_range("dereference end of a container");
-            }
-            return &node->value.get();
+        pointer operator->() const noexcept {
+            this->check_dereference();
+            return &rbtree_t::value_ref(this->node);
         }
 
-        const_reference operator*() const {
-            this->check_version();
-            if (this->node == nullptr) {
-                throw std::out_of_range("dereference end of a container");
-            }
-            return node->value.get();
+        const_reference operator*() const noexcept {
+            this->check_dereference();
+            return rbtree_t::value_ref(this->node);
         }
 
-        reference operator*() {
-            this->check_version();
-            if (this->node == nullptr) {
-                throw std::out_of_range("dereference end of a container");
-            }
-            return node->value.get();
+        reference operator*() noexcept {
+            this->check_dereference();
+            return rbtree_t::value_ref(this->node);
         }
 
-        const_reference operator[](difference_type n) const {
+        const_reference operator[](difference_type n) const noexcept {
             auto val = this->operator+(n);
             return *val;
         }
 
-        reference operator[](difference_type n) {
+        reference operator[](difference_type n) noexcept {
             auto val = this->operator+(n);
             return *val;
         }
 
-        RBTreeImplIterator& operator++() {
-            auto tree = this->check_version();
-            if (this->node == nullptr) {
-                throw std::out_of_range("increment end iterator");
-            }
-
-            this->node = tree->advance(this->node, reverse ? -1 : 1);
+        RBTreeImplFastIterator& operator++() noexcept {
+            this->check_dereference();
+            this->move_to(reverse ? this->node->prev() : this->node->next());
             return *this;
         }
 
-        RBTreeImplIterator operator++(int) {
+        RBTreeImplFastIterator operator++(int) noexcept {
             auto ans = *this;
             this->operator++();
             return ans;
         }
 
-        RBTreeImplIterator& operator--() {
-            auto tree = this->check_version();
-            if (reverse && this->node == nullptr && tree->size() > 0) {
-                this->node = tree->begin();
-                return *this;
-            }
-
-            auto dec = tree->advance(this->node, reverse ? 1 : -1);
-            if (dec == nullptr) {
-                throw std::out_of_range("decrement begin iterator");
+        RBTreeImplFastIterator& operator--() noexcept {
+            if (this->node == nullptr) {
+                this->check_version();
+                const auto tree = this->get_tree();
+                RB_ASSERT(tree != nullptr);
+                this->move_to(reverse ? tree->begin() : tree->rbegin());
             } else {
-                this->node = dec;
+                this->check_dereference();
+                this->move_to(reverse ? this->node->next() : this->node->prev());
             }
+            RB_ASSERT(this->node != nullptr);
             return *this;
         }
 
-        RBTreeImplIterator operator--(int) {
+        RBTreeImplFastIterator operator--(int) noexcept {
             auto ans = *this;
             this->operator--();
             return ans;
         }
 
-        RBTreeImplIterator& operator+=(int n) {
-            auto tree = this->check_version();
+        RBTreeImplFastIterator& operator+=(difference_type n) noexcept {
+            this->check_version();
             if (n == 0) return *this;
 
-            if (reverse && this->node == nullptr && n < 0 && tree->size() > 0) {
-                this->node = tree->begin();
+            const auto tree = this->get_tree();
+            RB_ASSERT(tree != nullptr);
+            if (reverse && this->node == nullptr && n < 0) {
+                this->move_to(tree->begin());
                 n += 1;
             }
 
-            auto m = tree->advance(this->node, reverse ? -n : n);
-            if (m == nullptr) {
-                long idx = tree->indexof(this->node);
-                if (0 > idx + n || idx + n > tree->size()) {
-                    throw std::out_of_range(
-                            "out of range by adding '" + std::to_string(n) + 
-                            "', current_idx: " + std::to_string(idx) + 
-                            ", size: " + std::to_string(tree->size()));
-                }
-            }
-            this->node = m;
+#ifdef DEBUG
+            RB_ASSERT(this->node == nullptr || !tree->erased(this->node, this->version));
+            // advance() stops at the end, moving past it is an error
+            const difference_type size = tree->size();
+            const difference_type idx = this->node != nullptr ? static_cast<difference_type>(tree->indexof(this->node)) : (reverse ? -1 : size);
+            const difference_type to = reverse ? idx - n : idx + n;
+            RB_ASSERT(reverse ? (-1 <= to && to < size) : (0 <= to && to <= size));
+#endif // DEBUG
+            this->move_to(tree->advance(this->node, reverse ? -n : n));
             return *this;
         }
 
-        RBTreeImplIterator& operator-=(difference_type n) {
+        RBTreeImplFastIterator& operator-=(difference_type n) noexcept {
             return this->operator+=(-n);
         }
 
-        RBTreeImplIterator operator+(difference_type n) const {
+        RBTreeImplFastIterator operator+(difference_type n) const noexcept {
             auto ans = *this;
             return ans.operator+=(n);
         }
 
-        RBTreeImplIterator operator-(difference_type n) const {
+        RBTreeImplFastIterator operator-(difference_type n) const noexcept {
             auto ans = *this;
             return ans.operator-=(n);
         }
 
-        difference_type operator-(RBTreeImplIterator iter) const {
+        difference_type operator-(const RBTreeImplFastIterator& iter) const {
             difference_type idx1 = this->indexof(), idx2 = iter.indexof();
 
             if (reverse) {
-                auto tree = this->check_version();
-                auto size = tree->size();
+                const auto tree = this->get_tree();
+                difference_type size = tree != nullptr ? tree->size() : 0;
                 idx1 = idx1 != size ? size - 1 - idx1 : idx1;
                 idx2 = idx2 != size ? size - 1 - idx2 : idx2;
             }
 
-            return idx1 - idx2;
+            return idx1 - idx2;
+        }
+
+        /** end iterators taken before the container had a tree equal the end iterators of its tree */
+        bool operator==(const RBTreeImplFastIterator& oth) const noexcept {
+            this->check_version();
+            oth.check_version();
+            return this->node == oth.node && (this->treeref == oth.treeref || this->identity() == oth.identity());
+        }
+
+        bool operator!=(const RBTreeImplFastIterator& oth) const noexcept {
+            return !this->operator==(oth);
+        }
+
+        bool operator<(const RBTreeImplFastIterator& oth) const {
+            RB_ASSERT(this->identity() == oth.identity());
+            const auto idx1 = this->indexof(), idx2 = oth.indexof();
+            return reverse ? idx1 > idx2 :  idx1 < idx2;
+        }
+
+        bool operator>(const RBTreeImplFastIterator& oth) const {
+            RB_ASSERT(this->identity() == oth.identity());
+            const auto idx1 = this->indexof(), idx2 = oth.indexof();
+            return reverse ? idx1 < idx2 :  idx1 > idx2;
+        }
+
+        inline bool operator<=(const RBTreeImplFastIterator& oth) const {
+            return oth.operator>(*this);
+        }
+
+        inline bool operator>=(const RBTreeImplFastIterator& oth) const {
+            return oth.operator<(*this);
+        }
+
+        RBTreeImplFastIterator(rbtree_t* tree, nodeptr_t node, size_t version) noexcept:
+#ifdef DEBUG
+            treeref(reinterpret_cast<std::uintptr_t>(tree)), node(node), version(version) {}
+#else
+            treeref(reinterpret_cast<std::uintptr_t>(tree)), node(node) { (void)version; }
+#endif // DEBUG
+        RBTreeImplFastIterator(const std::shared_ptr<rbtree_t>& tree, nodeptr_t node, size_t version) noexcept:
+            RBTreeImplFastIterator(tree.get(), node, version) {}
+        /** end iterator of a container which has no tree, owner is where the container keeps its tree */
+        explicit RBTreeImplFastIterator(const std::shared_ptr<rbtree_t>* owner) noexcept:
+            RBTreeImplFastIterator(reinterpret_cast<rbtree_t*>(reinterpret_cast<std::uintptr_t>(owner) | 1), nullptr, 0) {}
+};
+
+
+#if __cplusplus >= 202002
+template<bool reverse, bool const_iterator, C_RBTreeImpl RBTreeType>
+#else
+template<bool reverse, bool const_iterator, typename RBTreeType, typename std::enable_if<IsRBTreeImpl<RBTreeType>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+RBTreeImplFastIterator<reverse,const_iterator,RBTreeType> 
+operator+(
+        typename  std::iterator_traits<RBTreeImplFastIterator<reverse,const_iterator,RBTreeType>>::difference_type n,
+        RBTreeImplFastIterator<reverse,const_iterator,RBTreeType> iter) noexcept
+{
+    return iter + n;
+}
+
+
+/** tree behind generic_container, NodePolicy may be a tag which selects another backend */
+template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc, typename SizeT, typename NodePolicy>
+struct rbtree_backend_selector {
+    using type = RBTreeImpl<_Key,_Value,multi,keep_position_info,Compare,Alloc,SizeT,NodePolicy>;
+};
+
+#if __cplusplus >= 201703
+/** NodePolicy of a container, selects the B+tree backend */
+struct bptree_nodes {};
+
+template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc, typename SizeT>
+struct rbtree_backend_selector<_Key,_Value,multi,keep_position_info,Compare,Alloc,SizeT,bptree_nodes> {
+    using type = BPTreeImpl<_Key,_Value,multi,keep_position_info,Compare,Alloc,SizeT>;
+};
+#endif // __cplusplus >= 201703
+
+template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc, typename SizeT, typename NodePolicy>
+using rbtree_backend_type = typename rbtree_backend_selector<_Key,_Value,multi,keep_position_info,Compare,Alloc,SizeT,NodePolicy>::type;
+
+
+/** index of the lowest set bit plus one, x must not be zero */
+inline unsigned rbtree_ffs(size_t x) noexcept {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ffsll(static_cast<long long>(x)));
+#else
+    unsigned ans = 1;
+    for (;(x & 1) == 0;x >>= 1,ans++);
+    return ans;
+#endif // __GNUC__
+}
+
+/**
+ * read-only snapshot of a sorted container, see generic_container::freeze().
+ * the values are kept in sorted order, the keys are copied into an Eytzinger (BFS)
+ * array whose lookups are branchless and fetch the cache lines of the next levels in advance,
+ * iterators are pointers into the sorted values so rank and select are O(1)
+ */
+template<typename _Key, typename _Value, typename Compare = default_compare_t<_Key>, typename Alloc = std::allocator<_Key>>
+class frozen_container {
+    public:
+        using key_type        = _Key;
+        using mapped_type     = _Value;
+        using value_type      = typename std::conditional<std::is_same<_Value,void>::value,_Key,std::pair<const _Key,_Value>>::type;
+        using size_type       = size_t;
+        using difference_type = std::ptrdiff_t;
+        using key_compare     = Compare;
+        using allocator_type  = Alloc;
+        using const_reference = const value_type&;
+        using reference       = const_reference;
+        using const_iterator  = const value_type*;
+        using iterator        = const_iterator;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+        using reverse_iterator       = const_reverse_iterator;
+
+    private:
+        using value_allocator_ = typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+        using key_allocator_   = typename std::allocator_traits<Alloc>::template rebind_alloc<_Key>;
+        using index_allocator_ = typename std::allocator_traits<Alloc>::template rebind_alloc<size_t>;
+
+        /** number of levels below the current one whose first node is prefetched */
+        constexpr static size_t prefetch_levels = 4;
+
+        std::vector<value_type,value_allocator_> values;
+        /** keys[k-1] and ranks[k-1] belong to the k-th node of the Eytzinger layout */
+        std::vector<_Key,key_allocator_> keys;
+        std::vector<size_t,index_allocator_> ranks;
+        Compare cmp;
+
+        static inline const _Key& key_of(const _Key& val) { return val; }
+        template<typename K, typename V>
+        static inline const _Key& key_of(const std::pair<K,V>& val) { return val.first; }
+
+        void number_inorder(size_t k, size_t& rank) {
+            if (k > this->ranks.size()) return;
+            this->number_inorder(2 * k, rank);
+            this->ranks[k - 1] = rank++;
+            this->number_inorder(2 * k + 1, rank);
+        }
+
+        void build() {
+            const auto n = this->values.size();
+            this->ranks.resize(n);
+            size_t rank = 0;
+            this->number_inorder(1, rank);
+            this->keys.reserve(n);
+            for (size_t k=0;k<n;k++) {
+                this->keys.push_back(key_of(this->values[this->ranks[k]]));
+            }
+        }
+
+        /** rank of the first value v which doesn't satisfy pred(v), pred must be partitioning */
+        template<typename Pred>
+        size_t partition_point(Pred pred) const {
+            const auto n = this->keys.size();
+            const _Key* keys = this->keys.data();
+            size_t k = 1;
+            while (k <= n) {
+                rbtree_prefetch(keys + (std::min(k << prefetch_levels, n) - 1));
+                k = 2 * k + static_cast<size_t>(pred(keys[k - 1]));
+            }
+            k >>= rbtree_ffs(~k);
+            return k == 0 ? n : this->ranks[k - 1];
+        }
+
+    public:
+        explicit frozen_container(const Compare& cmp = Compare(), const Alloc& alloc = Alloc()):
+            values(value_allocator_(alloc)), keys(key_allocator_(alloc)), ranks(index_allocator_(alloc)), cmp(cmp) {}
+
+        /** [first, last) must be sorted by cmp */
+        template<typename Iter>
+        frozen_container(Iter first, Iter last, const Compare& cmp = Compare(), const Alloc& alloc = Alloc()):
+            frozen_container(cmp, alloc)
+        {
+            this->values.reserve(std::distance(first, last));
+            for (;first!=last;++first) {
+                RB_ASSERT(this->values.empty() || !this->cmp(key_of(*first), key_of(this->values.back())));
+                this->values.emplace_back(*first);
+            }
+            this->build();
+        }
+
+        inline const_iterator begin() const noexcept { return this->values.data(); }
+        inline const_iterator end() const noexcept { return this->values.data() + this->values.size(); }
+        inline const_iterator cbegin() const noexcept { return this->begin(); }
+        inline const_iterator cend() const noexcept { return this->end(); }
+        inline const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(this->end()); }
+        inline const_reverse_iterator rend() const noexcept { return const_reverse_iterator(this->begin()); }
+
+        inline size_t size() const noexcept { return this->values.size(); }
+        inline bool empty() const noexcept { return this->values.empty(); }
+        Compare key_comp() const { return this->cmp; }
+        Alloc get_allocator() const { return Alloc(this->values.get_allocator()); }
+
+        template<typename _K>
+        const_iterator lower_bound(const _K& key) const {
+            const auto& cmp = this->cmp;
+            return this->begin() + this->partition_point([&](const _Key& k) { return cmp(k, key); });
+        }
+
+        template<typename _K>
+        const_iterator upper_bound(const _K& key) const {
+            const auto& cmp = this->cmp;
+            return this->begin() + this->partition_point([&](const _Key& k) { return !cmp(key, k); });
+        }
+
+        template<typename _K>
+        const_iterator find(const _K& key) const {
+            auto lb = this->lower_bound(key);
+            return (lb == this->end() || this->cmp(key, key_of(*lb))) ? this->end() : lb;
+        }
+
+        template<typename _K>
+        std::pair<const_iterator,const_iterator> equal_range(const _K& key) const {
+            return std::make_pair(this->lower_bound(key), this->upper_bound(key));
+        }
+
+        template<typename _K>
+        size_t count(const _K& key) const {
+            return this->upper_bound(key) - this->lower_bound(key);
+        }
+
+        template<typename _K>
+        bool contains(const _K& key) const {
+            return this->find(key) != this->end();
+        }
+
+        /** position of iter in sorted order */
+        inline size_t rank(const_iterator iter) const noexcept {
+            return iter - this->begin();
         }
 
-        bool operator==(const RBTreeImplIterator& oth) const {
-            auto t1 = this->check_version(), t2 = oth.check_version();
-            return t1 == t2 && oth.node == this->node;
+        /** iterator of the n-th smallest value */
+        inline const_iterator select(size_t n) const noexcept {
+            return this->begin() + n;
         }
 
-        bool operator!=(const RBTreeImplIterator& oth) const {
-            return !this->operator==(oth);
+        inline const_iterator nth(size_t n) const noexcept {
+            return this->select(n);
         }
 
-        bool operator<(const RBTreeImplIterator& oth) const {
-            auto t1 = this->check_version(), t2 = oth.check_version();
-            if (t1 != t2) {
-                throw std::logic_error("it's invalid to compare iterators from different container");
-            }
-            const auto idx1 = t1->indexof(this->node), idx2 = t1->indexof(oth.node);
-            return reverse ? idx1 > idx2 :  idx1 < idx2;
+        /** number of values less than key */
+        template<typename _K>
+        size_t rank(const _K& key) const {
+            return this->lower_bound(key) - this->begin();
         }
 
-        bool operator>(const RBTreeImplIterator& oth) const {
-            auto t1 = this->check_version(), t2 = oth.check_version();
-            if (t1 != t2) {
-                throw std::logic_error("it's invalid to compare iterators from different container");
-            }
-            const auto idx1 = t1->indexof(this->node), idx2 = t1->indexof(oth.node);
-            return reverse ? idx1 < idx2 :  idx1 > idx2;
+        /** number of values in [lo, hi) */
+        template<typename _K1, typename _K2>
+        size_t count_between(const _K1& lo, const _K2& hi) const {
+            auto first = this->lower_bound(lo), last = this->lower_bound(hi);
+            return first < last ? last - first : 0;
         }
 
-        inline bool operator<=(const RBTreeImplIterator& oth) const {
-            return oth.operator>(*this);
+        template<typename _K>
+        std::pair<const_iterator,size_t> lower_bound_with_rank(const _K& key) const {
+            auto lb = this->lower_bound(key);
+            return std::make_pair(lb, static_cast<size_t>(lb - this->begin()));
         }
 
-        inline bool operator>=(const RBTreeImplIterator& oth) const {
-            return oth.operator<(*this);
+        const_reference operator[](size_t n) const noexcept {
+            return this->values[n];
         }
 
-        RBTreeImplIterator(std::weak_ptr<rbtree_t> tree, nodeptr_t node, size_t version): tree(tree), node(node), version(version) {}
+        template<typename _K, typename V = _Value, typename std::enable_if<!std::is_same<V,void>::value,bool>::type = true>
+        const V& at(const _K& key) const {
+            auto it = this->find(key);
+            if (it == this->end()) {
+                throw std::out_of_range("key doesn't exist");
+            }
+            return it->second;
+        }
 };
 
+template<typename _Key, typename _Value, typename Compare, typename Alloc>
+bool operator==(const frozen_container<_Key,_Value,Compare,Alloc>& lhs, const frozen_container<_Key,_Value,Compare,Alloc>& rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
 
-#if __cplusplus >= 202002
-template<bool reverse, bool const_iterator, C_RBTreeImpl RBTreeType>
-#else
-template<bool reverse, bool const_iterator, typename RBTreeType, typename std::enable_if<IsRBTreeImpl<RBTreeType>::value,bool>::type = true>
-#endif // __cplusplus >= 202002
-RBTreeImplIterator<reverse,const_iterator,RBTreeType> 
-operator+(
-        typename  std::iterator_traits<RBTreeImplIterator<reverse,const_iterator,RBTreeType>>::difference_type n,
-        RBTreeImplIterator<reverse,const_iterator,RBTreeType> iter)
-{
-    return iter + n;
+template<typename _Key, typename _Value, typename Compare, typename Alloc>
+bool operator!=(const frozen_container<_Key,_Value,Compare,Alloc>& lhs, const frozen_container<_Key,_Value,Compare,Alloc>& rhs) {
+    return !(lhs == rhs);
 }
 
 
@@ -1898,11 +6604,82 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,_Value>>
+    typename Alloc = default_allocato_t<_Key,_Value>, bool checked_iterator = true, typename SizeT = size_t,
+    typename NodePolicy = rbtree_plain>
 class generic_container {
     protected:
-        using rbtree_t = RBTreeImpl<_Key,_Value,multi,keep_position_info,Compare,Alloc>;
+        using rbtree_t = rbtree_backend_type<_Key,_Value,multi,keep_position_info,Compare,Alloc,SizeT,NodePolicy>;
+        /**
+         * the tree is allocated on the first insertion from the comparator and the allocator kept
+         * by the container, once there is a tree they are read from it
+         */
         std::shared_ptr<rbtree_t> rbtree;
+        Compare cmp;
+        Alloc allocator;
+
+        // merge() takes the tree of a container with another comparator
+#if __cplusplus >= 202002
+        template<typename K, typename V, bool mu, bool kp, C_KeyCompare<K> C, typename A, bool ci, typename S, typename N>
+#else
+        template<typename K, typename V, bool mu, bool kp, typename C, typename A, bool ci, typename S, typename N>
+#endif // __cplusplus >= 202002
+        friend class generic_container;
+
+        constexpr static bool nothrow_copy_policy = std::is_nothrow_copy_constructible<Compare>::value &&
+                                                    std::is_nothrow_copy_constructible<Alloc>::value;
+        template<typename propagate>
+        constexpr static bool nothrow_swap_policy() {
+            return std::is_nothrow_move_constructible<Compare>::value && std::is_nothrow_move_assignable<Compare>::value &&
+                   (!propagate::value || (std::is_nothrow_move_constructible<Alloc>::value && std::is_nothrow_move_assignable<Alloc>::value));
+        }
+
+        /** the allocator follows the tree if the allocator propagates, otherwise it's assumed to equal the other one */
+        inline void swap_allocator(generic_container& oth, std::true_type) {
+            std::swap(this->allocator, oth.allocator);
+        }
+        inline void swap_allocator(generic_container&, std::false_type) {}
+
+        /** tree of the container, allocated if it isn't yet. Only the members which add values call it */
+        inline rbtree_t& mtree() {
+            if (!this->rbtree) {
+                this->rbtree = std::make_shared<rbtree_t>(this->cmp, this->allocator);
+            }
+            return *this->rbtree;
+        }
+
+        template<bool reverse, bool const_iterator>
+        using iterator_t = typename std::conditional<checked_iterator,
+                                                     RBTreeImplIterator<reverse,const_iterator,rbtree_t>,
+                                                     RBTreeImplFastIterator<reverse,const_iterator,rbtree_t>>::type;
+
+        /**
+         * iterator of node. A container without tree returns end iterators which read the tree through
+         * this->rbtree, so that they equal end() after the first insertion as well
+         */
+        template<typename Iter>
+        inline Iter make_iterator(typename rbtree_t::nodeptr_t node) const {
+            return this->rbtree ? Iter(this->rbtree, node, this->rbtree->version()) : Iter(&this->rbtree);
+        }
+
+        /** keys of other types than _Key which are accepted by erase(), extract() and at() */
+        template<typename _K>
+        using transparent_key = std::integral_constant<bool,
+            rbtree_transparent<Compare>::value && !std::is_same<typename std::decay<_K>::type,_Key>::value &&
+            !std::is_convertible<_K,iterator_t<false,false>>::value && !std::is_convertible<_K,iterator_t<false,true>>::value>;
+
+        /**
+         * lookup keys are passed to the tree as they are if the comparator is transparent,
+         * otherwise they are converted to _Key once instead of at every comparison
+         */
+        template<typename _K>
+        using lookup_key_t = typename std::conditional<
+            rbtree_transparent<Compare>::value || std::is_same<typename std::decay<_K>::type,_Key>::value || !std::is_constructible<_Key,const _K&>::value,
+            const _K&, _Key>::type;
+
+        template<typename _K>
+        static inline lookup_key_t<_K> lookup_key(const _K& key) {
+            return lookup_key_t<_K>(key);
+        }
 
     public:
         using rbtree_storage_type = typename rbtree_t::storage_type;
@@ -1919,10 +6696,10 @@ class generic_container {
         using const_reference        = typename rbtree_t::const_reference;
         using pointer                = typename rbtree_t::pointer;
         using const_pointer          = typename rbtree_t::const_pointer;
-        using iterator               = RBTreeImplIterator<false,false,rbtree_t>;
-        using const_iterator         = RBTreeImplIterator<false,true,rbtree_t>;
-        using reverse_iterator       = RBTreeImplIterator<true,false,rbtree_t>;
-        using reverse_const_iterator = RBTreeImplIterator<true,true,rbtree_t>;
+        using iterator               = iterator_t<false,false>;
+        using const_iterator         = iterator_t<false,true>;
+        using reverse_iterator       = iterator_t<true,false>;
+        using reverse_const_iterator = iterator_t<true,true>;
 
     private:
         class node_type_generic {
@@ -2061,7 +6838,7 @@ class generic_container {
             explicit node_type_set(Args&&... args): node_type_generic(std::forward<Args>(args)...) { }
 
             value_type& value() const {
-                return const_cast<value_type&>(this->get_node().get());
+                return const_cast<value_type&>(this->get_node().value.get());
             }
         };
         class node_type_map: public node_type_generic {
@@ -2074,11 +6851,11 @@ class generic_container {
             explicit node_type_map(Args&&... args): node_type_generic(std::forward<Args>(args)...) { }
 
             key_type& key() const {
-                return const_cast<key_type&>(this->get_node().get().first);
+                return const_cast<key_type&>(this->get_node().value.get().first);
             }
 
             mapped_type& mapped() const {
-                return const_cast<mapped_type&>(this->get_node().get().second);
+                return const_cast<mapped_type&>(this->get_node().value.get().second);
             }
         };
 
@@ -2092,28 +6869,39 @@ class generic_container {
             insert_return_type(iterator pos, bool inserted, node_type&& nh): position(pos), inserted(inserted), node(std::move(nh)) {}
         };
 
-        generic_container(): rbtree(std::make_shared<rbtree_t>()) {}
-        explicit generic_container(const Compare& cmp, const Alloc& alloc = Alloc()): rbtree(std::make_shared<rbtree_t>(cmp, alloc)) {
+        generic_container() noexcept(std::is_nothrow_default_constructible<Compare>::value && std::is_nothrow_default_constructible<Alloc>::value) {}
+        explicit generic_container(const Compare& cmp, const Alloc& alloc = Alloc()): cmp(cmp), allocator(alloc) {
         }
-        explicit generic_container(const Alloc& alloc): rbtree(std::make_shared<rbtree_t>(alloc)) {
+        explicit generic_container(const Alloc& alloc): allocator(alloc) {
         }
 
-        generic_container(const generic_container& oth): rbtree(std::make_shared<rbtree_t>(oth.rbtree->cmp_object(), oth.rbtree->get_allocator()))
+        /**
+         * a copy of at least rbtree_parallel_copy_size values which are rbtree_value_concurrent_copy is cloned
+         * on up to hardware_concurrency() threads, parallel_assign() copies with another executor
+         */
+        generic_container(const generic_container& oth): cmp(oth.key_comp()), allocator(oth.get_allocator())
         {
-            oth.rbtree->copy_to(*this->rbtree);
+            if (!oth.empty()) copy_tree(*oth.rbtree, this->mtree());
         }
-        generic_container(const generic_container& oth, const Alloc& alloc): rbtree(std::make_shared<rbtree_t>(oth.rbtree->cmp_object(), alloc))
+        generic_container(const generic_container& oth, const Alloc& alloc): cmp(oth.key_comp()), allocator(alloc)
         {
-            oth.rbtree->copy_to(*this->rbtree);
+            if (!oth.empty()) copy_tree(*oth.rbtree, this->mtree());
         }
 
-        generic_container(generic_container&& oth): rbtree(std::make_shared<rbtree_t>(oth.rbtree->cmp_object(), oth.rbtree->get_allocator()))
+        /** the tree is handed over, the moved-from container is left without tree */
+        generic_container(generic_container&& oth) noexcept(nothrow_copy_policy):
+            cmp(oth.key_comp()), allocator(oth.get_allocator())
         {
-            std::swap(oth.rbtree, this->rbtree);
+            this->rbtree = std::move(oth.rbtree);
         }
-        generic_container(generic_container&& oth, const Alloc& alloc): rbtree(std::make_shared<rbtree_t>(oth.rbtree->cmp_object(), alloc))
+        generic_container(generic_container&& oth, const Alloc& alloc): cmp(oth.key_comp()), allocator(alloc)
         {
-            std::swap(oth.rbtree, this->rbtree);
+            if (alloc == oth.get_allocator()) {
+                this->rbtree = std::move(oth.rbtree);
+            } else if (!oth.empty()) {
+                copy_tree(*oth.rbtree, this->mtree());
+                oth.clear();
+            }
         }
 
 #if __cplusplus >= 202002
@@ -2128,7 +6916,7 @@ class generic_container {
                 bool>::type = true>
 #endif // __cplusplus >= 202002
         generic_container(InputIt begin, InputIt end, const Compare& cmp = Compare(), const Alloc& alloc = Alloc()):
-            rbtree(std::make_shared<rbtree_t>(cmp, alloc))
+            cmp(cmp), allocator(alloc)
         {
             this->insert(begin, end);
         }
@@ -2145,7 +6933,7 @@ class generic_container {
                 bool>::type = true>
 #endif // __cplusplus >= 202002
         generic_container(InputIt begin, InputIt end, const Alloc& alloc):
-            rbtree(std::make_shared<rbtree_t>(alloc))
+            allocator(alloc)
         {
             this->insert(begin, end);
         }
@@ -2155,7 +6943,7 @@ class generic_container {
 #else
         template<typename T, typename std::enable_if<std::is_constructible<rbtree_storage_type,T>::value, bool>::type = true>
 #endif // __cplusplus >= 202002
-        generic_container(std::initializer_list<T> init, const Compare& cmp = {}, const Alloc& alloc = {}): rbtree(std::make_shared<rbtree_t>(cmp, alloc)) {
+        generic_container(std::initializer_list<T> init, const Compare& cmp = {}, const Alloc& alloc = {}): cmp(cmp), allocator(alloc) {
             this->insert(init);
         }
 
@@ -2164,109 +6952,228 @@ class generic_container {
 #else
         template<typename T, typename std::enable_if<std::is_constructible<rbtree_storage_type,T>::value, bool>::type = true>
 #endif // __cplusplus >= 202002
-        generic_container(std::initializer_list<T> init, const Alloc& alloc): rbtree(std::make_shared<rbtree_t>(alloc)) {
+        generic_container(std::initializer_list<T> init, const Alloc& alloc): allocator(alloc) {
             this->insert(init);
         }
 
         generic_container& operator=(const generic_container& oth) {
-            oth.rbtree->copy_to(*this->rbtree);
+            if (oth.empty()) {
+                this->clear();
+            } else {
+                copy_tree(*oth.rbtree, this->mtree());
+            }
+            return *this;
+        }
+
+        /**
+         * copy assignment whose subtrees are cloned as tasks of executor, see RBTreeImpl::parallel_copy_to().
+         * The values are copied concurrently, copy construction and copy assignment do it only for values
+         * which are rbtree_value_concurrent_copy
+         */
+        template<typename Executor = rbtree_thread_executor>
+        generic_container& parallel_assign(const generic_container& oth, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            if (this == &oth) return *this;
+            if (oth.empty()) {
+                this->clear();
+            } else {
+                oth.rbtree->parallel_copy_to(this->mtree(), executor, grain);
+            }
             return *this;
         }
-        generic_container& operator=(generic_container&& oth) {
-            this->rbtree->clear();
+        /**
+         * the tree is taken along with the comparator and, if it propagates, the allocator of oth,
+         * oth is left with the cleared tree and the comparator of this one
+         */
+        generic_container& operator=(generic_container&& oth)
+            noexcept(nothrow_swap_policy<typename std::allocator_traits<Alloc>::propagate_on_container_move_assignment>())
+        {
+            if (this->rbtree) this->rbtree->clear();
             std::swap(this->rbtree, oth.rbtree);
-            this->rbtree->touch();
-            oth.rbtree->touch();
+            std::swap(this->cmp, oth.cmp);
+            swap_allocator(oth, typename std::allocator_traits<Alloc>::propagate_on_container_move_assignment());
+            if (this->rbtree) this->rbtree->touch();
+            if (oth.rbtree) oth.rbtree->touch();
             return *this;
         }
 
         Alloc get_allocator() const noexcept {
-            return this->rbtree->get_allocator();
+            return this->rbtree ? this->rbtree->get_allocator() : this->allocator;
         }
         Compare key_comp() const {
-            return this->rbtree->cmp_object();
+            return this->rbtree ? this->rbtree->cmp_object() : this->cmp;
         }
         Compare value_comp() const {
-            return this->rbtree->cmp_object();
+            return this->key_comp();
         }
 
-        inline iterator begin() { return iterator(this->rbtree, this->rbtree->begin(), this->rbtree->version()); }
-        inline iterator end() { return iterator(this->rbtree, nullptr, this->rbtree->version()); }
+        /**
+         * lookups and iteration never allocate, a container which has no tree returns end iterators
+         * that stay valid across the first insertion
+         */
+        inline iterator begin() { return this->make_iterator<iterator>(this->rbtree ? this->rbtree->begin() : nullptr); }
+        inline iterator end() { return this->make_iterator<iterator>(nullptr); }
 
-        inline const_iterator begin() const { return const_iterator(this->rbtree, this->rbtree->begin(), this->rbtree->version()); }
-        inline const_iterator end() const { return const_iterator(this->rbtree, nullptr, this->rbtree->version()); }
+        inline const_iterator begin() const { return this->make_iterator<const_iterator>(this->rbtree ? this->rbtree->begin() : nullptr); }
+        inline const_iterator end() const { return this->make_iterator<const_iterator>(nullptr); }
 
-        inline const_iterator cbegin() const { return const_iterator(this->rbtree, this->rbtree->begin(), this->rbtree->version()); }
-        inline const_iterator cend() const { return const_iterator(this->rbtree, nullptr, this->rbtree->version()); }
+        inline const_iterator cbegin() const { return this->begin(); }
+        inline const_iterator cend() const { return this->end(); }
 
-        inline reverse_iterator rbegin() { return reverse_iterator(this->rbtree, this->rbtree->rbegin(), this->rbtree->version()); }
-        inline reverse_iterator rend() { return reverse_iterator(this->rbtree, nullptr, this->rbtree->version()); }
+        inline reverse_iterator rbegin() { return this->make_iterator<reverse_iterator>(this->rbtree ? this->rbtree->rbegin() : nullptr); }
+        inline reverse_iterator rend() { return this->make_iterator<reverse_iterator>(nullptr); }
 
-        inline reverse_const_iterator rbegin() const { return reverse_const_iterator(this->rbtree, this->rbtree->rbegin(), this->rbtree->version()); }
-        inline reverse_const_iterator rend() const { return reverse_const_iterator(this->rbtree, nullptr, this->rbtree->version()); }
+        inline reverse_const_iterator rbegin() const { return this->make_iterator<reverse_const_iterator>(this->rbtree ? this->rbtree->rbegin() : nullptr); }
+        inline reverse_const_iterator rend() const { return this->make_iterator<reverse_const_iterator>(nullptr); }
 
-        inline reverse_const_iterator crbegin() const { return reverse_const_iterator(this->rbtree, this->rbtree->rbegin(), this->rbtree->version()); }
-        inline reverse_const_iterator crend() const { return reverse_const_iterator(this->rbtree, nullptr, this->rbtree->version()); }
+        inline reverse_const_iterator crbegin() const { return this->rbegin(); }
+        inline reverse_const_iterator crend() const { return this->rend(); }
 
         template<typename _K>
         iterator lower_bound(const _K& key) {
-            auto lb = this->rbtree->lower_bound(key);
-            return iterator(this->rbtree, lb, this->rbtree->version());
+            return this->make_iterator<iterator>(this->rbtree ? this->rbtree->lower_bound(this->lookup_key(key)) : nullptr);
         }
 
         template<typename _K>
         const_iterator lower_bound(const _K& key) const {
-            auto lb = this->rbtree->lower_bound(key);
-            return const_iterator(this->rbtree, lb, this->rbtree->version());
+            return this->make_iterator<const_iterator>(this->rbtree ? this->rbtree->lower_bound(this->lookup_key(key)) : nullptr);
         }
 
         template<typename _K>
         iterator upper_bound(const _K& key) {
-            auto ub = this->rbtree->upper_bound(key);
-            return iterator(this->rbtree, ub, this->rbtree->version());
+            return this->make_iterator<iterator>(this->rbtree ? this->rbtree->upper_bound(this->lookup_key(key)) : nullptr);
         }
 
         template<typename _K>
         const_iterator upper_bound(const _K& key) const {
-            auto ub = this->rbtree->upper_bound(key);
-            return const_iterator(this->rbtree, ub, this->rbtree->version());
+            return this->make_iterator<const_iterator>(this->rbtree ? this->rbtree->upper_bound(this->lookup_key(key)) : nullptr);
         }
 
         template<typename _K>
         iterator find(const _K& key) {
-            auto node = this->rbtree->find(key);
-            return iterator(this->rbtree, node, this->rbtree->version());
+            return this->make_iterator<iterator>(this->rbtree ? this->rbtree->find(this->lookup_key(key)) : nullptr);
         }
 
         template<typename _K>
         const_iterator find(const _K& key) const {
-            auto node = this->rbtree->find(key);
-            return const_iterator(this->rbtree, node, this->rbtree->version());
+            return this->make_iterator<const_iterator>(this->rbtree ? this->rbtree->find(this->lookup_key(key)) : nullptr);
         }
 
         template<typename _K>
         std::pair<iterator,iterator> equal_range(const _K& key) {
-            return std::make_pair(this->lower_bound(key), this->upper_bound(key));
+            auto&& k = this->lookup_key(key);
+            return std::make_pair(this->lower_bound(k), this->upper_bound(k));
         }
 
         template<typename _K>
         std::pair<const_iterator,const_iterator> equal_range(const _K& key) const {
-            return std::make_pair(this->lower_bound(key), this->upper_bound(key));
+            auto&& k = this->lookup_key(key);
+            return std::make_pair(this->lower_bound(k), this->upper_bound(k));
         }
 
         template<typename _K>
         size_t count(const _K& key) const {
-            return this->rbtree->count(key);
+            return this->rbtree ? this->rbtree->count(this->lookup_key(key)) : 0;
         }
 
         template<typename _K>
         bool contains(const _K& key) const {
-            return this->find(key) != this->end();
+            return this->rbtree && this->rbtree->find(this->lookup_key(key)) != nullptr;
+        }
+
+        /**
+         * number of values less than key, the position containers (e.g. pset) find it in a single
+         * descent, the others walk to the lower bound
+         */
+        template<typename _K>
+        size_t rank(const _K& key) const {
+            return this->rbtree ? this->rbtree->lower_bound_with_rank(this->lookup_key(key)).second : 0;
+        }
+
+        /** number of values in [lo, hi) */
+        template<typename _K1, typename _K2>
+        size_t count_between(const _K1& lo, const _K2& hi) const {
+            const size_t first = this->rank(lo), last = this->rank(hi);
+            return first < last ? last - first : 0;
+        }
+
+        template<typename _K>
+        std::pair<iterator,size_t> lower_bound_with_rank(const _K& key) {
+            if (!this->rbtree) return std::make_pair(this->end(), static_cast<size_t>(0));
+            auto lb = this->rbtree->lower_bound_with_rank(this->lookup_key(key));
+            return std::make_pair(this->make_iterator<iterator>(lb.first), static_cast<size_t>(lb.second));
+        }
+
+        template<typename _K>
+        std::pair<const_iterator,size_t> lower_bound_with_rank(const _K& key) const {
+            if (!this->rbtree) return std::make_pair(this->end(), static_cast<size_t>(0));
+            auto lb = this->rbtree->lower_bound_with_rank(this->lookup_key(key));
+            return std::make_pair(this->make_iterator<const_iterator>(lb.first), static_cast<size_t>(lb.second));
+        }
+
+        /** iterator of the k-th smallest value, end() if k is out of range */
+        iterator select(size_t k) {
+            return this->make_iterator<iterator>(k < this->size() ? this->rbtree->select(k) : nullptr);
+        }
+
+        const_iterator select(size_t k) const {
+            return this->make_iterator<const_iterator>(k < this->size() ? this->rbtree->select(k) : nullptr);
+        }
+
+        inline iterator nth(size_t k) { return this->select(k); }
+        inline const_iterator nth(size_t k) const { return this->select(k); }
+
+        /**
+         * lower bounds of the keys in [first, last), written to out in the order of the keys.
+         * Sorted keys which are dense are searched one after another starting from the previous
+         * bound, so m keys cost O(m lg(n/m)) instead of O(m lg n). Other keys are searched from
+         * the root several at a time, so that their cache misses overlap
+         */
+        template<typename ForwardIt, typename OutputIt>
+        OutputIt lower_bound_many(ForwardIt first, ForwardIt last, OutputIt out) {
+            return this->lower_bound_many_<iterator>(first, last, out, false);
+        }
+
+        template<typename ForwardIt, typename OutputIt>
+        OutputIt lower_bound_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+            return this->lower_bound_many_<const_iterator>(first, last, out, false);
         }
 
-        inline size_t size() const { return this->rbtree->size(); }
+        /** find() of the keys in [first, last), see lower_bound_many() */
+        template<typename ForwardIt, typename OutputIt>
+        OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) {
+            return this->lower_bound_many_<iterator>(first, last, out, true);
+        }
+
+        template<typename ForwardIt, typename OutputIt>
+        OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+            return this->lower_bound_many_<const_iterator>(first, last, out, true);
+        }
+
+        /** contains() of the keys in [first, last), see lower_bound_many() */
+        template<typename ForwardIt, typename OutputIt>
+        OutputIt contains_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+            using node_t = typename rbtree_t::nodeptr_t;
+            return this->lookup_many(first, last, out, true, [](node_t node) { return node != nullptr; });
+        }
+
+        /**
+         * rank() of the keys in [first, last), the keys are visited in sorted order and when
+         * they are dense each search starts from the previous bound
+         */
+        template<typename ForwardIt, typename OutputIt>
+        OutputIt rank_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+            using node_t = typename rbtree_t::nodeptr_t;
+            using key_t = typename std::iterator_traits<ForwardIt>::value_type;
+            const auto tree = this->rbtree.get();
+            const bool sorted = this->keys_sorted(first, last), dense = this->dense_keys(first, last);
+            return this->bounds_many(first, last, out, sorted, dense, [&](node_t node, size_type rank, const key_t&) {
+                return static_cast<size_t>(keep_position_info || tree == nullptr ? rank : tree->indexof(node));
+            });
+        }
+
+        inline size_t size() const { return this->rbtree ? this->rbtree->size() : 0; }
         inline bool empty() const { return this->size() == 0; }
-        inline size_t max_size() const noexcept { return std::numeric_limits<size_t>::max(); }
+        inline size_t max_size() const noexcept { return rbtree_t::max_size(); }
 
 #if __cplusplus >= 202002
         template<typename ValType> requires std::constructible_from<value_type,ValType&&>
@@ -2275,8 +7182,8 @@ class generic_container {
 #endif // __cplusplu >= 202002
         std::pair<iterator,bool> insert(ValType&& val)
         {
-            auto result = this->rbtree->insert(std::forward<ValType>(val));
-            return make_pair(iterator(this->rbtree, result.first, this->rbtree->version()), result.second);
+            auto result = this->mtree().insert(std::forward<ValType>(val));
+            return make_pair(this->make_iterator<iterator>(result.first), result.second);
         }
 
 #if __cplusplus >= 202002
@@ -2299,6 +7206,11 @@ class generic_container {
             return this->emplace_hint(hint, std::forward<ValType>(val));
         }
 
+        /**
+         * a batch of at least a quarter of the size of the container is sorted, merged with the
+         * values of the container and the tree is rebuilt in O(n + m lg m), the result is the same
+         * as inserting the values one by one
+         */
 #if __cplusplus >= 202002
         template<std::forward_iterator InputIt>
             requires std::constructible_from<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>
@@ -2311,6 +7223,12 @@ class generic_container {
                 bool>::type = true>
 #endif // __cplusplus >= 202002
         void insert(InputIt first, InputIt last) {
+            // rebuilding visits every node of the tree, it pays off once the batch is a quarter of it
+            const size_t n = std::distance(first, last);
+            if (n >= 16 && n * 4 >= this->size()) {
+                this->mtree().insert_by_rebuild(first, last);
+                return;
+            }
             for(;first != last;first++) this->insert(*first);
         }
 
@@ -2328,12 +7246,12 @@ class generic_container {
                 return insert_return_type(this->end(), false, std::move(nh));
             }
 
-            if (nh.get_allocator() != this->rbtree->get_allocator()) {
+            if (nh.get_allocator() != this->get_allocator()) {
                 throw std::logic_error("allocator of node doesn't equal with allocator of container");
             } else {
-                auto result = this->rbtree->insert_node(nullptr, nh.get());
+                auto result = this->insert_node(nullptr, nh);
                 nh.restore(std::get<1>(result));
-                iterator iter(this->rbtree, std::get<0>(result), this->rbtree->version());
+                auto iter = this->make_iterator<iterator>(std::get<0>(result));
                 return insert_return_type(iter, std::get<2>(result), std::move(nh));
             }
         }
@@ -2341,12 +7259,12 @@ class generic_container {
         iterator insert(const_iterator hint, node_type&& nh) {
             if (!nh) return this->end();
 
-            if (nh.get_allocator() != this->rbtree->get_allocator()) {
+            if (nh.get_allocator() != this->get_allocator()) {
                 throw std::logic_error("allocator of node doesn't equal with allocator of container");
             } else {
-                auto result = this->rbtree->insert_node(hint.nodeptr(), nh.get());
+                auto result = this->insert_node(hint.nodeptr(), nh);
                 nh.restore(std::get<1>(result));
-                return iterator(this->rbtree, std::get<0>(result), this->rbtree->version());
+                return this->make_iterator<iterator>(std::get<0>(result));
             }
         }
 
@@ -2360,8 +7278,8 @@ class generic_container {
         template<typename ... Args, typename std::enable_if<std::is_constructible<value_type,Args&&...>::value,bool>::type = true>
 #endif // __cplusplu >= 202002
         inline std::pair<iterator,bool> emplace( Args&&... args ){
-            auto result = this->rbtree->emplace(nullptr, std::forward<Args>(args)...);
-            return std::make_pair(iterator(this->rbtree, result.first, this->rbtree->version()), result.second);
+            auto result = this->mtree().emplace(nullptr, std::forward<Args>(args)...);
+            return std::make_pair(this->make_iterator<iterator>(result.first), result.second);
         }
 
 #if __cplusplus >= 202002
@@ -2374,145 +7292,537 @@ class generic_container {
                 throw std::logic_error("hint is an invalid iterator");
             }
 
-            auto result = this->rbtree->emplace(hint.nodeptr(), std::forward<Args>(args)...);
-            return iterator(this->rbtree, result.first, this->rbtree->version());
+            auto result = this->mtree().emplace(hint.nodeptr(), std::forward<Args>(args)...);
+            return this->make_iterator<iterator>(result.first);
+        }
+
+        iterator erase(iterator pos) {
+            if (!pos.treeid()) {
+                throw std::logic_error("erase an invalid iterator");
+            }
+
+            auto  node= pos.nodeptr();
+            if (node == nullptr) {
+                throw std::logic_error("erase end iterator");
+            }
+            auto next_ptr = this->rbtree->erase(node, true);
+            return this->make_iterator<iterator>(next_ptr);
+        }
+
+        iterator erase(const_iterator pos) {
+            if (!pos.treeid()) {
+                throw std::logic_error("erase an invalid iterator");
+            }
+
+            auto node = pos.nodeptr();
+            if (node == nullptr) {
+                throw std::logic_error("erase end iterator");
+            }
+            auto next_ptr = this->rbtree->erase(node, true);
+            return this->make_iterator<iterator>(next_ptr);
+        }
+
+        iterator erase(iterator first, iterator last) {
+            return this->erase(const_iterator(first), const_iterator(last));
+        }
+
+        iterator erase(const_iterator first, const_iterator last) {
+            // iterators are compared by their ranks, which are only O(lg n) if the positions are kept
+            RB_ASSERT(!(first > last));
+            if (keep_position_info && first > last) {
+                throw std::logic_error("invalid range");
+            }
+
+            if (first == last) {
+                return this->make_iterator<iterator>(first.nodeptr());
+            }
+            auto next_ptr = this->rbtree->erase_range(first.nodeptr(), last.nodeptr());
+            return this->make_iterator<iterator>(next_ptr);
+        }
+
+        /** erase the values whose ranks are in [first, last) */
+        iterator erase_nth(size_t first, size_t last) {
+            if (first > last || last > this->size()) {
+                throw std::out_of_range("invalid range of ranks");
+            }
+            return this->erase(this->select(first), this->select(last));
+        }
+
+        size_t erase(const _Key& key) {
+            return this->erase_key(key);
+        }
+
+#if __cplusplus >= 202002
+        template<typename _K> requires ( transparent_key<_K>::value )
+#else
+        template<typename _K, typename std::enable_if<transparent_key<_K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        size_t erase(_K&& key) {
+            return this->erase_key(key);
+        }
+
+        node_type extract(const_iterator position) {
+            auto node = position.nodeptr();
+            if (node == nullptr) {
+                throw std::logic_error("extract end iterator");
+            }
+
+            auto extracted = this->rbtree->extract(node, false).first;
+            return node_type(this->rbtree->release_node(extracted), this->get_allocator());
+        }
+
+        node_type extract(const _Key& key) {
+            return this->extract_key(key);
+        }
+
+#if __cplusplus >= 202002
+        template<typename _K> requires ( transparent_key<_K>::value )
+#else
+        template<typename _K, typename std::enable_if<transparent_key<_K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        node_type extract(_K&& key) {
+            return this->extract_key(key);
+        }
+
+        template <typename C2, bool m, bool ci>
+        inline void merge(generic_container<_Key,_Value,m,keep_position_info,C2,Alloc,ci,SizeT,NodePolicy>&& source) {
+            this->merge(source);
+        }
+
+#if __cplusplus >= 202002
+        template<std::forward_iterator InputIt>
+            requires std::constructible_from<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>
+#else
+        template<
+            typename InputIt, 
+            typename std::enable_if<
+                std::is_constructible<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>::value &&
+                std::is_convertible<typename std::iterator_traits<InputIt>::iterator_category,std::forward_iterator_tag>::value,
+                bool>::type = true>
+#endif // __cplusplus >= 202002
+        inline bool emplace_asc(InputIt begin, InputIt end) {
+            return this->mtree().construct_from_asc_iter(begin, end);
+        }
+
+        /**
+         * values of source whose keys aren't in a unique container stay in source, the trees are merged and
+         * rebuilt in O(n + m), see RBTreeImpl::merge()
+         */
+        template <typename C2, bool m, bool ci>
+        void merge(generic_container<_Key,_Value,m,keep_position_info,C2,Alloc,ci,SizeT,NodePolicy>& source) {
+            if (this->get_allocator() != source.get_allocator()) {
+                throw std::logic_error("allocators don't equal");
+            }
+
+            if (static_cast<const void*>(this) == static_cast<const void*>(&source) || source.empty()) return;
+            this->mtree().merge(*source.rbtree);
+        }
+
+        /**
+         * move the values which aren't less than key to the returned container by splitting the tree in O(lg n),
+         * the k moved values of a container with a node pool are moved out of the pool in O(k) first
+         */
+        template<typename _K>
+        generic_container split_off(const _K& key) {
+            return this->split_off_from(this->lower_bound(key));
+        }
+
+        /** move the values whose ranks aren't less than index to the returned container */
+        generic_container split_off_at(size_t index) {
+            if (index > this->size()) {
+                throw std::out_of_range("rank is out of range");
+            }
+            return this->split_off_from(this->select(index));
+        }
+
+        /**
+         * move the values of other to the end of this container by joining the trees in O(lg n + lg m),
+         * they must be greater than the values of this container, or not less if it's a multi-container.
+         * if other has a node pool, its values are moved out of the pool in O(m) first
+         */
+        void append(generic_container&& other) {
+            if (this->get_allocator() != other.get_allocator()) {
+                throw std::logic_error("allocators don't equal");
+            }
+            if (this == &other || other.empty()) return;
+            if (!this->empty() && !this->rbtree->precedes(*other.rbtree)) {
+                throw std::logic_error("appended values don't follow the values of container");
+            }
+            this->mtree().append(*other.rbtree);
+        }
+
+        /**
+         * move [first, last) of other to this container in O(lg n + lg m) if the range fits between two
+         * neighbouring values, otherwise the values are inserted one by one and duplicates replace existing values.
+         * if other has a node pool, the k values of the range are moved out of the pool in O(k) first
+         */
+        void splice(generic_container& other, const_iterator first, const_iterator last) {
+            if (this->get_allocator() != other.get_allocator()) {
+                throw std::logic_error("allocators don't equal");
+            }
+            RB_ASSERT(!(first > last));
+            if (this == &other || first == last) return;
+            this->mtree().splice(*other.rbtree, first.nodeptr(), last.nodeptr());
+        }
+
+        void splice(generic_container&& other, const_iterator first, const_iterator last) {
+            this->splice(other, first, last);
+        }
+
+        /**
+         * set algebra of containers of unique keys in place, the value of this container is kept for a key in both.
+         * the nodes of an rvalue are reused, other containers are copied first, see RBTreeImpl::set_operation()
+         */
+        void set_union(generic_container&& other) {
+            this->set_operation(other, rbtree_set_operation{true, true, true, false});
+        }
+
+        void set_union(const generic_container& other) {
+            this->set_union(generic_container(other));
+        }
+
+        void set_intersection(generic_container&& other) {
+            this->set_operation(other, rbtree_set_operation{false, true, false, false});
+        }
+
+        void set_intersection(const generic_container& other) {
+            this->set_intersection(generic_container(other));
+        }
+
+        void set_difference(generic_container&& other) {
+            this->set_operation(other, rbtree_set_operation{true, false, false, false});
+        }
+
+        void set_difference(const generic_container& other) {
+            this->set_difference(generic_container(other));
+        }
+
+        void set_symmetric_difference(generic_container&& other) {
+            this->set_operation(other, rbtree_set_operation{true, false, true, false});
+        }
+
+        void set_symmetric_difference(const generic_container& other) {
+            this->set_symmetric_difference(generic_container(other));
+        }
+
+        /**
+         * set_union() and the others with the halves of the trees combined as tasks of executor, executor(f, g) runs
+         * the tasks f and g, possibly in parallel, and returns after both are done. Parts of the trees which hold
+         * fewer than grain nodes together are combined serially
+         */
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_union(generic_container&& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_operation(other, rbtree_set_operation{true, true, true, false}, executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_union(const generic_container& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_union(generic_container(other), executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_intersection(generic_container&& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_operation(other, rbtree_set_operation{false, true, false, false}, executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_intersection(const generic_container& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_intersection(generic_container(other), executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_difference(generic_container&& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_operation(other, rbtree_set_operation{true, false, false, false}, executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_difference(const generic_container& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_difference(generic_container(other), executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_symmetric_difference(generic_container&& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_operation(other, rbtree_set_operation{true, false, true, false}, executor, grain);
+        }
+
+        template<typename Executor = rbtree_thread_executor>
+        void parallel_set_symmetric_difference(const generic_container& other, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            this->parallel_set_symmetric_difference(generic_container(other), executor, grain);
+        }
+
+        /**
+         * insert a batch of values into a container of unique keys with the same result as insert(first, last), the
+         * batch is built into a tree, which is cheapest for sorted values, and combined with this one like
+         * parallel_set_union(), except that the values of the batch replace those of the container
+         */
+#if __cplusplus >= 202002
+        template<std::forward_iterator InputIt, typename Executor = rbtree_thread_executor>
+            requires std::constructible_from<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>
+#else
+        template<
+            typename InputIt, typename Executor = rbtree_thread_executor,
+            typename std::enable_if<
+                std::is_constructible<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>::value &&
+                std::is_convertible<typename std::iterator_traits<InputIt>::iterator_category,std::forward_iterator_tag>::value,
+                bool>::type = true>
+#endif // __cplusplus >= 202002
+        void insert_batch(InputIt first, InputIt last, Executor&& executor = Executor(), size_type grain = rbtree_parallel_grain) {
+            generic_container batch(first, last, this->key_comp(), this->get_allocator());
+            this->parallel_set_operation(batch, rbtree_set_operation{true, true, true, true}, executor, grain);
+        }
+
+        void swap(generic_container& oth)
+            noexcept(nothrow_swap_policy<typename std::allocator_traits<Alloc>::propagate_on_container_swap>())
+        {
+            std::swap(this->rbtree, oth.rbtree);
+            std::swap(this->cmp, oth.cmp);
+            swap_allocator(oth, typename std::allocator_traits<Alloc>::propagate_on_container_swap());
+        }
+
+        void clear() {
+            if (this->rbtree) this->rbtree->clear();
         }
 
-        iterator erase(iterator pos) {
-            if (!pos.treeid()) {
-                throw std::logic_error("erase an invalid iterator");
-            }
+        /**
+         * nodes are allocated from contiguous chunks after calling reserve(),
+         * capacity is kept across clear() until shrink_to_fit()
+         */
+        void reserve(size_type n) {
+            this->mtree().reserve(n);
+        }
 
-            auto  node= pos.nodeptr();
-            if (node == nullptr) {
-                throw std::logic_error("erase end iterator");
-            }
-            auto next_ptr = this->rbtree->erase(node, true);
-            return iterator(this->rbtree, next_ptr, this->rbtree->version());
+        void shrink_to_fit() {
+            if (this->rbtree) this->rbtree->shrink_to_fit();
         }
 
-        iterator erase(const_iterator pos) {
-            if (!pos.treeid()) {
-                throw std::logic_error("erase an invalid iterator");
+        /**
+         * move the values into contiguous memory in sorted order and rebuild a balanced tree,
+         * scattered memory is released. it invalidates all iterators
+         */
+        void compact() {
+            if (this->rbtree) this->rbtree->compact();
+        }
+
+        using frozen_type = frozen_container<key_type,mapped_type,Compare,Alloc>;
+        /** read-only snapshot of the current values, built in O(n) */
+        frozen_type freeze() const {
+            return frozen_type(this->begin(), this->end(), this->key_comp(), this->get_allocator());
+        }
+
+    private:
+        /** the node of nh is inserted, nh keeps it if that throws, e.g. since the tree is full */
+        std::tuple<typename rbtree_t::nodeptr_t,typename rbtree_t::nodeptr_t,bool> insert_node(typename rbtree_t::nodeptr_t hint, node_type& nh) {
+            auto node = nh.get();
+            try {
+                return this->mtree().insert_node(hint, node);
+            } catch (...) {
+                nh.restore(node);
+                throw;
             }
+        }
 
-            auto node = pos.nodeptr();
-            if (node == nullptr) {
-                throw std::logic_error("erase end iterator");
+        /** large trees of values which are rbtree_value_concurrent_copy are cloned in parallel, see parallel_assign() */
+        static void copy_tree(const rbtree_t& from, rbtree_t& to) {
+            if (&from == &to) return;
+            if (from.size() < rbtree_parallel_copy_size || !rbtree_value_concurrent_copy<value_type>::value) {
+                from.copy_to(to);
+                return;
             }
-            auto next_ptr = this->rbtree->erase(node, true);
-            return iterator(this->rbtree, next_ptr, this->rbtree->version());
+            rbtree_thread_executor executor;
+            from.parallel_copy_to(to, executor, rbtree_parallel_grain);
         }
 
-        iterator erase(iterator first, iterator last) {
-            return this->erase(const_iterator(first), const_iterator(last));
+        void set_operation(generic_container& other, const rbtree_set_operation& op) {
+            if (this->trivial_set_operation(other, op)) return;
+            this->mtree().set_operation(other.mtree(), op);
         }
 
-        iterator erase(const_iterator first, const_iterator last) {
-            if (first > last) {
-                throw std::logic_error("invalid range");
-            }
+        template<typename Executor>
+        void parallel_set_operation(generic_container& other, const rbtree_set_operation& op, Executor& executor, size_type grain) {
+            if (this->trivial_set_operation(other, op)) return;
+            this->mtree().parallel_set_operation(other.mtree(), op, executor, grain);
+        }
 
-            iterator ans = this->end();
-            for (;first!=this->cend() && first!=last;) {
-                ans = this->erase(first);
-                first = const_iterator(ans);
-                last.sync_version();
+        /** whether the set operation is done without combining the trees */
+        bool trivial_set_operation(generic_container& other, const rbtree_set_operation& op) {
+            if (this->get_allocator() != other.get_allocator()) {
+                throw std::logic_error("allocators don't equal");
             }
-            return ans;
+            if (this == &other) {
+                if (!op.both) this->clear();
+                return true;
+            }
+            return this->empty() && other.empty();
         }
 
-        size_t erase(const _Key& key) {
-            auto first = this->lower_bound(key);
-            auto last = this->upper_bound(key);
-            auto ans = std::distance(first, last);
-            this->erase(first, last);
+        generic_container split_off_from(const_iterator pos) {
+            generic_container ans(this->key_comp(), this->get_allocator());
+            if (pos != this->end()) {
+                this->rbtree->split_off(pos.nodeptr(), ans.mtree());
+            }
             return ans;
         }
 
-        node_type extract(const_iterator position) {
-            auto node = position.nodeptr();
-            if (node == nullptr) {
-                throw std::logic_error("extract end iterator");
-            }
-
-            auto extracted = this->rbtree->extract(node, false).first;
-            return node_type(extracted, this->rbtree->get_allocator());
+        template<typename Iter, typename ForwardIt, typename OutputIt>
+        OutputIt lower_bound_many_(ForwardIt first, ForwardIt last, OutputIt out, bool exact) const {
+            using node_t = typename rbtree_t::nodeptr_t;
+            return this->lookup_many(first, last, out, exact, [&](node_t node) {
+                return this->make_iterator<Iter>(node);
+            });
         }
 
-        node_type extract(const _Key& key) {
-            auto pos = this->find(key);
-            if (pos == this->end()) {
-                return node_type_generic();
-            } else {
-                return extract(key);
+        /** make(node) of the lower bound (or of the match if exact) of each key is written to out */
+        template<typename ForwardIt, typename OutputIt, typename Make>
+        OutputIt lookup_many(ForwardIt first, ForwardIt last, OutputIt out, bool exact, Make make) const {
+            using node_t = typename rbtree_t::nodeptr_t;
+            using key_t = typename std::iterator_traits<ForwardIt>::value_type;
+            const auto tree = this->rbtree.get();
+            if (tree == nullptr) {
+                for (;first!=last;++first) *out++ = make(nullptr);
+                return out;
+            }
+            // sparse keys descend from the root together, see lookup_interleaved()
+            if (this->dense_keys(first, last) && this->keys_sorted(first, last)) {
+                return this->bounds_many(first, last, out, true, true, [&](node_t node, size_type, const key_t& key) {
+                    if (exact && !tree->key_equal(node, this->lookup_key(key))) node = nullptr;
+                    return make(node);
+                });
             }
+
+            return this->lookup_interleaved(first, last, out, exact, make,
+                                            std::is_reference<lookup_key_t<key_t>>());
         }
 
-        template <typename C2, bool m>
-        inline void merge(generic_container<_Key,_Value,m,keep_position_info,C2,Alloc>&& source) {
-            this->merge(source);
+        /** keys which are compared as they are */
+        template<typename ForwardIt, typename OutputIt, typename Make>
+        OutputIt lookup_interleaved(ForwardIt first, ForwardIt last, OutputIt out, bool exact, Make make, std::true_type) const {
+            std::vector<ForwardIt> keys;
+            for (;first!=last;++first) keys.push_back(first);
+            return this->lookup_interleaved(keys.size(), [&](size_t i) -> decltype(*keys[i]) { return *keys[i]; }, out, exact, make);
         }
 
-#if __cplusplus >= 202002
-        template<std::forward_iterator InputIt>
-            requires std::constructible_from<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>
-#else
-        template<
-            typename InputIt, 
-            typename std::enable_if<
-                std::is_constructible<rbtree_storage_type,typename std::iterator_traits<InputIt>::value_type>::value &&
-                std::is_convertible<typename std::iterator_traits<InputIt>::iterator_category,std::forward_iterator_tag>::value,
-                bool>::type = true>
-#endif // __cplusplus >= 202002
-        inline bool emplace_asc(InputIt begin, InputIt end) {
-            return this->rbtree->construct_from_asc_iter(begin, end);
+        /** keys which are converted to _Key, once for all comparisons */
+        template<typename ForwardIt, typename OutputIt, typename Make>
+        OutputIt lookup_interleaved(ForwardIt first, ForwardIt last, OutputIt out, bool exact, Make make, std::false_type) const {
+            std::vector<_Key> keys;
+            for (;first!=last;++first) keys.emplace_back(*first);
+            return this->lookup_interleaved(keys.size(), [&](size_t i) -> const _Key& { return keys[i]; }, out, exact, make);
         }
 
-        template <typename C2, bool m>
-        void merge(generic_container<_Key,_Value,m,keep_position_info,C2,Alloc>& source) {
-            if (this->get_allocator() != source.get_allocator()) {
-                throw std::logic_error("allocators don't equal");
+        template<typename KeyAt, typename OutputIt, typename Make>
+        OutputIt lookup_interleaved(size_t n, KeyAt key_at, OutputIt out, bool exact, Make make) const {
+            using node_t = typename rbtree_t::nodeptr_t;
+            const auto tree = this->rbtree.get();
+            std::vector<node_t> nodes(n);
+            tree->lower_bound_interleaved(n, key_at, nodes.data());
+            for (size_t i=0;i<n;i++) {
+                auto node = nodes[i];
+                if (exact && !tree->key_equal(node, key_at(i))) node = nullptr;
+                *out++ = make(node);
             }
+            return out;
+        }
+
+        /**
+         * a finger search climbs through parents which are rarely cached, it only pays off when
+         * there are at least size() / finger_search_ratio keys
+         */
+        constexpr static size_t finger_search_ratio = 4;
+
+        template<typename ForwardIt>
+        bool dense_keys(ForwardIt first, ForwardIt last) const {
+            return static_cast<size_t>(std::distance(first, last)) * finger_search_ratio >= this->size();
+        }
+
+        template<typename ForwardIt>
+        bool keys_sorted(ForwardIt first, ForwardIt last) const {
+            using key_t = typename std::iterator_traits<ForwardIt>::value_type;
+            const auto cmp = this->key_comp();
+            return std::is_sorted(first, last, [&](const key_t& a, const key_t& b) {
+                return cmp(this->lookup_key(a), this->lookup_key(b));
+            });
+        }
+
+        /**
+         * make(node, rank, key) of the lower bound of each key is written to out, sorted and dense are
+         * keys_sorted() and dense_keys() of the keys, which the caller knows already
+         */
+        template<typename ForwardIt, typename OutputIt, typename Make>
+        OutputIt bounds_many(ForwardIt first, ForwardIt last, OutputIt out, bool sorted, bool dense, Make make) const {
+            using node_t = typename rbtree_t::nodeptr_t;
+            using key_t = typename std::iterator_traits<ForwardIt>::value_type;
+            const auto tree = this->rbtree.get();
+            if (tree == nullptr) {
+                for (;first!=last;++first) *out++ = make(nullptr, 0, *first);
+                return out;
+            }
+            const auto cmp = this->key_comp();
+            auto less = [&](const key_t& a, const key_t& b) {
+                return cmp(this->lookup_key(a), this->lookup_key(b));
+            };
+
+            // keys after the end of the tree have no finger
+            node_t finger = nullptr;
+            size_type rank = 0;
+            bool started = false;
+            auto bound = [&](const key_t& key) {
+                if (!dense) return tree->bound_from(nullptr, 0, this->lookup_key(key), false);
+                if (!started || finger != nullptr) {
+                    const auto b = tree->bound_from(finger, rank, this->lookup_key(key), false);
+                    finger = b.first;
+                    rank = b.second;
+                    started = true;
+                }
+                return std::make_pair(finger, rank);
+            };
 
-            decltype(static_cast<node_type*>(nullptr)->get()) head = nullptr;
-            auto node = head;
-            size_t n_not_inserted = 0;
-            for (;!source.empty();) {
-                auto ext_node = source.extract(source.begin());
-                auto result = this->insert(std::move(ext_node));
-                if (!result.inserted) {
-                    n_not_inserted++;
-                    auto n = result.node.get();
-                    if (node) {
-                        node->right = n;
-                        node = n;
-                    } else {
-                        head = n;
-                        node = n;
-                    }
-                    node->right = nullptr;
+            if (sorted) {
+                for (;first!=last;++first) {
+                    auto b = bound(*first);
+                    *out++ = make(b.first, b.second, *first);
                 }
+                return out;
             }
 
-            if (head != nullptr) {
-                source.rbtree->construct_from_nodelist(head);
+            std::vector<ForwardIt> keys;
+            for (;first!=last;++first) keys.push_back(first);
+            std::vector<size_t> order(keys.size());
+            for (size_t i=0;i<order.size();i++) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return less(*keys[a], *keys[b]); });
+
+            std::vector<std::pair<node_t,size_type>> bounds(keys.size());
+            for (auto i: order) bounds[i] = bound(*keys[i]);
+            for (size_t i=0;i<keys.size();i++) {
+                *out++ = make(bounds[i].first, bounds[i].second, *keys[i]);
             }
+            return out;
         }
 
-        void swap(generic_container& oth) noexcept {
-            std::swap(this->rbtree, oth.rbtree);
+        template<typename _K>
+        size_t erase_key(const _K& key) {
+            if (this->empty()) return 0;
+            auto range = this->equal_range(key);
+            const auto n = this->size();
+            this->erase(range.first, range.second);
+            return n - this->size();
         }
 
-        void clear() {
-            this->rbtree->clear();
+        template<typename _K>
+        node_type extract_key(const _K& key) {
+            if (this->empty()) return node_type();
+            auto pos = this->find(key);
+            if (pos == this->end()) {
+                return node_type();
+            } else {
+                return this->extract(const_iterator(pos));
+            }
         }
 };
 
 
-template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc>
-bool operator==(const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc>& lhs,
-                const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc>& rhs)
+template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc, bool checked_iterator, typename SizeT, typename NodePolicy>
+bool operator==(const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>& lhs,
+                const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>& rhs)
 {
     if (lhs.size() != rhs.size()) return false;
 
@@ -2525,9 +7835,9 @@ bool operator==(const generic_container<_Key,_Value,multi,keep_position_info,Com
     return true;
 }
 
-template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc>
-bool operator!=(const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc>& lhs,
-                const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc>& rhs)
+template<typename _Key, typename _Value, bool multi, bool keep_position_info, typename Compare, typename Alloc, bool checked_iterator, typename SizeT, typename NodePolicy>
+bool operator!=(const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>& lhs,
+                const generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>& rhs)
 {
     return !operator==(lhs, rhs);
 }
@@ -2540,10 +7850,11 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,_Value>>
-class generic_map: public generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc> {
+    typename Alloc = default_allocato_t<_Key,_Value>, bool checked_iterator = true, typename SizeT = size_t,
+    typename NodePolicy = rbtree_plain>
+class generic_map: public generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy> {
     private:
-        using base_t = generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc>;
+        using base_t = generic_container<_Key,_Value,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>;
 
     public:
         static_assert(!std::is_same<_Value,void>::value, "_Value must not be void");
@@ -2593,10 +7904,11 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,void>>
-class generic_set: public generic_container<_Key,void,multi,keep_position_info,Compare,Alloc> {
+    typename Alloc = default_allocato_t<_Key,void>, bool checked_iterator = true, typename SizeT = size_t,
+    typename NodePolicy = rbtree_plain>
+class generic_set: public generic_container<_Key,void,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy> {
     private:
-        using base_t = generic_container<_Key,void,multi,keep_position_info,Compare,Alloc>;
+        using base_t = generic_container<_Key,void,multi,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>;
 
     public:
         using rbtree_storage_type = typename base_t::rbtree_storage_type;
@@ -2639,10 +7951,11 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,_Value>>
-class generic_unimap: public generic_map<_Key,_Value,false,keep_position_info,Compare,Alloc> {
+    typename Alloc = default_allocato_t<_Key,_Value>, bool checked_iterator = true, typename SizeT = size_t,
+    typename NodePolicy = rbtree_plain>
+class generic_unimap: public generic_map<_Key,_Value,false,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy> {
     private:
-        using base_t = generic_map<_Key,_Value,false,keep_position_info,Compare,Alloc>;
+        using base_t = generic_map<_Key,_Value,false,keep_position_info,Compare,Alloc,checked_iterator,SizeT,NodePolicy>;
 
     public:
         using rbtree_storage_type = typename base_t::rbtree_storage_type;
@@ -2677,7 +7990,91 @@ class generic_unimap: public generic_map<_Key,_Value,false,keep_position_info,Co
         generic_unimap(std::initializer_list<rbtree_storage_type_base> init, const Alloc& alloc): base_t(std::move(init), alloc) {
         }
 
-        _Value& at(const _Key& key) {
+        mapped_type& at(const _Key& key) {
+            return this->at_key(key);
+        }
+
+        const mapped_type& at(const _Key& key) const {
+            return this->at_key(key);
+        }
+
+#if __cplusplus >= 202002
+        template<typename K> requires ( base_t::template transparent_key<K>::value )
+#else
+        template<typename K, typename std::enable_if<base_t::template transparent_key<K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        mapped_type& at(const K& key) {
+            return this->at_key(key);
+        }
+
+#if __cplusplus >= 202002
+        template<typename K> requires ( base_t::template transparent_key<K>::value )
+#else
+        template<typename K, typename std::enable_if<base_t::template transparent_key<K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        const mapped_type& at(const K& key) const {
+            return this->at_key(key);
+        }
+
+        mapped_type& operator[](const _Key& key) {
+            return this->try_emplace_key(key).first->second;
+        }
+
+        mapped_type& operator[](_Key&& key) {
+            return this->try_emplace_key(std::move(key)).first->second;
+        }
+
+#if __cplusplus >= 202002
+        template<typename K> requires ( base_t::template transparent_key<K>::value )
+#else
+        template<typename K, typename std::enable_if<base_t::template transparent_key<K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        mapped_type& operator[](K&& key) {
+            return this->try_emplace_key(std::forward<K>(key)).first->second;
+        }
+
+        /** the mapped value is constructed from args only if key doesn't exist */
+        template<typename ...Args>
+        std::pair<iterator,bool> try_emplace(const _Key& key, Args&& ...args) {
+            return this->try_emplace_key(key, std::forward<Args>(args)...);
+        }
+
+        template<typename ...Args>
+        std::pair<iterator,bool> try_emplace(_Key&& key, Args&& ...args) {
+            return this->try_emplace_key(std::move(key), std::forward<Args>(args)...);
+        }
+
+#if __cplusplus >= 202002
+        template<typename K, typename ...Args> requires ( base_t::template transparent_key<K>::value )
+#else
+        template<typename K, typename ...Args, typename std::enable_if<base_t::template transparent_key<K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        std::pair<iterator,bool> try_emplace(K&& key, Args&& ...args) {
+            return this->try_emplace_key(std::forward<K>(key), std::forward<Args>(args)...);
+        }
+
+        template<typename M>
+        std::pair<iterator,bool> insert_or_assign(const _Key& key, M&& obj) {
+            return this->insert_or_assign_key(key, std::forward<M>(obj));
+        }
+
+        template<typename M>
+        std::pair<iterator,bool> insert_or_assign(_Key&& key, M&& obj) {
+            return this->insert_or_assign_key(std::move(key), std::forward<M>(obj));
+        }
+
+#if __cplusplus >= 202002
+        template<typename K, typename M> requires ( base_t::template transparent_key<K>::value )
+#else
+        template<typename K, typename M, typename std::enable_if<base_t::template transparent_key<K>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        std::pair<iterator,bool> insert_or_assign(K&& key, M&& obj) {
+            return this->insert_or_assign_key(std::forward<K>(key), std::forward<M>(obj));
+        }
+
+    private:
+        template<typename K>
+        mapped_type& at_key(const K& key) {
             auto at = this->find(key);
             if (at == this->end()) {
                 throw std::out_of_range("out of range");
@@ -2685,20 +8082,207 @@ class generic_unimap: public generic_map<_Key,_Value,false,keep_position_info,Co
             return at->second;
         }
 
-        const _Value& at(const _Key& key) const {
-            return const_cast<generic_unimap*>(this)->at(key);
-        }
-
         template<typename K>
-        _Value& operator[](K&& key) {
+        const mapped_type& at_key(const K& key) const {
             auto at = this->find(key);
             if (at == this->end()) {
-                auto ins_result = this->insert(rbtree_storage_type(std::forward<K>(key), _Value()));
-                RB_ASSERT(ins_result.second);
-                return ins_result.first->second;
-            } else {
-                return at->second;
+                throw std::out_of_range("out of range");
+            }
+            return at->second;
+        }
+
+        /**
+         * the key is looked up before anything is constructed, the value is constructed in its node at the end of
+         * the same descent, so the key is moved and the mapped value needn't be movable
+         */
+        template<typename K, typename ...Args>
+        std::pair<iterator,bool> try_emplace_key(K&& key, Args&& ...args) {
+            auto result = this->mtree().try_emplace(
+                this->lookup_key(key), std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            return std::make_pair(this->template make_iterator<iterator>(result.first), result.second);
+        }
+
+        template<typename K, typename M>
+        std::pair<iterator,bool> insert_or_assign_key(K&& key, M&& obj) {
+            auto result = this->mtree().try_emplace(
+                this->lookup_key(key), std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<M>(obj)));
+            auto at = this->template make_iterator<iterator>(result.first);
+            if (!result.second) at->second = std::forward<M>(obj);
+            return std::make_pair(at, result.second);
+        }
+};
+
+
+/**
+ * container of objects deriving from RBTreeHook<T,keep_position_info,SizeT,NodePolicy>, objects are linked
+ * into the tree instead of being copied, so that nothing is allocated by insert() and erase().
+ * the container doesn't own the objects, which must outlive their membership.
+ */
+template<
+    typename T, bool multi, bool keep_position_info,
+#if __cplusplus >= 202002
+    C_KeyCompare<T> Compare = default_compare_t<T>,
+#else
+    typename Compare = default_compare_t<T>,
+#endif // __cplusplus >= 202002
+    typename SizeT = size_t, typename NodePolicy = rbtree_plain>
+class intrusive_container {
+    public:
+        using hook_type = RBTreeHook<T,keep_position_info,SizeT,NodePolicy>;
+        using rbtree_t = RBTreeImpl<T,rbtree_intrusive,multi,keep_position_info,Compare,std::allocator<T>,SizeT,NodePolicy>;
+        static_assert(std::is_base_of<hook_type,T>::value, "object should derive from RBTreeHook");
+
+    private:
+        using nodeptr_t = typename rbtree_t::nodeptr_t;
+        rbtree_t tree;
+
+        inline rbtree_t* treeptr() const { return const_cast<rbtree_t*>(&this->tree); }
+
+        template<typename Iter>
+        inline Iter make_iterator(typename rbtree_t::const_nodeptr_t node) const {
+            return Iter(this->treeptr(), const_cast<nodeptr_t>(node), this->tree.version());
+        }
+
+    public:
+        using key_type               = T;
+        using value_type             = T;
+        using size_type              = typename rbtree_t::size_type;
+        using difference_type        = typename rbtree_t::difference_type;
+        using key_compare            = Compare;
+        using reference              = T&;
+        using const_reference        = const T&;
+        using pointer                = T*;
+        using const_pointer          = const T*;
+        using iterator               = RBTreeImplFastIterator<false,false,rbtree_t>;
+        using const_iterator         = RBTreeImplFastIterator<false,true,rbtree_t>;
+        using reverse_iterator       = RBTreeImplFastIterator<true,false,rbtree_t>;
+        using reverse_const_iterator = RBTreeImplFastIterator<true,true,rbtree_t>;
+
+        intrusive_container() = default;
+        explicit intrusive_container(const Compare& cmp): tree(cmp, std::allocator<T>()) {}
+
+        intrusive_container(const intrusive_container&) = delete;
+        intrusive_container& operator=(const intrusive_container&) = delete;
+
+        /** objects are unlinked, but not destroyed */
+        ~intrusive_container() = default;
+
+        Compare key_comp() const { return this->tree.cmp_object(); }
+        Compare value_comp() const { return this->tree.cmp_object(); }
+
+        inline iterator begin() { return this->make_iterator<iterator>(this->tree.begin()); }
+        inline iterator end() { return this->make_iterator<iterator>(nullptr); }
+        inline const_iterator begin() const { return this->make_iterator<const_iterator>(this->tree.begin()); }
+        inline const_iterator end() const { return this->make_iterator<const_iterator>(nullptr); }
+        inline const_iterator cbegin() const { return this->begin(); }
+        inline const_iterator cend() const { return this->end(); }
+
+        inline reverse_iterator rbegin() { return this->make_iterator<reverse_iterator>(this->tree.rbegin()); }
+        inline reverse_iterator rend() { return this->make_iterator<reverse_iterator>(nullptr); }
+        inline reverse_const_iterator rbegin() const { return this->make_iterator<reverse_const_iterator>(this->tree.rbegin()); }
+        inline reverse_const_iterator rend() const { return this->make_iterator<reverse_const_iterator>(nullptr); }
+        inline reverse_const_iterator crbegin() const { return this->rbegin(); }
+        inline reverse_const_iterator crend() const { return this->rend(); }
+
+        inline size_t size() const { return this->tree.size(); }
+        inline bool empty() const { return this->size() == 0; }
+        inline size_t max_size() const noexcept { return this->tree.max_size(); }
+
+        /** iterator of an object in the container, O(1) */
+        inline iterator iterator_to(T& obj) {
+            return this->make_iterator<iterator>(static_cast<nodeptr_t>(static_cast<hook_type*>(&obj)));
+        }
+
+        inline const_iterator iterator_to(const T& obj) const {
+            return this->make_iterator<const_iterator>(static_cast<nodeptr_t>(const_cast<hook_type*>(static_cast<const hook_type*>(&obj))));
+        }
+
+        template<typename _K>
+        iterator lower_bound(const _K& key) { return this->make_iterator<iterator>(this->tree.lower_bound(key)); }
+        template<typename _K>
+        const_iterator lower_bound(const _K& key) const { return this->make_iterator<const_iterator>(this->tree.lower_bound(key)); }
+
+        template<typename _K>
+        iterator upper_bound(const _K& key) { return this->make_iterator<iterator>(this->tree.upper_bound(key)); }
+        template<typename _K>
+        const_iterator upper_bound(const _K& key) const { return this->make_iterator<const_iterator>(this->tree.upper_bound(key)); }
+
+        template<typename _K>
+        iterator find(const _K& key) { return this->make_iterator<iterator>(this->tree.find(key)); }
+        template<typename _K>
+        const_iterator find(const _K& key) const { return this->make_iterator<const_iterator>(this->tree.find(key)); }
+
+        template<typename _K>
+        std::pair<iterator,iterator> equal_range(const _K& key) {
+            return std::make_pair(this->lower_bound(key), this->upper_bound(key));
+        }
+
+        template<typename _K>
+        std::pair<const_iterator,const_iterator> equal_range(const _K& key) const {
+            return std::make_pair(this->lower_bound(key), this->upper_bound(key));
+        }
+
+        template<typename _K>
+        size_t count(const _K& key) const { return this->tree.count(key); }
+
+        template<typename _K>
+        bool contains(const _K& key) const { return this->tree.find(key) != nullptr; }
+
+        /**
+         * link obj into the container, for unique containers the object isn't linked
+         * if an equivalent one exists, whose iterator is returned
+         */
+        std::pair<iterator,bool> insert(T& obj) {
+            auto result = this->tree.insert_node(nullptr, static_cast<hook_type*>(&obj));
+            return std::make_pair(this->make_iterator<iterator>(std::get<0>(result)), std::get<2>(result));
+        }
+
+        iterator insert(const_iterator hint, T& obj) {
+            auto result = this->tree.insert_node(const_cast<nodeptr_t>(hint.nodeptr()), static_cast<hook_type*>(&obj));
+            return this->make_iterator<iterator>(std::get<0>(result));
+        }
+
+        /** unlink the object, which must be in this container */
+        iterator erase(T& obj) {
+            return this->erase(const_iterator(this->iterator_to(obj)));
+        }
+
+        iterator erase(const_iterator pos) {
+            auto node = const_cast<nodeptr_t>(pos.nodeptr());
+            if (node == nullptr) {
+                throw std::logic_error("erase end iterator");
+            }
+            return this->make_iterator<iterator>(this->tree.erase(node, true));
+        }
+
+        iterator erase(const_iterator first, const_iterator last) {
+            auto node = const_cast<nodeptr_t>(first.nodeptr());
+            for (;node!=nullptr && node!=last.nodeptr();) {
+                node = this->tree.erase(node, true);
+            }
+            return this->make_iterator<iterator>(node);
+        }
+
+#if __cplusplus >= 202002
+        template<typename _K> requires (!std::convertible_to<const _K&,const_iterator>)
+#else
+        template<typename _K, typename std::enable_if<!std::is_convertible<const _K&,const_iterator>::value,bool>::type = true>
+#endif // __cplusplus >= 202002
+        size_t erase(const _K& key) {
+            size_t n = 0;
+            auto node = this->tree.lower_bound(key);
+            const auto last = this->tree.upper_bound(key);
+            for (;node!=last;n++) {
+                node = this->tree.erase(node, true);
             }
+            return n;
+        }
+
+        /** unlink all objects */
+        void clear() {
+            this->tree.clear();
         }
 };
 
@@ -2720,8 +8304,8 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,void>>
-using pset = generic_set<_Key,false,true,Compare,Alloc>;
+    typename Alloc = default_allocato_t<_Key,void>, typename SizeT = size_t>
+using pset = generic_set<_Key,false,true,Compare,Alloc,true,SizeT>;
 
 template<
     typename _Key,
@@ -2740,8 +8324,8 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,void>>
-using pmultiset = generic_set<_Key,true,true,Compare,Alloc>;
+    typename Alloc = default_allocato_t<_Key,void>, typename SizeT = size_t>
+using pmultiset = generic_set<_Key,true,true,Compare,Alloc,true,SizeT>;
 
 
 template<
@@ -2761,8 +8345,8 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,_Value>>
-using pmultimap = generic_map<_Key,_Value,true,true,Compare,Alloc>;
+    typename Alloc = default_allocato_t<_Key,_Value>, typename SizeT = size_t>
+using pmultimap = generic_map<_Key,_Value,true,true,Compare,Alloc,true,SizeT>;
 
 template<
     typename _Key, typename _Value,
@@ -2781,23 +8365,163 @@ template<
 #else
     typename Compare = default_compare_t<_Key>,
 #endif // __cplusplus >= 202002
-    typename Alloc = default_allocato_t<_Key,_Value>>
-using pmap = generic_unimap<_Key,_Value,true,Compare,Alloc>;
+    typename Alloc = default_allocato_t<_Key,_Value>, typename SizeT = size_t>
+using pmap = generic_unimap<_Key,_Value,true,Compare,Alloc,true,SizeT>;
+
+
+namespace fast {
+    /** containers whose iterators are RBTreeImplFastIterator */
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>>
+    using set2 = generic_set<Key, false, false, Compare, Alloc, false>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+    using pset = generic_set<Key, false, true, Compare, Alloc, false, SizeT>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>>
+    using multiset2 = generic_set<Key, true, false, Compare, Alloc, false>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+    using pmultiset = generic_set<Key, true, true, Compare, Alloc, false, SizeT>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>>
+    using map2 = generic_unimap<Key, Value, false, Compare, Alloc, false>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+    using pmap = generic_unimap<Key, Value, true, Compare, Alloc, false, SizeT>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>>
+    using multimap2 = generic_map<Key, Value, true, false, Compare, Alloc, false>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+    using pmultimap = generic_map<Key, Value, true, true, Compare, Alloc, false, SizeT>;
+} // namespace fast
+
+
+namespace threaded {
+    /** containers whose nodes are threaded in order, see rbtree_threaded */
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>>
+    using set2 = generic_set<Key, false, false, Compare, Alloc, true, size_t, rbtree_threaded>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+    using pset = generic_set<Key, false, true, Compare, Alloc, true, SizeT, rbtree_threaded>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>>
+    using multiset2 = generic_set<Key, true, false, Compare, Alloc, true, size_t, rbtree_threaded>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+    using pmultiset = generic_set<Key, true, true, Compare, Alloc, true, SizeT, rbtree_threaded>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>>
+    using map2 = generic_unimap<Key, Value, false, Compare, Alloc, true, size_t, rbtree_threaded>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+    using pmap = generic_unimap<Key, Value, true, Compare, Alloc, true, SizeT, rbtree_threaded>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>>
+    using multimap2 = generic_map<Key, Value, true, false, Compare, Alloc, true, size_t, rbtree_threaded>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+    using pmultimap = generic_map<Key, Value, true, true, Compare, Alloc, true, SizeT, rbtree_threaded>;
+
+    namespace fast {
+        template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+        using pset = generic_set<Key, false, true, Compare, Alloc, false, SizeT, rbtree_threaded>;
+
+        template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+        using pmultiset = generic_set<Key, true, true, Compare, Alloc, false, SizeT, rbtree_threaded>;
+
+        template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+        using pmap = generic_unimap<Key, Value, true, Compare, Alloc, false, SizeT, rbtree_threaded>;
+
+        template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+        using pmultimap = generic_map<Key, Value, true, true, Compare, Alloc, false, SizeT, rbtree_threaded>;
+    } // namespace fast
+} // namespace threaded
+
+
+namespace split {
+    /** maps whose nodes only hold the keys, see RBTreeValueKVSplit */
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,rbtree_cold<Value>>>
+    using map2 = generic_unimap<Key, rbtree_cold<Value>, false, Compare, Alloc>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,rbtree_cold<Value>>, class SizeT = size_t>
+    using pmap = generic_unimap<Key, rbtree_cold<Value>, true, Compare, Alloc, true, SizeT>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,rbtree_cold<Value>>>
+    using multimap2 = generic_map<Key, rbtree_cold<Value>, true, false, Compare, Alloc>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,rbtree_cold<Value>>, class SizeT = size_t>
+    using pmultimap = generic_map<Key, rbtree_cold<Value>, true, true, Compare, Alloc, true, SizeT>;
+} // namespace split
+
+
+namespace intrusive {
+    /** hooks which objects derive from, e.g. struct Foo: curly::intrusive::pset_hook<Foo> { ... } */
+    template <class T>
+    using set_hook = RBTreeHook<T, false>;
+
+    template <class T, class SizeT = size_t>
+    using pset_hook = RBTreeHook<T, true, SizeT>;
+
+    template <class T, class Compare = default_compare_t<T>>
+    using set2 = intrusive_container<T, false, false, Compare>;
+
+    template <class T, class Compare = default_compare_t<T>, class SizeT = size_t>
+    using pset = intrusive_container<T, false, true, Compare, SizeT>;
+
+    template <class T, class Compare = default_compare_t<T>>
+    using multiset2 = intrusive_container<T, true, false, Compare>;
+
+    template <class T, class Compare = default_compare_t<T>, class SizeT = size_t>
+    using pmultiset = intrusive_container<T, true, true, Compare, SizeT>;
+} // namespace intrusive
+
+
+#if __cplusplus >= 201703
+namespace bptree {
+    /** containers backed by BPTreeImpl, insertion and erasure invalidate all their iterators */
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+    using pset = generic_set<Key, false, true, Compare, Alloc, true, SizeT, bptree_nodes>;
+
+    template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+    using pmultiset = generic_set<Key, true, true, Compare, Alloc, true, SizeT, bptree_nodes>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+    using pmap = generic_unimap<Key, Value, true, Compare, Alloc, true, SizeT, bptree_nodes>;
+
+    template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+    using pmultimap = generic_map<Key, Value, true, true, Compare, Alloc, true, SizeT, bptree_nodes>;
+
+    namespace fast {
+        template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+        using pset = generic_set<Key, false, true, Compare, Alloc, false, SizeT, bptree_nodes>;
+
+        template <class Key, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,void>, class SizeT = size_t>
+        using pmultiset = generic_set<Key, true, true, Compare, Alloc, false, SizeT, bptree_nodes>;
+
+        template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+        using pmap = generic_unimap<Key, Value, true, Compare, Alloc, false, SizeT, bptree_nodes>;
+
+        template <class Key, class Value, class Compare = default_compare_t<Key>, class Alloc = default_allocato_t<Key,Value>, class SizeT = size_t>
+        using pmultimap = generic_map<Key, Value, true, true, Compare, Alloc, false, SizeT, bptree_nodes>;
+    } // namespace fast
+} // namespace bptree
+#endif // __cplusplus >= 201703
 
 
 #if __cplusplus >= 201703
 namespace pmr {
-    template <class Key, class Compare = std::less<Key>>
-    using pset = pset<Key, Compare, std::pmr::polymorphic_allocator<Key>>;
+    template <class Key, class Compare = std::less<Key>, class SizeT = size_t>
+    using pset = pset<Key, Compare, std::pmr::polymorphic_allocator<Key>, SizeT>;
 
-    template <class Key, class Compare = std::less<Key>>
-    using pmultiset = pmultiset<Key, Compare, std::pmr::polymorphic_allocator<Key>>;
+    template <class Key, class Compare = std::less<Key>, class SizeT = size_t>
+    using pmultiset = pmultiset<Key, Compare, std::pmr::polymorphic_allocator<Key>, SizeT>;
 
-    template <class Key, class Value, class Compare = std::less<Key>>
-    using pmap = pmap<Key, Value, Compare, ::std::pmr::polymorphic_allocator<Key>>;
+    template <class Key, class Value, class Compare = std::less<Key>, class SizeT = size_t>
+    using pmap = pmap<Key, Value, Compare, ::std::pmr::polymorphic_allocator<Key>, SizeT>;
 
-    template <class Key, class Value, class Compare = std::less<Key>>
-    using pmultimap = pmultimap<Key, Value, Compare, ::std::pmr::polymorphic_allocator<Key>>;
+    template <class Key, class Value, class Compare = std::less<Key>, class SizeT = size_t>
+    using pmultimap = pmultimap<Key, Value, Compare, ::std::pmr::polymorphic_allocator<Key>, SizeT>;
 } // namespace pmr
 #endif // __cplusplus >= 201703
 } // namespace curly
@@ -0,0 +1,305 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+using namespace std;
+using namespace curly;
+
+
+#if __cplusplus >= 201703
+std::default_random_engine generator;
+template<bool multi>
+static void bptree_impl_test(const size_t n_vals) {
+    BPTreeImpl<int, void, multi> tree;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-n_vals, n_vals);
+    const size_t freq = n_vals / 8 > 0 ? n_vals / 8 : 1;
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        if (tree.insert(val).second) {
+            stl_set.insert(val);
+        }
+        if (i % freq == 0) {
+            tree.check_consistency();
+        }
+    }
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), stl_set.size());
+
+    size_t idx = 0;
+    auto stl_iter = stl_set.begin();
+    for (auto node=tree.begin();node!=nullptr;node=node->next(),idx++,stl_iter++) {
+        ASSERT_EQ(node->value.get(), *stl_iter);
+        ASSERT_EQ(tree.indexof(node), idx);
+        ASSERT_EQ(tree.advance(tree.begin(), idx), node);
+        ASSERT_EQ(tree.advance(nullptr, static_cast<long>(idx) - static_cast<long>(tree.size())), node);
+    }
+    ASSERT_EQ(tree.advance(tree.rbegin(), 1), nullptr);
+
+    for (int i=0;i<10;i++) {
+        auto val = distribution(generator);
+        ASSERT_EQ(tree.count(val), stl_set.count(val));
+        ASSERT_EQ(tree.indexof(tree.lower_bound(val)), std::distance(stl_set.begin(), stl_set.lower_bound(val)));
+        ASSERT_EQ(tree.indexof(tree.upper_bound(val)), std::distance(stl_set.begin(), stl_set.upper_bound(val)));
+    }
+
+    std::uniform_int_distribution<size_t> mdist(0, n_vals);
+    const auto total = tree.size();
+    for (size_t i=0;i<total;i++) {
+        auto pos = mdist(generator) % tree.size();
+        auto node = tree.advance(tree.begin(), pos);
+        auto stl_pos = std::next(stl_set.begin(), pos);
+        ASSERT_EQ(node->value.get(), *stl_pos);
+        auto next = tree.erase(node, true);
+        auto stl_next = stl_set.erase(stl_pos);
+        ASSERT_EQ(tree.indexof(next), pos);
+        ASSERT_TRUE(stl_next == stl_set.end() ? next == nullptr : next->value.get() == *stl_next);
+        ASSERT_EQ(tree.size(), stl_set.size());
+        if (i % freq == 0) {
+            tree.check_consistency();
+        }
+    }
+    ASSERT_EQ(tree.begin(), nullptr);
+}
+
+TEST(bptree_impl, insert_erase) {
+    for (size_t i=1;i<=20;i++) {
+        bptree_impl_test<false>(i * i * 20);
+        bptree_impl_test<true>(i * i * 20);
+    }
+}
+
+TEST(bptree_impl, construct_from_asc_iter) {
+    for (size_t n: {0, 1, 10, 100, 1000, 10000, 100000}) {
+        std::vector<int> vals(n);
+        for (size_t i=0;i<n;i++) vals[i] = i / 2;
+
+        BPTreeImpl<int, void, true> mtree;
+        ASSERT_TRUE(mtree.construct_from_asc_iter(vals.begin(), vals.end()));
+        mtree.check_consistency();
+        ASSERT_EQ(mtree.size(), n);
+
+        BPTreeImpl<int, void, false> tree;
+        tree.insert(-1);
+        ASSERT_EQ(tree.construct_from_asc_iter(vals.begin(), vals.end()), n < 3);
+        tree.check_consistency();
+        ASSERT_EQ(tree.size(), n < 3 ? n : 1);
+
+        BPTreeImpl<int, void, true> copied;
+        mtree.copy_to(copied);
+        copied.check_consistency();
+        ASSERT_EQ(copied.size(), n);
+        for (size_t i=0;i<n;i+=n/10+1) {
+            ASSERT_EQ(copied.advance(copied.begin(), i)->value.get(), vals[i]);
+        }
+    }
+}
+
+template<typename S>
+static void bptree_set_test(const size_t n_vals) {
+    S s;
+    std::set<int> stl_set;
+    std::uniform_int_distribution<int> distribution(0, n_vals * 2);
+
+    s.reserve(n_vals);
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        ASSERT_EQ(s.insert(val).second, stl_set.insert(val).second);
+    }
+    ASSERT_EQ(s.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin()));
+    ASSERT_TRUE(std::equal(s.rbegin(), s.rend(), stl_set.rbegin()));
+
+    for (size_t i=0;i<n_vals/4;i++) {
+        auto v1 = distribution(generator), v2 = distribution(generator);
+        if (v1 > v2) std::swap(v1, v2);
+        auto first = s.lower_bound(v1), last = s.upper_bound(v2);
+        ASSERT_EQ(last - first, std::distance(stl_set.lower_bound(v1), stl_set.upper_bound(v2)));
+        ASSERT_EQ(first - s.begin(), std::distance(stl_set.begin(), stl_set.lower_bound(v1)));
+        if (first != s.end()) {
+            ASSERT_EQ(*first, *stl_set.lower_bound(v1));
+        }
+
+        if (i % 2 == 0) {
+            auto next = s.erase(first, last);
+            auto stl_next = stl_set.erase(stl_set.lower_bound(v1), stl_set.upper_bound(v2));
+            ASSERT_EQ(next == s.end(), stl_next == stl_set.end());
+            if (next != s.end()) {
+                ASSERT_EQ(*next, *stl_next);
+            }
+        } else {
+            ASSERT_EQ(s.erase(v1), stl_set.erase(v1));
+        }
+    }
+    ASSERT_EQ(s.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin()));
+
+    S other;
+    for (size_t i=0;i<n_vals/2 && !s.empty();i++) {
+        auto pos = s.begin() + distribution(generator) % s.size();
+        auto val = *pos;
+        auto nh = s.extract(pos);
+        ASSERT_EQ(nh.value(), val);
+        ASSERT_TRUE(other.insert(std::move(nh)).inserted);
+        ASSERT_EQ(stl_set.erase(val), 1);
+    }
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin()));
+
+    const auto total = s.size() + other.size();
+    s.merge(other);
+    ASSERT_EQ(s.size(), total);
+    ASSERT_TRUE(std::is_sorted(s.begin(), s.end()));
+
+    S copied(s);
+    ASSERT_TRUE(copied == s);
+    s.clear();
+    ASSERT_TRUE(s.empty());
+    s.shrink_to_fit();
+    ASSERT_EQ(copied.size(), total);
+}
+
+TEST(bptree_set, random) {
+    for (size_t i=1;i<=20;i++) {
+        bptree_set_test<bptree::pset<int>>(i * i * 20);
+        bptree_set_test<bptree::fast::pset<int>>(i * i * 20);
+        bptree_set_test<bptree::pset<int,std::less<int>,std::allocator<int>,uint32_t>>(i * i * 20);
+    }
+}
+
+TEST(bptree_set, multiset) {
+    bptree::pmultiset<int> s;
+    std::multiset<int> stl_set;
+    for (int i=0;i<10000;i++) {
+        s.insert(i % 37);
+        stl_set.insert(i % 37);
+    }
+    ASSERT_EQ(s.count(5), stl_set.count(5));
+    ASSERT_EQ(s.erase(5), stl_set.erase(5));
+    ASSERT_EQ(s.count(5), 0);
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin()));
+}
+
+TEST(bptree_map, string) {
+    bptree::pmap<std::string,std::string> m;
+    std::map<std::string,std::string> stl_map;
+    std::uniform_int_distribution<int> distribution(0, 5000);
+    for (int i=0;i<5000;i++) {
+        auto key = std::to_string(distribution(generator)) + std::string(20, 'k');
+        m[key] += "v";
+        stl_map[key] += "v";
+    }
+    for (int i=0;i<2000;i++) {
+        auto key = std::to_string(distribution(generator)) + std::string(20, 'k');
+        ASSERT_EQ(m.erase(key), stl_map.erase(key));
+    }
+    ASSERT_EQ(m.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(m.begin(), m.end(), stl_map.begin()));
+
+    bptree::pmultimap<int,std::string> mm;
+    for (int i=0;i<1000;i++) {
+        mm.insert(std::make_pair(i % 10, std::to_string(i)));
+    }
+    ASSERT_EQ(mm.count(3), 100);
+    ASSERT_EQ(mm.lower_bound(3)->second, "3");
+}
+
+TEST(bptree_set, pmr) {
+    std::pmr::monotonic_buffer_resource resource;
+    bptree::pset<int,std::less<int>,std::pmr::polymorphic_allocator<int>> s(&resource);
+    for (int i=0;i<10000;i++) {
+        s.insert(i * 7 % 10000);
+    }
+    ASSERT_EQ(s.size(), 10000);
+    ASSERT_EQ(*(s.begin() + 1234), 1234);
+}
+
+// an empty tree stays empty when the first value can't be moved into its leaf
+TEST(bptree_set, throwing_first_value) {
+    bptree::pset<ThrowingCopy> s;
+    // the value is copied into a detached slot first, then into the leaf
+    ThrowingCopy::copies_left = 1;
+    ASSERT_THROW(s.insert(ThrowingCopy(1)), std::runtime_error);
+    ThrowingCopy::copies_left = -1;
+    ASSERT_TRUE(s.empty());
+    ASSERT_EQ(s.begin(), s.end());
+    ASSERT_EQ(s.rbegin(), s.rend());
+    s.insert(ThrowingCopy(2));
+    ASSERT_EQ(s.size(), 1u);
+    ASSERT_EQ(s.begin()->v, 2);
+    ASSERT_EQ(s.rbegin()->v, 2);
+}
+
+// a failed insertion, also one which splits a leaf, leaves the tree as it was
+TEST(bptree_set, throwing_insertion) {
+    bptree::pset<ThrowingCopy> s;
+    std::set<int> stl_set;
+    std::uniform_int_distribution<int> distribution(0, 100000);
+    std::uniform_int_distribution<int> copies(0, 40);
+    size_t failed = 0;
+    for (int i=0;i<20000;i++) {
+        const int v = distribution(generator);
+        ThrowingCopy::copies_left = copies(generator);
+        try {
+            s.insert(ThrowingCopy(v));
+            ThrowingCopy::copies_left = -1;
+            stl_set.insert(v);
+        } catch (const std::runtime_error&) {
+            ThrowingCopy::copies_left = -1;
+            failed++;
+        }
+        ASSERT_EQ(s.size(), stl_set.size());
+    }
+    ASSERT_GT(failed, 0u);
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin(), [](const ThrowingCopy& a, int b) { return a.v == b; }));
+    for (int v: stl_set) {
+        auto it = s.find(ThrowingCopy(v));
+        ASSERT_NE(it, s.end());
+        ASSERT_EQ(it->v, v);
+    }
+}
+
+// the const keys of the slots which shift are moved, only the separators of inner nodes are copies
+TEST(bptree_set, key_copies) {
+    bptree::pmap<CountedKey,std::string> m;
+    std::uniform_int_distribution<int> distribution(0, 100000);
+    const size_t n = 20000;
+    CountedKey::copies = 0;
+    for (size_t i=0;i<n;i++) {
+        m.insert(std::make_pair(CountedKey(distribution(generator)), std::string("v")));
+    }
+    ASSERT_LT(CountedKey::copies, n / 2);
+
+    const auto size = m.size();
+    CountedKey::copies = 0;
+    for (;m.size() > size / 2;) {
+        m.erase(m.begin() + m.size() / 3);
+    }
+    ASSERT_LT(CountedKey::copies, size / 4);
+}
+
+// insertion moves the values of a leaf, the checked iterators taken before it are invalid
+TEST(bptree_set, invalidated_iterator) {
+    bptree::pset<int> s;
+    for (int i=0;i<100;i++) s.insert(i * 2);
+    auto it = s.find(50);
+    ASSERT_EQ(*it, 50);
+    s.insert(1);
+    ASSERT_THROW(*it, std::logic_error);
+    ASSERT_THROW(++it, std::logic_error);
+    it = s.find(50);
+    ASSERT_EQ(*it, 50);
+    s.insert(50);
+    ASSERT_EQ(*it, 50);
+    s.erase(0);
+    ASSERT_THROW(*it, std::logic_error);
+}
+#endif // __cplusplus >= 201703
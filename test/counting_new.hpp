@@ -0,0 +1,67 @@
+#pragma once
+/**
+ * replaces the global allocation functions of a test, so that it can check how many times it allocates.
+ * include it in a single translation unit, every form of operator new and operator delete is replaced
+ */
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+
+
+static size_t n_allocations = 0;
+// the allocations which succeed before one throws std::bad_alloc, unlimited if negative
+static long allocations_left = -1;
+
+static void count_allocation() {
+    if (allocations_left == 0) throw std::bad_alloc();
+    if (allocations_left > 0) allocations_left--;
+    n_allocations++;
+}
+
+static void* counted_allocate(std::size_t n) {
+    count_allocation();
+    if (auto ptr = std::malloc(n == 0 ? 1 : n)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n) { return counted_allocate(n); }
+void* operator new[](std::size_t n) { return counted_allocate(n); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+    try { return counted_allocate(n); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept {
+    try { return counted_allocate(n); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+
+#if __cplusplus >= 201703
+static void* counted_allocate(std::size_t n, std::align_val_t al) {
+    count_allocation();
+    const auto align = static_cast<std::size_t>(al);
+    // aligned_alloc() takes a multiple of the alignment
+    if (auto ptr = std::aligned_alloc(align, (n + align - 1) / align * align + (n == 0 ? align : 0))) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n, std::align_val_t al) { return counted_allocate(n, al); }
+void* operator new[](std::size_t n, std::align_val_t al) { return counted_allocate(n, al); }
+void* operator new(std::size_t n, std::align_val_t al, const std::nothrow_t&) noexcept {
+    try { return counted_allocate(n, al); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t n, std::align_val_t al, const std::nothrow_t&) noexcept {
+    try { return counted_allocate(n, al); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+#endif // __cplusplus >= 201703
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <set>
+#include <map>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename S>
+static void frozen_set_test(const size_t n_vals) {
+    S s;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(0, n_vals * 2);
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        const auto size = s.size();
+        s.insert(val);
+        if (s.size() != size) {
+            stl_set.insert(val);
+        }
+    }
+
+    const auto frozen = s.freeze();
+    ASSERT_EQ(frozen.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(frozen.begin(), frozen.end(), stl_set.begin()));
+    ASSERT_TRUE(std::equal(frozen.rbegin(), frozen.rend(), stl_set.rbegin()));
+
+    for (int val=-1;val<=static_cast<int>(n_vals*2)+1;val++) {
+        auto lb = frozen.lower_bound(val), ub = frozen.upper_bound(val);
+        ASSERT_EQ(frozen.rank(lb), std::distance(stl_set.begin(), stl_set.lower_bound(val)));
+        ASSERT_EQ(frozen.rank(ub), std::distance(stl_set.begin(), stl_set.upper_bound(val)));
+        ASSERT_EQ(frozen.count(val), stl_set.count(val));
+        ASSERT_EQ(frozen.contains(val), stl_set.find(val) != stl_set.end());
+        auto it = frozen.find(val);
+        if (it != frozen.end()) {
+            ASSERT_EQ(*it, val);
+            ASSERT_EQ(it, lb);
+        }
+    }
+
+    for (size_t i=0;i<frozen.size();i++) {
+        ASSERT_EQ(frozen.select(i), frozen.begin() + i);
+        ASSERT_EQ(frozen[i], *(s.begin() + i));
+    }
+
+    s.clear();
+    ASSERT_EQ(frozen.size(), stl_set.size());
+}
+
+TEST(frozen_set, random) {
+    for (size_t n: {0, 1, 2, 3, 7, 8, 15, 16, 17, 100, 1000, 5000}) {
+        frozen_set_test<pset<int>>(n);
+        frozen_set_test<set2<int>>(n);
+        frozen_set_test<pmultiset<int>>(n);
+#if __cplusplus >= 201703
+        frozen_set_test<bptree::pset<int>>(n);
+#endif // __cplusplus >= 201703
+    }
+}
+
+TEST(frozen_map, string) {
+    pmap<std::string,int> m;
+    std::map<std::string,int> stl_map;
+    for (int i=0;i<3000;i++) {
+        auto key = std::to_string(i * 7919 % 3001);
+        m[key] = i;
+        stl_map[key] = i;
+    }
+
+    auto frozen = m.freeze();
+    ASSERT_EQ(frozen.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(frozen.begin(), frozen.end(), stl_map.begin()));
+    for (int i=0;i<3005;i++) {
+        auto key = std::to_string(i);
+        auto stl_iter = stl_map.find(key);
+        if (stl_iter == stl_map.end()) {
+            ASSERT_EQ(frozen.find(key), frozen.end());
+            ASSERT_THROW(frozen.at(key), std::out_of_range);
+        } else {
+            ASSERT_EQ(frozen.at(key), stl_iter->second);
+            ASSERT_EQ(frozen.rank(frozen.find(key)), std::distance(stl_map.begin(), stl_iter));
+        }
+    }
+
+    split::pmap<int,std::string> sm;
+    for (int i=0;i<100;i++) sm[i] = std::to_string(i);
+    auto sfrozen = sm.freeze();
+    ASSERT_EQ(sfrozen.at(42), "42");
+    ASSERT_TRUE(sfrozen == sm.freeze());
+}
+
+#if __cplusplus >= 201703
+TEST(frozen_set, pmr) {
+    std::pmr::monotonic_buffer_resource resource;
+    pset<int,std::less<int>,std::pmr::polymorphic_allocator<int>> s(&resource);
+    for (int i=0;i<1000;i++) s.insert(i * 7 % 1000);
+    auto frozen = s.freeze();
+    ASSERT_EQ(frozen.get_allocator().resource(), &resource);
+    ASSERT_EQ(*frozen.lower_bound(500), 500);
+}
+#endif // __cplusplus >= 201703
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "counting_new.hpp"
+using namespace std;
+using namespace curly;
+
+
+struct PItem: public intrusive::pset_hook<PItem> {
+    int key;
+    explicit PItem(int key = 0): key(key) {}
+    bool operator<(const PItem& oth) const { return this->key < oth.key; }
+};
+
+struct SItem: public intrusive::set_hook<SItem> {
+    int key;
+    explicit SItem(int key = 0): key(key) {}
+    bool operator<(const SItem& oth) const { return this->key < oth.key; }
+};
+
+struct KeyLess {
+    template<typename T>
+    bool operator()(const T& a, const T& b) const { return a.key < b.key; }
+    template<typename T>
+    bool operator()(const T& a, int b) const { return a.key < b; }
+    template<typename T>
+    bool operator()(int a, const T& b) const { return a < b.key; }
+};
+
+std::default_random_engine generator;
+template<typename C, typename Obj, bool multi>
+static void intrusive_test(const size_t n_vals) {
+    std::vector<Obj> objs;
+    objs.reserve(n_vals);
+    std::uniform_int_distribution<int> distribution(0, n_vals);
+    for (size_t i=0;i<n_vals;i++) objs.emplace_back(distribution(generator));
+
+    C c;
+    std::multiset<int> stl_set;
+    std::vector<bool> linked(n_vals, false);
+
+    size_t n_alloc = 0;
+    for (size_t i=0;i<n_vals;i++) {
+        const auto n = n_allocations;
+        auto result = c.insert(objs[i]);
+        n_alloc += n_allocations - n;
+        if (multi || stl_set.count(objs[i].key) == 0) {
+            ASSERT_TRUE(result.second);
+            ASSERT_EQ(&*result.first, &objs[i]);
+            stl_set.insert(objs[i].key);
+            linked[i] = true;
+        } else {
+            ASSERT_FALSE(result.second);
+            ASSERT_EQ(result.first->key, objs[i].key);
+        }
+    }
+    ASSERT_EQ(c.size(), stl_set.size());
+
+    for (size_t i=0;i<n_vals;i+=2) {
+        if (!linked[i]) continue;
+        auto it = c.iterator_to(objs[i]);
+        ASSERT_EQ(&*it, &objs[i]);
+        const auto n = n_allocations;
+        c.erase(objs[i]);
+        n_alloc += n_allocations - n;
+        stl_set.erase(stl_set.find(objs[i].key));
+        linked[i] = false;
+    }
+    ASSERT_EQ(n_alloc, 0);
+    ASSERT_EQ(c.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(c.begin(), c.end(), stl_set.begin(), [](const Obj& a, int b) { return a.key == b; }));
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = distribution(generator);
+        ASSERT_EQ(c.count(Obj(key)), stl_set.count(key));
+        auto lb = c.lower_bound(Obj(key));
+        auto stl_lb = stl_set.lower_bound(key);
+        ASSERT_EQ(lb == c.end(), stl_lb == stl_set.end());
+        if (lb != c.end()) {
+            ASSERT_EQ(lb->key, *stl_lb);
+        }
+    }
+
+    auto key = objs[1].key;
+    ASSERT_EQ(c.erase(Obj(key)), stl_set.erase(key));
+    ASSERT_FALSE(c.contains(Obj(key)));
+
+    c.clear();
+    ASSERT_TRUE(c.empty());
+    for (auto& obj: objs) c.insert(obj);
+    std::set<int> keys;
+    for (auto& obj: objs) keys.insert(obj.key);
+    ASSERT_EQ(c.size(), multi ? n_vals : keys.size());
+    c.clear();
+}
+
+TEST(intrusive, set) {
+    for (size_t i=1;i<=50;i++) {
+        intrusive_test<intrusive::pset<PItem>, PItem, false>(i * 20);
+        intrusive_test<intrusive::pmultiset<PItem, KeyLess>, PItem, true>(i * 20);
+        intrusive_test<intrusive::set2<SItem, KeyLess>, SItem, false>(i * 20);
+        intrusive_test<intrusive::multiset2<SItem>, SItem, true>(i * 20);
+    }
+}
+
+TEST(intrusive, position) {
+    std::vector<PItem> objs;
+    for (int i=0;i<1000;i++) objs.emplace_back(i);
+
+    intrusive::pset<PItem, KeyLess> c;
+    for (int i=999;i>=0;i--) c.insert(objs[i]);
+    for (int i=0;i<1000;i+=7) {
+        auto it = c.iterator_to(objs[i]);
+        ASSERT_EQ(it.indexof(), i);
+        ASSERT_EQ((c.begin() + i)->key, i);
+        ASSERT_EQ(it - c.begin(), i);
+    }
+    ASSERT_EQ(c.find(500)->key, 500);
+    ASSERT_EQ(c.find(1000), c.end());
+    ASSERT_EQ(c.rbegin()->key, 999);
+
+    // copies of an object aren't linked
+    PItem copied = objs[10];
+    c.erase(objs[10]);
+    ASSERT_TRUE(c.insert(copied).second);
+    ASSERT_EQ(&*c.find(10), &copied);
+    c.erase(c.find(10));
+    c.clear();
+}
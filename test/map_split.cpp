@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <map>
+#include <stdexcept>
+#if __cplusplus >= 201703
+#include <memory_resource>
+#endif // __cplusplus >= 201703
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename M>
+static void split_map_test(const size_t n_vals) {
+    M m;
+    std::map<int,std::string> stl_map;
+    std::uniform_int_distribution<int> distribution(0, n_vals * 2);
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = distribution(generator);
+        auto val = std::to_string(key) + std::string(32, 'x');
+        ASSERT_EQ(m.insert(std::make_pair(key, val)).second, stl_map.insert(std::make_pair(key, val)).second);
+    }
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = distribution(generator);
+        m[key] += "y";
+        stl_map[key] += "y";
+    }
+    ASSERT_EQ(m.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(m.begin(), m.end(), stl_map.begin()));
+
+    M copied(m);
+    for (size_t i=0;i<n_vals/2;i++) {
+        auto key = distribution(generator);
+        auto pos = m.find(key);
+        if (stl_map.erase(key) == 0) {
+            ASSERT_EQ(pos, m.end());
+            continue;
+        }
+        auto nh = m.extract(pos);
+        ASSERT_EQ(nh.key(), key);
+        ASSERT_EQ(nh.mapped(), copied.at(key));
+        ASSERT_TRUE(copied.erase(key));
+        ASSERT_TRUE(copied.insert(std::move(nh)).inserted);
+    }
+    ASSERT_EQ(m.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(m.begin(), m.end(), stl_map.begin()));
+
+    m = std::move(copied);
+    ASSERT_GE(m.size(), stl_map.size());
+    for (auto& kv: stl_map) {
+        ASSERT_EQ(m.at(kv.first), kv.second);
+    }
+}
+
+TEST(map, split) {
+    for (size_t i=1;i<=20;i++) {
+        split_map_test<split::pmap<int,std::string>>(i * 50);
+        split_map_test<split::map2<int,std::string>>(i * 50);
+    }
+
+    split::pmap<int,std::string> m;
+    m.reserve(100);
+    for (int i=0;i<100;i++) m[i] = std::to_string(i);
+    ASSERT_EQ(m.at(42), "42");
+    ASSERT_THROW(m.at(100), std::out_of_range);
+    ASSERT_EQ((m.begin() + 10)->second, "10");
+    m.clear();
+    ASSERT_TRUE(m.empty());
+}
+
+TEST(multimap, split) {
+    split::pmultimap<int,std::string> m;
+    std::multimap<int,std::string> stl_map;
+    for (int i=0;i<1000;i++) {
+        m.insert(std::make_pair(i % 37, std::to_string(i)));
+        stl_map.insert(std::make_pair(i % 37, std::to_string(i)));
+    }
+    ASSERT_EQ(m.size(), stl_map.size());
+    ASSERT_EQ(m.count(5), stl_map.count(5));
+}
+
+#if __cplusplus >= 201703
+struct CountingResource: std::pmr::memory_resource {
+    size_t allocations = 0, outstanding = 0;
+
+    void* do_allocate(size_t bytes, size_t align) override {
+        allocations++;
+        outstanding++;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+        outstanding--;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& oth) const noexcept override {
+        return this == &oth;
+    }
+};
+
+// the pairs are allocated from the resource of the map, also those of a copy with another allocator
+TEST(map, split_pmr) {
+    using M = split::pmap<int,std::string,std::less<int>,std::pmr::polymorphic_allocator<int>>;
+    CountingResource resource, other;
+    {
+        M m(&resource);
+        for (int i=0;i<100;i++) m[i] = std::to_string(i);
+        m.try_emplace(100, "100");
+        m.insert(std::make_pair(101, std::string("101")));
+        ASSERT_GE(resource.allocations, 2 * m.size());
+
+        M copied(m, &other);
+        ASSERT_GE(other.allocations, 2 * copied.size());
+        ASSERT_EQ(copied.at(42), "42");
+
+        auto nh = copied.extract(42);
+        ASSERT_EQ(nh.mapped(), "42");
+        ASSERT_TRUE(copied.insert(std::move(nh)).inserted);
+        copied = m;
+        ASSERT_EQ(copied.size(), m.size());
+    }
+    ASSERT_EQ(resource.outstanding, 0u);
+    ASSERT_EQ(other.outstanding, 0u);
+}
+
+// the pair is released when the key kept in the node can't be copied
+TEST(map, split_throwing_key) {
+    CountingResource resource;
+    {
+        split::pmap<ThrowingCopy,int,std::less<ThrowingCopy>,std::pmr::polymorphic_allocator<ThrowingCopy>> m(&resource);
+        m.try_emplace(ThrowingCopy(1), 1);
+        const auto outstanding = resource.outstanding;
+        ThrowingCopy::copies_left = 1;
+        ASSERT_THROW(m.try_emplace(ThrowingCopy(2), 2), std::runtime_error);
+        ThrowingCopy::copies_left = -1;
+        ASSERT_EQ(resource.outstanding, outstanding);
+        ASSERT_EQ(m.size(), 1u);
+    }
+    ASSERT_EQ(resource.outstanding, 0u);
+}
+#endif // __cplusplus >= 201703
@@ -317,14 +317,23 @@ static void map_merge(int mvals) {
         map_##name<std::map<int,int>>(1000); \
         map_##name<map2<int,int>>(1000); \
         map_##name<pmap<int,int>>(1000); \
+        map_##name<fast::pmap<int,int>>(1000); \
+        map_##name<split::pmap<int,int>>(1000); \
+        map_##name<pmap<int,int,std::less<int>,std::allocator<int>,uint32_t>>(1000); \
+        map_##name<threaded::pmap<int,int>>(1000); \
         map_##name<std::pmr::map<int,int>>(1000); \
         map_##name<curly::pmr::pmap<int,int>>(1000); \
+        map_##name<bptree::pmap<int,int>>(1000); \
     }
 #define test_basic(name) \
     TEST(map, name) { \
         map_##name<std::map<int,int>>(1000); \
         map_##name<map2<int,int>>(1000); \
         map_##name<pmap<int,int>>(1000); \
+        map_##name<fast::pmap<int,int>>(1000); \
+        map_##name<split::pmap<int,int>>(1000); \
+        map_##name<pmap<int,int,std::less<int>,std::allocator<int>,uint32_t>>(1000); \
+        map_##name<threaded::pmap<int,int>>(1000); \
     }
 #if __cplusplus >= 201703L
 #define test(name) test_inc_pmr(name)
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <string>
+#if __cplusplus >= 201703
+#include <string_view>
+#endif // __cplusplus >= 201703
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "counting_new.hpp"
+using namespace std;
+using namespace curly;
+
+
+// longer than the small string buffer, so that a temporary std::string allocates
+static std::string long_key(int i) {
+    return "a-key-which-does-not-fit-into-the-small-string-buffer-" + std::to_string(i);
+}
+
+struct StringLess {
+    using is_transparent = void;
+    bool operator()(const std::string& a, const std::string& b) const { return a < b; }
+    bool operator()(const std::string& a, const char* b) const { return a.compare(b) < 0; }
+    bool operator()(const char* a, const std::string& b) const { return b.compare(a) > 0; }
+};
+
+template<typename Map>
+static void transparent_test() {
+    Map map;
+    for (int i=0;i<100;i++) {
+        map[long_key(i)] = i;
+    }
+
+    auto k5 = long_key(5), k100 = long_key(100), k7 = long_key(7);
+    const char* key5 = k5.c_str();
+    const char* key100 = k100.c_str();
+    auto n = n_allocations;
+    ASSERT_EQ(map.find(key5)->second, 5);
+    ASSERT_EQ(map.find(key100), map.end());
+    ASSERT_EQ(map.count(key5), 1u);
+    ASSERT_TRUE(map.contains(key5));
+    ASSERT_EQ(map.at(key5), 5);
+    ASSERT_EQ(map.lower_bound(key5)->second, 5);
+    ASSERT_EQ(map.equal_range(key5).first->second, 5);
+    ASSERT_EQ(map.rank(key5), map.rank(k5));
+    ASSERT_THROW(map.at(key100), std::out_of_range);
+    ASSERT_EQ(map.erase(key100), 0u);
+    ASSERT_EQ(map.extract(key100).empty(), true);
+    ASSERT_EQ(map.try_emplace(key5, 50).second, false);
+    ASSERT_EQ(map[key5], 5);
+    ASSERT_EQ(map.insert_or_assign(key5, 55).second, false);
+    ASSERT_EQ(n_allocations, n + 1);  // the exception
+    ASSERT_EQ(map.at(key5), 55);
+
+    ASSERT_EQ(map.erase(key5), 1u);
+    ASSERT_FALSE(map.contains(key5));
+    auto nh = map.extract(k7.c_str());
+    ASSERT_FALSE(nh.empty());
+    ASSERT_EQ(nh.key(), k7);
+    ASSERT_EQ(map.size(), 98u);
+
+    ASSERT_TRUE(map.try_emplace(key5, 5).second);
+    ASSERT_EQ(map.at(k5), 5);
+    ASSERT_TRUE(map.insert_or_assign(key100, 100).second);
+    ASSERT_EQ(map.at(k100), 100);
+    map[k7.c_str()] = 7;
+    ASSERT_EQ(map.at(k7), 7);
+    ASSERT_EQ(map.size(), 101u);
+}
+
+TEST(map_transparent, transparent_compare) {
+    transparent_test<pmap<std::string,int,StringLess>>();
+    transparent_test<fast::pmap<std::string,int,StringLess>>();
+    transparent_test<map2<std::string,int,StringLess>>();
+}
+
+TEST(map_transparent, key_conversion) {
+    pmap<std::string,int> map;
+    for (int i=0;i<100;i++) {
+        map.insert_or_assign(long_key(i), i);
+    }
+    ASSERT_EQ(map.try_emplace(long_key(3), 30).second, false);
+    ASSERT_EQ(map.at(long_key(3)), 3);
+
+    // the key is converted to std::string once rather than at each comparison
+    auto k5 = long_key(5);
+    auto n = n_allocations;
+    ASSERT_EQ(map.find(k5.c_str())->second, 5);
+    ASSERT_EQ(n_allocations, n + 1);
+    ASSERT_EQ(map.count(k5.c_str()), 1u);
+    ASSERT_EQ(map.erase(k5.c_str()), 1u);
+    ASSERT_EQ(map.extract(long_key(6)).key(), long_key(6));
+    ASSERT_EQ(map.extract(long_key(6)).empty(), true);
+    ASSERT_EQ(map.size(), 98u);
+}
+
+#if __cplusplus >= 201703
+TEST(map_transparent, string_view) {
+    pmap<std::string,int,std::less<>> map;
+    for (int i=0;i<100;i++) {
+        map.try_emplace(long_key(i), i);
+    }
+
+    auto k5 = long_key(5);
+    std::string_view key5(k5);
+    auto n = n_allocations;
+    ASSERT_EQ(map.find(key5)->second, 5);
+    ASSERT_EQ(map.at(key5), 5);
+    ASSERT_EQ(map[key5], 5);
+    ASSERT_EQ(n_allocations, n);
+    ASSERT_EQ(map.erase(key5), 1u);
+    ASSERT_TRUE(map.try_emplace(key5, 6).second);
+    ASSERT_EQ(map.at(k5), 6);
+
+    pmultiset<std::string,std::less<>> set;
+    for (int i=0;i<10;i++) {
+        set.insert(long_key(i % 3));
+    }
+    auto k1 = long_key(1);
+    ASSERT_EQ(set.count(std::string_view(k1)), 3u);
+    ASSERT_EQ(set.erase(std::string_view(k1)), 3u);
+    ASSERT_EQ(set.size(), 7u);
+}
+#endif // __cplusplus >= 201703
+
+// neither with each other nor with an id are employees comparable by operator==, the comparator decides
+struct Employee {
+    int id;
+    std::string name;
+};
+
+struct ById {
+    using is_transparent = void;
+    bool operator()(const Employee& a, const Employee& b) const { return a.id < b.id; }
+    bool operator()(const Employee& a, int b) const { return a.id < b; }
+    bool operator()(int a, const Employee& b) const { return a < b.id; }
+};
+
+template<typename Set>
+static void equivalence_test() {
+    Set set;
+    for (int i=0;i<100;i++) {
+        set.insert(Employee{i * 7 % 100, long_key(i)});
+    }
+    ASSERT_FALSE(set.insert(Employee{5, "again"}).second);
+    ASSERT_EQ(set.size(), 100u);
+
+    ASSERT_EQ(set.find(5)->id, 5);
+    ASSERT_EQ(set.find(100), set.end());
+    ASSERT_EQ(set.find(Employee{6, ""})->id, 6);
+    ASSERT_EQ(set.count(5), 1u);
+    ASSERT_TRUE(set.contains(5));
+    ASSERT_FALSE(set.contains(-1));
+    ASSERT_EQ(set.equal_range(5).first->id, 5);
+
+    ASSERT_EQ(set.erase(5), 1u);
+    ASSERT_EQ(set.erase(5), 0u);
+    ASSERT_FALSE(set.extract(6).empty());
+    ASSERT_EQ(set.size(), 98u);
+}
+
+TEST(map_transparent, equivalence) {
+    equivalence_test<pset<Employee,ById>>();
+    equivalence_test<set2<Employee,ById>>();
+    equivalence_test<fast::pset<Employee,ById>>();
+    equivalence_test<threaded::pset<Employee,ById>>();
+#if __cplusplus >= 201703
+    equivalence_test<bptree::pset<Employee,ById>>();
+#endif // __cplusplus >= 201703
+}
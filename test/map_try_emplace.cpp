@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <map>
+#include <random>
+#include <atomic>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+#include "counting_new.hpp"
+using namespace std;
+using namespace curly;
+
+
+// longer than the small string buffer, so that copying it allocates
+static std::string long_value(int i) {
+    return "a-value-which-does-not-fit-into-the-small-string-buffer-" + std::to_string(i);
+}
+
+// nothing is allocated for a key which is in the map already
+template<typename Map>
+static void duplicate_test(bool allocates_nodes) {
+    Map map;
+    for (int i=0;i<100;i++) {
+        map.insert(std::make_pair(i, long_value(i)));
+    }
+
+    auto v = long_value(50);
+    const auto v50 = long_value(50), v5 = long_value(5), v6 = long_value(6);
+    auto n = n_allocations;
+    ASSERT_FALSE(map.try_emplace(5, std::move(v)).second);
+    ASSERT_EQ(v, v50);
+    ASSERT_EQ(map.at(5), v5);
+    ASSERT_EQ(map[6], v6);
+    ASSERT_FALSE(map.insert_or_assign(7, std::move(v)).second);
+    ASSERT_EQ(map.at(7), v50);
+    ASSERT_EQ(n_allocations, n);
+
+    // emplace() and insert() of a duplicate assign the value
+    auto p = std::make_pair(8, long_value(80));
+    typename Map::value_type q(9, long_value(90));
+    const auto v80 = long_value(80), v90 = long_value(90);
+    n = n_allocations;
+    ASSERT_FALSE(map.emplace(std::move(p)).second);
+    ASSERT_EQ(map.at(8), v80);
+    ASSERT_FALSE(map.insert(std::move(q)).second);
+    ASSERT_EQ(map.at(9), v90);
+    if (allocates_nodes) {
+        ASSERT_EQ(n_allocations, n);
+    }
+
+    // so do emplace() of the key and the value and of a piecewise pair, the key is looked up first
+    auto w = long_value(10), x = long_value(11);
+    const auto v10 = long_value(10), v11 = long_value(11);
+    n = n_allocations;
+    ASSERT_FALSE(map.emplace(5, std::move(w)).second);
+    ASSERT_EQ(map.at(5), v10);
+    ASSERT_FALSE(map.emplace(std::piecewise_construct, std::forward_as_tuple(6), std::forward_as_tuple(std::move(x))).second);
+    ASSERT_EQ(map.at(6), v11);
+    if (allocates_nodes) {
+        ASSERT_EQ(n_allocations, n);
+    }
+
+    ASSERT_TRUE(map.try_emplace(100, long_value(100)).second);
+    ASSERT_TRUE(map[101].empty());
+    ASSERT_TRUE(map.insert_or_assign(102, long_value(102)).second);
+    ASSERT_TRUE(map.emplace(std::make_pair(103, long_value(103))).second);
+    ASSERT_EQ(map.size(), 104u);
+    int k = 0;
+    for (auto& kv: map) {
+        ASSERT_EQ(kv.first, k++);
+    }
+}
+
+TEST(map_try_emplace, duplicate) {
+    duplicate_test<pmap<int,std::string>>(true);
+    duplicate_test<map2<int,std::string>>(true);
+    duplicate_test<fast::pmap<int,std::string>>(true);
+    duplicate_test<threaded::pmap<int,std::string>>(true);
+    duplicate_test<split::pmap<int,std::string>>(true);
+#if __cplusplus >= 201703
+    duplicate_test<bptree::pmap<int,std::string>>(false);
+#endif // __cplusplus >= 201703
+}
+
+TEST(map_try_emplace, set) {
+    pset<std::string> set;
+    for (int i=0;i<100;i++) {
+        set.insert(long_value(i));
+    }
+
+    auto v = long_value(5);
+    auto n = n_allocations;
+    ASSERT_FALSE(set.emplace(std::move(v)).second);
+    ASSERT_FALSE(set.insert(v).second);
+    ASSERT_EQ(n_allocations, n);
+    ASSERT_EQ(set.size(), 100u);
+
+    pmultiset<std::string> mset;
+    for (auto& val: set) mset.insert(val);
+    ASSERT_TRUE(mset.emplace(v).second);
+    ASSERT_EQ(mset.count(v), 2u);
+}
+
+// mostly duplicates, in the same order as std::map
+template<typename Map>
+static void random_test() {
+    std::default_random_engine generator(7);
+    std::uniform_int_distribution<int> distribution(0, 300);
+    Map map;
+    std::map<int,int> stl_map;
+    for (int i=0;i<3000;i++) {
+        const int key = distribution(generator);
+        switch (i % 5) {
+            case 0: {
+                const bool inserted = stl_map.count(key) == 0;
+                if (inserted) stl_map[key] = i;
+                ASSERT_EQ(map.try_emplace(key, i).second, inserted);
+                break;
+            }
+            case 1: {
+                const bool inserted = stl_map.count(key) == 0;
+                stl_map[key] = i;
+                ASSERT_EQ(map.insert_or_assign(key, i).second, inserted);
+                break;
+            }
+            case 2:
+                map[key] += i;
+                stl_map[key] += i;
+                break;
+            case 3: {
+                const auto size = stl_map.size();
+                stl_map[key] = i;
+                ASSERT_EQ(map.emplace(std::make_pair(key, i)).second, stl_map.size() != size);
+                break;
+            }
+            default:
+                ASSERT_EQ(map.erase(key), stl_map.erase(key));
+        }
+    }
+    ASSERT_EQ(map.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), stl_map.begin()));
+}
+
+TEST(map_try_emplace, random) {
+    random_test<pmap<int,int>>();
+    random_test<map2<int,int>>();
+    random_test<threaded::pmap<int,int>>();
+    random_test<split::pmap<int,int>>();
+#if __cplusplus >= 201703
+    random_test<bptree::pmap<int,int>>();
+#endif // __cplusplus >= 201703
+}
+
+TEST(map_try_emplace, tree) {
+    RBTreeImpl<int, int, false, true> tree;
+    std::default_random_engine generator(3);
+    std::uniform_int_distribution<int> distribution(0, 1000);
+    std::map<int,int> stl_map;
+    for (int i=0;i<5000;i++) {
+        const int key = distribution(generator);
+        const bool inserted = stl_map.count(key) == 0;
+        if (inserted) stl_map[key] = i;
+        auto result = tree.try_emplace(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(i));
+        ASSERT_EQ(result.second, inserted);
+        ASSERT_EQ(result.first->value.get().first, key);
+        ASSERT_EQ(result.first->value.get().second, stl_map[key]);
+        if (i % 100 == 0) tree.check_consistency();
+    }
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), stl_map.size());
+}
+
+// the value is constructed in its node, a moved key isn't copied and the mapped value needn't be movable
+template<typename Map>
+static void in_place_test(size_t copies_per_key) {
+    Map map;
+    CountedKey::copies = 0;
+    for (int i=0;i<100;i++) {
+        ASSERT_TRUE(map.try_emplace(CountedKey(i), i).second);
+        ASSERT_EQ(map[CountedKey(i)].load(), i);
+    }
+    ASSERT_FALSE(map.try_emplace(CountedKey(5), 50).second);
+    ASSERT_EQ(map.at(CountedKey(5)).load(), 5);
+    map[CountedKey(100)]++;
+    ASSERT_EQ(map.at(CountedKey(100)).load(), 1);
+    ASSERT_EQ(CountedKey::copies, 101 * copies_per_key);
+    ASSERT_EQ(map.size(), 101u);
+}
+
+TEST(map_try_emplace, in_place) {
+    in_place_test<pmap<CountedKey,std::atomic<int>>>(0);
+    in_place_test<map2<CountedKey,std::atomic<int>>>(0);
+    in_place_test<fast::pmap<CountedKey,std::atomic<int>>>(0);
+    in_place_test<threaded::pmap<CountedKey,std::atomic<int>>>(0);
+    // the node keeps a copy of the key next to the separately allocated pair
+    in_place_test<split::pmap<CountedKey,std::atomic<int>>>(1);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <utility>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename Tree, bool multi>
+static void bulk_insert_impl_test(const size_t n_vals, const size_t n_batch) {
+    Tree tree;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-n_vals, n_vals);
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        if (tree.insert(val).second) {
+            stl_set.insert(val);
+        }
+    }
+
+    std::vector<int> batch;
+    for (size_t i=0;i<n_batch;i++) {
+        batch.push_back(distribution(generator));
+    }
+    const auto version = tree.version();
+    tree.insert_by_rebuild(batch.begin(), batch.end());
+    tree.check_consistency();
+    if (!batch.empty()) {
+        ASSERT_NE(tree.version(), version);
+    }
+    for (auto val: batch) {
+        if (multi || stl_set.count(val) == 0) stl_set.insert(val);
+    }
+    ASSERT_EQ(tree.size(), stl_set.size());
+
+    size_t idx = 0;
+    auto stl_iter = stl_set.begin();
+    for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1),idx++,stl_iter++) {
+        ASSERT_EQ(node->value.get(), *stl_iter);
+        ASSERT_EQ(tree.indexof(node), idx);
+    }
+    ASSERT_EQ(stl_iter, stl_set.end());
+}
+
+template<typename Tree, bool multi>
+static void bulk_insert_impl_tests() {
+    for (size_t n: {0, 1, 10, 100, 1000}) {
+        for (size_t m: {0, 1, 2, 10, 1000, 3000}) {
+            bulk_insert_impl_test<Tree,multi>(n, m);
+        }
+    }
+}
+
+TEST(rbtree_impl_bulk_insert, rbtree) {
+    bulk_insert_impl_tests<RBTreeImpl<int, void, true, true>,true>();
+    bulk_insert_impl_tests<RBTreeImpl<int, void, false, true>,false>();
+    bulk_insert_impl_tests<RBTreeImpl<int, void, true, false>,true>();
+    bulk_insert_impl_tests<RBTreeImpl<int, void, false, false>,false>();
+    bulk_insert_impl_tests<RBTreeImpl<int, void, true, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,true>();
+    bulk_insert_impl_tests<RBTreeImpl<int, void, false, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,false>();
+}
+
+#if __cplusplus >= 201703
+TEST(rbtree_impl_bulk_insert, bptree) {
+    bulk_insert_impl_tests<BPTreeImpl<int, void, true>,true>();
+    bulk_insert_impl_tests<BPTreeImpl<int, void, false>,false>();
+}
+#endif // __cplusplus >= 201703
+
+// the range insertion gives the same values in the same order as inserting them one by one
+template<typename Map>
+static void bulk_insert_map_test(const size_t n_vals, const size_t n_batch) {
+    std::uniform_int_distribution<int> distribution(0, n_vals);
+    Map map, expected;
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = distribution(generator);
+        map.insert(std::make_pair(key, static_cast<int>(i)));
+        expected.insert(std::make_pair(key, static_cast<int>(i)));
+    }
+
+    std::vector<std::pair<int,int>> batch;
+    for (size_t i=0;i<n_batch;i++) {
+        batch.emplace_back(distribution(generator), static_cast<int>(n_vals + i));
+    }
+    map.insert(batch.begin(), batch.end());
+    for (auto& kv: batch) {
+        expected.insert(kv);
+    }
+
+    ASSERT_EQ(map.size(), expected.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), expected.begin()));
+}
+
+TEST(rbtree_impl_bulk_insert, containers) {
+    for (size_t n: {0, 10, 1000}) {
+        for (size_t m: {1, 10, 100, 2000}) {
+            bulk_insert_map_test<pmap<int,int>>(n, m);
+            bulk_insert_map_test<pmultimap<int,int>>(n, m);
+            bulk_insert_map_test<map2<int,int>>(n, m);
+            bulk_insert_map_test<threaded::pmultimap<int,int>>(n, m);
+#if __cplusplus >= 201703
+            bulk_insert_map_test<bptree::pmap<int,int>>(n, m);
+            bulk_insert_map_test<bptree::pmultimap<int,int>>(n, m);
+#endif // __cplusplus >= 201703
+        }
+    }
+
+    std::vector<int> values = {5, 3, 5, 1, 3, 9, 7, 5, 1, 2, 8, 6, 4, 0, 9, 8, 3};
+    pset<int> set(values.begin(), values.end());
+    ASSERT_EQ(set.size(), 10u);
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), std::set<int>(values.begin(), values.end()).begin()));
+}
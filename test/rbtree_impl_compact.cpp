@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<bool keep_position_info>
+static void compact_test(const size_t n_vals, bool pooled) {
+    RBTreeImpl<int, void, true, keep_position_info> tree;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-n_vals * 3,n_vals * 3);
+
+    if (pooled) tree.reserve(n_vals);
+    for (size_t i=0;i<n_vals * 2;i++) {
+        auto val = distribution(generator);
+        tree.insert(val);
+        stl_set.insert(val);
+        if (i % 3 == 0) {
+            auto node = tree.find(distribution(generator));
+            if (node) {
+                stl_set.erase(stl_set.find(node->value.get()));
+                tree.erase(node, false);
+            }
+        }
+    }
+
+    const auto version = tree.version();
+    tree.compact();
+    tree.check_consistency();
+    if (!stl_set.empty()) {
+        ASSERT_NE(tree.version(), version);
+    }
+    ASSERT_EQ(tree.size(), stl_set.size());
+    ASSERT_EQ(tree.capacity(), tree.size());
+
+    auto node = tree.begin();
+    for (auto& val: stl_set) {
+        ASSERT_EQ(node->value.get(), val);
+        auto next = tree.advance(node, 1);
+        if (next) {
+            ASSERT_EQ(next, node + 1);
+        }
+        node = next;
+    }
+    ASSERT_EQ(node, nullptr);
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        tree.insert(val);
+        stl_set.insert(val);
+    }
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), stl_set.size());
+    tree.clear();
+    tree.compact();
+    ASSERT_EQ(tree.capacity(), 0);
+}
+
+TEST(rbtree_impl, compact) {
+    for (size_t n: {0, 1, 2, 10, 100, 1000, 10000}) {
+        compact_test<true>(n, false);
+        compact_test<true>(n, true);
+        compact_test<false>(n, false);
+        compact_test<false>(n, true);
+    }
+}
+
+struct throw_on_copy {
+    static int copies_left;
+    int val;
+
+    explicit throw_on_copy(int val): val(val) {}
+    throw_on_copy(const throw_on_copy& oth): val(oth.val) {
+        if (copies_left-- == 0) throw std::runtime_error("copy");
+    }
+    throw_on_copy(throw_on_copy&& oth): val(oth.val) {
+        if (copies_left-- == 0) throw std::runtime_error("move");
+    }
+
+    bool operator<(const throw_on_copy& oth) const { return this->val < oth.val; }
+    bool operator==(const throw_on_copy& oth) const { return this->val == oth.val; }
+};
+int throw_on_copy::copies_left = -1;
+
+TEST(rbtree_impl, compact_exception) {
+    RBTreeImpl<throw_on_copy, void, false> tree;
+    for (int i=0;i<100;i++) tree.insert(throw_on_copy(i * 37 % 100));
+
+    throw_on_copy::copies_left = 50;
+    ASSERT_THROW(tree.compact(), std::runtime_error);
+    throw_on_copy::copies_left = -1;
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), 100);
+    ASSERT_EQ(tree.capacity(), 100);
+
+    int i = 0;
+    for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1),i++) {
+        ASSERT_EQ(node->value.get().val, i);
+    }
+}
+
+TEST(map, compact) {
+    pmap<std::string,std::string> m;
+    std::map<std::string,std::string> stl_map;
+    std::uniform_int_distribution<int> distribution(0, 3000);
+    for (int i=0;i<5000;i++) {
+        auto key = std::to_string(distribution(generator));
+        m[key] = std::string(40, 'v') + key;
+        stl_map[key] = std::string(40, 'v') + key;
+        if (i % 2 == 0) {
+            key = std::to_string(distribution(generator));
+            ASSERT_EQ(m.erase(key), stl_map.erase(key));
+        }
+    }
+
+    m.compact();
+    ASSERT_EQ(m.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(m.begin(), m.end(), stl_map.begin()));
+    ASSERT_EQ(*(m.begin() + 100), *std::next(stl_map.begin(), 100));
+
+#if __cplusplus >= 201703
+    bptree::pmap<std::string,std::string> bm(stl_map.begin(), stl_map.end());
+    for (int i=0;i<3000;i+=2) {
+        bm.erase(std::to_string(i));
+    }
+    bm.compact();
+    for (int i=0;i<3000;i++) {
+        auto key = std::to_string(i);
+        ASSERT_EQ(bm.count(key), i % 2 == 1 && stl_map.count(key) ? 1 : 0);
+    }
+#endif // __cplusplus >= 201703
+}
+
+// compact() of a tree without reserve() leaves its pool inactive, erased nodes are released
+TEST(rbtree_impl, compact_without_reserve) {
+    RBTreeImpl<int, void, false, true> tree;
+    for (int i=0;i<1000;i++) tree.insert(i * 7 % 1000);
+    tree.compact();
+    ASSERT_EQ(tree.capacity(), tree.size());
+
+    for (int i=1000;i<1100;i++) tree.insert(i);
+    ASSERT_EQ(tree.capacity(), tree.size());
+    for (int i=0;i<1100;i+=2) tree.erase(tree.find(i), false);
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), 550u);
+    ASSERT_EQ(tree.capacity(), tree.size());
+
+    // the chunk of compact() is released with its last node
+    while (tree.size() > 0) tree.erase(tree.begin(), false);
+    ASSERT_EQ(tree.capacity(), 0u);
+    tree.insert(1);
+    ASSERT_EQ(tree.capacity(), 1u);
+
+    // a reserved pool keeps the erased nodes
+    tree.reserve(100);
+    tree.compact();
+    for (int i=0;i<10;i++) tree.insert(i + 2);
+    const auto capacity = tree.capacity();
+    ASSERT_GT(capacity, tree.size());
+    tree.erase(tree.begin(), false);
+    ASSERT_EQ(tree.capacity(), capacity);
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <iterator>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename Tree>
+static void erase_range_test(const size_t n_vals) {
+    Tree tree;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-n_vals, n_vals);
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        if (tree.insert(val).second) {
+            stl_set.insert(val);
+        }
+    }
+
+    for (;!stl_set.empty();) {
+        std::uniform_int_distribution<size_t> index_distribution(0, stl_set.size());
+        auto i = index_distribution(generator), j = index_distribution(generator);
+        if (i > j) std::swap(i, j);
+        if (i == j && j < stl_set.size()) j++;
+
+        auto first = tree.begin(), last = tree.begin();
+        for (size_t k=0;k<i;k++) first = tree.advance(first, 1);
+        last = j == stl_set.size() ? nullptr : tree.advance(first, j - i);
+        auto next = tree.erase_range(first, last);
+        auto stl_next = stl_set.erase(std::next(stl_set.begin(), i), std::next(stl_set.begin(), j));
+        ASSERT_EQ(next == nullptr, stl_next == stl_set.end());
+        if (next) {
+            ASSERT_EQ(next->value.get(), *stl_next);
+            ASSERT_EQ(tree.indexof(next), i);
+        }
+
+        tree.check_consistency();
+        ASSERT_EQ(tree.size(), stl_set.size());
+        size_t idx = 0;
+        auto stl_iter = stl_set.begin();
+        for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1),idx++,stl_iter++) {
+            ASSERT_EQ(node->value.get(), *stl_iter);
+            ASSERT_EQ(tree.indexof(node), idx);
+        }
+        ASSERT_EQ(stl_iter, stl_set.end());
+        auto stl_riter = stl_set.rbegin();
+        for (auto node=tree.rbegin();node!=nullptr;node=tree.advance(node, -1),stl_riter++) {
+            ASSERT_EQ(node->value.get(), *stl_riter);
+        }
+        ASSERT_EQ(stl_riter, stl_set.rend());
+    }
+}
+
+template<typename Tree>
+static void erase_range_tests() {
+    for (size_t n: {1, 2, 10, 17, 100, 1000, 5000}) {
+        erase_range_test<Tree>(n);
+    }
+}
+
+TEST(rbtree_impl_erase_range, rbtree) {
+    erase_range_tests<RBTreeImpl<int, void, true, true>>();
+    erase_range_tests<RBTreeImpl<int, void, false, true>>();
+    erase_range_tests<RBTreeImpl<int, void, true, false>>();
+    erase_range_tests<RBTreeImpl<int, void, false, false>>();
+    erase_range_tests<RBTreeImpl<int, void, true, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+    erase_range_tests<RBTreeImpl<int, void, false, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+}
+
+#if __cplusplus >= 201703
+TEST(rbtree_impl_erase_range, bptree) {
+    erase_range_tests<BPTreeImpl<int, void, true>>();
+}
+#endif // __cplusplus >= 201703
+
+template<typename Set>
+static void erase_container_test() {
+    Set set;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(0, 50);
+    for (size_t i=0;i<3000;i++) {
+        auto val = distribution(generator);
+        set.insert(val);
+        stl_set.insert(val);
+    }
+
+    for (int key=0;key<50;key+=3) {
+        ASSERT_EQ(set.erase(key), stl_set.erase(key));
+    }
+    ASSERT_EQ(set.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), stl_set.begin()));
+
+    auto it = set.erase_nth(100, 1000);
+    stl_set.erase(std::next(stl_set.begin(), 100), std::next(stl_set.begin(), 1000));
+    ASSERT_EQ(std::distance(set.begin(), it), 100);
+    ASSERT_EQ(set.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), stl_set.begin()));
+
+    it = set.erase(std::next(set.begin(), 10), set.end());
+    ASSERT_EQ(it, set.end());
+    ASSERT_EQ(set.size(), 10u);
+    ASSERT_THROW(set.erase_nth(5, 11), std::out_of_range);
+    set.erase_nth(0, set.size());
+    ASSERT_TRUE(set.empty());
+}
+
+TEST(rbtree_impl_erase_range, containers) {
+    erase_container_test<pmultiset<int>>();
+    erase_container_test<multiset2<int>>();
+    erase_container_test<threaded::pmultiset<int>>();
+#if __cplusplus >= 201703
+    erase_container_test<bptree::pmultiset<int>>();
+#endif // __cplusplus >= 201703
+}
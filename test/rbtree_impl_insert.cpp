@@ -47,7 +47,7 @@ static void insert_test(const size_t n_vals) {
     auto b1=tree_multi.begin(),b2=tree_multi2.begin();
     for (;b1!=nullptr;b1=tree_multi.advance(b1,1),b2=tree_multi2.advance(b2,1)) {
         ASSERT_EQ(b1->value.get(), b2->value.get());
-        ASSERT_EQ(b1->black, b2->black);
+        ASSERT_EQ(b1->is_black(), b2->is_black());
         ASSERT_EQ(b1->num_of_nodes(), b2->num_of_nodes());
     }
     ASSERT_EQ(b2, nullptr);
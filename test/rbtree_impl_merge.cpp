@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename Tree, typename Source, bool multi, bool source_multi>
+static void merge_test(size_t n, size_t m, bool pooled) {
+    Tree tree;
+    Source source;
+    std::multiset<int> stl_set;
+    std::multiset<int,typename Source::key_compare> stl_source;
+    if (pooled) {
+        tree.reserve(n);
+        source.reserve(m);
+    }
+    const int range = static_cast<int>(std::max(n, m));
+    fill(tree, stl_set, n, 0, range);
+    fill(source, stl_source, m, 0, range);
+
+    tree.merge(source);
+    std::multiset<int,typename Source::key_compare> stl_rejected;
+    for (auto v: stl_source) {
+        if (multi || stl_set.count(v) == 0) {
+            stl_set.insert(v);
+        } else {
+            stl_rejected.insert(v);
+        }
+    }
+    check_tree(tree, stl_set);
+    check_tree(source, stl_rejected);
+
+    // both trees are still usable, the nodes which left the pool of source outlive it
+    tree.insert(-1);
+    source.insert(-1);
+    tree.check_consistency();
+    source.check_consistency();
+    source.clear();
+    source.shrink_to_fit();
+    stl_set.insert(-1);
+    check_tree(tree, stl_set);
+}
+
+template<typename Tree, typename Source, bool multi, bool source_multi>
+static void merge_tests() {
+    for (bool pooled: {false, true}) {
+        for (size_t n: {0, 1, 10, 1000}) {
+            for (size_t m: {0, 1, 10, 1000}) {
+                merge_test<Tree,Source,multi,source_multi>(n, m, pooled);
+            }
+        }
+    }
+}
+
+TEST(rbtree_impl_merge, rbtree) {
+    merge_tests<RBTreeImpl<int, void, false, true>,RBTreeImpl<int, void, false, true>,false,false>();
+    merge_tests<RBTreeImpl<int, void, false, true>,RBTreeImpl<int, void, true, true>,false,true>();
+    merge_tests<RBTreeImpl<int, void, true, true>,RBTreeImpl<int, void, true, true>,true,true>();
+    merge_tests<RBTreeImpl<int, void, true, true>,RBTreeImpl<int, void, false, true>,true,false>();
+    merge_tests<RBTreeImpl<int, void, false, false>,RBTreeImpl<int, void, true, false>,false,true>();
+    merge_tests<RBTreeImpl<int, void, true, false>,RBTreeImpl<int, void, true, false>,true,true>();
+    merge_tests<RBTreeImpl<int, void, false, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,
+                RBTreeImpl<int, void, true, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,false,true>();
+    merge_tests<RBTreeImpl<int, void, true, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,
+                RBTreeImpl<int, void, true, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,true,true>();
+    // the nodes of a source with another order are sorted
+    merge_tests<RBTreeImpl<int, void, false, true>,RBTreeImpl<int, void, true, true, std::greater<int>>,false,true>();
+    merge_tests<RBTreeImpl<int, void, true, false>,RBTreeImpl<int, void, false, false, std::greater<int>>,true,false>();
+}
+
+#if __cplusplus >= 201703
+// the values which stay in source, and the order of equal keys, are the ones of std::map::merge()
+template<typename Map, typename Source, typename StlMap, typename StlSource>
+static void merge_container_test(size_t n, size_t m) {
+    Map map;
+    Source source;
+    StlMap stl_map;
+    StlSource stl_source;
+    std::uniform_int_distribution<int> distribution(0, static_cast<int>(std::max(n, m)));
+    // insert() of a unique map assigns the value of a duplicate key, so only the first value of a key is inserted
+    for (size_t i=0;i<n;i++) {
+        auto v = std::make_pair(distribution(generator), static_cast<int>(i));
+        const auto size = stl_map.size();
+        stl_map.insert(v);
+        if (stl_map.size() != size) map.insert(v);
+    }
+    for (size_t i=0;i<m;i++) {
+        auto v = std::make_pair(distribution(generator), -static_cast<int>(i));
+        const auto size = stl_source.size();
+        stl_source.insert(v);
+        if (stl_source.size() != size) source.insert(v);
+    }
+
+    map.merge(source);
+    stl_map.merge(stl_source);
+    ASSERT_EQ(map.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), stl_map.begin()));
+    ASSERT_EQ(source.size(), stl_source.size());
+    ASSERT_TRUE(std::equal(source.begin(), source.end(), stl_source.begin()));
+
+    map.merge(map);
+    ASSERT_EQ(map.size(), stl_map.size());
+}
+
+TEST(rbtree_impl_merge, containers) {
+    for (size_t n: {0, 5, 100, 1000}) {
+        for (size_t m: {0, 5, 100, 1000}) {
+            merge_container_test<pmap<int,int>,pmap<int,int>,std::map<int,int>,std::map<int,int>>(n, m);
+            merge_container_test<pmap<int,int>,pmultimap<int,int>,std::map<int,int>,std::multimap<int,int>>(n, m);
+            merge_container_test<pmultimap<int,int>,pmultimap<int,int>,std::multimap<int,int>,std::multimap<int,int>>(n, m);
+            merge_container_test<map2<int,int>,map2<int,int,std::greater<int>>,std::map<int,int>,std::map<int,int,std::greater<int>>>(n, m);
+            merge_container_test<threaded::pmap<int,int>,threaded::pmap<int,int>,std::map<int,int>,std::map<int,int>>(n, m);
+            merge_container_test<split::pmap<int,int>,split::pmap<int,int>,std::map<int,int>,std::map<int,int>>(n, m);
+            merge_container_test<bptree::pmap<int,int>,bptree::pmap<int,int,std::greater<int>>,std::map<int,int>,std::map<int,int,std::greater<int>>>(n, m);
+            merge_container_test<bptree::pmultimap<int,int>,bptree::pmultimap<int,int>,std::multimap<int,int>,std::multimap<int,int>>(n, m);
+        }
+    }
+}
+#endif // __cplusplus >= 201703
@@ -11,9 +11,10 @@ using namespace curly;
 
 
 std::default_random_engine generator;
+template<typename Tree>
 static void move_test(const size_t n_vals)
 {
-    RBTreeImpl<int, void, true> tree_multi;
+    Tree tree_multi;
     std::uniform_int_distribution<int> distribution(-100000,100000);
 
     for (size_t i=0;i<n_vals;i++) {
@@ -34,9 +35,18 @@ static void move_test(const size_t n_vals)
 
 TEST(rbtree_impl, move) {
     for (size_t i=1;i<=100;i++) {
-        move_test(i);
-        move_test(i * 10);
-        move_test(i * 100);
-        move_test(i * 1000);
+        move_test<RBTreeImpl<int, void, true>>(i);
+        move_test<RBTreeImpl<int, void, true>>(i * 10);
+        move_test<RBTreeImpl<int, void, true>>(i * 100);
+        move_test<RBTreeImpl<int, void, true>>(i * 1000);
+    }
+}
+
+TEST(rbtree_impl, move_uint32_counter) {
+    using tree_t = RBTreeImpl<int, void, true, true, std::less<int>, std::allocator<int>, uint32_t>;
+    for (size_t i=1;i<=100;i++) {
+        move_test<tree_t>(i);
+        move_test<tree_t>(i * 10);
+        move_test<tree_t>(i * 100);
     }
 }
@@ -0,0 +1,220 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+
+template<typename Tree>
+static void check_copy(Tree& tree, Tree& copy) {
+    copy.check_consistency();
+    ASSERT_EQ(copy.size(), tree.size());
+    size_t idx = 0;
+    auto node = tree.begin();
+    for (auto cnode=copy.begin();cnode!=nullptr;cnode=copy.advance(cnode, 1),node=tree.advance(node, 1),idx++) {
+        ASSERT_NE(cnode, node);
+        ASSERT_EQ(cnode->value.get(), node->value.get());
+        ASSERT_EQ(copy.indexof(cnode), idx);
+    }
+    ASSERT_EQ(node, nullptr);
+}
+
+template<typename Tree>
+static void parallel_copy_test(size_t n, size_t grain) {
+    Tree tree, copy, pooled;
+    std::uniform_int_distribution<int> distribution(0, static_cast<int>(n));
+    for (size_t i=0;i<n;i++) {
+        tree.insert(distribution(generator));
+    }
+    copy.insert(-1);
+    pooled.reserve(n);
+    const auto capacity = pooled.capacity();
+
+    rbtree_thread_executor executor(4);
+    tree.parallel_copy_to(copy, executor, grain);
+    check_copy(tree, copy);
+
+    serial_executor serial;
+    tree.parallel_copy_to(copy, serial, grain);
+    check_copy(tree, copy);
+
+    // each task fills its own range of the nodes of the pool
+    tree.parallel_copy_to(pooled, executor, grain);
+    check_copy(tree, pooled);
+    ASSERT_EQ(pooled.capacity(), capacity);
+}
+
+template<typename Tree>
+static void parallel_copy_tests() {
+    for (size_t n: {0, 1, 100, 5000}) {
+        for (size_t grain: {1, 16, 1000}) {
+            parallel_copy_test<Tree>(n, grain);
+        }
+    }
+}
+
+TEST(rbtree_impl_parallel_copy, rbtree) {
+    parallel_copy_tests<RBTreeImpl<int, void, false, true>>();
+    parallel_copy_tests<RBTreeImpl<int, void, true, true>>();
+    parallel_copy_tests<RBTreeImpl<int, void, false, false>>();
+    parallel_copy_tests<RBTreeImpl<int, void, true, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+    parallel_copy_tests<RBTreeImpl<int, void, false, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+}
+
+// the nodes which were cloned before a copy threw are released, the target is left empty
+TEST(rbtree_impl_parallel_copy, exception) {
+    RBTreeImpl<ThrowingCopy, void, false, true> tree, copy;
+    for (int i=0;i<3000;i++) {
+        tree.insert(ThrowingCopy(i));
+    }
+
+    for (int n: {0, 100, 1500, 2999}) {
+        rbtree_thread_executor executor(4);
+        ThrowingCopy::copies_left = n;
+        ASSERT_THROW(tree.parallel_copy_to(copy, executor, 16), std::runtime_error);
+        copy.check_consistency();
+        ASSERT_EQ(copy.size(), 0u);
+    }
+    ThrowingCopy::copies_left = -1;
+    rbtree_thread_executor executor(4);
+    tree.parallel_copy_to(copy, executor, 16);
+    ASSERT_EQ(copy.size(), 3000u);
+    copy.check_consistency();
+
+    // all nodes taken from a pool go back to it
+    RBTreeImpl<ThrowingCopy, void, false, true> pooled;
+    pooled.reserve(3000);
+    const auto capacity = pooled.capacity();
+    for (int n: {0, 100, 2999}) {
+        ThrowingCopy::copies_left = n;
+        ASSERT_THROW(tree.parallel_copy_to(pooled, executor, 16), std::runtime_error);
+        pooled.check_consistency();
+        ASSERT_EQ(pooled.size(), 0u);
+        ASSERT_EQ(pooled.capacity(), capacity);
+    }
+    ThrowingCopy::copies_left = -1;
+    tree.parallel_copy_to(pooled, executor, 16);
+    ASSERT_EQ(pooled.size(), 3000u);
+    ASSERT_EQ(pooled.capacity(), capacity);
+}
+
+template<typename Set>
+static void container_copy_test(size_t n) {
+    Set set;
+    for (size_t i=0;i<n;i++) {
+        set.insert(static_cast<int>(i * 7 % n));
+    }
+
+    Set copy(set);
+    ASSERT_TRUE(copy == set);
+    Set assigned;
+    assigned.insert(-1);
+    assigned = set;
+    ASSERT_TRUE(assigned == set);
+
+    Set parallel;
+    parallel.parallel_assign(set, rbtree_thread_executor(4), 16);
+    ASSERT_TRUE(parallel == set);
+    parallel.parallel_assign(parallel);
+    ASSERT_TRUE(parallel == set);
+    parallel.insert(static_cast<int>(n));
+    ASSERT_EQ(parallel.size(), set.size() + 1);
+}
+
+TEST(rbtree_impl_parallel_copy, containers) {
+    for (size_t n: {size_t(0), size_t(1000), size_t(1) << 17}) {
+        container_copy_test<pset<int>>(n);
+        container_copy_test<set2<int>>(n);
+        container_copy_test<threaded::pset<int>>(n);
+        container_copy_test<fast::pmultiset<int>>(n);
+#if __cplusplus >= 201703
+        container_copy_test<bptree::pset<int>>(n);
+#endif // __cplusplus >= 201703
+    }
+}
+
+static std::atomic<int> foreign_thread_copies(0);
+static std::thread::id copying_thread;
+template<bool nothrow>
+struct ThreadCheckedCopy {
+    int v;
+    explicit ThreadCheckedCopy(int v): v(v) {}
+    ThreadCheckedCopy(const ThreadCheckedCopy& oth) noexcept(nothrow): v(oth.v) {
+        if (std::this_thread::get_id() != copying_thread) foreign_thread_copies++;
+    }
+    bool operator<(const ThreadCheckedCopy& oth) const { return v < oth.v; }
+    bool operator==(const ThreadCheckedCopy& oth) const { return v == oth.v; }
+    bool operator!=(const ThreadCheckedCopy& oth) const { return v != oth.v; }
+};
+
+// stateless, but not declared by rbtree_allocator_concurrent
+template<typename T>
+struct StatelessAllocator: std::allocator<T> {
+    template<typename U> struct rebind { using other = StatelessAllocator<U>; };
+    StatelessAllocator() = default;
+    template<typename U> StatelessAllocator(const StatelessAllocator<U>&) {}
+};
+
+static_assert(rbtree_allocator_concurrent<std::allocator<int>>::value, "std::allocator is thread-safe");
+static_assert(!rbtree_allocator_concurrent<StatelessAllocator<int>>::value, "stateless allocators must opt in");
+static_assert(rbtree_value_concurrent_copy<int>::value, "nothrow values are copied concurrently");
+static_assert(rbtree_value_concurrent_copy<std::pair<const int,int>>::value, "nothrow values are copied concurrently");
+static_assert(!rbtree_value_concurrent_copy<ThreadCheckedCopy<false>>::value, "throwing values must opt in");
+
+// copy construction and copy assignment clone values which may throw on the calling thread
+TEST(rbtree_impl_parallel_copy, serial_copies) {
+    copying_thread = std::this_thread::get_id();
+    pset<ThreadCheckedCopy<false>> set;
+    for (int i=0;i<static_cast<int>(rbtree_parallel_copy_size);i++) set.insert(ThreadCheckedCopy<false>(i));
+    foreign_thread_copies = 0;
+    pset<ThreadCheckedCopy<false>> copy(set);
+    pset<ThreadCheckedCopy<false>> assigned;
+    assigned = set;
+    ASSERT_TRUE(copy == set);
+    ASSERT_TRUE(assigned == set);
+    ASSERT_EQ(foreign_thread_copies.load(), 0);
+
+    // neither does a tree with another allocator
+    using tree_t = RBTreeImpl<ThreadCheckedCopy<false>, void, false, true, std::less<ThreadCheckedCopy<false>>, StatelessAllocator<ThreadCheckedCopy<false>>>;
+    tree_t tree, tree_copy;
+    for (int i=0;i<3000;i++) tree.insert(ThreadCheckedCopy<false>(i));
+    rbtree_thread_executor executor(4);
+    tree.parallel_copy_to(tree_copy, executor, 16);
+    ASSERT_EQ(tree_copy.size(), 3000u);
+    ASSERT_EQ(foreign_thread_copies.load(), 0);
+
+    // unless the nodes come from a pool
+    tree_t pooled;
+    pooled.reserve(3000);
+    tree.parallel_copy_to(pooled, executor, 16);
+    ASSERT_EQ(pooled.size(), 3000u);
+    pooled.check_consistency();
+    ASSERT_GT(foreign_thread_copies.load(), 0);
+}
+
+// copy construction and copy assignment of large trees of nothrow values start threads
+TEST(rbtree_impl_parallel_copy, parallel_copies) {
+    copying_thread = std::this_thread::get_id();
+    fast::pset<ThreadCheckedCopy<true>> set;
+    for (int i=0;i<static_cast<int>(rbtree_parallel_copy_size);i++) set.insert(ThreadCheckedCopy<true>(i));
+    foreign_thread_copies = 0;
+    fast::pset<ThreadCheckedCopy<true>> copy(set);
+    fast::pset<ThreadCheckedCopy<true>> assigned;
+    assigned.reserve(set.size());
+    assigned = set;
+    ASSERT_TRUE(copy == set);
+    ASSERT_TRUE(assigned == set);
+    if (std::thread::hardware_concurrency() > 1) {
+        ASSERT_GT(foreign_thread_copies.load(), 0);
+    }
+}
@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "counting_new.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+static void pool_churn_test(const size_t n_vals) {
+    RBTreeImpl<int, void, true> tree;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-n_vals * 3,n_vals * 3);
+
+    for (size_t i=0;i<n_vals/2;i++) {
+        auto val = distribution(generator);
+        tree.insert(val);
+        stl_set.insert(val);
+    }
+
+    tree.reserve(n_vals);
+    const auto capacity = tree.capacity();
+    ASSERT_GE(capacity, n_vals);
+
+    for (size_t i=n_vals/2;i<n_vals;i++) {
+        auto val = distribution(generator);
+        tree.insert(val);
+        stl_set.insert(val);
+    }
+    ASSERT_EQ(tree.capacity(), capacity);
+    tree.check_consistency();
+
+    for (size_t i=0;i<n_vals * 2;i++) {
+        auto node = tree.advance(tree.begin(), i % tree.size());
+        stl_set.erase(stl_set.find(node->value.get()));
+        tree.erase(node, false);
+
+        auto val = distribution(generator);
+        tree.insert(val);
+        stl_set.insert(val);
+    }
+    ASSERT_GE(tree.capacity(), tree.size());
+    tree.check_consistency();
+
+    ASSERT_EQ(tree.size(), stl_set.size());
+    auto node = tree.begin();
+    for (auto& val: stl_set) {
+        ASSERT_EQ(node->value.get(), val);
+        node = tree.advance(node, 1);
+    }
+    ASSERT_EQ(node, nullptr);
+
+    const auto capacity_before_clear = tree.capacity();
+    tree.clear();
+    ASSERT_EQ(tree.size(), 0);
+    ASSERT_LE(tree.capacity(), capacity_before_clear);
+    ASSERT_GE(tree.capacity(), capacity - n_vals / 2);
+
+    tree.shrink_to_fit();
+    ASSERT_EQ(tree.capacity(), 0);
+
+    tree.insert(1);
+    tree.insert(2);
+    ASSERT_EQ(tree.capacity(), 2);
+}
+
+TEST(rbtree_impl, pool) {
+    for (size_t i=1;i<=100;i++) {
+        pool_churn_test(i);
+        pool_churn_test(i * 10);
+        pool_churn_test(i * 100);
+    }
+}
+
+TEST(rbtree_impl, pool_shrink_partial) {
+    RBTreeImpl<int, void, false> tree;
+    tree.reserve(100);
+    for (int i=0;i<100;i++) tree.insert(i);
+    tree.reserve(200);
+    for (int i=100;i<200;i++) tree.insert(i);
+    ASSERT_EQ(tree.capacity(), 200);
+
+    for (int i=0;i<100;i++) tree.erase(tree.find(i), false);
+    tree.check_consistency();
+    tree.shrink_to_fit();
+    ASSERT_EQ(tree.capacity(), 100);
+    ASSERT_EQ(tree.size(), 100);
+    ASSERT_EQ(tree.begin()->value.get(), 100);
+}
+
+TEST(set, reserve_node_handle) {
+    pset<int> s1, s2;
+    s1.reserve(1000);
+    for (int i=0;i<1000;i++) s1.insert(i);
+
+    for (int i=0;i<1000;i+=2) {
+        auto nh = s1.extract(s1.find(i));
+        ASSERT_TRUE(nh);
+        ASSERT_EQ(nh.value(), i);
+        ASSERT_TRUE(s2.insert(std::move(nh)).inserted);
+    }
+    ASSERT_EQ(s1.size(), 500);
+    ASSERT_EQ(s2.size(), 500);
+
+    s1.clear();
+    s1.shrink_to_fit();
+    s1.reserve(10);
+    for (auto& v: s2) s1.insert(v);
+    ASSERT_EQ(s1, s2);
+}
+
+TEST(rbtree_impl, pool_bulk_clear) {
+    RBTreeImpl<int, void, false> tree;
+    tree.reserve(16);
+    for (int i=0;i<1000;i++) tree.insert(i);
+    const auto capacity = tree.capacity();
+
+    for (int k=0;k<3;k++) {
+        tree.clear();
+        ASSERT_EQ(tree.size(), 0);
+        ASSERT_EQ(tree.capacity(), capacity);
+
+        for (int i=0;i<1000;i++) tree.insert(i * 2);
+        ASSERT_EQ(tree.capacity(), capacity);
+        tree.check_consistency();
+    }
+
+    // pending node list of a failed construction must survive clearing the old content
+    std::vector<int> unordered = { 1, 3, 2 };
+    ASSERT_FALSE(tree.construct_from_asc_iter(unordered.begin(), unordered.end()));
+    ASSERT_EQ(tree.size(), 1000);
+    std::vector<int> ordered = { 1, 2, 3 };
+    ASSERT_TRUE(tree.construct_from_asc_iter(ordered.begin(), ordered.end()));
+    ASSERT_EQ(tree.size(), 3);
+    tree.check_consistency();
+
+    tree.clear();
+    tree.shrink_to_fit();
+    ASSERT_EQ(tree.capacity(), 0);
+}
+
+static size_t n_deallocate = 0;
+template<typename T>
+struct counting_allocator: std::allocator<T> {
+    template<typename U> struct rebind { using other = counting_allocator<U>; };
+
+    counting_allocator() = default;
+    template<typename U>
+    counting_allocator(const counting_allocator<U>&) {}
+
+    void deallocate(T* ptr, size_t n) {
+        n_deallocate++;
+        std::allocator<T>::deallocate(ptr, n);
+    }
+};
+
+static std::vector<std::unique_ptr<char[]>> arena;
+template<typename T>
+struct arena_allocator {
+    using value_type = T;
+    template<typename U> struct rebind { using other = arena_allocator<U>; };
+
+    arena_allocator() = default;
+    template<typename U>
+    arena_allocator(const arena_allocator<U>&) {}
+
+    T* allocate(size_t n) {
+        arena.emplace_back(new char[n * sizeof(T)]);
+        return reinterpret_cast<T*>(arena.back().get());
+    }
+    void deallocate(T*, size_t) {
+        n_deallocate++;
+    }
+
+    template<typename U>
+    bool operator==(const arena_allocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const arena_allocator<U>&) const { return false; }
+};
+
+namespace curly {
+template<typename T>
+struct rbtree_allocator_bulk_release<arena_allocator<T>> {
+    static bool allowed(const arena_allocator<T>&) { return true; }
+};
+}
+
+TEST(rbtree_impl, allocator_bulk_clear) {
+    {
+        RBTreeImpl<int, void, false, true, std::less<int>, counting_allocator<int>> tree;
+        for (int i=0;i<100;i++) tree.insert(i);
+        n_deallocate = 0;
+        tree.clear();
+        ASSERT_EQ(n_deallocate, 100);
+    }
+
+    {
+        RBTreeImpl<int, void, false, true, std::less<int>, arena_allocator<int>> tree;
+        for (int i=0;i<100;i++) tree.insert(i);
+        n_deallocate = 0;
+        tree.clear();
+        ASSERT_EQ(n_deallocate, 0);
+
+        for (int i=0;i<100;i++) tree.insert(i);
+        tree.check_consistency();
+    }
+    arena.clear();
+}
+
+static long n_outstanding = 0;
+template<typename T>
+struct balance_allocator: std::allocator<T> {
+    template<typename U> struct rebind { using other = balance_allocator<U>; };
+
+    balance_allocator() = default;
+    template<typename U>
+    balance_allocator(const balance_allocator<U>&) {}
+
+    T* allocate(size_t n) {
+        auto ptr = std::allocator<T>::allocate(n);
+        n_outstanding += static_cast<long>(n);
+        return ptr;
+    }
+    void deallocate(T* ptr, size_t n) {
+        n_outstanding -= static_cast<long>(n);
+        std::allocator<T>::deallocate(ptr, n);
+    }
+};
+
+// a chunk is given back if the bookkeeping of the pool fails to grow
+TEST(rbtree_impl, pool_chunk_exception) {
+    RBTreeImpl<int, void, false, true, std::less<int>, balance_allocator<int>> tree;
+    n_outstanding = 0;
+    allocations_left = 1;
+    ASSERT_THROW(tree.reserve(100), std::bad_alloc);
+    allocations_left = -1;
+    ASSERT_EQ(n_outstanding, 0);
+    ASSERT_EQ(tree.capacity(), 0);
+
+    tree.reserve(100);
+    ASSERT_EQ(tree.capacity(), 100);
+    for (int i=0;i<100;i++) tree.insert(i);
+    ASSERT_EQ(n_outstanding, 100);
+    tree.check_consistency();
+}
+
+#if __cplusplus >= 201703
+TEST(rbtree_impl, pmr_monotonic_clear) {
+    std::pmr::monotonic_buffer_resource resource;
+    curly::pmr::pset<int> s1{std::pmr::polymorphic_allocator<int>(&resource)};
+    for (int i=0;i<1000;i++) s1.insert(i);
+    s1.clear();
+    ASSERT_TRUE(s1.empty());
+    for (int i=0;i<10;i++) s1.insert(i);
+    ASSERT_EQ(s1.size(), 10);
+
+    curly::pmr::pset<std::string> s2{std::pmr::polymorphic_allocator<std::string>(&resource)};
+    for (int i=0;i<100;i++) s2.insert(std::string(100, 'a' + i % 26) + std::to_string(i));
+    s2.clear();
+    ASSERT_TRUE(s2.empty());
+}
+#endif // __cplusplus >= 201703
@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <map>
+#include <iterator>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+static const rbtree_set_operation set_operations[] = {
+    {true, true, true, false}, {false, true, false, false}, {true, false, false, false}, {true, false, true, false},
+    {true, true, true, true},
+};
+
+static std::set<int> expected_values(const std::set<int>& a, const std::set<int>& b, const rbtree_set_operation& op) {
+    std::set<int> ans;
+    for (auto v: a) {
+        if (b.count(v) ? op.both : op.left) ans.insert(v);
+    }
+    for (auto v: b) {
+        if (!a.count(v) && op.right) ans.insert(v);
+    }
+    return ans;
+}
+
+template<typename Tree>
+static void fill(Tree& tree, std::set<int>& stl_set, size_t n_vals, int range, bool pooled) {
+    if (pooled) tree.reserve(n_vals);
+    std::uniform_int_distribution<int> distribution(0, range);
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        tree.insert(val);
+        stl_set.insert(val);
+    }
+}
+
+template<typename Tree>
+static void set_operation_test(size_t n, size_t m, const rbtree_set_operation& op, bool pooled, size_t parallel_grain = 0) {
+    Tree tree, other;
+    std::set<int> stl_set, stl_other;
+    const int range = static_cast<int>(std::max(n, m)) * 2;
+    fill(tree, stl_set, n, range, pooled);
+    fill(other, stl_other, m, range, pooled);
+
+    if (parallel_grain == 0) {
+        tree.set_operation(other, op);
+    } else if (parallel_grain % 2 == 0) {
+        rbtree_thread_executor executor(4);
+        tree.parallel_set_operation(other, op, executor, parallel_grain);
+    } else {
+        serial_executor executor;
+        tree.parallel_set_operation(other, op, executor, parallel_grain);
+    }
+    tree.check_consistency();
+    other.check_consistency();
+    ASSERT_EQ(other.size(), 0u);
+
+    const auto expected = expected_values(stl_set, stl_other, op);
+    ASSERT_EQ(tree.size(), expected.size());
+    size_t idx = 0;
+    auto stl_iter = expected.begin();
+    for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1),idx++,stl_iter++) {
+        ASSERT_EQ(node->value.get(), *stl_iter);
+        ASSERT_EQ(tree.indexof(node), idx);
+    }
+    ASSERT_EQ(stl_iter, expected.end());
+    auto stl_riter = expected.rbegin();
+    for (auto node=tree.rbegin();node!=nullptr;node=tree.advance(node, -1),stl_riter++) {
+        ASSERT_EQ(node->value.get(), *stl_riter);
+    }
+    ASSERT_EQ(stl_riter, expected.rend());
+
+    // the tree is still usable afterwards
+    tree.insert(-1);
+    tree.check_consistency();
+}
+
+template<typename Tree>
+static void set_operation_tests() {
+    for (auto& op: set_operations) {
+        for (bool pooled: {false, true}) {
+            for (size_t n: {0, 1, 10, 100, 1000}) {
+                for (size_t m: {0, 1, 10, 100, 1000}) {
+                    set_operation_test<Tree>(n, m, op, pooled);
+                }
+            }
+        }
+    }
+}
+
+TEST(rbtree_impl_set_algebra, rbtree) {
+    set_operation_tests<RBTreeImpl<int, void, false, true>>();
+    set_operation_tests<RBTreeImpl<int, void, false, false>>();
+    set_operation_tests<RBTreeImpl<int, void, false, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+    set_operation_tests<RBTreeImpl<int, void, false, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+}
+
+template<typename Tree>
+static void parallel_set_operation_tests() {
+    for (auto& op: set_operations) {
+        for (bool pooled: {false, true}) {
+            for (size_t n: {0, 1, 100, 1000}) {
+                for (size_t m: {0, 10, 1000}) {
+                    for (size_t grain: {1, 2, 32}) {
+                        set_operation_test<Tree>(n, m, op, pooled, grain);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(rbtree_impl_set_algebra, parallel) {
+    parallel_set_operation_tests<RBTreeImpl<int, void, false, true>>();
+    parallel_set_operation_tests<RBTreeImpl<int, void, false, false>>();
+    parallel_set_operation_tests<RBTreeImpl<int, void, false, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+    parallel_set_operation_tests<RBTreeImpl<int, void, false, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>>();
+}
+
+#if __cplusplus >= 201703
+TEST(rbtree_impl_set_algebra, bptree) {
+    for (auto& op: set_operations) {
+        for (size_t n: {0, 1, 10, 1000}) {
+            for (size_t m: {0, 1, 10, 1000}) {
+                set_operation_test<BPTreeImpl<int, void, false>>(n, m, op, false);
+            }
+        }
+    }
+}
+#endif // __cplusplus >= 201703
+
+// the values of the left container are kept for keys in both
+template<typename Map>
+static void set_algebra_container_test(size_t n, size_t m) {
+    Map a, b;
+    std::map<int,int> stl_a, stl_b;
+    std::uniform_int_distribution<int> distribution(0, static_cast<int>(std::max(n, m)) * 2);
+    for (size_t i=0;i<n;i++) {
+        auto key = distribution(generator);
+        a.insert(std::make_pair(key, 1));
+        stl_a.insert(std::make_pair(key, 1));
+    }
+    for (size_t i=0;i<m;i++) {
+        auto key = distribution(generator);
+        b.insert(std::make_pair(key, 2));
+        stl_b.insert(std::make_pair(key, 2));
+    }
+    const Map b_copy = b;
+
+    std::vector<std::map<int,int>::value_type> expected;
+    Map u = a;
+    u.set_union(b);
+    std::set_union(stl_a.begin(), stl_a.end(), stl_b.begin(), stl_b.end(), std::back_inserter(expected), stl_a.value_comp());
+    ASSERT_EQ(u.size(), expected.size());
+    ASSERT_TRUE(std::equal(u.begin(), u.end(), expected.begin()));
+    ASSERT_EQ(b.size(), stl_b.size());
+
+    expected.clear();
+    Map i = a;
+    i.set_intersection(Map(b));
+    std::set_intersection(stl_a.begin(), stl_a.end(), stl_b.begin(), stl_b.end(), std::back_inserter(expected), stl_a.value_comp());
+    ASSERT_EQ(i.size(), expected.size());
+    ASSERT_TRUE(std::equal(i.begin(), i.end(), expected.begin()));
+
+    expected.clear();
+    Map d = a;
+    d.set_difference(b);
+    std::set_difference(stl_a.begin(), stl_a.end(), stl_b.begin(), stl_b.end(), std::back_inserter(expected), stl_a.value_comp());
+    ASSERT_EQ(d.size(), expected.size());
+    ASSERT_TRUE(std::equal(d.begin(), d.end(), expected.begin()));
+
+    expected.clear();
+    Map s = a;
+    s.set_symmetric_difference(std::move(b));
+    std::set_symmetric_difference(stl_a.begin(), stl_a.end(), stl_b.begin(), stl_b.end(), std::back_inserter(expected), stl_a.value_comp());
+    ASSERT_TRUE(b.empty());
+    ASSERT_EQ(s.size(), expected.size());
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), expected.begin()));
+
+    s.set_union(s);
+    ASSERT_EQ(s.size(), expected.size());
+    s.set_difference(s);
+    ASSERT_TRUE(s.empty());
+
+    // the parallel versions give the same results
+    rbtree_thread_executor executor(4);
+    Map pu = a, pi = a, pd = a, ps = a;
+    pu.parallel_set_union(b_copy, executor, 16);
+    ASSERT_TRUE(pu == u);
+    pi.parallel_set_intersection(b_copy, executor, 16);
+    ASSERT_TRUE(pi == i);
+    pd.parallel_set_difference(Map(b_copy), executor, 16);
+    ASSERT_TRUE(pd == d);
+    ps.parallel_set_symmetric_difference(Map(b_copy));
+    ASSERT_EQ(ps.size(), expected.size());
+    ASSERT_TRUE(std::equal(ps.begin(), ps.end(), expected.begin()));
+
+    // duplicates in the batch and in the container keep the values which came first
+    std::vector<std::pair<int,int>> batch;
+    for (size_t k=0;k<m;k++) batch.push_back(std::make_pair(distribution(generator), static_cast<int>(k)));
+    Map inserted = a, batched = a;
+    inserted.insert(batch.begin(), batch.end());
+    batched.insert_batch(batch.begin(), batch.end(), executor, 16);
+    ASSERT_TRUE(batched == inserted);
+    std::sort(batch.begin(), batch.end());
+    batched = a;
+    inserted = a;
+    inserted.insert(batch.begin(), batch.end());
+    batched.insert_batch(batch.begin(), batch.end());
+    ASSERT_TRUE(batched == inserted);
+}
+
+TEST(rbtree_impl_set_algebra, containers) {
+    for (size_t n: {0, 5, 100, 1000}) {
+        for (size_t m: {0, 5, 100, 1000}) {
+            set_algebra_container_test<pmap<int,int>>(n, m);
+            set_algebra_container_test<map2<int,int>>(n, m);
+            set_algebra_container_test<threaded::pmap<int,int>>(n, m);
+#if __cplusplus >= 201703
+            set_algebra_container_test<bptree::pmap<int,int>>(n, m);
+#endif // __cplusplus >= 201703
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <map>
+#include <iterator>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "test_helpers.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename Tree>
+static void split_join_test(const size_t n_vals, bool pooled) {
+    Tree tree;
+    std::multiset<int> stl_set;
+    if (pooled) tree.reserve(n_vals);
+    fill(tree, stl_set, n_vals, -n_vals, n_vals);
+
+    // split at a random key, and append the part back
+    for (size_t round=0;round<5;round++) {
+        std::uniform_int_distribution<int> distribution(-n_vals-1, n_vals+1);
+        const auto key = distribution(generator);
+        Tree right;
+        const auto version = tree.version();
+        tree.split(key, right);
+        std::multiset<int> stl_right(stl_set.lower_bound(key), stl_set.end());
+        std::multiset<int> stl_left(stl_set.begin(), stl_set.lower_bound(key));
+        check_tree(tree, stl_left);
+        check_tree(right, stl_right);
+        if (!stl_right.empty()) {
+            ASSERT_NE(tree.version(), version);
+        }
+
+        ASSERT_TRUE(tree.precedes(right));
+        tree.append(right);
+        check_tree(tree, stl_set);
+        check_tree(right, std::multiset<int>());
+    }
+
+    // split at every kind of rank
+    for (size_t index: {size_t(0), stl_set.size() / 3, stl_set.size() - stl_set.size() / 5, stl_set.size()}) {
+        Tree right;
+        tree.split_at(index, right);
+        check_tree(tree, std::multiset<int>(stl_set.begin(), std::next(stl_set.begin(), index)));
+        check_tree(right, std::multiset<int>(std::next(stl_set.begin(), index), stl_set.end()));
+        tree.append(right);
+        check_tree(tree, stl_set);
+    }
+}
+
+template<typename Tree, bool multi>
+static void splice_test(const size_t n_vals, const size_t n_other, bool pooled) {
+    Tree tree, other;
+    std::multiset<int> stl_set, stl_other;
+    if (pooled) other.reserve(n_other);
+    fill(tree, stl_set, n_vals, 0, n_vals * 4);
+    // the values of other mostly fall into the gaps of tree
+    fill(other, stl_other, n_other, 0, n_vals * 4);
+
+    for (;!stl_other.empty();) {
+        std::uniform_int_distribution<size_t> index_distribution(0, std::min<size_t>(stl_other.size(), 20));
+        const auto i = std::uniform_int_distribution<size_t>(0, stl_other.size() - 1)(generator);
+        const auto j = std::min(stl_other.size(), i + 1 + index_distribution(generator));
+        auto first = other.begin();
+        for (size_t k=0;k<i;k++) first = other.advance(first, 1);
+        auto last = j == stl_other.size() ? nullptr : other.advance(first, j - i);
+        tree.splice(other, first, last);
+
+        auto stl_first = std::next(stl_other.begin(), i), stl_last = std::next(stl_other.begin(), j);
+        for (auto it=stl_first;it!=stl_last;it++) {
+            if (multi || stl_set.count(*it) == 0) stl_set.insert(*it);
+        }
+        stl_other.erase(stl_first, stl_last);
+        check_tree(tree, stl_set);
+        check_tree(other, stl_other);
+    }
+}
+
+template<typename Tree, bool multi>
+static void split_join_tests() {
+    for (bool pooled: {false, true}) {
+        for (size_t n: {1, 2, 10, 17, 100, 1000}) {
+            split_join_test<Tree>(n, pooled);
+        }
+        for (size_t n: {0, 1, 10, 300}) {
+            for (size_t m: {1, 10, 300}) {
+                splice_test<Tree,multi>(n, m, pooled);
+            }
+        }
+    }
+}
+
+TEST(rbtree_impl_split_join, rbtree) {
+    split_join_tests<RBTreeImpl<int, void, true, true>,true>();
+    split_join_tests<RBTreeImpl<int, void, false, true>,false>();
+    split_join_tests<RBTreeImpl<int, void, true, false>,true>();
+    split_join_tests<RBTreeImpl<int, void, false, false>,false>();
+    split_join_tests<RBTreeImpl<int, void, true, true, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,true>();
+    split_join_tests<RBTreeImpl<int, void, false, false, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>,false>();
+}
+
+#if __cplusplus >= 201703
+TEST(rbtree_impl_split_join, bptree) {
+    split_join_tests<BPTreeImpl<int, void, true>,true>();
+    split_join_tests<BPTreeImpl<int, void, false>,false>();
+}
+#endif // __cplusplus >= 201703
+
+template<typename Map>
+static void split_join_container_test() {
+    Map map;
+    std::map<int,int> stl_map;
+    for (int i=0;i<1000;i++) {
+        map.insert(std::make_pair(i * 2, i));
+        stl_map.insert(std::make_pair(i * 2, i));
+    }
+
+    Map right = map.split_off(701);
+    ASSERT_EQ(map.size(), 351u);
+    ASSERT_EQ(right.size(), 649u);
+    ASSERT_EQ(right.begin()->first, 702);
+    ASSERT_THROW(right.append(Map(map)), std::logic_error);
+
+    Map tail = right.split_off_at(600);
+    ASSERT_EQ(right.size(), 600u);
+    ASSERT_EQ(tail.size(), 49u);
+    ASSERT_THROW(right.split_off_at(601), std::out_of_range);
+    ASSERT_TRUE(right.split_off_at(600).empty());
+
+    map.append(std::move(right));
+    map.append(std::move(tail));
+    ASSERT_TRUE(right.empty());
+    ASSERT_EQ(map.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), stl_map.begin()));
+
+    // odd keys fit between the keys of map, a second splice of the same keys replaces the values
+    Map odd;
+    for (int i=0;i<100;i++) {
+        odd.insert(std::make_pair(i * 2 + 1, -i));
+        stl_map[i * 2 + 1] = -i;
+    }
+    Map copy = odd;
+    map.splice(odd, odd.find(21), odd.find(51));
+    map.splice(odd, odd.begin(), odd.end());
+    ASSERT_TRUE(odd.empty());
+    map.splice(copy, copy.begin(), copy.end());
+    ASSERT_TRUE(copy.empty());
+    ASSERT_EQ(map.size(), stl_map.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), stl_map.begin()));
+}
+
+TEST(rbtree_impl_split_join, containers) {
+    split_join_container_test<pmap<int,int>>();
+    split_join_container_test<map2<int,int>>();
+    split_join_container_test<threaded::pmap<int,int>>();
+#if __cplusplus >= 201703
+    split_join_container_test<bptree::pmap<int,int>>();
+#endif // __cplusplus >= 201703
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <array>
+#include <vector>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+using set_node_t   = RBTreeImpl<uint64_t, void, false, false>::rbtree_node_type;
+using pset_node_t  = RBTreeImpl<uint64_t, void, false, true>::rbtree_node_type;
+using map_node_t   = RBTreeImpl<uint64_t, uint64_t, false, false>::rbtree_node_type;
+using pmap_node_t  = RBTreeImpl<uint64_t, uint64_t, false, true>::rbtree_node_type;
+using spset_node_t = RBTreeImpl<std::string, void, false, true>::rbtree_node_type;
+using pset32_node_t = RBTreeImpl<uint32_t, void, false, true, std::less<uint32_t>, std::allocator<uint32_t>, uint32_t>::rbtree_node_type;
+using pset32_wide_node_t = RBTreeImpl<uint32_t, void, false, true>::rbtree_node_type;
+using bigmap_node_t = RBTreeImpl<uint64_t, std::array<char,256>, false, true>::rbtree_node_type;
+using splitmap_node_t = RBTreeImpl<uint64_t, rbtree_cold<std::array<char,256>>, false, true>::rbtree_node_type;
+using pmap32_node_t = RBTreeImpl<uint32_t, uint32_t, false, true, std::less<uint32_t>, std::allocator<uint32_t>, uint32_t>::rbtree_node_type;
+
+static_assert(rbtree_node_footprint<set_node_t>::overhead  == 3 * sizeof(void*), "set2 node");
+static_assert(rbtree_node_footprint<pset_node_t>::overhead == 3 * sizeof(void*) + sizeof(size_t), "pset node");
+static_assert(rbtree_node_footprint<map_node_t>::overhead  == 3 * sizeof(void*), "map2 node");
+static_assert(rbtree_node_footprint<pmap_node_t>::overhead == 3 * sizeof(void*) + sizeof(size_t), "pmap node");
+static_assert(rbtree_node_footprint<spset_node_t>::overhead == 3 * sizeof(void*) + sizeof(size_t), "pset<string> node");
+static_assert(rbtree_node_footprint<splitmap_node_t>::size == rbtree_node_footprint<pmap_node_t>::size, "split::pmap node holds key and pointer to value");
+static_assert(rbtree_node_footprint<splitmap_node_t>::size < rbtree_node_footprint<bigmap_node_t>::size, "split::pmap node");
+static_assert(rbtree_node_footprint<pset32_node_t>::size < rbtree_node_footprint<pset32_wide_node_t>::size, "pset<uint32_t> node with uint32_t counter");
+static_assert(rbtree_node_footprint<pset32_node_t>::size == 3 * sizeof(void*) + 2 * sizeof(uint32_t), "uint32_t key and counter share a word");
+static_assert(rbtree_node_footprint<pmap32_node_t>::size <= 3 * sizeof(void*) + 3 * sizeof(uint32_t) + alignof(void*), "pmap<uint32_t,uint32_t> node with uint32_t counter");
+
+template<typename Node>
+static void report_footprint(const std::string& name) {
+    const size_t size = rbtree_node_footprint<Node>::size;
+    const size_t overhead = rbtree_node_footprint<Node>::overhead;
+    ::testing::Test::RecordProperty(name + "_size", std::to_string(size));
+    ::testing::Test::RecordProperty(name + "_overhead", std::to_string(overhead));
+    ASSERT_EQ(size % alignof(Node), 0);
+    ASSERT_GT(alignof(Node), 1);
+}
+
+TEST(rbtree_node, footprint) {
+    report_footprint<set_node_t>("set2<uint64_t>");
+    report_footprint<pset_node_t>("pset<uint64_t>");
+    report_footprint<map_node_t>("map2<uint64_t,uint64_t>");
+    report_footprint<pmap_node_t>("pmap<uint64_t,uint64_t>");
+    report_footprint<spset_node_t>("pset<std::string>");
+    report_footprint<pset32_node_t>("pset<uint32_t,uint32_t>");
+    report_footprint<pmap32_node_t>("pmap<uint32_t,uint32_t,uint32_t>");
+}
+
+TEST(rbtree_node, counter_capacity) {
+    RBTreeImpl<int, void, false, true, std::less<int>, std::allocator<int>, uint8_t> tree;
+    ASSERT_EQ(tree.max_size(), 255);
+    for (int i=0;i<255;i++) tree.insert(i);
+    tree.check_consistency();
+    ASSERT_EQ(tree.indexof(tree.find(200)), 200);
+    ASSERT_THROW(tree.insert(1000), std::length_error);
+    ASSERT_EQ(tree.size(), 255);
+    tree.check_consistency();
+}
+
+// duplicates which are not inserted don't count against the capacity
+TEST(rbtree_node, counter_capacity_merge) {
+    using tree_t = RBTreeImpl<int, void, false, true, std::less<int>, std::allocator<int>, uint8_t>;
+    tree_t tree, source, rest;
+    for (int i=0;i<200;i++) tree.insert(i);
+    for (int i=100;i<255;i++) source.insert(i);
+    tree.merge(source);
+    tree.check_consistency();
+    source.check_consistency();
+    ASSERT_EQ(tree.size(), 255);
+    ASSERT_EQ(source.size(), 100);
+
+    std::vector<int> values;
+    for (int i=0;i<255;i++) values.push_back(i);
+    tree.insert_by_rebuild(values.begin(), values.end());
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), 255);
+
+    rest.insert(1000);
+    ASSERT_THROW(tree.merge(rest), std::length_error);
+    values.push_back(1000);
+    ASSERT_THROW(tree.insert_by_rebuild(values.begin(), values.end()), std::length_error);
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), 255);
+    ASSERT_EQ(rest.size(), 1);
+}
+
+// a duplicate is assigned to a full tree
+TEST(rbtree_node, counter_capacity_duplicate) {
+    using set_t = pset<int, std::less<int>, std::allocator<int>, uint8_t>;
+    set_t full, other;
+    for (int i=0;i<255;i++) full.insert(i);
+    other.insert(5);
+    other.insert(1000);
+    auto result = full.insert(other.extract(5));
+    ASSERT_FALSE(result.inserted);
+    ASSERT_TRUE(result.node);
+    ASSERT_THROW(full.insert(other.extract(1000)), std::length_error);
+    ASSERT_EQ(full.size(), 255);
+
+    using map_t = pmap<int, int, std::less<int>, std::allocator<std::pair<const int,int>>, uint8_t>;
+    map_t map;
+    for (int i=0;i<255;i++) map.emplace(i, i);
+    ASSERT_FALSE(map.emplace(5, 50).second);
+    ASSERT_EQ(map.at(5), 50);
+    ASSERT_THROW(map.emplace(1000, 0), std::length_error);
+    ASSERT_EQ(map.size(), 255);
+}
+
+// set operations which may keep the values of both sets check the capacity before combining them
+TEST(rbtree_node, counter_capacity_set_operation) {
+    using set_t = pset<int, std::less<int>, std::allocator<int>, uint8_t>;
+    set_t a, b;
+    for (int i=0;i<255;i++) {
+        a.insert(i);
+        b.insert(i + 255);
+    }
+    ASSERT_THROW(a.set_union(b), std::length_error);
+    ASSERT_THROW(a.set_symmetric_difference(b), std::length_error);
+    ASSERT_THROW(a.set_union(set_t(b)), std::length_error);
+    ASSERT_EQ(a.size(), 255);
+    ASSERT_EQ(b.size(), 255);
+    ASSERT_EQ(*a.rbegin(), 254);
+
+    set_t c(b);
+    a.set_difference(std::move(c));
+    ASSERT_EQ(a.size(), 255);
+    b.erase(b.begin(), std::next(b.begin(), 200));
+    a.erase(a.begin(), std::next(a.begin(), 55));
+    a.set_union(b);
+    ASSERT_EQ(a.size(), 255);
+    ASSERT_EQ(*a.begin(), 55);
+    ASSERT_EQ(*a.rbegin(), 509);
+}
+
+TEST(rbtree_node, counter_capacity_parallel_set_operation) {
+    using set_t = pset<int, std::less<int>, std::allocator<int>, uint8_t>;
+    set_t a, b;
+    std::vector<int> values;
+    for (int i=0;i<255;i++) {
+        a.insert(i);
+        b.insert(i + 255);
+        values.push_back(i + 100);
+    }
+    ASSERT_THROW(a.parallel_set_union(b, rbtree_thread_executor(), 16), std::length_error);
+    ASSERT_THROW(a.parallel_set_symmetric_difference(b, rbtree_thread_executor(), 16), std::length_error);
+    ASSERT_THROW(a.insert_batch(values.begin(), values.end(), rbtree_thread_executor(), 16), std::length_error);
+    ASSERT_EQ(a.size(), 255);
+    ASSERT_EQ(b.size(), 255);
+    ASSERT_EQ(*a.rbegin(), 254);
+
+    // the sizes are added up, so duplicates count until both are combined
+    a.erase(a.begin(), std::next(a.begin(), 100));
+    a.insert_batch(values.begin(), std::next(values.begin(), 100), rbtree_thread_executor(), 16);
+    ASSERT_EQ(a.size(), 155);
+    ASSERT_EQ(*a.begin(), 100);
+}
+
+TEST(rbtree_node, color_and_parent) {
+    RBTreeImpl<int, void, false> tree;
+    for (int i=0;i<1000;i++) tree.insert(i);
+    tree.check_consistency();
+
+    auto root = tree.begin()->root();
+    ASSERT_TRUE(root->is_black());
+    ASSERT_EQ(root->parent(), nullptr);
+
+    for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1)) {
+        auto parent = node->parent();
+        if (parent) {
+            ASSERT_TRUE(parent->left == node || parent->right == node);
+        }
+        const bool black = node->is_black();
+        node->set_black(!black);
+        ASSERT_EQ(node->parent(), parent);
+        node->set_black(black);
+        ASSERT_EQ(node->parent(), parent);
+    }
+    tree.check_consistency();
+}
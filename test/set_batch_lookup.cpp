@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <string>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename Set>
+static void batch_lookup_test(const size_t n_vals, const size_t n_keys, bool sorted) {
+    Set set;
+    std::uniform_int_distribution<int> distribution(-static_cast<int>(n_vals), n_vals);
+    for (size_t i=0;i<n_vals;i++) {
+        set.emplace(distribution(generator));
+    }
+
+    std::uniform_int_distribution<int> key_distribution(-static_cast<int>(n_vals) - 10, n_vals + 10);
+    std::vector<int> keys;
+    for (size_t i=0;i<n_keys;i++) {
+        keys.push_back(key_distribution(generator));
+    }
+    if (sorted) std::sort(keys.begin(), keys.end());
+
+    std::vector<typename Set::iterator> lbs, founds;
+    std::vector<size_t> ranks;
+    std::vector<bool> contains;
+    set.lower_bound_many(keys.begin(), keys.end(), std::back_inserter(lbs));
+    set.find_many(keys.begin(), keys.end(), std::back_inserter(founds));
+    set.rank_many(keys.begin(), keys.end(), std::back_inserter(ranks));
+    set.contains_many(keys.begin(), keys.end(), std::back_inserter(contains));
+    ASSERT_EQ(lbs.size(), keys.size());
+    ASSERT_EQ(founds.size(), keys.size());
+    ASSERT_EQ(ranks.size(), keys.size());
+    ASSERT_EQ(contains.size(), keys.size());
+
+    for (size_t i=0;i<keys.size();i++) {
+        ASSERT_EQ(lbs[i], set.lower_bound(keys[i]));
+        ASSERT_EQ(founds[i], set.find(keys[i]));
+        ASSERT_EQ(ranks[i], set.rank(keys[i]));
+        ASSERT_EQ(contains[i], set.contains(keys[i]));
+    }
+
+    const auto& cset = set;
+    std::vector<typename Set::const_iterator> clbs;
+    cset.lower_bound_many(keys.begin(), keys.end(), std::back_inserter(clbs));
+    std::vector<size_t> cranks(keys.size());
+    auto end = cset.rank_many(keys.begin(), keys.end(), cranks.data());
+    ASSERT_EQ(end, cranks.data() + cranks.size());
+    for (size_t i=0;i<keys.size();i++) {
+        ASSERT_EQ(clbs[i], cset.lower_bound(keys[i]));
+        ASSERT_EQ(cranks[i], ranks[i]);
+    }
+}
+
+template<typename Set>
+static void batch_lookup_tests() {
+    for (size_t n: {0, 1, 10, 100, 2000}) {
+        for (size_t m: {0, 1, 7, 100, 3000}) {
+            batch_lookup_test<Set>(n, m, true);
+            batch_lookup_test<Set>(n, m, false);
+        }
+    }
+}
+
+TEST(set_batch_lookup, position_containers) {
+    batch_lookup_tests<pset<int>>();
+    batch_lookup_tests<pmultiset<int>>();
+    batch_lookup_tests<fast::pset<int>>();
+    batch_lookup_tests<threaded::pmultiset<int>>();
+}
+
+TEST(set_batch_lookup, plain_containers) {
+    batch_lookup_tests<set2<int>>();
+    batch_lookup_tests<multiset2<int>>();
+}
+
+#if __cplusplus >= 201703
+TEST(set_batch_lookup, bptree) {
+    batch_lookup_tests<bptree::pset<int>>();
+    batch_lookup_tests<bptree::pmultiset<int>>();
+}
+#endif // __cplusplus >= 201703
+
+TEST(set_batch_lookup, map) {
+    pmap<int,int> map;
+    for (int i=0;i<1000;i+=2) {
+        map[i] = i * 10;
+    }
+    std::vector<int> keys = {5, 4, 998, 1000, -1, 4};
+    std::vector<pmap<int,int>::iterator> founds;
+    map.find_many(keys.begin(), keys.end(), std::back_inserter(founds));
+    ASSERT_EQ(founds[0], map.end());
+    ASSERT_EQ(founds[1]->second, 40);
+    ASSERT_EQ(founds[2]->second, 9980);
+    ASSERT_EQ(founds[3], map.end());
+    ASSERT_EQ(founds[4], map.end());
+    ASSERT_EQ(founds[5], founds[1]);
+}
+
+TEST(set_batch_lookup, converted_keys) {
+    pmap<std::string,int> map;
+    for (int i=0;i<1000;i++) {
+        map[std::to_string(i * 2)] = i;
+    }
+    std::vector<const char*> keys = {"4", "5", "1998", "", "4"};
+    std::vector<pmap<std::string,int>::iterator> founds;
+    std::vector<bool> contains;
+    map.find_many(keys.begin(), keys.end(), std::back_inserter(founds));
+    map.contains_many(keys.begin(), keys.end(), std::back_inserter(contains));
+    ASSERT_EQ(founds[0]->second, 2);
+    ASSERT_EQ(founds[1], map.end());
+    ASSERT_EQ(founds[2]->second, 999);
+    ASSERT_EQ(founds[3], map.end());
+    ASSERT_EQ(founds[4], founds[0]);
+    ASSERT_EQ(contains, std::vector<bool>({true, false, true, false, true}));
+}
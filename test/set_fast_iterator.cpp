@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename S, typename STL>
+static void fast_iterator_test(const size_t n_vals) {
+    S fset;
+    STL stl_set;
+
+    std::uniform_int_distribution<int> distribution(-n_vals * 3,n_vals * 3);
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        fset.insert(val);
+        stl_set.insert(val);
+    }
+    ASSERT_EQ(fset.size(), stl_set.size());
+
+    auto stl_iter = stl_set.begin();
+    for (auto iter=fset.begin();iter!=fset.end();++iter, ++stl_iter) {
+        ASSERT_EQ(*iter, *stl_iter);
+    }
+    ASSERT_EQ(stl_iter, stl_set.end());
+
+    auto stl_riter = stl_set.rbegin();
+    for (auto iter=fset.rbegin();iter!=fset.rend();iter++, stl_riter++) {
+        ASSERT_EQ(*iter, *stl_riter);
+    }
+    ASSERT_EQ(stl_riter, stl_set.rend());
+
+    auto last = fset.end();
+    auto stl_last = stl_set.end();
+    for (size_t i=0;i<fset.size();i++) {
+        --last;
+        --stl_last;
+        ASSERT_EQ(*last, *stl_last);
+    }
+    ASSERT_EQ(last, fset.begin());
+
+    std::uniform_int_distribution<long> mdist(0,fset.size());
+    for (size_t i=0;i<100;i++) {
+        auto n = mdist(generator);
+        auto iter = fset.cbegin();
+        std::advance(iter, n);
+        ASSERT_EQ(std::distance(fset.cbegin(), iter), n);
+        if (static_cast<size_t>(n) < fset.size()) {
+            ASSERT_EQ(*iter, *std::next(stl_set.begin(), n));
+        } else {
+            ASSERT_EQ(iter, fset.cend());
+        }
+    }
+
+    for (auto iter=fset.begin();iter!=fset.end();) {
+        if (*iter % 2 == 0) {
+            iter = fset.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    for (auto& val: fset) {
+        ASSERT_NE(val % 2, 0);
+    }
+}
+
+TEST(fast_iterator, pset) {
+    for (size_t i=1;i<=100;i++) {
+        fast_iterator_test<fast::pset<int>,std::set<int>>(i);
+        fast_iterator_test<fast::pset<int>,std::set<int>>(i * 10);
+        fast_iterator_test<fast::pset<int>,std::set<int>>(i * 100);
+    }
+}
+
+TEST(fast_iterator, set2) {
+    for (size_t i=1;i<=100;i++) {
+        fast_iterator_test<fast::set2<int>,std::set<int>>(i);
+        fast_iterator_test<fast::set2<int>,std::set<int>>(i * 10);
+        fast_iterator_test<fast::set2<int>,std::set<int>>(i * 100);
+    }
+}
+
+TEST(fast_iterator, pmultiset) {
+    for (size_t i=1;i<=100;i++) {
+        fast_iterator_test<fast::pmultiset<int>,std::multiset<int>>(i);
+        fast_iterator_test<fast::pmultiset<int>,std::multiset<int>>(i * 10);
+        fast_iterator_test<fast::pmultiset<int>,std::multiset<int>>(i * 100);
+    }
+}
+
+// values are only modified through mutable iterators
+TEST(fast_iterator, const_pmap) {
+    using map_t = fast::pmap<int,int>;
+    static_assert(std::is_same<map_t::const_iterator::pointer, const map_t::value_type*>::value, "const_iterator hands out mutable pointers");
+    static_assert(std::is_same<decltype(std::declval<const map_t&>().begin().operator->()), const map_t::value_type*>::value,
+                  "const_iterator hands out mutable pointers");
+    static_assert(std::is_same<decltype(std::declval<map_t&>().begin().operator->()), map_t::value_type*>::value,
+                  "iterator hands out const pointers");
+
+    map_t map;
+    map[1] = 1;
+    map.begin()->second = 42;
+    const map_t& cmap = map;
+    ASSERT_EQ(cmap.begin()->second, 42);
+}
+
+// erasing a value leaves the iterators of the other values valid, also when DEBUG checks them
+template<typename S>
+static void erase_neighbour_test() {
+    S s{1, 2, 3, 4};
+    auto a = s.find(1);
+    auto b = s.find(4);
+    auto c = s.cbegin();
+    s.erase(3);
+    ASSERT_EQ(*a, 1);
+    ASSERT_EQ(*b, 4);
+    ASSERT_EQ(*c, 1);
+    s.erase(s.find(2));
+    ++a;
+    ASSERT_EQ(*a, 4);
+    --b;
+    ASSERT_EQ(*b, 1);
+    ASSERT_EQ(++c, std::prev(s.cend()));
+    s.insert(5);
+    ASSERT_EQ(*++b, 4);
+}
+
+TEST(fast_iterator, erase_neighbour) {
+    erase_neighbour_test<fast::pset<int>>();
+    erase_neighbour_test<fast::set2<int>>();
+    erase_neighbour_test<fast::pmultiset<int>>();
+    erase_neighbour_test<threaded::fast::pset<int>>();
+}
+
+// under DEBUG an iterator of an erased value, of a value moved to another container or moved past the end fails
+template<typename S>
+static void invalid_iterator_test() {
+    S s;
+    for (int i=1;i<=4;i++) s.insert(i);
+    auto erased = s.find(2);
+    s.erase(erased);
+    // it's the failed assertion, not a read of the freed node
+    ASSERT_DEATH((void)*erased, "Assertion");
+    ASSERT_DEATH(++erased, "Assertion");
+    ASSERT_DEATH(--erased, "Assertion");
+
+    // the memory of the erased node is likely to be taken by the new one
+    s.insert(2);
+    ASSERT_DEATH((void)*erased, "Assertion");
+    auto it = s.begin();
+    ASSERT_EQ(*++it, 2);
+
+    auto moved = s.find(4);
+    auto rest = s.split_off(3);
+    ASSERT_EQ(*rest.find(4), 4);
+    ASSERT_DEATH((void)*moved, "Assertion");
+
+    auto first = s.begin();
+    ASSERT_DEATH(first += 3, "");
+    auto rfirst = s.rbegin();
+    ASSERT_DEATH(rfirst += 3, "");
+    first += 2;
+    ASSERT_EQ(first, s.end());
+
+    auto cleared = s.begin();
+    s.clear();
+    s.insert(1);
+    ASSERT_DEATH((void)*cleared, "Assertion");
+    ASSERT_EQ(*s.begin(), 1);
+}
+
+TEST(fast_iterator, invalid_iterator) {
+    invalid_iterator_test<fast::pset<int>>();
+    invalid_iterator_test<fast::set2<int>>();
+    invalid_iterator_test<threaded::fast::pset<int>>();
+}
+
+// checked iterators throw instead
+template<typename S>
+static void checked_invalid_iterator_test() {
+    S s;
+    for (int i=1;i<=4;i++) s.insert(i);
+    auto erased = s.find(2);
+    s.erase(erased);
+    ASSERT_THROW(*erased, std::logic_error);
+    ASSERT_THROW(++erased, std::logic_error);
+
+    s.insert(2);
+    ASSERT_THROW(*erased, std::logic_error);
+    auto it = s.begin();
+    ASSERT_EQ(*++it, 2);
+
+    auto moved = s.find(4);
+    auto rest = s.split_off(3);
+    ASSERT_EQ(*rest.find(4), 4);
+    ASSERT_THROW(*moved, std::logic_error);
+    ASSERT_THROW(s.begin() += 3, std::out_of_range);
+
+    auto cleared = s.begin();
+    s.clear();
+    s.insert(1);
+    ASSERT_THROW(*cleared, std::logic_error);
+    ASSERT_EQ(*s.begin(), 1);
+}
+
+TEST(fast_iterator, checked_invalid_iterator) {
+    checked_invalid_iterator_test<pset<int>>();
+    checked_invalid_iterator_test<set2<int>>();
+}
@@ -0,0 +1,312 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <type_traits>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+#include "counting_new.hpp"
+using namespace std;
+using namespace curly;
+
+
+struct StatefulLess {
+    int id = 0;
+    StatefulLess() = default;
+    explicit StatefulLess(int id): id(id) {}
+    bool operator()(int a, int b) const { return a < b; }
+};
+
+static_assert(std::is_nothrow_default_constructible<pset<int>>::value, "empty construction doesn't allocate");
+static_assert(std::is_nothrow_move_constructible<pset<int>>::value, "move construction doesn't allocate");
+static_assert(std::is_nothrow_move_assignable<pset<int>>::value, "move assignment doesn't allocate");
+static_assert(std::is_nothrow_move_constructible<fast::pmultiset<int>>::value, "move construction doesn't allocate");
+static_assert(std::is_nothrow_move_constructible<pmap<int,int>>::value, "move construction doesn't allocate");
+#if __cplusplus >= 201703
+static_assert(std::is_nothrow_move_constructible<curly::pmr::pset<int>>::value, "move construction doesn't allocate");
+static_assert(std::is_nothrow_move_constructible<curly::pmr::pmap<int,int>>::value, "move construction doesn't allocate");
+#endif // __cplusplus >= 201703
+
+template<typename Set>
+static void no_allocation_test() {
+    const int keys[] = {1, 2, 3};
+    std::vector<typename Set::iterator> found;
+    found.reserve(3);
+    auto n = n_allocations;
+    Set s1;
+    Set s2(std::move(s1));
+    Set s3;
+    s3 = std::move(s2);
+    std::vector<Set> sets;
+    sets.reserve(100);
+    auto m = n_allocations;
+    for (size_t i=0;i<100;i++) sets.emplace_back();
+    ASSERT_EQ(n_allocations, m);
+    ASSERT_EQ(s3.count(1), 0u);
+    ASSERT_FALSE(s3.contains(1));
+    ASSERT_EQ(s3.erase(1), 0u);
+    ASSERT_TRUE(s3.empty());
+    s3.clear();
+    s3.shrink_to_fit();
+    s3.compact();
+    Set s4(s3);
+    s4 = s3;
+    ASSERT_EQ(n_allocations, n + 1);
+    ASSERT_TRUE(s4.empty());
+
+    // lookups and iteration of an empty container never allocate
+    const Set& cs3 = s3;
+    ASSERT_EQ(cs3.find(1), cs3.end());
+    ASSERT_EQ(cs3.begin(), cs3.end());
+    ASSERT_EQ(cs3.lower_bound(1), cs3.cend());
+    ASSERT_EQ(cs3.select(0), cs3.end());
+    ASSERT_EQ(cs3.rbegin(), cs3.rend());
+    ASSERT_EQ(s3.find(1), s3.end());
+    ASSERT_EQ(s3.begin(), s3.end());
+    ASSERT_EQ(s3.lower_bound(1), s3.end());
+    ASSERT_EQ(s3.upper_bound(1), s3.end());
+    ASSERT_EQ(s3.equal_range(1).first, s3.end());
+    ASSERT_EQ(s3.select(0), s3.end());
+    ASSERT_EQ(s3.rbegin(), s3.rend());
+    ASSERT_EQ(s3.rank(1), 0u);
+    for (auto& v: s3) (void)v;
+    s3.find_many(keys, keys + 3, std::back_inserter(found));
+    ASSERT_EQ(found[2], s3.end());
+    bool contained[3];
+    s3.contains_many(keys, keys + 3, contained);
+    ASSERT_FALSE(contained[0]);
+    ASSERT_EQ(n_allocations, n + 1);
+}
+
+TEST(set_move, empty_no_allocation) {
+    no_allocation_test<pset<int>>();
+    no_allocation_test<pmultiset<int>>();
+    no_allocation_test<fast::pset<int>>();
+    no_allocation_test<set2<int>>();
+#if __cplusplus >= 201703
+    no_allocation_test<curly::pmr::pset<int>>();
+#endif // __cplusplus >= 201703
+}
+
+// end iterators of different containers differ, also while the containers have no tree
+template<typename Set>
+static void end_identity_test() {
+    Set a, b;
+    const Set& ca = a;
+    ASSERT_EQ(a.end(), a.end());
+    ASSERT_EQ(ca.end(), a.cend());
+    ASSERT_NE(a.end(), b.end());
+    b.insert(1);
+    ASSERT_NE(a.end(), b.end());
+    ASSERT_NE(ca.end(), b.cend());
+    a.insert(1);
+    ASSERT_NE(a.end(), b.end());
+}
+
+TEST(set_move, end_identity) {
+    end_identity_test<pset<int>>();
+    end_identity_test<fast::pset<int>>();
+    end_identity_test<set2<int>>();
+}
+
+// iterators which the members return for an empty container stay valid across the first insertion
+template<typename Set>
+static void end_before_insertion_test() {
+    Set s;
+    const Set& cs = s;
+    auto e = s.end();
+    auto re = s.rend();
+    ASSERT_EQ(s.begin(), e);
+    ASSERT_EQ(cs.end(), e);
+    s.insert(1);
+    s.insert(2);
+    ASSERT_EQ(s.end(), e);
+    ASSERT_EQ(e, s.end());
+    ASSERT_EQ(cs.end(), e);
+    ASSERT_NE(s.begin(), e);
+    ASSERT_EQ(e - s.begin(), 2);
+    auto last = e;
+    --last;
+    ASSERT_EQ(*last, 2);
+    size_t n = 0;
+    for (auto it = s.begin(); it != e; ++it) n++;
+    ASSERT_EQ(n, 2u);
+    n = 0;
+    for (auto it = s.rbegin(); it != re; ++it) n++;
+    ASSERT_EQ(n, 2u);
+    ASSERT_EQ(s.find(3), e);
+
+    Set t;
+    auto f = t.find(1);
+    t.insert(1);
+    ASSERT_EQ(f, t.end());
+    ASSERT_NE(t.find(1), f);
+    ASSERT_NE(f, s.end());
+}
+
+TEST(set_move, end_before_insertion) {
+    end_before_insertion_test<pset<int>>();
+    end_before_insertion_test<pmultiset<int>>();
+    end_before_insertion_test<fast::pset<int>>();
+    end_before_insertion_test<set2<int>>();
+}
+
+template<typename Set>
+static void const_end_before_insertion_test() {
+    Set s;
+    const Set& cs = s;
+    auto e = s.cend();
+    auto ce = cs.end();
+    auto cre = s.crend();
+    ASSERT_EQ(s.cbegin(), e);
+    s.insert(1);
+    s.insert(2);
+    ASSERT_EQ(s.cend(), e);
+    ASSERT_EQ(cs.end(), ce);
+    ASSERT_EQ(e, ce);
+    size_t n = 0;
+    for (auto it = s.cbegin(); it != e; ++it) n++;
+    ASSERT_EQ(n, 2u);
+    n = 0;
+    for (auto it = cs.begin(); it != ce; ++it) n++;
+    ASSERT_EQ(n, 2u);
+    n = 0;
+    for (auto it = s.crbegin(); it != cre; ++it) n++;
+    ASSERT_EQ(n, 2u);
+    auto last = cs.end();
+    --last;
+    ASSERT_EQ(*last, 2);
+
+    Set t;
+    const Set& ct = t;
+    auto f = ct.find(1);
+    t.insert(1);
+    ASSERT_EQ(f, ct.end());
+    ASSERT_NE(ct.find(1), f);
+}
+
+TEST(set_move, const_end_before_insertion) {
+    const_end_before_insertion_test<pset<int>>();
+    const_end_before_insertion_test<pmultiset<int>>();
+    const_end_before_insertion_test<fast::pset<int>>();
+    const_end_before_insertion_test<set2<int>>();
+}
+
+template<typename Set>
+static void move_test() {
+    Set s1;
+    for (int i=0;i<100;i++) s1.insert(i);
+    auto it = s1.find(42);
+
+    auto n = n_allocations;
+    Set s2(std::move(s1));
+    ASSERT_EQ(n_allocations, n);
+    ASSERT_TRUE(s1.empty());
+    ASSERT_EQ(s2.size(), 100u);
+    ASSERT_EQ(*it, 42);
+    ASSERT_EQ(it, s2.find(42));
+    ++it;
+    ASSERT_EQ(*it, 43);
+
+    Set s3;
+    s3 = std::move(s2);
+    ASSERT_EQ(n_allocations, n);
+    ASSERT_TRUE(s2.empty());
+    ASSERT_EQ(s3.size(), 100u);
+
+    // moved-from containers are usable
+    s1.insert(7);
+    s2.insert(8);
+    ASSERT_EQ(*s1.begin(), 7);
+    ASSERT_EQ(*s2.begin(), 8);
+    s1 = std::move(s2);
+    ASSERT_EQ(s1.size(), 1u);
+    ASSERT_EQ(*s1.begin(), 8);
+    s2 = s1;
+    ASSERT_EQ(s2.size(), 1u);
+    s3 = Set();
+    ASSERT_TRUE(s3.empty());
+    s3.insert(1);
+    ASSERT_EQ(s3.size(), 1u);
+}
+
+TEST(set_move, move_keeps_iterators) {
+    move_test<pset<int>>();
+    move_test<pmultiset<int>>();
+    move_test<set2<int>>();
+    move_test<fast::pset<int>>();
+}
+
+TEST(set_move, stateful_compare) {
+    using set_t = pset<int,StatefulLess>;
+    static_assert(std::is_nothrow_move_constructible<set_t>::value, "the comparator is copied to the moved-to container");
+    set_t s1(StatefulLess(3));
+    s1.insert(1);
+    set_t s2(std::move(s1));
+    ASSERT_EQ(s2.key_comp().id, 3);
+    ASSERT_EQ(s1.key_comp().id, 3);
+    s1.insert(2);
+    ASSERT_EQ(s1.size(), 1u);
+    ASSERT_EQ(s2.size(), 1u);
+}
+
+struct DirLess {
+    bool desc = false;
+    DirLess() = default;
+    explicit DirLess(bool desc): desc(desc) {}
+    bool operator()(int a, int b) const { return desc ? b < a : a < b; }
+};
+
+// the comparator goes along with the tree, also to and from a container which has no tree yet
+template<typename Set>
+static void stateful_swap_test() {
+    Set a(DirLess(true)), b(DirLess(false));
+    b.insert(1);
+    a.swap(b);
+    b.insert(3);
+    b.insert(1);
+    ASSERT_TRUE(b.key_comp().desc);
+    ASSERT_EQ(*b.begin(), 3);
+    ASSERT_FALSE(a.key_comp().desc);
+    a.insert(2);
+    ASSERT_EQ(*a.begin(), 1);
+
+    Set c(DirLess(true)), d(DirLess(false));
+    c.swap(d);
+    c.insert(1);
+    c.insert(2);
+    ASSERT_EQ(*c.begin(), 1);
+    d.insert(1);
+    d.insert(2);
+    ASSERT_EQ(*d.begin(), 2);
+}
+
+template<typename Set>
+static void stateful_move_assign_test() {
+    Set a(DirLess(false)), empty_desc(DirLess(true));
+    a.insert(1);
+    a = std::move(empty_desc);
+    ASSERT_TRUE(a.key_comp().desc);
+    a.insert(1);
+    a.insert(2);
+    ASSERT_EQ(*a.begin(), 2);
+
+    Set b(DirLess(false)), desc(DirLess(true));
+    desc.insert(1);
+    desc.insert(2);
+    b = std::move(desc);
+    ASSERT_TRUE(b.key_comp().desc);
+    b.insert(3);
+    ASSERT_EQ(*b.begin(), 3);
+}
+
+TEST(set_move, stateful_swap) {
+    stateful_swap_test<pset<int,DirLess>>();
+    stateful_swap_test<fast::pset<int,DirLess>>();
+    stateful_swap_test<set2<int,DirLess>>();
+}
+
+TEST(set_move, stateful_move_assign) {
+    stateful_move_assign_test<pset<int,DirLess>>();
+    stateful_move_assign_test<fast::pset<int,DirLess>>();
+    stateful_move_assign_test<set2<int,DirLess>>();
+}
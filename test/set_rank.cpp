@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<typename Set>
+static void rank_test(const size_t n_vals) {
+    Set set;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-static_cast<int>(n_vals), n_vals);
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        set.emplace(val);
+        if (set.size() != stl_set.size()) stl_set.insert(val);
+    }
+    ASSERT_EQ(set.size(), stl_set.size());
+    std::vector<int> vals(stl_set.begin(), stl_set.end());
+
+    for (int key=-static_cast<int>(n_vals)-1;key<=static_cast<int>(n_vals)+1;key++) {
+        const size_t expected = std::lower_bound(vals.begin(), vals.end(), key) - vals.begin();
+        ASSERT_EQ(set.rank(key), expected);
+        auto lb = set.lower_bound_with_rank(key);
+        ASSERT_EQ(lb.second, expected);
+        ASSERT_EQ(lb.first, set.lower_bound(key));
+        ASSERT_EQ(set.count(key), stl_set.count(key));
+
+        const int hi = key + distribution(generator) % 8;
+        const size_t expected_between = hi > key ?
+            std::lower_bound(vals.begin(), vals.end(), hi) - vals.begin() - expected : 0;
+        ASSERT_EQ(set.count_between(key, hi), expected_between);
+    }
+
+    for (size_t k=0;k<vals.size();k++) {
+        ASSERT_EQ(*set.select(k), vals[k]);
+        ASSERT_EQ(set.nth(k), set.select(k));
+    }
+    ASSERT_EQ(set.select(vals.size()), set.end());
+    ASSERT_EQ(set.select(vals.size() + 100), set.end());
+}
+
+TEST(set_rank, position_containers) {
+    for (size_t n: {0, 1, 2, 10, 100, 1000}) {
+        rank_test<pset<int>>(n);
+        rank_test<pmultiset<int>>(n);
+        rank_test<fast::pset<int>>(n);
+        rank_test<threaded::pset<int>>(n);
+    }
+}
+
+TEST(set_rank, plain_containers) {
+    for (size_t n: {0, 1, 10, 300}) {
+        rank_test<set2<int>>(n);
+        rank_test<multiset2<int>>(n);
+    }
+}
+
+#if __cplusplus >= 201703
+TEST(set_rank, bptree) {
+    for (size_t n: {0, 1, 10, 100, 5000}) {
+        rank_test<bptree::pset<int>>(n);
+        rank_test<bptree::pmultiset<int>>(n);
+    }
+}
+#endif // __cplusplus >= 201703
+
+TEST(set_rank, frozen) {
+    pmultiset<int> set;
+    std::uniform_int_distribution<int> distribution(-500, 500);
+    for (int i=0;i<1000;i++) set.insert(distribution(generator));
+    auto frozen = set.freeze();
+
+    for (int key=-501;key<=501;key++) {
+        ASSERT_EQ(frozen.rank(key), set.rank(key));
+        ASSERT_EQ(frozen.lower_bound_with_rank(key).second, set.rank(key));
+        ASSERT_EQ(frozen.count_between(key, key + 5), set.count_between(key, key + 5));
+        ASSERT_EQ(frozen.count_between(key, key - 5), 0u);
+    }
+    for (size_t k=0;k<set.size();k++) {
+        ASSERT_EQ(*frozen.nth(k), *set.nth(k));
+    }
+}
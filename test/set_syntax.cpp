@@ -288,14 +288,24 @@ static void set_merge(int mvals) {
         set_##name<std::set<int>>(1000); \
         set_##name<set2<int>>(1000); \
         set_##name<pset<int>>(1000); \
+        set_##name<fast::pset<int>>(1000); \
+        set_##name<pset<int,std::less<int>,std::allocator<int>,uint32_t>>(1000); \
+        set_##name<threaded::pset<int>>(1000); \
+        set_##name<threaded::fast::pset<int>>(1000); \
         set_##name<std::pmr::set<int>>(1000); \
         set_##name<curly::pmr::pset<int>>(1000); \
+        set_##name<bptree::pset<int>>(1000); \
+        set_##name<bptree::fast::pset<int>>(1000); \
     }
 #define test_basic(name) \
     TEST(set, name) { \
         set_##name<std::set<int>>(1000); \
         set_##name<set2<int>>(1000); \
         set_##name<pset<int>>(1000); \
+        set_##name<fast::pset<int>>(1000); \
+        set_##name<pset<int,std::less<int>,std::allocator<int>,uint32_t>>(1000); \
+        set_##name<threaded::pset<int>>(1000); \
+        set_##name<threaded::fast::pset<int>>(1000); \
     }
 #if __cplusplus >= 201703L
 #define test(name) test_inc_pmr(name)
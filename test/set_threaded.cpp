@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+std::default_random_engine generator;
+template<bool multi, bool keep_position_info>
+static void threaded_impl_test(const size_t n_vals) {
+    using tree_t = RBTreeImpl<int, void, multi, keep_position_info, std::less<int>, default_allocato_t<int,void>, size_t, rbtree_threaded>;
+    static_assert(tree_t::rbtree_node_type::Threaded, "nodes should be threaded");
+    tree_t tree;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(-n_vals, n_vals);
+    const size_t freq = n_vals / 8 > 0 ? n_vals / 8 : 1;
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        auto hint = i % 2 == 0 ? tree.lower_bound(val) : nullptr;
+        if (tree.insert(hint, val).second) {
+            stl_set.insert(val);
+        }
+        if (i % freq == 0) {
+            tree.check_consistency();
+        }
+    }
+    tree.check_consistency();
+
+    for (size_t i=0;i<n_vals/2;i++) {
+        auto node = tree.find(distribution(generator));
+        if (node == nullptr) continue;
+        auto stl_next = stl_set.erase(stl_set.lower_bound(node->value.get()));
+        auto next = tree.erase(node, true);
+        ASSERT_EQ(next == nullptr, stl_next == stl_set.end());
+        if (next) {
+            ASSERT_EQ(next->value.get(), *stl_next);
+        }
+        if (i % freq == 0) {
+            tree.check_consistency();
+        }
+    }
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), stl_set.size());
+
+    auto stl_iter = stl_set.begin();
+    for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1),stl_iter++) {
+        ASSERT_EQ(node->value.get(), *stl_iter);
+    }
+    ASSERT_EQ(stl_iter, stl_set.end());
+    auto stl_riter = stl_set.rbegin();
+    for (auto node=tree.rbegin();node!=nullptr;node=tree.advance(node, -1),stl_riter++) {
+        ASSERT_EQ(node->value.get(), *stl_riter);
+    }
+    ASSERT_EQ(stl_riter, stl_set.rend());
+
+    tree_t copied;
+    tree.copy_to(copied);
+    copied.check_consistency();
+    copied.convert2BST();
+    copied.check_consistency();
+    tree.compact();
+    tree.check_consistency();
+    ASSERT_EQ(copied.size(), stl_set.size());
+    ASSERT_EQ(tree.size(), stl_set.size());
+    stl_iter = stl_set.begin();
+    for (auto n1=tree.begin(),n2=copied.begin();n1!=nullptr;n1=n1->next(),n2=n2->next(),stl_iter++) {
+        ASSERT_EQ(n1->value.get(), *stl_iter);
+        ASSERT_EQ(n2->value.get(), *stl_iter);
+    }
+}
+
+TEST(rbtree_impl, threaded) {
+    for (size_t i=1;i<=20;i++) {
+        threaded_impl_test<false,true>(i * i * 10);
+        threaded_impl_test<true,true>(i * i * 10);
+        threaded_impl_test<false,false>(i * i * 10);
+        threaded_impl_test<true,false>(i * i * 10);
+    }
+}
+
+template<typename S>
+static void threaded_set_test(const size_t n_vals) {
+    S s, other;
+    std::multiset<int> stl_set;
+    std::uniform_int_distribution<int> distribution(0, n_vals);
+
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        s.insert(val);
+        stl_set.insert(val);
+    }
+    for (size_t i=0;i<n_vals/2 && !s.empty();i++) {
+        auto pos = s.find(distribution(generator));
+        if (pos == s.end()) continue;
+        stl_set.erase(stl_set.find(*pos));
+        if (i % 2 == 0) {
+            other.insert(s.extract(pos));
+        } else {
+            s.erase(pos);
+        }
+    }
+    ASSERT_EQ(s.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin()));
+    ASSERT_TRUE(std::equal(s.rbegin(), s.rend(), stl_set.rbegin()));
+
+    for (auto& val: other) stl_set.insert(val);
+    s.merge(other);
+    ASSERT_EQ(s.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), stl_set.begin()));
+
+    S copied(s);
+    ASSERT_EQ(copied.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(copied.begin(), copied.end(), stl_set.begin()));
+    auto it = copied.end();
+    for (auto stl_it=stl_set.end();stl_it!=stl_set.begin();) {
+        ASSERT_EQ(*--it, *--stl_it);
+    }
+}
+
+TEST(set, threaded) {
+    for (size_t n: {0, 1, 10, 100, 1000, 10000}) {
+        threaded_set_test<threaded::pmultiset<int>>(n);
+        threaded_set_test<threaded::fast::pmultiset<int>>(n);
+        threaded_set_test<threaded::multiset2<int>>(n);
+    }
+}
+
+struct Item: public RBTreeHook<Item, true, size_t, rbtree_threaded> {
+    int key;
+    explicit Item(int key = 0): key(key) {}
+    bool operator<(const Item& oth) const { return this->key < oth.key; }
+};
+
+TEST(intrusive_set, threaded) {
+    std::vector<Item> items;
+    for (int i=0;i<1000;i++) items.emplace_back(i * 7 % 1000);
+
+    intrusive_container<Item, false, true, std::less<Item>, size_t, rbtree_threaded> c;
+    for (auto& item: items) c.insert(item);
+    for (size_t i=0;i<items.size();i+=3) c.erase(items[i]);
+
+    int last = -1;
+    size_t n = 0;
+    for (auto& item: c) {
+        ASSERT_LT(last, item.key);
+        last = item.key;
+        n++;
+    }
+    ASSERT_EQ(n, c.size());
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <set>
+#include <cmath>
+
+#define DEBUG 1
+#include "rbtree.hpp"
+using namespace std;
+using namespace curly;
+
+
+static size_t n_less = 0, n_compare = 0;
+struct CountingCompare {
+    bool operator()(const std::string& a, const std::string& b) const {
+        n_less++;
+        return a < b;
+    }
+    int compare(const std::string& a, const std::string& b) const {
+        n_compare++;
+        return a.compare(b);
+    }
+};
+
+struct BoolCompare {
+    bool operator()(int a, int b) const { return a < b; }
+    bool compare(int a, int b) const { return a < b; }
+};
+
+static_assert(rbtree_three_way<CountingCompare,std::string,std::string>::value, "compare() is a three-way comparison");
+static_assert(!rbtree_three_way<BoolCompare,int,int>::value, "compare() returning bool is not a three-way comparison");
+static_assert(!rbtree_three_way<std::less<int>,int,int>::value, "scalars are compared by operator<");
+static_assert(rbtree_three_way<std::less<std::string>,std::string,std::string>::value, "std::string has compare()");
+#if __cplusplus >= 201402
+static_assert(rbtree_three_way<std::less<>,std::string,std::string>::value, "std::string has compare()");
+#endif // __cplusplus >= 201402
+static_assert(rbtree_three_way<std::less<std::wstring>,std::wstring,std::wstring>::value, "std::wstring has compare()");
+#if __cplusplus >= 202002
+
+// std::less of a program-defined key orders it unlike its operator<=>
+struct Reversed {
+    int v;
+    auto operator<=>(const Reversed&) const = default;
+};
+template<>
+struct std::less<Reversed> {
+    bool operator()(const Reversed& a, const Reversed& b) const { return a.v > b.v; }
+};
+static_assert(!rbtree_three_way<std::less<Reversed>,Reversed,Reversed>::value, "std::less may be specialized");
+#endif // __cplusplus >= 202002
+
+std::default_random_engine generator;
+static std::string random_key(size_t n_vals) {
+    std::uniform_int_distribution<size_t> distribution(0, n_vals * 2);
+    return "key-with-a-long-common-prefix-" + std::to_string(distribution(generator));
+}
+
+template<typename Set>
+static void three_way_test(const size_t n_vals) {
+    Set set;
+    std::multiset<std::string> stl_set;
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = random_key(n_vals);
+        set.insert(key);
+        if (set.size() != stl_set.size()) stl_set.insert(key);
+    }
+    ASSERT_EQ(set.size(), stl_set.size());
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), stl_set.begin()));
+
+    // a red-black tree is at most 2 lg(n+1) deep
+    const size_t max_depth = 2 * std::ceil(std::log2(n_vals + 1)) + 1;
+    for (size_t i=0;i<n_vals;i++) {
+        auto key = random_key(n_vals);
+        n_less = n_compare = 0;
+        auto it = set.find(key);
+        ASSERT_EQ(n_less, 0u);
+        ASSERT_LE(n_compare, max_depth);
+
+        auto stl_it = stl_set.find(key);
+        if (stl_it == stl_set.end()) {
+            ASSERT_EQ(it, set.end());
+        } else {
+            ASSERT_NE(it, set.end());
+            ASSERT_EQ(*it, key);
+            ASSERT_EQ(std::distance(set.begin(), it), std::distance(stl_set.begin(), stl_it));
+        }
+
+        n_less = n_compare = 0;
+        auto lb = set.lower_bound(key);
+        ASSERT_LE(n_less, max_depth);
+        ASSERT_EQ(std::distance(set.begin(), lb), std::distance(stl_set.begin(), stl_set.lower_bound(key)));
+    }
+}
+
+TEST(set_three_way, compare_method) {
+    for (size_t n: {1, 10, 100, 1000}) {
+        three_way_test<pset<std::string,CountingCompare>>(n);
+        three_way_test<pmultiset<std::string,CountingCompare>>(n);
+        three_way_test<set2<std::string,CountingCompare>>(n);
+        three_way_test<multiset2<std::string,CountingCompare>>(n);
+    }
+}
+
+TEST(set_three_way, insert_single_comparison) {
+    pset<std::string,CountingCompare> set;
+    for (size_t i=0;i<1000;i++) {
+        auto key = random_key(1000);
+        n_less = n_compare = 0;
+        set.insert(key);
+        ASSERT_EQ(n_less, 0u);
+        ASSERT_LE(n_compare, 2 * std::ceil(std::log2(set.size() + 1)) + 1);
+    }
+}
+
+TEST(set_three_way, map) {
+    pmap<std::string,int,CountingCompare> map;
+    for (int i=0;i<100;i++) {
+        map[std::to_string(i % 50)] += i;
+    }
+    ASSERT_EQ(map.size(), 50u);
+    ASSERT_EQ(map.at("7"), 7 + 57);
+    ASSERT_EQ(map.find("100"), map.end());
+}
+
+template<typename Set>
+static void string_less_test() {
+    for (size_t n: {1, 10, 100}) {
+        Set set;
+        std::multiset<std::string> stl_set;
+        for (size_t i=0;i<n;i++) {
+            auto key = random_key(n);
+            set.insert(key);
+            stl_set.insert(key);
+        }
+        for (size_t i=0;i<n;i++) {
+            auto key = random_key(n);
+            auto it = set.find(key);
+            auto stl_it = stl_set.find(key);
+            ASSERT_EQ(std::distance(set.begin(), it), std::distance(stl_set.begin(), stl_it));
+        }
+    }
+}
+
+TEST(set_three_way, string_less) {
+    string_less_test<pmultiset<std::string>>();
+#if __cplusplus >= 201402
+    string_less_test<pmultiset<std::string,std::less<>>>();
+#endif // __cplusplus >= 201402
+    string_less_test<multiset2<std::string>>();
+}
+
+#if __cplusplus >= 202002
+
+TEST(set_three_way, specialized_less) {
+    pset<Reversed> set;
+    for (int i=0;i<50;i++) set.insert(Reversed{i * 7 % 50});
+    int expected = 49;
+    for (auto& v: set) ASSERT_EQ(v.v, expected--);
+    for (int i=0;i<50;i++) {
+        auto it = set.find(Reversed{i});
+        ASSERT_NE(it, set.end());
+        ASSERT_EQ(it->v, i);
+        ASSERT_EQ(set.rank(Reversed{i}), static_cast<size_t>(49 - i));
+    }
+}
+#endif // __cplusplus >= 202002
@@ -0,0 +1,81 @@
+#pragma once
+/**
+ * helpers shared by the tests: checks of a tree against std::multiset, an executor without threads
+ * and values whose copies throw or are counted. include it after rbtree.hpp
+ */
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <atomic>
+#include <stdexcept>
+
+
+// defined by each test
+extern std::default_random_engine generator;
+
+/** the values of tree are those of stl_set in the same order, and their indices are right */
+template<typename Tree, typename C>
+static void check_tree(Tree& tree, const std::multiset<int,C>& stl_set) {
+    tree.check_consistency();
+    ASSERT_EQ(tree.size(), stl_set.size());
+    size_t idx = 0;
+    auto stl_iter = stl_set.begin();
+    for (auto node=tree.begin();node!=nullptr;node=tree.advance(node, 1),idx++,stl_iter++) {
+        ASSERT_EQ(node->value.get(), *stl_iter);
+        ASSERT_EQ(tree.indexof(node), idx);
+    }
+    ASSERT_EQ(stl_iter, stl_set.end());
+    auto stl_riter = stl_set.rbegin();
+    for (auto node=tree.rbegin();node!=nullptr;node=tree.advance(node, -1),stl_riter++) {
+        ASSERT_EQ(node->value.get(), *stl_riter);
+    }
+    ASSERT_EQ(stl_riter, stl_set.rend());
+}
+
+/** insert n_vals random values of [lo, hi] into tree, and those which it takes into stl_set */
+template<typename Tree, typename C>
+static void fill(Tree& tree, std::multiset<int,C>& stl_set, size_t n_vals, int lo, int hi) {
+    std::uniform_int_distribution<int> distribution(lo, hi);
+    for (size_t i=0;i<n_vals;i++) {
+        auto val = distribution(generator);
+        if (tree.insert(val).second) {
+            stl_set.insert(val);
+        }
+    }
+}
+
+// runs the tasks one after another, in the reverse order
+struct serial_executor {
+    template<typename F, typename G>
+    void operator()(F&& f, G&& g) {
+        g();
+        f();
+    }
+};
+
+struct ThrowingCopy {
+    // the copies which succeed before one throws, unlimited if negative
+    static std::atomic<int> copies_left;
+    int v;
+
+    explicit ThrowingCopy(int v): v(v) {}
+    ThrowingCopy(const ThrowingCopy& oth): v(oth.v) {
+        if (copies_left.load() >= 0 && copies_left.fetch_sub(1) == 0) throw std::runtime_error("copy");
+    }
+    bool operator<(const ThrowingCopy& oth) const { return v < oth.v; }
+    bool operator==(const ThrowingCopy& oth) const { return v == oth.v; }
+};
+std::atomic<int> ThrowingCopy::copies_left(-1);
+
+struct CountedKey {
+    // copies since it was reset, moves aren't counted
+    static size_t copies;
+    int v;
+
+    explicit CountedKey(int v): v(v) {}
+    CountedKey(const CountedKey& oth): v(oth.v) { copies++; }
+    CountedKey(CountedKey&&) noexcept = default;
+    bool operator<(const CountedKey& oth) const { return v < oth.v; }
+    bool operator==(const CountedKey& oth) const { return v == oth.v; }
+};
+size_t CountedKey::copies = 0;